@@ -264,11 +264,11 @@ static gboolean zbar_processing_idle_callback(gpointer data)
 
     if (!msg) {
 	if (zbar->video_enabled_state) {
-	    zbar_image_t *image = zbar_video_next_image(zbar->video);
+	    zbar_image_t *image = zbar_video_borrow_image(zbar->video);
 	    if (zbar_gtk_process_image(self, image) < 0)
 		zbar->video_enabled_state = FALSE;
 	    if (image)
-		zbar_image_destroy(image);
+		zbar_video_return_image(zbar->video, image);
 
 	    if (zbar->video_enabled_state)
 		return TRUE;
@@ -185,10 +185,20 @@ typedef enum zbar_config_e
     ZBAR_CFG_UNCERTAINTY = 0x40, /**< required video consistency frames */
 
     ZBAR_CFG_POSITION = 0x80, /**< enable scanner to collect position data */
-    ZBAR_CFG_TEST_INVERTED,   /**< if fails to decode, test inverted */
+    ZBAR_CFG_TEST_INVERTED,   /**< also decode inverted symbols */
+    ZBAR_CFG_LAZY_BINARIZE,   /**< binarize QR images only where sampled */
+    ZBAR_CFG_QR_TRACK,        /**< look for QR codes where last seen first */
+    ZBAR_CFG_QR_LINE_TIMES,   /**< time QR finder line collection */
 
     ZBAR_CFG_X_DENSITY = 0x100, /**< image scanner vertical scan density */
     ZBAR_CFG_Y_DENSITY,		/**< image scanner horizontal scan density */
+    ZBAR_CFG_THREADS,		/**< image scanner worker threads */
+    ZBAR_CFG_CACHE_PROXIMITY,	/**< ms between "nearby" cached images */
+    ZBAR_CFG_CACHE_HYSTERESIS,	/**< ms a cached result must be absent */
+    ZBAR_CFG_CACHE_TIMEOUT,	/**< ms after which cache entries expire */
+    ZBAR_CFG_QR_THREADS,	/**< threads decoding QR candidates */
+    ZBAR_CFG_QR_SCRATCH,	/**< bytes of QR scratch memory kept */
+    ZBAR_CFG_JPEG_SCALE,	/**< largest JPEG frame decode reduction */
 } zbar_config_t;
 
 /** decoder symbology modifier flags.
@@ -651,6 +661,24 @@ extern unsigned zbar_image_get_width(const zbar_image_t *image);
  */
 extern unsigned zbar_image_get_height(const zbar_image_t *image);
 
+/** retrieve the distance in bytes between the start of adjacent lines.
+ * for planar formats this is the stride of the luminance plane
+ * @returns the stride set by zbar_image_set_stride(), or the packed
+ * line length implied by the image width and format if none was set
+ * @since 0.24
+ */
+extern unsigned zbar_image_get_stride(const zbar_image_t *image);
+
+/** retrieve the dmabuf file descriptor holding a video frame, to
+ * share the frame with other devices or processes without copying it.
+ * the descriptor belongs to the video device and is valid until it is
+ * closed; the frame contents only until the image is destroyed
+ * @returns the file descriptor, or -1 if the image was not captured
+ * with DMABUF I/O
+ * @since 0.24
+ */
+extern int zbar_image_get_dmabuf(const zbar_image_t *image);
+
 /** retrieve both dimensions of the image.
  * fills in the width and height in samples
  */
@@ -719,6 +747,17 @@ extern void zbar_image_set_sequence(zbar_image_t *image, unsigned sequence_num);
 extern void zbar_image_set_size(zbar_image_t *image, unsigned width,
 				unsigned height);
 
+/** specify the distance in bytes between the start of adjacent lines.
+ * allows scanning a sub-rectangle of a larger buffer in place.
+ * for planar formats this is the stride of the luminance plane,
+ * chroma lines use the stride shifted by the horizontal subsampling
+ * and each plane follows the previous one at stride * plane height.
+ * 0 (the default) means lines are packed with no padding
+ * @note this does not affect the data!
+ * @since 0.24
+ */
+extern void zbar_image_set_stride(zbar_image_t *image, unsigned stride);
+
 /** specify a rectangular region of the image to scan.
  * the rectangle will be clipped to the image boundaries.
  * defaults to the full image specified by zbar_image_set_size()
@@ -835,6 +874,7 @@ extern int zbar_processor_request_interface(zbar_processor_t *processor,
     1 = force I/O using read()
     2 = force memory mapped I/O using mmap()
     3 = force USERPTR I/O (v4l2 only)
+    4 = force DMABUF I/O, exporting driver buffers (v4l2 only)
 @endverbatim
  * @note must be called before zbar_processor_init()
  * @since 0.7
@@ -851,6 +891,9 @@ extern int zbar_processor_force_format(zbar_processor_t *processor,
 /** setup result handler callback.
  * the specified function will be called by the processor whenever
  * new results are available from the video stream or a static image.
+ * video frames are scanned in the capture buffer, so an image from the
+ * video stream must not be referenced beyond the callback; use
+ * zbar_image_convert() to keep a copy.
  * pass a NULL value to disable callbacks.
  * @param processor the object on which to set the handler.
  * @param handler the function to call when new results are available.
@@ -1059,12 +1102,26 @@ extern int zbar_video_request_interface(zbar_video_t *video, int version);
     1 = force I/O using read()
     2 = force memory mapped I/O using mmap()
     3 = force USERPTR I/O (v4l2 only)
+    4 = force DMABUF I/O, exporting driver buffers (v4l2 only)
 @endverbatim
  * @note must be called before zbar_video_open()
  * @since 0.7
  */
 extern int zbar_video_request_iomode(zbar_video_t *video, int iomode);
 
+/** capture into application allocated dmabufs (v4l2 DMABUF I/O).
+ * the video device imports the nfds file descriptors, one per
+ * image, and the frames are mapped read only for scanning.  the
+ * descriptors remain owned by the application and must stay open
+ * until the video device is closed
+ * @returns 0 if successful or -1 if nfds is not between 1 and 4 (the
+ * most images a video device holds), or the device is already open
+ * @note must be called before zbar_video_open()
+ * @since 0.24
+ */
+extern int zbar_video_request_dmabufs(zbar_video_t *video, const int *fds,
+				      int nfds);
+
 /** retrieve current output image width.
  * @returns the width or 0 if the video device is not open
  */
@@ -1088,10 +1145,40 @@ extern int zbar_video_init(zbar_video_t *video, unsigned long format);
 extern int zbar_video_enable(zbar_video_t *video, int enable);
 
 /** retrieve next captured image.  blocks until an image is available.
+ * the image may be kept referenced for as long as needed: when the
+ * driver only has a single buffer, it is a copy of the frame
  * @returns NULL if video is not enabled or an error occurs
+ * @see zbar_video_borrow_image()
  */
 extern zbar_image_t *zbar_video_next_image(zbar_video_t *video);
 
+/** borrow the next captured image directly from the driver's buffer.
+ * blocks until an image is available.  the frame is never copied;
+ * the buffer is not available for capture until the image is handed
+ * back with zbar_video_return_image(), so it should be returned as
+ * soon as it has been scanned.  any other reference taken to it must
+ * be released first.  zbar_window_draw() keeps a copy when needed
+ * @returns NULL if video is not enabled or an error occurs
+ * @since 0.24
+ */
+extern zbar_image_t *zbar_video_borrow_image(zbar_video_t *video);
+
+/** hand a borrowed image back for capture.
+ * releases the reference obtained from zbar_video_borrow_image(),
+ * requeuing the driver's buffer
+ * @returns 0 if successful or -1 if the image was not borrowed from
+ * this video
+ * @since 0.24
+ */
+extern int zbar_video_return_image(zbar_video_t *video, zbar_image_t *image);
+
+/** retrieve the number of frames that still had to be copied out of a
+ * driver buffer, by zbar_video_next_image() or zbar_window_draw(),
+ * because the driver has a single buffer.
+ * @since 0.24
+ */
+extern unsigned long zbar_video_get_copies(const zbar_video_t *video);
+
 /** set video control value (integer).
  * @returns 0 for success, non-0 for failure
  * @since 0.20
@@ -1312,6 +1399,8 @@ static inline int zbar_image_scanner_parse_config(zbar_image_scanner_t *scanner,
  * mostly useful for scanning video frames, the cache filters
  * duplicate results from consecutive images, while adding some
  * consistency checking and hysteresis to the results.
+ * cache timing may be adjusted with ::ZBAR_CFG_CACHE_PROXIMITY,
+ * ::ZBAR_CFG_CACHE_HYSTERESIS and ::ZBAR_CFG_CACHE_TIMEOUT.
  * this interface also clears the cache
  */
 extern void zbar_image_scanner_enable_cache(zbar_image_scanner_t *scanner,
@@ -1337,15 +1426,80 @@ extern void zbar_image_scanner_recycle_image(zbar_image_scanner_t *scanner,
 extern const zbar_symbol_set_t *
 zbar_image_scanner_get_results(const zbar_image_scanner_t *scanner);
 
-/** scan for symbols in provided image.  The image format must be
- * "Y800" or "GRAY".
+/** scan for symbols in provided image.  The luminance of the image
+ * is read in place, so the format must be grayscale ("Y800", "GREY"),
+ * planar YUV (eg, "I420", "NV12"), packed YUV ("YUYV", "UYVY") or
+ * 24/32-bit RGB, whose green channel is scanned.  Other formats must
+ * be converted first.
  * @returns >0 if symbols were successfully decoded from the image,
  * 0 if no symbols were found or -1 if an error occurs
  * @see zbar_image_convert()
  * @since 0.9 - changed to only accept grayscale images
+ * @since 0.24 - also scans YUV and RGB images without converting them
  */
 extern int zbar_scan_image(zbar_image_scanner_t *scanner, zbar_image_t *image);
 
+/** scan a batch of images concurrently.
+ * each image is scanned as by zbar_scan_image() and its results are
+ * attached to the image.  the images are shared out among up to
+ * @a nthreads threads (including the caller), each with a private
+ * scanner that follows the configuration of this one.  the data
+ * handler, if any, may be called concurrently from any of these
+ * threads.  the inter-image result cache is not used
+ * @returns the total number of symbols decoded from all images,
+ * or -1 if any image could not be scanned
+ * @since 0.24
+ */
+extern int zbar_scan_images(zbar_image_scanner_t *scanner,
+			    zbar_image_t **images, int nimages, int nthreads);
+
+/** image scanner processing stages.
+ * timed by zbar_image_scanner_get_stats()
+ * @since 0.24
+ */
+typedef enum zbar_scan_stage_e
+{
+    ZBAR_STAGE_HSCAN = 0,	/**< horizontal (row) scan pass */
+    ZBAR_STAGE_VSCAN,		/**< vertical (column) scan pass */
+    ZBAR_STAGE_QR_LINES,	/**< QR finder line collection */
+    ZBAR_STAGE_QR_BINARIZE,	/**< QR image binarization */
+    ZBAR_STAGE_QR_CENTERS,	/**< QR finder center location and matching */
+    ZBAR_STAGE_QR_RS,		/**< QR Reed-Solomon error correction */
+    ZBAR_STAGE_QR_TEXT,		/**< QR text extraction */
+    ZBAR_STAGE_SQ_DECODE,	/**< SQ code decode */
+    ZBAR_STAGE_NUM,		/**< number of stages */
+} zbar_scan_stage_t;
+
+/** image scanner statistics.
+ * counters and ns timings accumulate from scanner creation.
+ * QR line collection is part of the scan passes that find the lines.
+ * it is timed for each line, so only with #ZBAR_CFG_QR_LINE_TIMES.
+ * with #ZBAR_CFG_THREADS, #ZBAR_CFG_QR_THREADS or zbar_scan_images(),
+ * times of stages run in parallel are summed over the threads
+ * @since 0.24
+ */
+typedef struct zbar_image_scanner_stats_s {
+    unsigned long frames;  /**< images scanned */
+    unsigned long symbols; /**< symbols reported */
+    unsigned long edges;   /**< edges found by the linear scanner */
+    /** symbology decoder invocations, indexed by symbol type.
+     * the EAN/UPC decoder is counted as #ZBAR_EAN13, the DataBar
+     * decoder as #ZBAR_DATABAR and the QR finder as #ZBAR_QRCODE
+     */
+    unsigned long decodes[ZBAR_CODE128 + 1];
+    /** cumulative time spent in each stage */
+    unsigned long long total_ns[ZBAR_STAGE_NUM];
+    /** time spent in each stage for the last image (or batch) */
+    unsigned long long last_ns[ZBAR_STAGE_NUM];
+} zbar_image_scanner_stats_t;
+
+/** retrieve image scanner statistics.
+ * @returns 0 for success, non-0 for failure
+ * @since 0.24
+ */
+extern int zbar_image_scanner_get_stats(const zbar_image_scanner_t *scanner,
+					zbar_image_scanner_stats_t *stats);
+
 /*@}*/
 
 /*------------------------------------------------------------*/
@@ -1504,6 +1658,15 @@ struct zbar_scanner_s;
 /** opaque scanner object. */
 typedef struct zbar_scanner_s zbar_scanner_t;
 
+/** located edge, as collected by the scanner in edge list mode.
+ * @see zbar_scanner_enable_edges()
+ * @since 0.24
+ */
+typedef struct zbar_edge_s {
+    unsigned pos;   /**< fixed point edge position (1/32 pixel) */
+    unsigned width; /**< width of the element ending at this edge */
+} zbar_edge_t;
+
 /** constructor.
  * if decoder is non-NULL it will be attached to scanner
  * and called automatically at each new edge
@@ -1548,6 +1711,18 @@ extern zbar_symbol_type_t zbar_scanner_flush(zbar_scanner_t *scanner);
  */
 extern zbar_symbol_type_t zbar_scan_y(zbar_scanner_t *scanner, int y);
 
+/** process a run of 8-bit sample intensity values.
+ * equivalent to calling zbar_scan_y() for each of @a n samples,
+ * starting at @a data and advancing @a stride bytes per sample
+ * (negative to scan backwards), but much faster.
+ * @returns the highest priority result of the equivalent
+ * zbar_scan_y() calls
+ * @since 0.24
+ */
+extern zbar_symbol_type_t zbar_scan_row(zbar_scanner_t *scanner,
+					const void *data, unsigned n,
+					int stride);
+
 /** process next sample from RGB (or BGR) triple. */
 static inline zbar_symbol_type_t zbar_scan_rgb24(zbar_scanner_t *scanner,
 						 unsigned char *rgb)
@@ -1555,6 +1730,38 @@ static inline zbar_symbol_type_t zbar_scan_rgb24(zbar_scanner_t *scanner,
     return (zbar_scan_y(scanner, rgb[0] + rgb[1] + rgb[2]));
 }
 
+/** enable or disable edge list mode.
+ * when enabled, located edges are collected into a list instead of
+ * being passed to the associated decoder as they are found.
+ * the list for a scan line may then be retrieved with
+ * zbar_scanner_get_edges() and decoded with zbar_scanner_decode_edges()
+ * (possibly more than once, or with different decoder configurations).
+ * zbar_scanner_new_scan() does not update the decoder in this mode,
+ * call zbar_decoder_new_scan() after decoding each scan line instead
+ * @since 0.24
+ */
+extern void zbar_scanner_enable_edges(zbar_scanner_t *scanner, int enable);
+
+/** retrieve edges collected in edge list mode.
+ * the list is valid until the next sample of a new scan line is
+ * processed or the scanner is reset
+ * @returns the number of edges collected for the current scan line
+ * @since 0.24
+ */
+extern unsigned zbar_scanner_get_edges(const zbar_scanner_t *scanner,
+				       const zbar_edge_t **edges);
+
+/** pass a list of collected edges to the associated decoder.
+ * while each edge is decoded, zbar_scanner_get_width() and
+ * zbar_scanner_get_edge() report that edge, as they would have
+ * when the edge was originally located
+ * @returns the highest priority decode result
+ * @since 0.24
+ */
+extern zbar_symbol_type_t zbar_scanner_decode_edges(zbar_scanner_t *scanner,
+						    const zbar_edge_t *edges,
+						    unsigned n);
+
 /** retrieve last scanned width. */
 extern unsigned zbar_scanner_get_width(const zbar_scanner_t *scanner);
 
@@ -201,6 +201,30 @@ public:
 	zbar_image_set_size(_img, width, height);
     }
 
+    /// retrieve the line stride of the image.
+    /// see zbar_image_get_stride()
+    /// @since 0.24
+    unsigned get_stride() const
+    {
+	return (zbar_image_get_stride(_img));
+    }
+
+    /// retrieve the dmabuf file descriptor holding a video frame.
+    /// see zbar_image_get_dmabuf()
+    /// @since 0.24
+    int get_dmabuf() const
+    {
+	return (zbar_image_get_dmabuf(_img));
+    }
+
+    /// specify the line stride of the image data.
+    /// see zbar_image_set_stride()
+    /// @since 0.24
+    void set_stride(unsigned stride)
+    {
+	zbar_image_set_stride(_img, stride);
+    }
+
     /// retrieve the scan crop rectangle.
     /// see zbar_image_get_crop()
     void get_crop(unsigned &x, unsigned &y, unsigned &width,
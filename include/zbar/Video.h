@@ -137,6 +137,14 @@ public:
 	return (Image(img));
     }
 
+    /// retrieve the number of held frames that had to be copied.
+    /// see zbar_video_get_copies()
+    /// @since 0.24
+    unsigned long get_copies() const
+    {
+	return (zbar_video_get_copies(_video));
+    }
+
     /// request a preferred size for the video image from the device.
     /// see zbar_video_request_size()
     /// @since 0.6
@@ -162,6 +170,15 @@ public:
 	    throw_exception(_video);
     }
 
+    /// capture into application allocated dmabufs.
+    /// see zbar_video_request_dmabufs()
+    /// @since 0.24
+    void request_dmabufs(const int *fds, int nfds)
+    {
+	if (zbar_video_request_dmabufs(_video, fds, nfds))
+	    throw_exception(_video);
+    }
+
     /// get the information about a control at a given index
     /// see zbar_video_get_controls()
     /// @since 0.11
@@ -48,9 +48,29 @@ public class Config
 
     /** Enable scanner to collect position data. */
     public static final int POSITION = 0x80;
+    /** Binarize QR code images only where they are sampled. */
+    public static final int LAZY_BINARIZE = 0x82;
+    /** Look for QR codes where they were in the last image first. */
+    public static final int QR_TRACK = 0x83;
+    /** Time QR finder line collection in the scanner statistics. */
+    public static final int QR_LINE_TIMES = 0x84;
 
     /** Image scanner vertical scan density. */
     public static final int X_DENSITY = 0x100;
     /** Image scanner horizontal scan density. */
     public static final int Y_DENSITY = 0x101;
+    /** Image scanner worker threads. */
+    public static final int THREADS = 0x102;
+    /** Time interval (ms) for which two cached images are "nearby". */
+    public static final int CACHE_PROXIMITY = 0x103;
+    /** Time (ms) a cached result must be absent before it is reported again. */
+    public static final int CACHE_HYSTERESIS = 0x104;
+    /** Time (ms) after which cache entries are invalidated. */
+    public static final int CACHE_TIMEOUT = 0x105;
+    /** Threads decoding candidate QR codes in parallel. */
+    public static final int QR_THREADS = 0x106;
+    /** Bytes of QR scratch memory kept between images. */
+    public static final int QR_SCRATCH = 0x107;
+    /** Largest factor JPEG frames are reduced by while decoding. */
+    public static final int JPEG_SCALE = 0x108;
 }
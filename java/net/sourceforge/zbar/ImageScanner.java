@@ -91,7 +91,8 @@ public class ImageScanner
     private native long getResults(long peer);
 
     /** Scan for symbols in provided Image.
-     * The image format must currently be "Y800" or "GRAY".
+     * The image format must be grayscale ("Y800" or "GREY"), YUV
+     * (eg, "NV12", "YUYV") or 24/32-bit RGB, which are scanned in place.
      * @returns the number of symbols successfully decoded from the image.
      */
     public native int scanImage(Image image);
@@ -68,8 +68,22 @@ static const enumdef config_defs[] = { { "ENABLE", ZBAR_CFG_ENABLE },
 				       { "MAX_LEN", ZBAR_CFG_MAX_LEN },
 				       { "UNCERTAINTY", ZBAR_CFG_UNCERTAINTY },
 				       { "POSITION", ZBAR_CFG_POSITION },
+				       { "LAZY_BINARIZE",
+					 ZBAR_CFG_LAZY_BINARIZE },
+				       { "QR_TRACK", ZBAR_CFG_QR_TRACK },
+				       { "QR_LINE_TIMES",
+					 ZBAR_CFG_QR_LINE_TIMES },
 				       { "X_DENSITY", ZBAR_CFG_X_DENSITY },
 				       { "Y_DENSITY", ZBAR_CFG_Y_DENSITY },
+				       { "THREADS", ZBAR_CFG_THREADS },
+				       { "CACHE_PROXIMITY",
+					 ZBAR_CFG_CACHE_PROXIMITY },
+				       { "CACHE_HYSTERESIS",
+					 ZBAR_CFG_CACHE_HYSTERESIS },
+				       { "CACHE_TIMEOUT", ZBAR_CFG_CACHE_TIMEOUT },
+				       { "QR_THREADS", ZBAR_CFG_QR_THREADS },
+				       { "QR_SCRATCH", ZBAR_CFG_QR_SCRATCH },
+				       { "JPEG_SCALE", ZBAR_CFG_JPEG_SCALE },
 				       {
 					   NULL,
 				       } };
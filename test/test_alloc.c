@@ -0,0 +1,163 @@
+/*------------------------------------------------------------------------
+ *  This file is part of the ZBar Bar Code Reader.
+ *
+ *  The ZBar Bar Code Reader is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Lesser Public License as
+ *  published by the Free Software Foundation; either version 2.1 of
+ *  the License, or (at your option) any later version.
+ *
+ *  The ZBar Bar Code Reader is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ *  of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser Public License
+ *  along with the ZBar Bar Code Reader; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301  USA
+ *
+ *  http://sourceforge.net/projects/zbar
+ *------------------------------------------------------------------------*/
+
+/* check that, once warmed up, scanning another frame of the same size
+ * does not touch the heap: result symbols, their data and location
+ * points must all come from the scanner's recycled pool.  frames of an
+ * EAN-13, an EAN-13 with an add-on reported as a composite, a QR code
+ * and an SQ code are checked in turn
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zbar.h>
+#include "test_images.h"
+
+#define WARMUP_FRAMES 4
+#define TEST_FRAMES   16
+
+#ifdef __GLIBC__
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+static int counting = 0;
+static int nallocs  = 0;
+
+void *malloc(size_t size)
+{
+    if (counting)
+	nallocs++;
+    return (__libc_malloc(size));
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    if (counting)
+	nallocs++;
+    return (__libc_calloc(nmemb, size));
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (counting)
+	nallocs++;
+    return (__libc_realloc(ptr, size));
+}
+
+typedef struct frame_s {
+    const char *name;
+    int (*fill)(zbar_image_t *);
+    zbar_symbol_type_t type;
+    const char *const *data;
+} frame_t;
+
+static const frame_t frames[] = {
+    { "EAN-13", test_image_ean13, ZBAR_EAN13, &test_image_ean13_data },
+    { "composite", test_image_composite, ZBAR_COMPOSITE,
+      &test_image_composite_data },
+    { "QR", test_image_qr, ZBAR_QRCODE, &test_image_qr_data },
+    { "SQ", test_image_sq, ZBAR_SQCODE, &test_image_sq_data },
+    { NULL }
+};
+
+static int scan_frame(zbar_image_scanner_t *scanner, zbar_image_t *img,
+		      const frame_t *frame)
+{
+    const zbar_symbol_t *sym;
+    int n = zbar_scan_image(scanner, img);
+    if (n != 1)
+	return (-1);
+    sym = zbar_image_first_symbol(img);
+    if (!sym || zbar_symbol_get_type(sym) != frame->type ||
+	strcmp(zbar_symbol_get_data(sym), *frame->data))
+	return (-1);
+    return (0);
+}
+
+static int check_frame(zbar_image_scanner_t *scanner, const frame_t *frame)
+{
+    zbar_image_t *img;
+    int i, rc = 0;
+
+    img = zbar_image_create();
+    zbar_image_set_format(img, fourcc('Y', '8', '0', '0'));
+    if (frame->fill(img)) {
+	zbar_image_destroy(img);
+	return (2);
+    }
+
+    for (i = 0; i < WARMUP_FRAMES && !rc; i++)
+	if (scan_frame(scanner, img, frame)) {
+	    fprintf(stderr, "ERROR: %s warm up scan %d failed\n", frame->name,
+		    i);
+	    rc = 1;
+	}
+
+    for (i = 0; i < TEST_FRAMES && !rc; i++) {
+	counting = 1;
+	nallocs	 = 0;
+	rc	 = scan_frame(scanner, img, frame);
+	counting = 0;
+	if (rc)
+	    fprintf(stderr, "ERROR: %s scan %d failed\n", frame->name, i);
+	else if (nallocs) {
+	    fprintf(stderr, "ERROR: %s scan %d made %d heap allocations\n",
+		    frame->name, i, nallocs);
+	    rc = 1;
+	}
+    }
+
+    zbar_image_destroy(img);
+    return (rc);
+}
+
+int main(int argc, char *argv[])
+{
+    zbar_image_scanner_t *scanner;
+    const frame_t *frame;
+    int rc = 0;
+
+    scanner = zbar_image_scanner_create();
+    zbar_image_scanner_set_config(scanner, ZBAR_EAN2, ZBAR_CFG_ENABLE, 1);
+    zbar_image_scanner_set_config(scanner, ZBAR_COMPOSITE, ZBAR_CFG_ENABLE, 1);
+
+    for (frame = frames; frame->name; frame++)
+	rc |= check_frame(scanner, frame);
+
+    zbar_image_scanner_destroy(scanner);
+    if (test_image_check_cleanup())
+	rc = 1;
+    return (rc);
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+    fprintf(stderr, "allocation counting not supported, skipped\n");
+    return (0);
+}
+
+#endif
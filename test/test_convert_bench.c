@@ -0,0 +1,222 @@
+/*------------------------------------------------------------------------
+ *  This file is part of the ZBar Bar Code Reader.
+ *
+ *  The ZBar Bar Code Reader is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Lesser Public License as
+ *  published by the Free Software Foundation; either version 2.1 of
+ *  the License, or (at your option) any later version.
+ *
+ *  The ZBar Bar Code Reader is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ *  of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser Public License
+ *  along with the ZBar Bar Code Reader; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301  USA
+ *
+ *  http://sourceforge.net/projects/zbar
+ *------------------------------------------------------------------------*/
+
+/* time the conversions the scanner and the display spend most of their
+ * time in at 1080p and 4K, after checking that they produce exactly what
+ * the per pixel formulas give for random data across a range of widths
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zbar.h>
+
+#define Y800 zbar_fourcc('Y', '8', '0', '0')
+#define BGR4 zbar_fourcc('B', 'G', 'R', '4')
+
+typedef struct conv_s {
+    const char *name;
+    unsigned long fourcc;
+    int bpp;
+    /* byte offset of the luma (yuv) or bit offsets of r, g and b (rgb) */
+    int y, r, g, b;
+} conv_t;
+
+static const conv_t convs[] = {
+    { "YUYV", zbar_fourcc('Y', 'U', 'Y', 'V'), 2, 0, -1, -1, -1 },
+    { "UYVY", zbar_fourcc('U', 'Y', 'V', 'Y'), 2, 1, -1, -1, -1 },
+    { "RGB3", zbar_fourcc('R', 'G', 'B', '3'), 3, -1, 0, 8, 16 },
+    { "BGR3", zbar_fourcc('B', 'G', 'R', '3'), 3, -1, 16, 8, 0 },
+    { "RGB4", zbar_fourcc('R', 'G', 'B', '4'), 4, -1, 8, 16, 24 },
+    { "BGR4", BGR4, 4, -1, 16, 8, 0 },
+};
+#define NCONVS (sizeof(convs) / sizeof(*convs))
+
+static double elapsed_ms(const struct timespec *start,
+			 const struct timespec *end)
+{
+    return ((end->tv_sec - start->tv_sec) * 1e3 +
+	    (end->tv_nsec - start->tv_nsec) / 1e6);
+}
+
+static void fill(uint8_t *data, unsigned long len)
+{
+    while (len--)
+	*(data++) = rand();
+}
+
+/* luma of the pixel at p, the way the scalar converters compute it */
+static uint8_t ref_luma(const conv_t *conv, const uint8_t *p)
+{
+    uint32_t v = 0;
+    unsigned r, g, b;
+    if (conv->bpp == 2)
+	return (p[conv->y]);
+    if (conv->bpp == 3)
+	v = p[0] | (p[1] << 8) | (p[2] << 16);
+    else
+	memcpy(&v, p, 4);
+    r = (v >> conv->r) & 0xff;
+    g = (v >> conv->g) & 0xff;
+    b = (v >> conv->b) & 0xff;
+    return ((77 * r + 150 * g + 29 * b + 0x80) >> 8);
+}
+
+static zbar_image_t *make_image(unsigned long fourcc, unsigned w, unsigned h,
+				unsigned long len)
+{
+    zbar_image_t *img = zbar_image_create();
+    uint8_t *data     = malloc(len);
+    fill(data, len);
+    zbar_image_set_format(img, fourcc);
+    zbar_image_set_size(img, w, h);
+    zbar_image_set_data(img, data, len, zbar_image_free_data);
+    return (img);
+}
+
+static int check_to_y800(const conv_t *conv, unsigned w, unsigned h)
+{
+    zbar_image_t *src, *dst;
+    const uint8_t *s, *d;
+    unsigned x, y;
+    int rc = 0;
+
+    src = make_image(conv->fourcc, w, h, (unsigned long)w * h * conv->bpp);
+    dst = zbar_image_convert(src, Y800);
+    if (!dst) {
+	fprintf(stderr, "%s -> Y800 (%ux%u): conversion failed\n", conv->name,
+		w, h);
+	zbar_image_destroy(src);
+	return (1);
+    }
+    s = zbar_image_get_data(src);
+    d = zbar_image_get_data(dst);
+    for (y = 0; y < h && !rc; y++)
+	for (x = 0; x < w; x++, s += conv->bpp, d++)
+	    if (*d != ref_luma(conv, s)) {
+		fprintf(stderr, "%s -> Y800 (%ux%u): (%u,%u) is %u not %u\n",
+			conv->name, w, h, x, y, *d, ref_luma(conv, s));
+		rc = 1;
+		break;
+	    }
+    zbar_image_destroy(dst);
+    zbar_image_destroy(src);
+    return (rc);
+}
+
+static int check_to_bgr4(unsigned w, unsigned h)
+{
+    zbar_image_t *src, *dst;
+    const uint8_t *s, *d;
+    unsigned x, y;
+    uint32_t v;
+    int rc = 0;
+
+    src = make_image(Y800, w, h, (unsigned long)w * h);
+    dst = zbar_image_convert(src, BGR4);
+    if (!dst) {
+	fprintf(stderr, "Y800 -> BGR4 (%ux%u): conversion failed\n", w, h);
+	zbar_image_destroy(src);
+	return (1);
+    }
+    s = zbar_image_get_data(src);
+    d = zbar_image_get_data(dst);
+    for (y = 0; y < h && !rc; y++)
+	for (x = 0; x < w; x++, s++, d += 4) {
+	    memcpy(&v, d, 4);
+	    if (v != *s * 0x010101u) {
+		fprintf(stderr, "Y800 -> BGR4 (%ux%u): (%u,%u) is %08x\n", w,
+			h, x, y, (unsigned)v);
+		rc = 1;
+		break;
+	    }
+	}
+    zbar_image_destroy(dst);
+    zbar_image_destroy(src);
+    return (rc);
+}
+
+/* convert niter times, reporting the time per frame and the rate at
+ * which source bytes are consumed
+ */
+static void bench(const char *name, unsigned long fourcc, int bpp,
+		  unsigned long dstfourcc, unsigned w, unsigned h, int niter)
+{
+    zbar_image_t *src, *dst;
+    struct timespec start, end;
+    double ms;
+    int i;
+
+    src = make_image(fourcc, w, h, (unsigned long)w * h * bpp);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < niter; i++) {
+	dst = zbar_image_convert(src, dstfourcc);
+	zbar_image_destroy(dst);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ms = elapsed_ms(&start, &end) / niter;
+    printf("%s (%ux%u px): %.2f ms per frame, %.0f MB/s\n", name, w, h, ms,
+	   (double)w * h * bpp / (ms * 1e3));
+    zbar_image_destroy(src);
+}
+
+int main(int argc, char *argv[])
+{
+    static const unsigned sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+    char name[32];
+    int niter = 10, i, j, opt, rc = 0;
+    unsigned w;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+	if (opt == 'n')
+	    niter = atoi(optarg);
+	else {
+	    fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+	    return (2);
+	}
+
+    /* every width up to a few vectors exercises the row tails */
+    for (w = 2; w <= 80 && !rc; w++) {
+	for (i = 0; i < NCONVS; i++)
+	    if (convs[i].bpp != 2 || !(w & 1))
+		rc |= check_to_y800(&convs[i], w, 3);
+	rc |= check_to_bgr4(w, 3);
+    }
+    for (i = 0; i < NCONVS; i++)
+	rc |= check_to_y800(&convs[i], (convs[i].bpp == 2) ? 334 : 333, 7);
+    rc |= check_to_bgr4(333, 7);
+    if (rc)
+	return (rc);
+
+    for (j = 0; j < sizeof(sizes) / sizeof(*sizes); j++) {
+	for (i = 0; i < NCONVS; i++) {
+	    snprintf(name, sizeof(name), "%s -> Y800", convs[i].name);
+	    bench(name, convs[i].fourcc, convs[i].bpp, Y800, sizes[j][0],
+		  sizes[j][1], niter);
+	}
+	bench("Y800 -> BGR4", Y800, 1, BGR4, sizes[j][0], sizes[j][1], niter);
+    }
+    return (0);
+}
@@ -141,6 +141,35 @@ static const char *encoded_widths =
     "9 111 212241113121211311141132 11111 311213121312121332111132 111 9";
 const char *test_image_ean13_data = "6268964977804";
 
+/* the same EAN-13 followed by an EAN-2 add-on */
+static const char *composite_widths =
+    "9 111 212241113121211311141132 11111 311213121312121332111132 111 9"
+    " 112 2221 11 2122 9";
+const char *test_image_composite_data = "626896497780412";
+
+/* version 2 QR code */
+const char *const test_image_qr_modules[TEST_IMAGE_QR_SIZE] = {
+    "####### ###   #   #######", "#     #     ##  # #     #",
+    "# ### #  # ####   # ### #", "# ### #  #  ##### # ### #",
+    "# ### #  ##  ## # # ### #", "#     #  ######   #     #",
+    "####### # # # # # #######", "        #  ### #         ",
+    "## ## #  ###  ### #     #", "### ## # ### ###   ##### ",
+    "    ### # ##   # # # #  #", " # # #  ###   ##  ## ####",
+    "### ###  #  #   # ##    #", "####    #  ##### #  #  # ",
+    "##   ###    #  #### #####", "# # #  ##  ##  ## ## ## #",
+    "#  ########### ###### ## ", "        #    #  #   # ## ",
+    "#######  # # ## # # #   #", "#     #     #####   #  # ",
+    "# ### # #   # #######  # ", "# ### # #  #  #####    ##",
+    "# ### #    ##    #  #####", "#     # #  ## ## # ## ###",
+    "####### # # #   ###  #  #"
+};
+const char *test_image_qr_data = "https://github.com/mchehab/zbar";
+
+/* SQ code of 8 bytes, one pixel per dot */
+static const char sq_bytes[] = "zbar-sq!";
+#define SQ_BORDER 14
+const char *test_image_sq_data = "emJhci1zcSE=";
+
 static int allocated_images = 0;
 
 int test_image_check_cleanup()
@@ -531,3 +560,92 @@ int test_image_ean13(zbar_image_t *img)
     assert(p == data + datalen);
     return (0);
 }
+
+/* allocate a white w x h grayscale image */
+static uint8_t *alloc_gray(zbar_image_t *img, unsigned w, unsigned h)
+{
+    zbar_image_set_size(img, w, h);
+    const format_def_t *fmt = alloc_data(img);
+    if (!fmt || fmt->type != GRAY)
+	return (NULL);
+
+    uint8_t *data = (void *)zbar_image_get_data(img);
+    assert(data);
+    memset(data, 0xff, w * h);
+    return (data);
+}
+
+int test_image_composite(zbar_image_t *img)
+{
+    unsigned w = 0, h = 85, x, y;
+    const char *c;
+    for (c = composite_widths; *c; c++)
+	if (*c != ' ')
+	    w += *c - '0';
+
+    uint8_t *data = alloc_gray(img, w, h);
+    if (!data)
+	return (-1);
+
+    uint8_t color = 0xff;
+    for (x = 0, c = composite_widths; *c; c++) {
+	int dx;
+	if (*c == ' ')
+	    continue;
+	for (dx = *c - '0'; dx > 0; dx--, x++)
+	    for (y = 10; y < h - 10; y++)
+		data[y * w + x] = color;
+	color = ~color;
+    }
+    assert(!color && x == w);
+    return (0);
+}
+
+int test_image_qr(zbar_image_t *img)
+{
+    unsigned scale = 3, quiet = 4 * scale, x, y;
+    unsigned w = TEST_IMAGE_QR_SIZE * scale + 2 * quiet;
+
+    uint8_t *data = alloc_gray(img, w, w);
+    if (!data)
+	return (-1);
+
+    for (y = 0; y < TEST_IMAGE_QR_SIZE * scale; y++)
+	for (x = 0; x < TEST_IMAGE_QR_SIZE * scale; x++)
+	    if (test_image_qr_modules[y / scale][x / scale] == '#')
+		data[(quiet + y) * w + quiet + x] = 0;
+    return (0);
+}
+
+int test_image_sq(zbar_image_t *img)
+{
+    unsigned w = SQ_BORDER + 8, o = 2, x, y, i;
+
+    uint8_t *data = alloc_gray(img, w, w);
+    if (!data)
+	return (-1);
+
+    /* dots every other pixel down the top and left borders, and shifted
+     * by one down the right and bottom ones, with diagonal pairs for the
+     * top right and bottom left corners
+     */
+    for (i = 0; i < SQ_BORDER - 1; i += 2) {
+	data[o * w + o + i]   = 0;
+	data[(o + i) * w + o] = 0;
+    }
+    data[(o + 1) * w + o + SQ_BORDER - 1] = 0;
+    data[(o + SQ_BORDER - 1) * w + o + 1] = 0;
+    for (i = 3; i < SQ_BORDER; i += 2) {
+	data[(o + i) * w + o + SQ_BORDER - 1] = 0;
+	data[(o + SQ_BORDER - 1) * w + o + i] = 0;
+    }
+
+    /* data bits fill the square inside, most significant first */
+    i = 0;
+    for (y = 3; y < SQ_BORDER - 3; y++)
+	for (x = 3; x < SQ_BORDER - 3; x++, i++)
+	    if (sq_bytes[i / 8] & (0x80 >> i % 8))
+		data[(o + y) * w + o + x] = 0;
+    assert(i == 8 * (sizeof(sq_bytes) - 1));
+    return (0);
+}
@@ -25,12 +25,17 @@
 
 #define fourcc zbar_fourcc
 
+#define TEST_IMAGE_QR_SIZE 25
+
 #ifdef __cplusplus
 
 extern "C" {
 int test_image_check_cleanup(void);
 int test_image_bars(zbar::zbar_image_t *);
 int test_image_ean13(zbar::zbar_image_t *);
+int test_image_composite(zbar::zbar_image_t *);
+int test_image_qr(zbar::zbar_image_t *);
+int test_image_sq(zbar::zbar_image_t *);
 }
 
 #else
@@ -38,9 +43,16 @@ int test_image_ean13(zbar::zbar_image_t *);
 int test_image_check_cleanup(void);
 int test_image_bars(zbar_image_t *);
 int test_image_ean13(zbar_image_t *);
+int test_image_composite(zbar_image_t *);
+int test_image_qr(zbar_image_t *);
+int test_image_sq(zbar_image_t *);
 
 #endif
 
 extern const char *test_image_ean13_data;
+extern const char *test_image_composite_data;
+extern const char *const test_image_qr_modules[TEST_IMAGE_QR_SIZE];
+extern const char *test_image_qr_data;
+extern const char *test_image_sq_data;
 
 #endif
@@ -0,0 +1,167 @@
+/*------------------------------------------------------------------------
+ *  This file is part of the ZBar Bar Code Reader.
+ *
+ *  The ZBar Bar Code Reader is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Lesser Public License as
+ *  published by the Free Software Foundation; either version 2.1 of
+ *  the License, or (at your option) any later version.
+ *
+ *  The ZBar Bar Code Reader is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ *  of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser Public License
+ *  along with the ZBar Bar Code Reader; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301  USA
+ *
+ *  http://sourceforge.net/projects/zbar
+ *------------------------------------------------------------------------*/
+
+/* check that decoding inverted symbols does not change 1D results:
+ * with ZBAR_CFG_TEST_INVERTED, a normal EAN-13 and its inverted copy
+ * must both be reported exactly as the normal one is with the option
+ * off (which is also what inverting and rescanning used to report),
+ * with the same data, quality, orientation and location
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zbar.h>
+#include "test_images.h"
+
+#define MAX_PTS 512
+
+typedef struct result_s {
+    zbar_symbol_type_t type;
+    char data[32];
+    int quality;
+    zbar_orientation_t orient;
+    unsigned npts;
+    int pts[MAX_PTS][2];
+} result_t;
+
+/* scan img with a new scanner and record its only symbol.
+ * decoder state is kept between images, so each scan starts afresh
+ */
+static int scan(zbar_image_t *img, int inverted, int threads, result_t *res)
+{
+    zbar_image_scanner_t *scanner = zbar_image_scanner_create();
+    const zbar_symbol_t *sym;
+    unsigned i;
+    int rc = -1;
+
+    memset(res, 0, sizeof(*res));
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_TEST_INVERTED,
+				  inverted);
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_THREADS, threads);
+    if (zbar_scan_image(scanner, img) != 1)
+	goto done;
+    sym = zbar_image_first_symbol(img);
+    if (!sym || zbar_symbol_next(sym) ||
+	zbar_symbol_get_data_length(sym) >= sizeof(res->data) ||
+	zbar_symbol_get_loc_size(sym) > MAX_PTS)
+	goto done;
+    res->type	 = zbar_symbol_get_type(sym);
+    res->quality = zbar_symbol_get_quality(sym);
+    res->orient	 = zbar_symbol_get_orientation(sym);
+    res->npts	 = zbar_symbol_get_loc_size(sym);
+    strcpy(res->data, zbar_symbol_get_data(sym));
+    for (i = 0; i < res->npts; i++) {
+	res->pts[i][0] = zbar_symbol_get_loc_x(sym, i);
+	res->pts[i][1] = zbar_symbol_get_loc_y(sym, i);
+    }
+    rc = 0;
+
+done:
+    zbar_image_scanner_destroy(scanner);
+    return (rc);
+}
+
+static int check(const char *name, const result_t *res, const result_t *ref)
+{
+    unsigned i;
+    if (res->type != ref->type || strcmp(res->data, ref->data)) {
+	fprintf(stderr, "ERROR: %s: found %s %s\n", name,
+		zbar_get_symbol_name(res->type), res->data);
+	return (1);
+    }
+    if (res->quality != ref->quality || res->orient != ref->orient ||
+	res->npts != ref->npts) {
+	fprintf(stderr,
+		"ERROR: %s: quality %d orient %d with %d points,"
+		" expected %d, %d, %d\n",
+		name, res->quality, res->orient, res->npts, ref->quality,
+		ref->orient, ref->npts);
+	return (1);
+    }
+    for (i = 0; i < res->npts; i++)
+	if (res->pts[i][0] != ref->pts[i][0] ||
+	    res->pts[i][1] != ref->pts[i][1]) {
+	    fprintf(stderr, "ERROR: %s: point %d at (%d,%d), expected (%d,%d)\n",
+		    name, i, res->pts[i][0], res->pts[i][1], ref->pts[i][0],
+		    ref->pts[i][1]);
+	    return (1);
+	}
+    return (0);
+}
+
+int main(int argc, char *argv[])
+{
+    static result_t ref, res;
+    zbar_image_t *img, *inv;
+    const unsigned char *data;
+    unsigned char *buf;
+    unsigned w, h, i;
+    int threads, rc = 0;
+
+    img = zbar_image_create();
+    zbar_image_set_format(img, fourcc('Y', '8', '0', '0'));
+    if (test_image_ean13(img))
+	return (2);
+    zbar_image_get_size(img, &w, &h);
+    data = zbar_image_get_data(img);
+
+    buf = malloc(w * h);
+    for (i = 0; i < w * h; i++)
+	buf[i] = 0xff - data[i];
+    inv = zbar_image_create();
+    zbar_image_set_format(inv, fourcc('Y', '8', '0', '0'));
+    zbar_image_set_size(inv, w, h);
+    zbar_image_set_data(inv, buf, w * h, NULL);
+
+    if (scan(img, 0, 1, &ref) || ref.type != ZBAR_EAN13 ||
+	strcmp(ref.data, test_image_ean13_data)) {
+	fprintf(stderr, "ERROR: normal scan failed\n");
+	rc = 1;
+    }
+    if (!scan(inv, 0, 1, &res)) {
+	fprintf(stderr, "ERROR: inverted image found with option off\n");
+	rc = 1;
+    }
+
+    for (threads = 1; threads <= 4 && !rc; threads += 3) {
+	if (scan(img, 1, threads, &res)) {
+	    fprintf(stderr, "ERROR: normal scan failed (%d threads)\n",
+		    threads);
+	    rc = 1;
+	} else
+	    rc |= check("normal image", &res, &ref);
+	if (scan(inv, 1, threads, &res)) {
+	    fprintf(stderr, "ERROR: inverted scan failed (%d threads)\n",
+		    threads);
+	    rc = 1;
+	} else
+	    rc |= check("inverted image", &res, &ref);
+    }
+
+    zbar_image_destroy(inv);
+    free(buf);
+    zbar_image_destroy(img);
+    if (test_image_check_cleanup())
+	rc = 1;
+    return (rc);
+}
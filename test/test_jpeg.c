@@ -29,7 +29,9 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <jpeglib.h>
 #include <zbar.h>
 
 #include "test_images.h"
@@ -119,6 +121,124 @@ static const struct argp argp = {
     .doc     = doc,
 };
 
+/* magnification of the EAN-13 test image, so its narrowest bars are
+ * still 2 pixels wide when decoded at 1/4 size
+ */
+#define EAN_ZOOM 8
+
+/* compress the magnified EAN-13 test image to JPEG in memory */
+static zbar_image_t *ean13_jpeg(void)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned char *buf = NULL, *line;
+    unsigned long len = 0;
+    unsigned w, h, x, y;
+    const unsigned char *data;
+    zbar_image_t *ean, *img;
+
+    ean = zbar_image_create();
+    zbar_image_set_format(ean, fourcc('Y', '8', '0', '0'));
+    if (test_image_ean13(ean))
+	return (NULL);
+    w	 = zbar_image_get_width(ean);
+    h	 = zbar_image_get_height(ean);
+    data = zbar_image_get_data(ean);
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &buf, &len);
+    cinfo.image_width	   = w * EAN_ZOOM;
+    cinfo.image_height	   = h * EAN_ZOOM;
+    cinfo.input_components = 1;
+    cinfo.in_color_space   = JCS_GRAYSCALE;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 90, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    line = malloc(w * EAN_ZOOM);
+    for (y = 0; y < h * EAN_ZOOM; y++) {
+	for (x = 0; x < w * EAN_ZOOM; x++)
+	    line[x] = data[(y / EAN_ZOOM) * w + x / EAN_ZOOM];
+	jpeg_write_scanlines(&cinfo, &line, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    free(line);
+    zbar_image_destroy(ean);
+
+    img = zbar_image_create();
+    zbar_image_set_format(img, fourcc('J', 'P', 'E', 'G'));
+    zbar_image_set_size(img, w * EAN_ZOOM, h * EAN_ZOOM);
+    zbar_image_set_data(img, buf, len, zbar_image_free_data);
+    return (img);
+}
+
+/* process img allowing JPEG decoding at 1/scale size, scanning every
+ * fourth line, and return the bounds of the symbol found in bbox
+ */
+static int process_scaled(zbar_image_t *img, int scale, int bbox[4])
+{
+    zbar_processor_t *proc = zbar_processor_create(0);
+    const zbar_symbol_t *sym;
+    unsigned i;
+    int rc = -1;
+
+    if (zbar_processor_init(proc, NULL, 0))
+	goto done;
+    zbar_processor_set_config(proc, 0, ZBAR_CFG_X_DENSITY, 4);
+    zbar_processor_set_config(proc, 0, ZBAR_CFG_Y_DENSITY, 4);
+    zbar_processor_set_config(proc, 0, ZBAR_CFG_JPEG_SCALE, scale);
+    if (zbar_process_image(proc, img) < 0)
+	goto done;
+
+    sym = zbar_image_first_symbol(img);
+    if (!sym || zbar_symbol_get_type(sym) != ZBAR_EAN13 ||
+	strcmp(zbar_symbol_get_data(sym), test_image_ean13_data))
+	goto done;
+    bbox[0] = bbox[1] = 1 << 30;
+    bbox[2] = bbox[3] = -1;
+    for (i = 0; i < zbar_symbol_get_loc_size(sym); i++) {
+	int x = zbar_symbol_get_loc_x(sym, i);
+	int y = zbar_symbol_get_loc_y(sym, i);
+	if (x < bbox[0])
+	    bbox[0] = x;
+	if (y < bbox[1])
+	    bbox[1] = y;
+	if (x > bbox[2])
+	    bbox[2] = x;
+	if (y > bbox[3])
+	    bbox[3] = y;
+    }
+    if (!quiet)
+	printf("1/%d: EAN-13 at (%d,%d)-(%d,%d)\n", scale, bbox[0], bbox[1],
+	       bbox[2], bbox[3]);
+    rc = 0;
+
+done:
+    zbar_processor_destroy(proc);
+    return (rc);
+}
+
+/* check that a JPEG decoded at reduced size is scanned along the same
+ * lines, and that the symbol is located where it is at full size
+ */
+static int check_scale(void)
+{
+    zbar_image_t *img = ean13_jpeg();
+    int full[4], quarter[4], i, rc = 0;
+
+    if (!img || process_scaled(img, 1, full) || process_scaled(img, 4, quarter))
+	rc = 1;
+    for (i = 0; i < 4 && !rc; i++)
+	if (abs(full[i] - quarter[i]) > EAN_ZOOM)
+	    rc = 1;
+    if (rc)
+	fprintf(stderr, "ERROR: EAN-13 not located in JPEG decoded at 1/4\n");
+    if (img)
+	zbar_image_destroy(img);
+    return (rc);
+}
+
 int main(int argc, char **argv)
 {
     if (argp_parse(&argp, argc, argv, ARGP_NO_HELP | ARGP_NO_EXIT, 0, 0)) {
@@ -130,6 +250,9 @@ int main(int argc, char **argv)
     else
 	zbar_set_verbosity(0);
 
+    if (check_scale())
+	return (5);
+
     zbar_processor_t *proc = zbar_processor_create(0);
     assert(proc);
     if (zbar_processor_init(proc, NULL, 1))
@@ -0,0 +1,413 @@
+/*------------------------------------------------------------------------
+ *  This file is part of the ZBar Bar Code Reader.
+ *
+ *  The ZBar Bar Code Reader is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Lesser Public License as
+ *  published by the Free Software Foundation; either version 2.1 of
+ *  the License, or (at your option) any later version.
+ *
+ *  The ZBar Bar Code Reader is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ *  of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser Public License
+ *  along with the ZBar Bar Code Reader; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301  USA
+ *
+ *  http://sourceforge.net/projects/zbar
+ *------------------------------------------------------------------------*/
+
+/* time the decoding of full high version QR codes, drawn slightly
+ * rotated so the sampling grid is not axis aligned, and of a code in a
+ * large image full of texture, and check that their data is read back
+ *
+ * the codes are encoded here in byte mode at error correction level L
+ * with data mask 0
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zbar.h>
+
+#define QR_QUIET 4
+#define QR_SCALE 4
+
+/* error correction codewords per block and number of blocks at level L */
+static const unsigned char qr_ecc_len[40] = {
+    7,	10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30,
+    22, 24, 28, 30, 28, 28, 28, 28, 30, 30, 26, 28, 30, 30,
+    30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30
+};
+static const unsigned char qr_nblocks[40] = {
+    1, 1,  1,  1,  1,  2,  2,  2,  2,  4,  4,  4,  4,  4,
+    6, 6,  6,  6,  7,  8,  8,  9,  9,  10, 12, 12, 12, 13,
+    14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25
+};
+
+static unsigned char gf_exp[512], gf_log[256];
+
+static void gf_init(void)
+{
+    int i, x = 1;
+    for (i = 0; i < 255; i++) {
+	gf_exp[i] = gf_exp[i + 255] = x;
+	gf_log[x]		    = i;
+	x			    = x << 1 ^ (x & 0x80 ? 0x11D : 0);
+    }
+}
+
+static unsigned char gf_mul(unsigned char a, unsigned char b)
+{
+    return (a && b ? gf_exp[gf_log[a] + gf_log[b]] : 0);
+}
+
+/* append the Reed-Solomon parity of the n bytes of data to it */
+static void rs_encode(unsigned char *data, int n, int npar)
+{
+    unsigned char gen[32], *par = data + n;
+    int i, j, root = 1;
+
+    /* generator with roots 2^0 ... 2^(npar-1), highest degree first */
+    memset(gen, 0, npar);
+    gen[npar - 1] = 1;
+    for (i = 0; i < npar; i++) {
+	for (j = 0; j < npar; j++)
+	    gen[j] = gf_mul(gen[j], root) ^ (j + 1 < npar ? gen[j + 1] : 0);
+	root = gf_mul(root, 2);
+    }
+    memset(par, 0, npar);
+    for (i = 0; i < n; i++) {
+	unsigned char f = data[i] ^ par[0];
+	memmove(par, par + 1, npar - 1);
+	par[npar - 1] = 0;
+	for (j = 0; j < npar; j++)
+	    par[j] ^= gf_mul(gen[j], f);
+    }
+}
+
+static int qr_ncodewords(int version)
+{
+    int n = ((16 * version + 128) * version + 64), nalign;
+    if (version >= 2) {
+	nalign = version / 7 + 2;
+	n -= (25 * nalign - 10) * nalign - 55;
+    }
+    if (version >= 7)
+	n -= 36;
+    return (n / 8);
+}
+
+/* the number of bytes a code holds in byte mode */
+static int qr_capacity(int version)
+{
+    int ndata = qr_ncodewords(version) -
+		qr_ecc_len[version - 1] * qr_nblocks[version - 1];
+    return ((ndata * 8 - 4 - (version < 10 ? 8 : 16)) / 8);
+}
+
+typedef struct {
+    int size;
+    unsigned char *dark;
+    unsigned char *fixed;
+} qr_matrix_t;
+
+static void qr_set(qr_matrix_t *qr, int x, int y, int dark)
+{
+    qr->dark[y * qr->size + x]	= dark;
+    qr->fixed[y * qr->size + x] = 1;
+}
+
+static void qr_draw_function(qr_matrix_t *qr, int version)
+{
+    static const int corners[3][2] = { { 3, 3 }, { -4, 3 }, { 3, -4 } };
+    int size = qr->size, pos[7], nalign = 0, i, j, dx, dy;
+    unsigned bits;
+
+    for (i = 0; i < size; i++) {
+	qr_set(qr, 6, i, !(i & 1));
+	qr_set(qr, i, 6, !(i & 1));
+    }
+    if (version > 1) {
+	int step;
+	nalign = version / 7 + 2;
+	step   = version == 32 ? 26 :
+			       (version * 4 + nalign * 2 + 1) /
+				   (nalign * 2 - 2) * 2;
+	pos[0] = 6;
+	for (i = nalign - 1, j = size - 7; i >= 1; i--, j -= step)
+	    pos[i] = j;
+    }
+    for (i = 0; i < nalign; i++)
+	for (j = 0; j < nalign; j++) {
+	    if (i == 0 && j == 0 || i == 0 && j == nalign - 1 ||
+		i == nalign - 1 && j == 0)
+		continue;
+	    for (dy = -2; dy <= 2; dy++)
+		for (dx = -2; dx <= 2; dx++)
+		    qr_set(qr, pos[i] + dx, pos[j] + dy,
+			   abs(dx) == 2 || abs(dy) == 2 || !dx && !dy);
+	}
+    for (i = 0; i < 3; i++) {
+	int cx = (corners[i][0] + size) % size;
+	int cy = (corners[i][1] + size) % size;
+	for (dy = -4; dy <= 4; dy++)
+	    for (dx = -4; dx <= 4; dx++) {
+		int d = abs(dx) > abs(dy) ? abs(dx) : abs(dy);
+		if (cx + dx >= 0 && cx + dx < size && cy + dy >= 0 &&
+		    cy + dy < size)
+		    qr_set(qr, cx + dx, cy + dy, d != 2 && d != 4);
+	    }
+    }
+
+    /* format information: level L (01), mask 0 */
+    bits = 1 << 3;
+    {
+	unsigned rem = bits;
+	for (i = 0; i < 10; i++)
+	    rem = rem << 1 ^ (rem >> 9) * 0x537;
+	bits = (bits << 10 | rem) ^ 0x5412;
+    }
+    for (i = 0; i <= 5; i++)
+	qr_set(qr, 8, i, bits >> i & 1);
+    qr_set(qr, 8, 7, bits >> 6 & 1);
+    qr_set(qr, 8, 8, bits >> 7 & 1);
+    qr_set(qr, 7, 8, bits >> 8 & 1);
+    for (i = 9; i < 15; i++)
+	qr_set(qr, 14 - i, 8, bits >> i & 1);
+    for (i = 0; i < 8; i++)
+	qr_set(qr, size - 1 - i, 8, bits >> i & 1);
+    for (i = 8; i < 15; i++)
+	qr_set(qr, 8, size - 15 + i, bits >> i & 1);
+    qr_set(qr, 8, size - 8, 1);
+
+    if (version >= 7) {
+	unsigned rem = version;
+	for (i = 0; i < 12; i++)
+	    rem = rem << 1 ^ (rem >> 11) * 0x1F25;
+	bits = version << 12 | rem;
+	for (i = 0; i < 18; i++) {
+	    qr_set(qr, size - 11 + i % 3, i / 3, bits >> i & 1);
+	    qr_set(qr, i / 3, size - 11 + i % 3, bits >> i & 1);
+	}
+    }
+}
+
+/* encode the text in a code of the given version, filling it up */
+static void qr_encode(qr_matrix_t *qr, int version, const char *text)
+{
+    int ncw = qr_ncodewords(version), npar = qr_ecc_len[version - 1];
+    int nblocks = qr_nblocks[version - 1], nshort = nblocks - ncw % nblocks;
+    int short_len = ncw / nblocks, ndata = ncw - npar * nblocks;
+    int len = strlen(text), nlen = version < 10 ? 8 : 16;
+    unsigned char *data, *blocks, *cw;
+    int i, j, k, bit, x, y, right;
+
+    /* mode, length, bytes, terminator and padding */
+    data = calloc(ndata, 1);
+    bit	 = 0;
+#define PUT(v, n)                                                     \
+    for (i = (n)-1; i >= 0; i--, bit++)                               \
+	data[bit >> 3] |= ((v) >> i & 1) << (7 - (bit & 7))
+    PUT(4, 4);
+    PUT(len, nlen);
+    for (k = 0; k < len; k++) {
+	PUT((unsigned char)text[k], 8);
+    }
+#undef PUT
+    for (k = bit + 4 + 7 >> 3; k < ndata; k++)
+	data[k] = (k - (bit + 4 + 7 >> 3)) & 1 ? 0x11 : 0xEC;
+
+    /* split into blocks, add parity and interleave */
+    blocks = malloc(nblocks * (short_len + 1));
+    for (i = k = 0; i < nblocks; i++) {
+	unsigned char *blk = blocks + i * (short_len + 1);
+	int n = short_len - npar + (i >= nshort);
+	memcpy(blk, data + k, n);
+	k += n;
+	rs_encode(blk, n, npar);
+	if (i < nshort)
+	    memmove(blk + n + 1, blk + n, npar);
+    }
+    cw = malloc(ncw);
+    for (i = k = 0; i <= short_len; i++)
+	for (j = 0; j < nblocks; j++)
+	    if (i != short_len - npar || j >= nshort)
+		cw[k++] = blocks[j * (short_len + 1) + i];
+
+    qr->size  = 17 + 4 * version;
+    qr->dark  = calloc(qr->size * qr->size, 1);
+    qr->fixed = calloc(qr->size * qr->size, 1);
+    qr_draw_function(qr, version);
+
+    /* place the codewords in the zigzag order, applying mask 0 */
+    for (right = qr->size - 1, bit = 0; right >= 1; right -= 2) {
+	if (right == 6)
+	    right = 5;
+	for (k = 0; k < qr->size; k++)
+	    for (j = 0; j < 2; j++) {
+		x = right - j;
+		y = (right + 1) & 2 ? k : qr->size - 1 - k;
+		if (qr->fixed[y * qr->size + x])
+		    continue;
+		qr->dark[y * qr->size + x] =
+		    (bit < ncw * 8 && cw[bit >> 3] >> (7 - (bit & 7)) & 1) ^
+		    !((x + y) & 1);
+		bit++;
+	    }
+    }
+    free(cw);
+    free(blocks);
+    free(data);
+}
+
+/* draw the code rotated by about 4 degrees */
+static unsigned char *qr_draw(const qr_matrix_t *qr, int *width)
+{
+    int m = qr->size + 2 * QR_QUIET, w = m * QR_SCALE * 6 / 5, x, y;
+    unsigned char *buf = malloc(w * w);
+    double c = 0.99756, s = 0.069756;
+
+    for (y = 0; y < w; y++)
+	for (x = 0; x < w; x++) {
+	    double xs = x + 0.5 - w / 2, ys = y + 0.5 - w / 2;
+	    double u = (c * xs + s * ys) / QR_SCALE + m / 2. - QR_QUIET;
+	    double v = (c * ys - s * xs) / QR_SCALE + m / 2. - QR_QUIET;
+	    int dark = 0;
+	    if (u >= 0 && v >= 0 && u < qr->size && v < qr->size)
+		dark = qr->dark[(int)v * qr->size + (int)u];
+	    buf[y * w + x] = dark ? 0x20 : 0xe0;
+	}
+    *width = w;
+    return (buf);
+}
+
+/* the text filling a code of the given version */
+static char *qr_text(int version)
+{
+    int len = qr_capacity(version), i;
+    char *text = malloc(len + 1);
+    for (i = 0; i < len; i++)
+	text[i] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+		  "abcdefghijklmnopqrstuvwxyz"[(i * 7 + i / 62) % 62];
+    text[len] = '\0';
+    return (text);
+}
+
+/* scan the image niter times, reporting the time per scan, and check
+ * that the one code in it is read back each time
+ */
+static int scan_timed(zbar_image_scanner_t *scanner, unsigned char *buf,
+		      int w, int h, const char *text, int niter,
+		      const char *label)
+{
+    zbar_image_t *img;
+    const zbar_symbol_t *sym;
+    struct timespec start, end;
+    int i, n, nok = 0;
+
+    img = zbar_image_create();
+    zbar_image_set_format(img, zbar_fourcc('Y', '8', '0', '0'));
+    zbar_image_set_size(img, w, h);
+    zbar_image_set_data(img, buf, w * h, zbar_image_free_data);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < niter; i++) {
+	n   = zbar_scan_image(scanner, img);
+	sym = zbar_image_first_symbol(img);
+	if (n == 1 && sym && !strcmp(zbar_symbol_get_data(sym), text))
+	    nok++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%s (%dx%d px): %d/%d decoded, %.2f ms per scan\n", label, w, h,
+	   nok, niter,
+	   ((end.tv_sec - start.tv_sec) * 1e3 +
+	    (end.tv_nsec - start.tv_nsec) / 1e6) /
+	       niter);
+    zbar_image_destroy(img);
+    return (nok != niter);
+}
+
+static int bench_version(zbar_image_scanner_t *scanner, int version,
+			 int niter)
+{
+    qr_matrix_t qr;
+    unsigned char *buf;
+    char *text, label[32];
+    int w, rc;
+
+    text = qr_text(version);
+    qr_encode(&qr, version, text);
+    buf = qr_draw(&qr, &w);
+    snprintf(label, sizeof(label), "version %d", version);
+    rc = scan_timed(scanner, buf, w, w, text, niter, label);
+
+    free(qr.dark);
+    free(qr.fixed);
+    free(text);
+    return (rc);
+}
+
+/* a version 10 code on a background of stripes in the 1:1:3:1:1 ratio of
+ * a finder pattern, at a scale that changes every 100 rows, like a
+ * halftone screen: nearly every row is full of spurious finder lines
+ */
+static int bench_texture(zbar_image_scanner_t *scanner, int niter)
+{
+    qr_matrix_t qr;
+    unsigned char *buf, *code;
+    char *text;
+    int w = 1600, h = 1200, cw, x, y, rc;
+
+    text = qr_text(10);
+    qr_encode(&qr, 10, text);
+    code = qr_draw(&qr, &cw);
+
+    buf = malloc(w * h);
+    for (y = 0; y < h; y++) {
+	int scale = 2 + y / 100 % 12;
+	for (x = 0; x < w; x++)
+	    buf[y * w + x] = "#_###_#___"[x / scale % 10] == '#' ? 0x20 : 0xe0;
+    }
+    for (y = 0; y < cw; y++)
+	memcpy(buf + ((h - cw) / 2 + y) * w + (w - cw) / 2, code + y * cw, cw);
+    rc = scan_timed(scanner, buf, w, h, text, niter, "texture");
+
+    free(code);
+    free(qr.dark);
+    free(qr.fixed);
+    free(text);
+    return (rc);
+}
+
+int main(int argc, char *argv[])
+{
+    static const int versions[] = { 10, 25, 40 };
+    zbar_image_scanner_t *scanner;
+    int niter = 10, i, opt, rc = 0;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+	if (opt == 'n')
+	    niter = atoi(optarg);
+	else {
+	    fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+	    return (2);
+	}
+
+    gf_init();
+    scanner = zbar_image_scanner_create();
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_ENABLE, 0);
+    zbar_image_scanner_set_config(scanner, ZBAR_QRCODE, ZBAR_CFG_ENABLE, 1);
+
+    for (i = 0; i < sizeof(versions) / sizeof(*versions); i++)
+	rc |= bench_version(scanner, versions[i], niter);
+    rc |= bench_texture(scanner, niter);
+
+    zbar_image_scanner_destroy(scanner);
+    return (rc);
+}
@@ -0,0 +1,262 @@
+/*------------------------------------------------------------------------
+ *  This file is part of the ZBar Bar Code Reader.
+ *
+ *  The ZBar Bar Code Reader is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Lesser Public License as
+ *  published by the Free Software Foundation; either version 2.1 of
+ *  the License, or (at your option) any later version.
+ *
+ *  The ZBar Bar Code Reader is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ *  of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser Public License
+ *  along with the ZBar Bar Code Reader; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301  USA
+ *
+ *  http://sourceforge.net/projects/zbar
+ *------------------------------------------------------------------------*/
+
+/* check that every code on a sheet of many QR codes is found, also with
+ * stray finder patterns that belong to no code, with candidate codes
+ * decoded in parallel, with light on dark codes next to normal ones and
+ * in video frames of a moving sheet with the codes tracked between
+ * frames, and report the time taken
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zbar.h>
+#include "test_images.h"
+
+#define QR_DATA	   test_image_qr_data
+#define QR_SIZE	   TEST_IMAGE_QR_SIZE
+#define QR_QUIET   6
+#define QR_SCALE   3
+#define QR_CELL	   ((QR_SIZE + QR_QUIET) * QR_SCALE)
+#define QR_FINDERS 7
+
+/* draw the top left n x n modules of the code at (x0, y0) */
+static void draw_modules(unsigned char *buf, int stride, int x0, int y0,
+			 int n)
+{
+    int x, y;
+    for (y = 0; y < n * QR_SCALE; y++)
+	for (x = 0; x < n * QR_SCALE; x++)
+	    if (test_image_qr_modules[y / QR_SCALE][x / QR_SCALE] == '#')
+		buf[(y0 + y) * stride + x0 + x] = 0;
+}
+
+static int scan_sheet(zbar_image_scanner_t *scanner, int cols, int rows,
+		      int nstray, int nthreads, unsigned long fmt)
+{
+    zbar_image_t *img;
+    const zbar_symbol_t *sym;
+    struct timespec start, end;
+    unsigned char *buf;
+    int w, h, i, j, n, nok;
+    int rc = 0;
+
+    w	= cols * QR_CELL + QR_QUIET * QR_SCALE + (nstray ? QR_CELL : 0);
+    h	= rows * QR_CELL + QR_QUIET * QR_SCALE;
+    buf = malloc(w * h);
+    memset(buf, 0xff, w * h);
+    for (i = 0; i < rows; i++)
+	for (j = 0; j < cols; j++)
+	    draw_modules(buf, w, QR_QUIET * QR_SCALE + j * QR_CELL,
+			 QR_QUIET * QR_SCALE + i * QR_CELL, QR_SIZE);
+    /* lone finder patterns in a column to the right of the codes */
+    for (i = 0; i < nstray; i++) {
+	int x = cols * QR_CELL + QR_QUIET * QR_SCALE + (i & 1) * 12 * QR_SCALE;
+	int y = QR_QUIET * QR_SCALE + (i >> 1) * (2 * h / (nstray + 1)) +
+		(i & 1) * QR_CELL / 3;
+	if (y + QR_FINDERS * QR_SCALE > h)
+	    break;
+	draw_modules(buf, w, x, y, QR_FINDERS);
+    }
+
+    img = zbar_image_create();
+    zbar_image_set_format(img, zbar_fourcc('Y', '8', '0', '0'));
+    zbar_image_set_size(img, w, h);
+    zbar_image_set_data(img, buf, w * h, zbar_image_free_data);
+    if (fmt != zbar_fourcc('Y', '8', '0', '0')) {
+	/* the luminance of other formats is read in place */
+	zbar_image_t *tmp = zbar_image_convert(img, fmt);
+	zbar_image_destroy(img);
+	img = tmp;
+    }
+
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_QR_THREADS, nthreads);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    n = zbar_scan_image(scanner, img);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    nok = 0;
+    for (sym = zbar_image_first_symbol(img); sym; sym = zbar_symbol_next(sym))
+	if (zbar_symbol_get_type(sym) == ZBAR_QRCODE &&
+	    !strcmp(zbar_symbol_get_data(sym), QR_DATA))
+	    nok++;
+    printf("%dx%d %.4s codes, %d stray finders, %d threads: found %d/%d in "
+	   "%.1f ms\n",
+	   cols, rows, (char *)&fmt, nstray, nthreads, nok, cols * rows,
+	   (end.tv_sec - start.tv_sec) * 1e3 +
+	       (end.tv_nsec - start.tv_nsec) / 1e6);
+    if (n != cols * rows || nok != n) {
+	fprintf(stderr, "ERROR: found %d codes (%d valid) out of %d\n", n,
+		nok, cols * rows);
+	rc = 1;
+    }
+    zbar_image_destroy(img);
+    return (rc);
+}
+
+/* count the codes found in a frame, or -1 if any is wrong */
+static int count_codes(zbar_image_t *img)
+{
+    const zbar_symbol_t *sym;
+    int nok = 0;
+    for (sym = zbar_image_first_symbol(img); sym; sym = zbar_symbol_next(sym))
+	if (zbar_symbol_get_type(sym) == ZBAR_QRCODE &&
+	    !strcmp(zbar_symbol_get_data(sym), QR_DATA))
+	    nok++;
+	else
+	    return (-1);
+    return (nok);
+}
+
+/* scan a sheet with normal codes on the left half and light on dark
+ * ones on the right half, which are all found in one pass only when
+ * inverted symbols are enabled
+ */
+static int scan_inverted(zbar_image_scanner_t *scanner, int cols, int rows,
+			 int nthreads)
+{
+    zbar_image_t *img;
+    unsigned char *buf;
+    int w, h, x, y, i, j, n;
+    int rc = 0;
+
+    w	= 2 * cols * QR_CELL + QR_QUIET * QR_SCALE;
+    h	= rows * QR_CELL + QR_QUIET * QR_SCALE;
+    buf = malloc(w * h);
+    memset(buf, 0xff, w * h);
+    for (i = 0; i < rows; i++)
+	for (j = 0; j < 2 * cols; j++)
+	    draw_modules(buf, w, QR_QUIET * QR_SCALE + j * QR_CELL,
+			 QR_QUIET * QR_SCALE + i * QR_CELL, QR_SIZE);
+    /* invert the right half, splitting the quiet zone between halves */
+    for (y = 0; y < h; y++)
+	for (x = cols * QR_CELL + QR_QUIET * QR_SCALE / 2; x < w; x++)
+	    buf[y * w + x] ^= 0xff;
+
+    img = zbar_image_create();
+    zbar_image_set_format(img, zbar_fourcc('Y', '8', '0', '0'));
+    zbar_image_set_size(img, w, h);
+    zbar_image_set_data(img, buf, w * h, zbar_image_free_data);
+
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_THREADS, nthreads);
+    for (i = 0; i < 2; i++) {
+	zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_TEST_INVERTED, i);
+	zbar_scan_image(scanner, img);
+	n = count_codes(img);
+	printf("%dx%d normal and inverted codes, %d threads, inverted %s: "
+	       "found %d\n",
+	       cols, rows, nthreads, i ? "on" : "off", n);
+	if (n != (i + 1) * cols * rows) {
+	    fprintf(stderr, "ERROR: found %d codes out of %d\n", n,
+		    (i + 1) * cols * rows);
+	    rc = 1;
+	}
+    }
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_TEST_INVERTED, 0);
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_THREADS, 1);
+    zbar_image_destroy(img);
+    return (rc);
+}
+
+/* scan frames of a sheet of codes drifting across the image */
+static int scan_video(zbar_image_scanner_t *scanner, int cols, int rows,
+		      int nframes, int track)
+{
+    struct timespec start, end;
+    unsigned char *buf;
+    double ms = 0;
+    int w, h, f, i, j, n, nmissed = 0;
+    int rc = 0;
+
+    w	= (cols + 1) * QR_CELL + QR_QUIET * QR_SCALE;
+    h	= (rows + 1) * QR_CELL + QR_QUIET * QR_SCALE;
+    buf = malloc(w * h);
+
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_QR_TRACK, track);
+    for (f = 0; f < nframes; f++) {
+	zbar_image_t *img;
+	/* a couple of pixels per frame, and a pause in the middle */
+	int dx = (f < nframes / 2 ? f : nframes / 2) * 2;
+	int dy = f < nframes / 2 ? f : nframes - f;
+
+	memset(buf, 0xff, w * h);
+	for (i = 0; i < rows; i++)
+	    for (j = 0; j < cols; j++)
+		draw_modules(buf, w, QR_QUIET * QR_SCALE + j * QR_CELL + dx,
+			     QR_QUIET * QR_SCALE + i * QR_CELL + dy, QR_SIZE);
+
+	img = zbar_image_create();
+	zbar_image_set_format(img, zbar_fourcc('Y', '8', '0', '0'));
+	zbar_image_set_size(img, w, h);
+	zbar_image_set_data(img, buf, w * h, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	zbar_scan_image(scanner, img);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ms += (end.tv_sec - start.tv_sec) * 1e3 +
+	      (end.tv_nsec - start.tv_nsec) / 1e6;
+
+	n = count_codes(img);
+	if (n != cols * rows) {
+	    fprintf(stderr, "ERROR: frame %d: found %d codes out of %d\n", f,
+		    n, cols * rows);
+	    nmissed++;
+	}
+	zbar_image_destroy(img);
+    }
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_QR_TRACK, 0);
+    printf("%dx%d codes, %d frames, tracking %s: %d frames wrong, %.1f ms "
+	   "per frame\n",
+	   cols, rows, nframes, track ? "on" : "off", nmissed, ms / nframes);
+    if (nmissed)
+	rc = 1;
+    free(buf);
+    return (rc);
+}
+
+int main(int argc, char *argv[])
+{
+    zbar_image_scanner_t *scanner;
+    int nthreads, rc = 0;
+
+    scanner = zbar_image_scanner_create();
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_ENABLE, 0);
+    zbar_image_scanner_set_config(scanner, ZBAR_QRCODE, ZBAR_CFG_ENABLE, 1);
+
+    for (nthreads = 1; nthreads <= 4; nthreads *= 4) {
+	unsigned long y800 = zbar_fourcc('Y', '8', '0', '0');
+	rc |= scan_sheet(scanner, 12, 10, 0, nthreads, y800);
+	rc |= scan_sheet(scanner, 12, 10, 20, nthreads, y800);
+	rc |= scan_sheet(scanner, 30, 20, 40, nthreads, y800);
+	rc |= scan_sheet(scanner, 12, 10, 20, nthreads,
+			 zbar_fourcc('Y', 'U', 'Y', 'V'));
+    }
+    rc |= scan_inverted(scanner, 4, 3, 1);
+    rc |= scan_inverted(scanner, 4, 3, 4);
+    rc |= scan_video(scanner, 4, 3, 40, 0);
+    rc |= scan_video(scanner, 4, 3, 40, 1);
+
+    zbar_image_scanner_destroy(scanner);
+    return (rc);
+}
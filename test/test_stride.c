@@ -0,0 +1,173 @@
+/*------------------------------------------------------------------------
+ *  This file is part of the ZBar Bar Code Reader.
+ *
+ *  The ZBar Bar Code Reader is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Lesser Public License as
+ *  published by the Free Software Foundation; either version 2.1 of
+ *  the License, or (at your option) any later version.
+ *
+ *  The ZBar Bar Code Reader is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ *  of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser Public License
+ *  along with the ZBar Bar Code Reader; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301  USA
+ *
+ *  http://sourceforge.net/projects/zbar
+ *------------------------------------------------------------------------*/
+
+/* check that an image embedded in a larger buffer is scanned and
+ * converted in place, using the line stride instead of the width,
+ * and that the luminance of YUV and RGB images is scanned in place
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zbar.h>
+#include "test_images.h"
+
+#define PAD_X 37
+#define PAD_Y 11
+
+static int check_symbol(const zbar_image_t *img)
+{
+    const zbar_symbol_t *sym = zbar_image_first_symbol(img);
+    if (!sym || zbar_symbol_get_type(sym) != ZBAR_EAN13 ||
+	strcmp(zbar_symbol_get_data(sym), test_image_ean13_data) ||
+	zbar_symbol_next(sym))
+	return (-1);
+    return (0);
+}
+
+/* convert both images through fmt and back to gray and compare */
+static int check_convert(const zbar_image_t *img, const zbar_image_t *sub,
+			 unsigned long fmt)
+{
+    zbar_image_t *a, *b, *ga, *gb;
+    const unsigned char *pa, *pb;
+    unsigned w = zbar_image_get_width(img), h = zbar_image_get_height(img);
+    unsigned y;
+    int rc = 0;
+
+    a  = zbar_image_convert(img, fmt);
+    b  = zbar_image_convert(sub, fmt);
+    ga = zbar_image_convert(a, fourcc('G', 'R', 'E', 'Y'));
+    gb = zbar_image_convert(b, fourcc('G', 'R', 'E', 'Y'));
+    pa = zbar_image_get_data(ga);
+    pb = zbar_image_get_data(gb);
+    for (y = 0; y < h && !rc; y++)
+	if (memcmp(pa + y * zbar_image_get_stride(ga),
+		   pb + y * zbar_image_get_stride(gb), w)) {
+	    fprintf(stderr, "ERROR: %.4s conversion differs at row %d\n",
+		    (char *)&fmt, y);
+	    rc = 1;
+	}
+    zbar_image_destroy(gb);
+    zbar_image_destroy(ga);
+    zbar_image_destroy(b);
+    zbar_image_destroy(a);
+    return (rc);
+}
+
+/* convert img to fmt and scan the luminance in place.  lines of packed
+ * formats (bpp bytes per pixel) are moved pad bytes further apart
+ */
+static int check_scan(zbar_image_scanner_t *scanner, const zbar_image_t *img,
+		      unsigned long fmt, unsigned bpp, unsigned pad)
+{
+    zbar_image_t *tmp = zbar_image_convert(img, fmt);
+    unsigned w = zbar_image_get_width(img), h = zbar_image_get_height(img);
+    unsigned char *buf = NULL;
+    int rc	       = 0;
+
+    if (pad) {
+	const unsigned char *data = zbar_image_get_data(tmp);
+	unsigned stride		  = w * bpp + pad, y;
+	buf			  = malloc(stride * h);
+	memset(buf, 0x80, stride * h);
+	for (y = 0; y < h; y++)
+	    memcpy(buf + y * stride, data + y * w * bpp, w * bpp);
+	zbar_image_set_stride(tmp, stride);
+	zbar_image_set_data(tmp, buf, stride * h, NULL);
+    }
+    if (zbar_scan_image(scanner, tmp) != 1 || check_symbol(tmp)) {
+	fprintf(stderr, "ERROR: %.4s image scan failed (pad %d)\n",
+		(char *)&fmt, pad);
+	rc = 1;
+    }
+    zbar_image_destroy(tmp);
+    free(buf);
+    return (rc);
+}
+
+int main(int argc, char *argv[])
+{
+    zbar_image_scanner_t *scanner;
+    zbar_image_t *img, *sub;
+    const unsigned char *data;
+    unsigned char *buf;
+    unsigned w, h, stride, y;
+    int rc = 0;
+
+    scanner = zbar_image_scanner_create();
+    img	    = zbar_image_create();
+    zbar_image_set_format(img, fourcc('Y', '8', '0', '0'));
+    if (test_image_ean13(img))
+	return (2);
+    zbar_image_get_size(img, &w, &h);
+    data = zbar_image_get_data(img);
+
+    /* surround the image with noise that must never be read */
+    stride = w + 2 * PAD_X;
+    buf	   = malloc(stride * (h + 2 * PAD_Y));
+    for (y = 0; y < stride * (h + 2 * PAD_Y); y++)
+	buf[y] = (y * 7919) >> 3;
+    for (y = 0; y < h; y++)
+	memcpy(buf + (y + PAD_Y) * stride + PAD_X, data + y * w, w);
+
+    sub = zbar_image_create();
+    zbar_image_set_format(sub, fourcc('Y', '8', '0', '0'));
+    zbar_image_set_size(sub, w, h);
+    zbar_image_set_stride(sub, stride);
+    zbar_image_set_data(sub, buf + PAD_Y * stride + PAD_X,
+			(h - 1) * stride + w, NULL);
+    if (zbar_image_get_stride(sub) != stride ||
+	zbar_image_get_stride(img) != w) {
+	fprintf(stderr, "ERROR: unexpected image stride\n");
+	rc = 1;
+    }
+
+    if (zbar_scan_image(scanner, img) != 1 || check_symbol(img)) {
+	fprintf(stderr, "ERROR: packed image scan failed\n");
+	rc = 1;
+    }
+    if (zbar_scan_image(scanner, sub) != 1 || check_symbol(sub)) {
+	fprintf(stderr, "ERROR: strided image scan failed\n");
+	rc = 1;
+    }
+
+    rc |= check_convert(img, sub, fourcc('Y', 'U', 'Y', 'V'));
+    rc |= check_convert(img, sub, fourcc('I', '4', '2', '0'));
+    rc |= check_convert(img, sub, fourcc('R', 'G', 'B', '3'));
+
+    rc |= check_scan(scanner, sub, fourcc('Y', 'U', 'Y', 'V'), 2, 0);
+    rc |= check_scan(scanner, sub, fourcc('Y', 'U', 'Y', 'V'), 2, 2 * PAD_X);
+    rc |= check_scan(scanner, sub, fourcc('U', 'Y', 'V', 'Y'), 2, 2 * PAD_X);
+    rc |= check_scan(scanner, sub, fourcc('I', '4', '2', '0'), 1, 0);
+    rc |= check_scan(scanner, sub, fourcc('N', 'V', '1', '2'), 1, 0);
+    rc |= check_scan(scanner, sub, fourcc('R', 'G', 'B', '3'), 3, PAD_X);
+    rc |= check_scan(scanner, sub, fourcc('B', 'G', 'R', '4'), 4, 0);
+
+    zbar_image_destroy(sub);
+    free(buf);
+    zbar_image_destroy(img);
+    zbar_image_scanner_destroy(scanner);
+    if (test_image_check_cleanup())
+	rc = 1;
+    return (rc);
+}
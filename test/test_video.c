@@ -22,6 +22,9 @@
  *------------------------------------------------------------------------*/
 
 #include "config.h"
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1 /* memfd_create() */
+#endif
 #include <argp.h>
 #ifdef HAVE_INTTYPES_H
 #include <inttypes.h>
@@ -35,6 +38,15 @@
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_LINUX_UDMABUF_H
+#include <fcntl.h>
+#include <linux/udmabuf.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
 #include <assert.h>
 
 #include <zbar.h>
@@ -52,18 +64,23 @@ zbar_video_t *video;
 #define PROGRAM_NAME "test_video"
 
 static const char doc[] =
-    "\nTest if ZBar is able to handle a video input (camera)\n";
+    "\nTest if ZBar is able to handle a video input (camera)\n"
+    "\nDMABUF I/O may be tested with the vivid virtual driver"
+    " (modprobe vivid)\n";
 
 static const struct argp_option options[] = {
     { "quiet", 'q', 0, 0, "Don't be verbose", 0 },
     { "dev", 'd', "devnode", 0, "open devnode for video in", 0 },
     { "format", 'f', "fourcc", 0, "Stop after #seconds", 0 },
+    { "iomode", 'i', "mode", 0,
+      "Request I/O mode (1=read 2=mmap 3=userptr 4=dmabuf)", 0 },
+    { "import", 'x', 0, 0, "Capture into dmabufs allocated by udmabuf", 0 },
     { "help", '?', 0, 0, "Give this help list", -1 },
     { "usage", -3, 0, 0, "Give a short usage message", 0 },
     { 0 }
 };
 
-static int quiet = 0;
+static int quiet = 0, iomode = 0, import = 0;
 uint32_t vidfmt	 = fourcc('B', 'G', 'R', '3');
 char *dev	 = "";
 
@@ -85,6 +102,12 @@ static error_t parse_opt(int k, char *optarg, struct argp_state *state)
     case 'd':
 	dev = optarg;
 	break;
+    case 'i':
+	iomode = strtol(optarg, NULL, 0);
+	break;
+    case 'x':
+	import = 1;
+	break;
     case '?':
 	argp_state_help(state, state->out_stream,
 			ARGP_HELP_SHORT_USAGE | ARGP_HELP_LONG | ARGP_HELP_DOC);
@@ -104,6 +127,71 @@ static const struct argp argp = {
     .doc     = doc,
 };
 
+#define NUM_DMABUFS 4
+
+#ifdef HAVE_LINUX_UDMABUF_H
+/* allocate n dmabufs of at least size bytes from memfds */
+static int create_udmabufs(int *fds, int n, unsigned long size)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    int dev   = open("/dev/udmabuf", O_RDWR), i;
+    if (dev < 0) {
+	perror("/dev/udmabuf");
+	return (-1);
+    }
+    size = (size + page - 1) / page * page;
+    for (i = 0; i < n; i++) {
+	struct udmabuf_create create;
+	int mem = memfd_create("test_video", MFD_ALLOW_SEALING);
+	if (mem < 0 || ftruncate(mem, size) ||
+	    fcntl(mem, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+	    perror("memfd");
+	    return (-1);
+	}
+	memset(&create, 0, sizeof(create));
+	create.memfd = mem;
+	create.size  = size;
+	fds[i]	     = ioctl(dev, UDMABUF_CREATE, &create);
+	close(mem);
+	if (fds[i] < 0) {
+	    perror("UDMABUF_CREATE");
+	    return (-1);
+	}
+    }
+    close(dev);
+    return (0);
+}
+#endif
+
+/* check that a frame captured with DMABUF I/O reads the same through
+ * its dmabuf, as another consumer of it would see it
+ */
+static int check_dmabuf(const zbar_image_t *image)
+{
+#ifdef HAVE_SYS_MMAN_H
+    int fd	      = zbar_image_get_dmabuf(image);
+    unsigned long len = zbar_image_get_data_length(image);
+    void *p;
+    int rc;
+    if (fd < 0) {
+	fprintf(stderr, "ERROR: captured frame has no dmabuf\n");
+	return (1);
+    }
+    p = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+	perror("mapping dmabuf");
+	return (1);
+    }
+    rc = memcmp(p, zbar_image_get_data(image), len) != 0;
+    munmap(p, len);
+    if (rc)
+	fprintf(stderr, "ERROR: dmabuf differs from the captured frame\n");
+    return (rc);
+#else
+    return (0);
+#endif
+}
+
 int main(int argc, char *argv[])
 {
     if (argp_parse(&argp, argc, argv, ARGP_NO_HELP | ARGP_NO_EXIT, 0, 0)) {
@@ -122,6 +210,21 @@ int main(int argc, char *argv[])
     }
 
     zbar_video_request_size(video, 640, 480);
+    if (iomode && zbar_video_request_iomode(video, iomode))
+	return (zbar_video_error_spew(video, 0));
+    if (import) {
+#ifdef HAVE_LINUX_UDMABUF_H
+	int fds[NUM_DMABUFS];
+	if (create_udmabufs(fds, NUM_DMABUFS, 640 * 480 * 4))
+	    return (1);
+	if (zbar_video_request_dmabufs(video, fds, NUM_DMABUFS))
+	    return (zbar_video_error_spew(video, 0));
+	iomode = 4;
+#else
+	fprintf(stderr, "ERROR: udmabuf is not available\n");
+	return (1);
+#endif
+    }
 
     if (zbar_video_open(video, dev)) {
 	zbar_video_error_spew(video, 0);
@@ -174,6 +277,8 @@ int main(int argc, char *argv[])
 		(char *)&format, data);
 	fflush(stderr);
     }
+    if (iomode == 4 && check_dmabuf(image))
+	return (16);
 
     zbar_image_destroy(image);
 
@@ -192,14 +297,18 @@ int main(int argc, char *argv[])
     start.tv_sec  = ustime.tv_sec;
 #endif
 
+    /* frames are borrowed in the driver's buffers, never copied */
     int i;
     for (i = 0; i < 100; i++) {
-	zbar_image_t *image = zbar_video_next_image(video);
+	zbar_image_t *image = zbar_video_borrow_image(video);
 	if (!image) {
 	    fprintf(stderr, "ERROR: unable to capture image\n");
 	    return (zbar_video_error_spew(video, 0));
 	}
-	zbar_image_destroy(image);
+	if (zbar_video_return_image(video, image)) {
+	    fprintf(stderr, "ERROR: unable to return image\n");
+	    return (zbar_video_error_spew(video, 0));
+	}
     }
 
 #if _POSIX_TIMERS > 0
@@ -214,6 +323,7 @@ int main(int argc, char *argv[])
     double fps = i / ms;
     if (!quiet) {
 	fprintf(stderr, "\nprocessed %d images in %gs @%gfps\n", i, ms, fps);
+	fprintf(stderr, "%lu frames copied\n", zbar_video_get_copies(video));
 	fflush(stderr);
     }
 
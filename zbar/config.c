@@ -149,8 +149,28 @@ int zbar_parse_config(const char *cfgstr, zbar_symbol_type_t *sym,
 	*cfg = ZBAR_CFG_UNCERTAINTY;
     else if (!strncmp(cfgstr, "test-inverted", len))
 	*cfg = ZBAR_CFG_TEST_INVERTED;
+    else if (!strncmp(cfgstr, "lazy-binarize", len))
+	*cfg = ZBAR_CFG_LAZY_BINARIZE;
+    else if (!strncmp(cfgstr, "qr-track", len))
+	*cfg = ZBAR_CFG_QR_TRACK;
+    else if (!strncmp(cfgstr, "qr-line-times", len))
+	*cfg = ZBAR_CFG_QR_LINE_TIMES;
     else if (!strncmp(cfgstr, "position", len))
 	*cfg = ZBAR_CFG_POSITION;
+    else if (!strncmp(cfgstr, "threads", len))
+	*cfg = ZBAR_CFG_THREADS;
+    else if (!strncmp(cfgstr, "cache-proximity", len))
+	*cfg = ZBAR_CFG_CACHE_PROXIMITY;
+    else if (!strncmp(cfgstr, "cache-hysteresis", len))
+	*cfg = ZBAR_CFG_CACHE_HYSTERESIS;
+    else if (!strncmp(cfgstr, "cache-timeout", len))
+	*cfg = ZBAR_CFG_CACHE_TIMEOUT;
+    else if (!strncmp(cfgstr, "qr-threads", len))
+	*cfg = ZBAR_CFG_QR_THREADS;
+    else if (!strncmp(cfgstr, "qr-scratch", len))
+	*cfg = ZBAR_CFG_QR_SCRATCH;
+    else if (!strncmp(cfgstr, "jpeg-scale", len))
+	*cfg = ZBAR_CFG_JPEG_SCALE;
     else
 	return (1);
 
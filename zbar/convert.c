@@ -22,6 +22,7 @@
  *------------------------------------------------------------------------*/
 
 #include "image.h"
+#include "simd.h"
 #include "video.h"
 #include "window.h"
 
@@ -270,6 +271,12 @@ static inline unsigned long uvp_size(const zbar_image_t *img,
 	    (img->height >> fmt->p.yuv.ysub2));
 }
 
+/* padding after each source line of len bytes */
+static inline unsigned long line_pad(const zbar_image_t *img, unsigned long len)
+{
+    return ((img->stride > len) ? img->stride - len : 0);
+}
+
 static inline uint32_t convert_read_rgb(const uint8_t *srcp, int bpp)
 {
     uint32_t p;
@@ -300,6 +307,333 @@ static inline void convert_write_rgb(uint8_t *dstp, uint32_t p, int bpp)
 	*dstp = p;
 }
 
+/* NEON kernels address the channels of a pixel by byte, so only
+ * little endian layouts match convert_read_rgb()
+ */
+#if defined(ZBAR_SIMD_X86)
+#define CONVERT_X86 (1)
+#include <immintrin.h>
+#elif defined(ZBAR_SIMD_NEON) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CONVERT_NEON (1)
+#include <arm_neon.h>
+#endif
+
+/* vectorized kernels for the most common conversions.  each converts
+ * as many leading pixels of a row as it can, reading no further than
+ * the last of the n pixels, and returns how many it converted.  the
+ * per-pixel loops finish the row, so results are bit exact
+ */
+typedef struct convert_kernels_s {
+    /* luma of packed YUV: every other byte from src */
+    unsigned (*yuv_to_y)(uint8_t *dst, const uint8_t *src, unsigned n);
+    /* 8-bit RGB channels at bit offsets r, g, b of 24/32-bit pixels
+     * (as read by convert_read_rgb) to luma
+     */
+    unsigned (*rgb3_to_y)(uint8_t *dst, const uint8_t *src, unsigned n,
+			  int r, int g, int b);
+    unsigned (*rgb4_to_y)(uint8_t *dst, const uint8_t *src, unsigned n,
+			  int r, int g, int b);
+    /* luma to 32-bit pixels with 8-bit channels at bit offsets r, g, b */
+    unsigned (*y_to_rgb4)(uint8_t *dst, const uint8_t *src, unsigned n,
+			  int r, int g, int b);
+} convert_kernels_t;
+
+#if defined(CONVERT_X86)
+/* luma of 8 pixels, from the channels of two vectors of 32-bit pixels */
+__attribute__((target("sse2"))) static inline __m128i
+convert_rgb_to_y8_sse2(__m128i p0, __m128i p1, __m128i r, __m128i g,
+		       __m128i b)
+{
+    const __m128i m = _mm_set1_epi32(0xff);
+    __m128i cr	    = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(p0, r), m),
+				      _mm_and_si128(_mm_srl_epi32(p1, r), m));
+    __m128i cg = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(p0, g), m),
+				 _mm_and_si128(_mm_srl_epi32(p1, g), m));
+    __m128i cb = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(p0, b), m),
+				 _mm_and_si128(_mm_srl_epi32(p1, b), m));
+    /* the weights add up to 256, so the sum fits in 16 bits */
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(cr, _mm_set1_epi16(77)),
+			      _mm_mullo_epi16(cg, _mm_set1_epi16(150)));
+    y	      = _mm_add_epi16(y, _mm_mullo_epi16(cb, _mm_set1_epi16(29)));
+    return _mm_srli_epi16(_mm_add_epi16(y, _mm_set1_epi16(0x80)), 8);
+}
+
+__attribute__((target("sse2"))) static unsigned
+convert_yuv_to_y_sse2(uint8_t *dst, const uint8_t *src, unsigned n)
+{
+    const __m128i m = _mm_set1_epi16(0xff);
+    unsigned x;
+    for (x = 0; 2 * x + 32 < 2 * n; x += 16) {
+	__m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * x));
+	__m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * x + 16));
+	_mm_storeu_si128((__m128i *)(dst + x),
+			 _mm_packus_epi16(_mm_and_si128(a, m),
+					  _mm_and_si128(b, m)));
+    }
+    return (x);
+}
+
+__attribute__((target("sse2"))) static unsigned
+convert_rgb4_to_y_sse2(uint8_t *dst, const uint8_t *src, unsigned n, int r,
+		       int g, int b)
+{
+    __m128i cr = _mm_cvtsi32_si128(r), cg = _mm_cvtsi32_si128(g);
+    __m128i cb = _mm_cvtsi32_si128(b);
+    unsigned x;
+    for (x = 0; x + 16 <= n; x += 16) {
+	const __m128i *p = (const __m128i *)(src + 4 * x);
+	__m128i y0	 = convert_rgb_to_y8_sse2(_mm_loadu_si128(p),
+						  _mm_loadu_si128(p + 1), cr, cg, cb);
+	__m128i y1 = convert_rgb_to_y8_sse2(_mm_loadu_si128(p + 2),
+					    _mm_loadu_si128(p + 3), cr, cg, cb);
+	_mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(y0, y1));
+    }
+    return (x);
+}
+
+__attribute__((target("sse2"))) static unsigned
+convert_y_to_rgb4_sse2(uint8_t *dst, const uint8_t *src, unsigned n, int r,
+		       int g, int b)
+{
+    const __m128i z = _mm_setzero_si128();
+    __m128i cr = _mm_cvtsi32_si128(r), cg = _mm_cvtsi32_si128(g);
+    __m128i cb = _mm_cvtsi32_si128(b);
+    unsigned x;
+    for (x = 0; x + 16 <= n; x += 16) {
+	__m128i y  = _mm_loadu_si128((const __m128i *)(src + x));
+	__m128i lo = _mm_unpacklo_epi8(y, z), hi = _mm_unpackhi_epi8(y, z);
+	__m128i q[4];
+	int i;
+	q[0] = _mm_unpacklo_epi16(lo, z);
+	q[1] = _mm_unpackhi_epi16(lo, z);
+	q[2] = _mm_unpacklo_epi16(hi, z);
+	q[3] = _mm_unpackhi_epi16(hi, z);
+	for (i = 0; i < 4; i++)
+	    _mm_storeu_si128(
+		(__m128i *)(dst + 4 * (x + 4 * i)),
+		_mm_or_si128(_mm_or_si128(_mm_sll_epi32(q[i], cr),
+					  _mm_sll_epi32(q[i], cg)),
+			     _mm_sll_epi32(q[i], cb)));
+    }
+    return (x);
+}
+
+__attribute__((target("avx2"))) static unsigned
+convert_yuv_to_y_avx2(uint8_t *dst, const uint8_t *src, unsigned n)
+{
+    const __m256i m = _mm256_set1_epi16(0xff);
+    unsigned x;
+    for (x = 0; 2 * x + 64 < 2 * n; x += 32) {
+	__m256i a = _mm256_loadu_si256((const __m256i *)(src + 2 * x));
+	__m256i b = _mm256_loadu_si256((const __m256i *)(src + 2 * x + 32));
+	/* packing works within 128-bit lanes, so restore the order */
+	_mm256_storeu_si256(
+	    (__m256i *)(dst + x),
+	    _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(a, m),
+							 _mm256_and_si256(b, m)),
+				     0xD8));
+    }
+    return (x + convert_yuv_to_y_sse2(dst + x, src + 2 * x, n - x));
+}
+
+/* 24-bit pixels are spread to 32 bits with a byte shuffle (SSSE3) */
+__attribute__((target("avx2"))) static unsigned
+convert_rgb3_to_y_avx2(uint8_t *dst, const uint8_t *src, unsigned n, int r,
+		       int g, int b)
+{
+    const __m128i s = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9,
+				    10, 11, -1);
+    __m128i cr = _mm_cvtsi32_si128(r), cg = _mm_cvtsi32_si128(g);
+    __m128i cb = _mm_cvtsi32_si128(b);
+    unsigned x;
+    for (x = 0; 3 * x + 52 <= 3 * n; x += 16) {
+	const uint8_t *p = src + 3 * x;
+	__m128i q[4], y0, y1;
+	int i;
+	for (i = 0; i < 4; i++)
+	    q[i] = _mm_shuffle_epi8(
+		_mm_loadu_si128((const __m128i *)(p + 12 * i)), s);
+	y0 = convert_rgb_to_y8_sse2(q[0], q[1], cr, cg, cb);
+	y1 = convert_rgb_to_y8_sse2(q[2], q[3], cr, cg, cb);
+	_mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(y0, y1));
+    }
+    return (x);
+}
+
+__attribute__((target("avx2"))) static unsigned
+convert_rgb4_to_y_avx2(uint8_t *dst, const uint8_t *src, unsigned n, int r,
+		       int g, int b)
+{
+    const __m256i m = _mm256_set1_epi32(0xff);
+    __m128i cr = _mm_cvtsi32_si128(r), cg = _mm_cvtsi32_si128(g);
+    __m128i cb = _mm_cvtsi32_si128(b);
+    unsigned x;
+    for (x = 0; x + 32 <= n; x += 32) {
+	const __m256i *p = (const __m256i *)(src + 4 * x);
+	__m256i c[3][2], y[2];
+	int i;
+	for (i = 0; i < 2; i++) {
+	    __m256i p0 = _mm256_loadu_si256(p + 2 * i);
+	    __m256i p1 = _mm256_loadu_si256(p + 2 * i + 1);
+	    c[0][i] = _mm256_packs_epi32(
+		_mm256_and_si256(_mm256_srl_epi32(p0, cr), m),
+		_mm256_and_si256(_mm256_srl_epi32(p1, cr), m));
+	    c[1][i] = _mm256_packs_epi32(
+		_mm256_and_si256(_mm256_srl_epi32(p0, cg), m),
+		_mm256_and_si256(_mm256_srl_epi32(p1, cg), m));
+	    c[2][i] = _mm256_packs_epi32(
+		_mm256_and_si256(_mm256_srl_epi32(p0, cb), m),
+		_mm256_and_si256(_mm256_srl_epi32(p1, cb), m));
+	    y[i] = _mm256_add_epi16(
+		_mm256_mullo_epi16(c[0][i], _mm256_set1_epi16(77)),
+		_mm256_mullo_epi16(c[1][i], _mm256_set1_epi16(150)));
+	    y[i] = _mm256_add_epi16(
+		y[i], _mm256_mullo_epi16(c[2][i], _mm256_set1_epi16(29)));
+	    y[i] = _mm256_srli_epi16(
+		_mm256_add_epi16(y[i], _mm256_set1_epi16(0x80)), 8);
+	}
+	/* both packs interleave the 128-bit lanes: 0 2 4 6 1 3 5 7 */
+	_mm256_storeu_si256(
+	    (__m256i *)(dst + x),
+	    _mm256_permutevar8x32_epi32(_mm256_packus_epi16(y[0], y[1]),
+					_mm256_setr_epi32(0, 4, 1, 5, 2, 6,
+							  3, 7)));
+    }
+    return (x + convert_rgb4_to_y_sse2(dst + x, src + 4 * x, n - x, r, g, b));
+}
+
+__attribute__((target("avx2"))) static unsigned
+convert_y_to_rgb4_avx2(uint8_t *dst, const uint8_t *src, unsigned n, int r,
+		       int g, int b)
+{
+    __m128i cr = _mm_cvtsi32_si128(r), cg = _mm_cvtsi32_si128(g);
+    __m128i cb = _mm_cvtsi32_si128(b);
+    unsigned x;
+    for (x = 0; x + 8 <= n; x += 8) {
+	__m256i y = _mm256_cvtepu8_epi32(
+	    _mm_loadl_epi64((const __m128i *)(src + x)));
+	_mm256_storeu_si256(
+	    (__m256i *)(dst + 4 * x),
+	    _mm256_or_si256(_mm256_or_si256(_mm256_sll_epi32(y, cr),
+					    _mm256_sll_epi32(y, cg)),
+			    _mm256_sll_epi32(y, cb)));
+    }
+    return (x);
+}
+#endif
+
+#if defined(CONVERT_NEON)
+static unsigned convert_yuv_to_y_neon(uint8_t *dst, const uint8_t *src,
+				      unsigned n)
+{
+    unsigned x;
+    for (x = 0; 2 * x + 32 < 2 * n; x += 16)
+	vst1q_u8(dst + x, vld2q_u8(src + 2 * x).val[0]);
+    return (x);
+}
+
+/* luma of 16 pixels from their channels */
+static inline uint8x16_t convert_rgb_to_y16_neon(uint8x16_t r, uint8x16_t g,
+						 uint8x16_t b)
+{
+    uint16x8_t lo = vmull_u8(vget_low_u8(r), vdup_n_u8(77));
+    uint16x8_t hi = vmull_u8(vget_high_u8(r), vdup_n_u8(77));
+    lo		  = vmlal_u8(lo, vget_low_u8(g), vdup_n_u8(150));
+    hi		  = vmlal_u8(hi, vget_high_u8(g), vdup_n_u8(150));
+    lo		  = vmlal_u8(lo, vget_low_u8(b), vdup_n_u8(29));
+    hi		  = vmlal_u8(hi, vget_high_u8(b), vdup_n_u8(29));
+    lo		  = vaddq_u16(lo, vdupq_n_u16(0x80));
+    hi		  = vaddq_u16(hi, vdupq_n_u16(0x80));
+    return vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+}
+
+static unsigned convert_rgb3_to_y_neon(uint8_t *dst, const uint8_t *src,
+				       unsigned n, int r, int g, int b)
+{
+    unsigned x;
+    for (x = 0; x + 16 <= n; x += 16) {
+	uint8x16x3_t p = vld3q_u8(src + 3 * x);
+	vst1q_u8(dst + x, convert_rgb_to_y16_neon(p.val[r >> 3], p.val[g >> 3],
+						  p.val[b >> 3]));
+    }
+    return (x);
+}
+
+static unsigned convert_rgb4_to_y_neon(uint8_t *dst, const uint8_t *src,
+				       unsigned n, int r, int g, int b)
+{
+    unsigned x;
+    for (x = 0; x + 16 <= n; x += 16) {
+	uint8x16x4_t p = vld4q_u8(src + 4 * x);
+	vst1q_u8(dst + x, convert_rgb_to_y16_neon(p.val[r >> 3], p.val[g >> 3],
+						  p.val[b >> 3]));
+    }
+    return (x);
+}
+
+static unsigned convert_y_to_rgb4_neon(uint8_t *dst, const uint8_t *src,
+				       unsigned n, int r, int g, int b)
+{
+    unsigned x;
+    for (x = 0; x + 16 <= n; x += 16) {
+	uint8x16_t y = vld1q_u8(src + x);
+	uint8x16x4_t p;
+	int i;
+	for (i = 0; i < 4; i++)
+	    p.val[i] = (i == r >> 3 || i == g >> 3 || i == b >> 3) ?
+			   y :
+			   vdupq_n_u8(0);
+	vst4q_u8(dst + 4 * x, p);
+    }
+    return (x);
+}
+#endif
+
+/* pick the kernels for this CPU, or NULL to convert pixel by pixel */
+static const convert_kernels_t *convert_kernels(void)
+{
+#if defined(CONVERT_X86)
+    static const convert_kernels_t sse2 = {
+	convert_yuv_to_y_sse2, NULL, convert_rgb4_to_y_sse2,
+	convert_y_to_rgb4_sse2
+    };
+    static const convert_kernels_t avx2 = {
+	convert_yuv_to_y_avx2, convert_rgb3_to_y_avx2, convert_rgb4_to_y_avx2,
+	convert_y_to_rgb4_avx2
+    };
+    /* detected once: racing first calls all store the same answer */
+    static volatile int cpu = -1;
+    if (cpu < 0) {
+	int supported = 0;
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	    supported = 2;
+	else if (__builtin_cpu_supports("sse2"))
+	    supported = 1;
+	cpu = supported;
+    }
+    if (cpu == 2)
+	return (&avx2);
+    if (cpu == 1)
+	return (&sse2);
+#elif defined(CONVERT_NEON)
+    static const convert_kernels_t neon = {
+	convert_yuv_to_y_neon, convert_rgb3_to_y_neon, convert_rgb4_to_y_neon,
+	convert_y_to_rgb4_neon
+    };
+    return (&neon);
+#endif
+    return (NULL);
+}
+
+/* whether all channels of an RGB format are whole bytes */
+static inline int rgb_bytes(const zbar_format_def_t *fmt)
+{
+    return (!RGB_SIZE(fmt->p.rgb.red) && !RGB_SIZE(fmt->p.rgb.green) &&
+	    !RGB_SIZE(fmt->p.rgb.blue));
+}
+
 /* cleanup linked image by unrefing */
 static void cleanup_ref(zbar_image_t *img)
 {
@@ -316,9 +650,11 @@ static inline void convert_y_resize(zbar_image_t *dst,
 				    const zbar_format_def_t *srcfmt, size_t n)
 {
     uint8_t *psrc, *pdst;
-    unsigned width, height, xpad, y;
+    unsigned width, height, xpad, srcl, y;
 
-    if (dst->width == src->width && dst->height == src->height) {
+    srcl = _zbar_image_stride(src);
+    if (dst->width == src->width && dst->height == src->height &&
+	srcl == src->width) {
 	memcpy((void *)dst->data, src->data, n);
 	return;
     }
@@ -330,13 +666,13 @@ static inline void convert_y_resize(zbar_image_t *dst,
     for (y = 0; y < height; y++) {
 	memcpy(pdst, psrc, width);
 	pdst += width;
-	psrc += src->width;
+	psrc += srcl;
 	if (xpad) {
 	    memset(pdst, *(psrc - 1), xpad);
 	    pdst += xpad;
 	}
     }
-    psrc -= src->width;
+    psrc -= srcl;
     for (; y < dst->height; y++) {
 	memcpy(pdst, psrc, width);
 	pdst += width;
@@ -356,6 +692,7 @@ static void convert_copy(zbar_image_t *dst, const zbar_format_def_t *dstfmt,
 	zbar_image_t *s = (zbar_image_t *)src;
 	dst->data	= src->data;
 	dst->datalen	= src->datalen;
+	dst->stride	= src->stride;
 	dst->cleanup	= cleanup_ref;
 	dst->next	= s;
 	_zbar_image_refcnt(s, 1);
@@ -393,7 +730,7 @@ static void convert_yuv_pack(zbar_image_t *dst, const zbar_format_def_t *dstfmt,
     unsigned long srcm, srcn;
     uint8_t flags, *srcy, *dstp;
     const uint8_t *srcu, *srcv;
-    unsigned srcl, xmask, ymask, x, y;
+    unsigned srcl, ystride, ypad, uvpad, xmask, ymask, x, y;
     uint8_t y0 = 0, y1 = 0, u = 0x80, v = 0x80;
 
     uv_roundup(dst, dstfmt);
@@ -403,9 +740,17 @@ static void convert_yuv_pack(zbar_image_t *dst, const zbar_format_def_t *dstfmt,
 	return;
     dstp = (void *)dst->data;
 
-    srcm = uvp_size(src, srcfmt);
-    srcn = src->width * src->height;
-    assert(src->datalen >= srcn + 2 * srcn);
+    /* chroma lines are padded proportionally to the luma stride */
+    ystride = _zbar_image_stride(src);
+    srcl    = ystride >> srcfmt->p.yuv.xsub2;
+    srcm    = (uvp_size(src, srcfmt)) ?
+		  srcl * (src->height >> srcfmt->p.yuv.ysub2) :
+		  0;
+    srcn    = ystride * src->height;
+    ypad    = ystride - src->width;
+    uvpad   = srcl - (src->width >> srcfmt->p.yuv.xsub2);
+    /* padding after the last luma line is optional */
+    assert(src->datalen + ypad >= srcn + 2 * srcm);
     flags = dstfmt->p.yuv.packorder ^ srcfmt->p.yuv.packorder;
     srcy  = (void *)src->data;
     if (flags & 1) {
@@ -417,12 +762,11 @@ static void convert_yuv_pack(zbar_image_t *dst, const zbar_format_def_t *dstfmt,
     }
     flags = dstfmt->p.yuv.packorder & 2;
 
-    srcl  = src->width >> srcfmt->p.yuv.xsub2;
     xmask = (1 << srcfmt->p.yuv.xsub2) - 1;
     ymask = (1 << srcfmt->p.yuv.ysub2) - 1;
     for (y = 0; y < dst->height; y++) {
 	if (y >= src->height) {
-	    srcy -= src->width;
+	    srcy -= ystride;
 	    srcu -= srcl;
 	    srcv -= srcl;
 	} else if (y & ymask) {
@@ -432,8 +776,9 @@ static void convert_yuv_pack(zbar_image_t *dst, const zbar_format_def_t *dstfmt,
 	for (x = 0; x < dst->width; x += 2) {
 	    if (x < src->width) {
 		y0 = *(srcy++);
-		y1 = *(srcy++);
-		if (!(x & xmask)) {
+		/* duplicate the last sample of an odd width line */
+		y1 = (x + 1 < src->width) ? *(srcy++) : y0;
+		if (srcm && !(x & xmask)) {
 		    u = *(srcu++);
 		    v = *(srcv++);
 		}
@@ -457,6 +802,9 @@ static void convert_yuv_pack(zbar_image_t *dst, const zbar_format_def_t *dstfmt,
 		srcv++;
 	    }
 	}
+	srcy += ypad;
+	srcu += uvpad;
+	srcv += uvpad;
     }
 }
 
@@ -471,8 +819,9 @@ static void convert_yuv_unpack(zbar_image_t *dst,
     unsigned long dstn, dstm2;
     uint8_t *dsty, flags;
     const uint8_t *srcp;
-    unsigned srcl, x, y;
+    unsigned srcl, srcpad, x, y, n;
     uint8_t y0 = 0, y1 = 0;
+    const convert_kernels_t *k = convert_kernels();
 
     uv_roundup(dst, dstfmt);
     dstn	 = dst->width * dst->height;
@@ -491,11 +840,18 @@ static void convert_yuv_unpack(zbar_image_t *dst,
     if (flags)
 	srcp++;
 
-    srcl = src->width + (src->width >> srcfmt->p.yuv.xsub2);
+    srcpad = line_pad(src, src->width * 2);
+    srcl   = src->width * 2 + srcpad;
+    /* the last pair is left to pad the line with */
+    n = (dst->width < src->width) ? dst->width : src->width;
+    n = (n > 2) ? (n - 1) & ~1 : 0;
     for (y = 0; y < dst->height; y++) {
 	if (y >= src->height)
 	    srcp -= srcl;
-	for (x = 0; x < dst->width; x += 2) {
+	x = (k && n) ? k->yuv_to_y(dsty, srcp, n) & ~1 : 0;
+	dsty += x;
+	srcp += x * 2;
+	for (; x < dst->width; x += 2) {
 	    if (x < src->width) {
 		y0 = *(srcp++);
 		srcp++;
@@ -507,6 +863,7 @@ static void convert_yuv_unpack(zbar_image_t *dst,
 	}
 	if (x < src->width)
 	    srcp += (src->width - x) * 2;
+	srcp += srcpad;
     }
 }
 
@@ -540,7 +897,7 @@ static void convert_uv_resample(zbar_image_t *dst,
     unsigned long dstn;
     uint8_t *dstp, flags;
     const uint8_t *srcp;
-    unsigned srcl, x, y;
+    unsigned srcl, srcpad, x, y;
     uint8_t y0 = 0, y1 = 0, u = 0x80, v = 0x80;
 
     uv_roundup(dst, dstfmt);
@@ -554,7 +911,8 @@ static void convert_uv_resample(zbar_image_t *dst,
     flags = (srcfmt->p.yuv.packorder ^ dstfmt->p.yuv.packorder) & 1;
     srcp  = src->data;
 
-    srcl = src->width + (src->width >> srcfmt->p.yuv.xsub2);
+    srcpad = line_pad(src, src->width * 2);
+    srcl   = src->width * 2 + srcpad;
     for (y = 0; y < dst->height; y++) {
 	if (y >= src->height)
 	    srcp -= srcl;
@@ -591,6 +949,7 @@ static void convert_uv_resample(zbar_image_t *dst,
 	}
 	if (x < src->width)
 	    srcp += (src->width - x) * 2;
+	srcp += srcpad;
     }
 }
 
@@ -605,8 +964,9 @@ static void convert_yuvp_to_rgb(zbar_image_t *dst,
     uint8_t *dstp, *srcy;
     int drbits, drbit0, dgbits, dgbit0, dbbits, dbbit0;
     unsigned long srcm, srcn;
-    unsigned x, y;
+    unsigned srcl, x, y, n = 0;
     uint32_t p = 0;
+    const convert_kernels_t *k = convert_kernels();
 
     dst->datalen = dst->width * dst->height * dstfmt->p.rgb.bpp;
     dst->data	 = malloc(dst->datalen);
@@ -626,10 +986,19 @@ static void convert_yuvp_to_rgb(zbar_image_t *dst,
     assert(src->datalen >= srcn + 2 * srcm);
     srcy = (void *)src->data;
 
+    srcl = _zbar_image_stride(src);
+    if (k && dstfmt->p.rgb.bpp == 4 && rgb_bytes(dstfmt)) {
+	/* the last pixel is left to pad the line with */
+	n = (dst->width < src->width) ? dst->width : src->width;
+	n = (n) ? n - 1 : 0;
+    }
     for (y = 0; y < dst->height; y++) {
 	if (y >= src->height)
-	    srcy -= src->width;
-	for (x = 0; x < dst->width; x++) {
+	    srcy -= srcl;
+	x = (n) ? k->y_to_rgb4(dstp, srcy, n, drbit0, dgbit0, dbbit0) : 0;
+	dstp += x * 4;
+	srcy += x;
+	for (; x < dst->width; x++) {
 	    if (x < src->width) {
 		/* FIXME color space? */
 		unsigned y0 = *(srcy++);
@@ -641,6 +1010,7 @@ static void convert_yuvp_to_rgb(zbar_image_t *dst,
 	}
 	if (x < src->width)
 	    srcy += (src->width - x);
+	srcy += srcl - src->width;
     }
 }
 
@@ -656,8 +1026,11 @@ static void convert_rgb_to_yuvp(zbar_image_t *dst,
     uint8_t *dsty;
     const uint8_t *srcp;
     int rbits, rbit0, gbits, gbit0, bbits, bbit0;
-    unsigned srcl, x, y;
+    unsigned srcl, srcpad, bpp, x, y, n = 0;
     uint16_t y0 = 0;
+    const convert_kernels_t *k = convert_kernels();
+    unsigned (*kernel)(uint8_t *, const uint8_t *, unsigned, int, int,
+		       int) = NULL;
 
     uv_roundup(dst, dstfmt);
     dstn	 = dst->width * dst->height;
@@ -680,15 +1053,27 @@ static void convert_rgb_to_yuvp(zbar_image_t *dst,
     bbits = RGB_SIZE(srcfmt->p.rgb.blue);
     bbit0 = RGB_OFFSET(srcfmt->p.rgb.blue);
 
-    srcl = src->width * srcfmt->p.rgb.bpp;
+    bpp	   = srcfmt->p.rgb.bpp;
+    srcpad = line_pad(src, src->width * bpp);
+    srcl   = src->width * bpp + srcpad;
+    if (k && rgb_bytes(srcfmt))
+	kernel = (bpp == 3) ? k->rgb3_to_y : (bpp == 4) ? k->rgb4_to_y : NULL;
+    if (kernel) {
+	/* the last pixel is left to pad the line with */
+	n = (dst->width < src->width) ? dst->width : src->width;
+	n = (n) ? n - 1 : 0;
+    }
     for (y = 0; y < dst->height; y++) {
 	if (y >= src->height)
 	    srcp -= srcl;
-	for (x = 0; x < dst->width; x++) {
+	x = (n) ? kernel(dsty, srcp, n, rbit0, gbit0, bbit0) : 0;
+	dsty += x;
+	srcp += x * bpp;
+	for (; x < dst->width; x++) {
 	    if (x < src->width) {
 		uint8_t r, g, b;
-		uint32_t p = convert_read_rgb(srcp, srcfmt->p.rgb.bpp);
-		srcp += srcfmt->p.rgb.bpp;
+		uint32_t p = convert_read_rgb(srcp, bpp);
+		srcp += bpp;
 
 		/* FIXME endianness? */
 		r = ((p >> rbit0) << rbits) & 0xff;
@@ -701,7 +1086,8 @@ static void convert_rgb_to_yuvp(zbar_image_t *dst,
 	    *(dsty++) = y0;
 	}
 	if (x < src->width)
-	    srcp += (src->width - x) * srcfmt->p.rgb.bpp;
+	    srcp += (src->width - x) * bpp;
+	srcp += srcpad;
     }
 }
 
@@ -715,7 +1101,7 @@ static void convert_yuv_to_rgb(zbar_image_t *dst,
     unsigned long dstn = dst->width * dst->height;
     int drbits, drbit0, dgbits, dgbit0, dbbits, dbbit0;
     const uint8_t *srcp;
-    unsigned srcl, x, y;
+    unsigned srcl, srcpad, x, y;
     uint32_t p = 0;
 
     dst->datalen = dstn * dstfmt->p.rgb.bpp;
@@ -738,7 +1124,8 @@ static void convert_yuv_to_rgb(zbar_image_t *dst,
 	srcp++;
 
     assert(srcfmt->p.yuv.xsub2 == 1);
-    srcl = src->width + (src->width >> 1);
+    srcpad = line_pad(src, src->width * 2);
+    srcl   = src->width * 2 + srcpad;
     for (y = 0; y < dst->height; y++) {
 	if (y >= src->height)
 	    srcp -= srcl;
@@ -762,6 +1149,7 @@ static void convert_yuv_to_rgb(zbar_image_t *dst,
 	}
 	if (x < src->width)
 	    srcp += (src->width - x) * 2;
+	srcp += srcpad;
     }
 }
 
@@ -776,7 +1164,7 @@ static void convert_rgb_to_yuv(zbar_image_t *dst,
     uint8_t *dstp, flags;
     const uint8_t *srcp;
     int rbits, rbit0, gbits, gbit0, bbits, bbit0;
-    unsigned srcl, x, y;
+    unsigned srcl, srcpad, x, y;
     uint16_t y0 = 0;
 
     uv_roundup(dst, dstfmt);
@@ -797,7 +1185,8 @@ static void convert_rgb_to_yuv(zbar_image_t *dst,
     bbits = RGB_SIZE(srcfmt->p.rgb.blue);
     bbit0 = RGB_OFFSET(srcfmt->p.rgb.blue);
 
-    srcl = src->width * srcfmt->p.rgb.bpp;
+    srcpad = line_pad(src, src->width * srcfmt->p.rgb.bpp);
+    srcl   = src->width * srcfmt->p.rgb.bpp + srcpad;
     for (y = 0; y < dst->height; y++) {
 	if (y >= src->height)
 	    srcp -= srcl;
@@ -825,6 +1214,7 @@ static void convert_rgb_to_yuv(zbar_image_t *dst,
 	}
 	if (x < src->width)
 	    srcp += (src->width - x) * srcfmt->p.rgb.bpp;
+	srcp += srcpad;
     }
 }
 
@@ -839,7 +1229,7 @@ static void convert_rgb_resample(zbar_image_t *dst,
     int drbits, drbit0, dgbits, dgbit0, dbbits, dbbit0;
     int srbits, srbit0, sgbits, sgbit0, sbbits, sbbit0;
     const uint8_t *srcp;
-    unsigned srcl, x, y;
+    unsigned srcl, srcpad, x, y;
     uint32_t p = 0;
 
     dst->datalen = dstn * dstfmt->p.rgb.bpp;
@@ -865,10 +1255,11 @@ static void convert_rgb_resample(zbar_image_t *dst,
     sbbits = RGB_SIZE(srcfmt->p.rgb.blue);
     sbbit0 = RGB_OFFSET(srcfmt->p.rgb.blue);
 
-    srcl = src->width * srcfmt->p.rgb.bpp;
+    srcpad = line_pad(src, src->width * srcfmt->p.rgb.bpp);
+    srcl   = src->width * srcfmt->p.rgb.bpp + srcpad;
     for (y = 0; y < dst->height; y++) {
 	if (y >= src->height)
-	    y -= srcl;
+	    srcp -= srcl;
 	for (x = 0; x < dst->width; x++) {
 	    if (x < src->width) {
 		uint8_t r, g, b;
@@ -888,6 +1279,7 @@ static void convert_rgb_resample(zbar_image_t *dst,
 	}
 	if (x < src->width)
 	    srcp += (src->width - x) * srcfmt->p.rgb.bpp;
+	srcp += srcpad;
     }
 }
 
@@ -986,6 +1378,55 @@ const zbar_format_def_t *_zbar_format_lookup(uint32_t fmt)
     return (NULL);
 }
 
+/* locate the luminance samples of an image without converting it:
+ * the first plane of planar YUV, every other byte of packed YUV and
+ * the green channel of 24/32-bit RGB.
+ * returns 0 on success, -1 if the format has no such channel
+ */
+int _zbar_image_luma(const zbar_image_t *img, zbar_luma_t *luma)
+{
+    const zbar_format_def_t *fmt = _zbar_format_lookup(img->format);
+    const uint8_t *data		 = img->data;
+    const uint32_t one		 = 1;
+    unsigned bpp, off;
+
+    if (!fmt || !data)
+	return (-1);
+    switch (fmt->group) {
+    case ZBAR_FMT_GRAY:
+    case ZBAR_FMT_YUV_PLANAR:
+    case ZBAR_FMT_YUV_NV:
+	luma->data   = data;
+	luma->step   = 1;
+	luma->stride = _zbar_image_stride(img);
+	return (0);
+
+    case ZBAR_FMT_YUV_PACKED:
+	/* chroma comes first for UYVY */
+	luma->data   = data + ((fmt->p.yuv.packorder & 2) ? 1 : 0);
+	luma->step   = 2;
+	luma->stride = img->width * 2 + line_pad(img, img->width * 2);
+	return (0);
+
+    case ZBAR_FMT_RGB_PACKED:
+	bpp = fmt->p.rgb.bpp;
+	off = RGB_OFFSET(fmt->p.rgb.green);
+	/* only whole bytes (RGB_SIZE is 8 - bits) */
+	if (bpp < 3 || RGB_SIZE(fmt->p.rgb.green) || (off & 7))
+	    return (-1);
+	/* 32-bit pixels are read as native words (see convert_read_rgb) */
+	if (bpp == 4 && !*(const uint8_t *)&one)
+	    off = 24 - off;
+	luma->data   = data + (off >> 3);
+	luma->step   = bpp;
+	luma->stride = img->width * bpp + line_pad(img, img->width * bpp);
+	return (0);
+
+    default:
+	return (-1);
+    }
+}
+
 #ifdef HAVE_LIBJPEG
 /* convert JPEG data via an intermediate format supported by libjpeg */
 static void convert_jpeg(zbar_image_t *dst, const zbar_format_def_t *dstfmt,
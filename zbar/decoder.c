@@ -111,6 +111,54 @@ void zbar_decoder_destroy(zbar_decoder_t *dcode)
     free(dcode);
 }
 
+/* copy symbology configuration from another decoder, leaving the
+ * destination buffers and callback intact and its decode state reset
+ */
+void _zbar_decoder_copy_config(zbar_decoder_t *dst, const zbar_decoder_t *src)
+{
+    unsigned buf_alloc		     = dst->buf_alloc;
+    unsigned char *buf		     = dst->buf;
+    void *userdata		     = dst->userdata;
+    zbar_decoder_handler_t *handler = dst->handler;
+    unsigned long ncalls[NUM_DECODES];
+#if ENABLE_DATABAR == 1
+    databar_segment_t *segs = dst->databar.segs;
+    unsigned csegs	    = dst->databar.csegs;
+#endif
+
+    memcpy(ncalls, dst->ncalls, sizeof(ncalls));
+    memcpy(dst, src, sizeof(zbar_decoder_t));
+    memcpy(dst->ncalls, ncalls, sizeof(ncalls));
+
+    dst->buf_alloc = buf_alloc;
+    dst->buf	   = buf;
+    dst->buflen	   = 0;
+    dst->userdata  = userdata;
+    dst->handler   = handler;
+#if ENABLE_DATABAR == 1
+    dst->databar.segs  = segs;
+    dst->databar.csegs = csegs;
+#endif
+    zbar_decoder_reset(dst);
+}
+
+/* add decoder invocations to image scanner statistics
+ * and restart counting
+ */
+void _zbar_decoder_collect_stats(zbar_decoder_t *dcode,
+				 zbar_image_scanner_stats_t *stats)
+{
+    static const zbar_symbol_type_t types[NUM_DECODES] = {
+	ZBAR_QRCODE,  ZBAR_EAN13,   ZBAR_CODE39, ZBAR_CODE93, ZBAR_CODE128,
+	ZBAR_DATABAR, ZBAR_CODABAR, ZBAR_I25,	 ZBAR_PDF417,
+    };
+    int i;
+    for (i = 0; i < NUM_DECODES; i++) {
+	stats->decodes[types[i]] += dcode->ncalls[i];
+	dcode->ncalls[i] = 0;
+    }
+}
+
 void zbar_decoder_reset(zbar_decoder_t *dcode)
 {
     memset(dcode, 0, (long)&dcode->buf_alloc - (long)dcode);
@@ -227,6 +275,10 @@ unsigned int zbar_decoder_get_modifiers(const zbar_decoder_t *dcode)
     return (dcode->modifiers);
 }
 
+/* run one symbology decoder, counting invocations */
+#define DECODE(dcode, idx, decode) \
+    ((dcode)->ncalls[DECODE_##idx]++, decode(dcode))
+
 zbar_symbol_type_t zbar_decode_width(zbar_decoder_t *dcode, unsigned w)
 {
     zbar_symbol_type_t tmp, sym = ZBAR_NONE;
@@ -241,47 +293,47 @@ zbar_symbol_type_t zbar_decode_width(zbar_decoder_t *dcode, unsigned w)
     /* each decoder processes width stream in parallel */
 #if ENABLE_QRCODE == 1
     if (TEST_CFG(dcode->qrf.config, ZBAR_CFG_ENABLE) &&
-	(tmp = _zbar_find_qr(dcode)) > ZBAR_PARTIAL)
+	(tmp = DECODE(dcode, QRCODE, _zbar_find_qr)) > ZBAR_PARTIAL)
 	sym = tmp;
 #endif
 #if ENABLE_EAN == 1
-    if ((dcode->ean.enable) && (tmp = _zbar_decode_ean(dcode)))
+    if ((dcode->ean.enable) && (tmp = DECODE(dcode, EAN, _zbar_decode_ean)))
 	sym = tmp;
 #endif
 #if ENABLE_CODE39 == 1
     if (TEST_CFG(dcode->code39.config, ZBAR_CFG_ENABLE) &&
-	(tmp = _zbar_decode_code39(dcode)) > ZBAR_PARTIAL)
+	(tmp = DECODE(dcode, CODE39, _zbar_decode_code39)) > ZBAR_PARTIAL)
 	sym = tmp;
 #endif
 #if ENABLE_CODE93 == 1
     if (TEST_CFG(dcode->code93.config, ZBAR_CFG_ENABLE) &&
-	(tmp = _zbar_decode_code93(dcode)) > ZBAR_PARTIAL)
+	(tmp = DECODE(dcode, CODE93, _zbar_decode_code93)) > ZBAR_PARTIAL)
 	sym = tmp;
 #endif
 #if ENABLE_CODE128 == 1
     if (TEST_CFG(dcode->code128.config, ZBAR_CFG_ENABLE) &&
-	(tmp = _zbar_decode_code128(dcode)) > ZBAR_PARTIAL)
+	(tmp = DECODE(dcode, CODE128, _zbar_decode_code128)) > ZBAR_PARTIAL)
 	sym = tmp;
 #endif
 #if ENABLE_DATABAR == 1
     if (TEST_CFG(dcode->databar.config | dcode->databar.config_exp,
 		 ZBAR_CFG_ENABLE) &&
-	(tmp = _zbar_decode_databar(dcode)) > ZBAR_PARTIAL)
+	(tmp = DECODE(dcode, DATABAR, _zbar_decode_databar)) > ZBAR_PARTIAL)
 	sym = tmp;
 #endif
 #if ENABLE_CODABAR == 1
     if (TEST_CFG(dcode->codabar.config, ZBAR_CFG_ENABLE) &&
-	(tmp = _zbar_decode_codabar(dcode)) > ZBAR_PARTIAL)
+	(tmp = DECODE(dcode, CODABAR, _zbar_decode_codabar)) > ZBAR_PARTIAL)
 	sym = tmp;
 #endif
 #if ENABLE_I25 == 1
     if (TEST_CFG(dcode->i25.config, ZBAR_CFG_ENABLE) &&
-	(tmp = _zbar_decode_i25(dcode)) > ZBAR_PARTIAL)
+	(tmp = DECODE(dcode, I25, _zbar_decode_i25)) > ZBAR_PARTIAL)
 	sym = tmp;
 #endif
 #if ENABLE_PDF417 == 1
     if (TEST_CFG(dcode->pdf417.config, ZBAR_CFG_ENABLE) &&
-	(tmp = _zbar_decode_pdf417(dcode)) > ZBAR_PARTIAL)
+	(tmp = DECODE(dcode, PDF417, _zbar_decode_pdf417)) > ZBAR_PARTIAL)
 	sym = tmp;
 #endif
 
@@ -86,6 +86,21 @@
 #define BUFFER_INCR 0x10
 #endif
 
+/* symbology decoders run on each width */
+enum
+{
+    DECODE_QRCODE = 0,
+    DECODE_EAN,
+    DECODE_CODE39,
+    DECODE_CODE93,
+    DECODE_CODE128,
+    DECODE_DATABAR,
+    DECODE_CODABAR,
+    DECODE_I25,
+    DECODE_PDF417,
+    NUM_DECODES
+};
+
 #define CFG(dcode, cfg)	      ((dcode).configs[(cfg)-ZBAR_CFG_MIN_LEN])
 #define TEST_CFG(config, cfg) (((config) >> (cfg)) & 1)
 #define MOD(mod)	      (1 << (mod))
@@ -107,6 +122,9 @@ struct zbar_decoder_s {
     void *userdata;		     /* application data */
     zbar_decoder_handler_t *handler; /* application callback */
 
+    /* symbology decoder invocations, for image scanner statistics */
+    unsigned long ncalls[NUM_DECODES];
+
     /* symbology specific state */
 #if ENABLE_EAN == 1
     ean_decoder_t ean; /* EAN/UPC parallel decode attempts */
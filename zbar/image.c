@@ -77,6 +77,25 @@ unsigned zbar_image_get_height(const zbar_image_t *img)
     return (img->height);
 }
 
+unsigned zbar_image_get_stride(const zbar_image_t *img)
+{
+    const zbar_format_def_t *fmt;
+    if (img->stride)
+	return (img->stride);
+    fmt = _zbar_format_lookup(img->format);
+    if (!fmt)
+	return (img->width);
+    switch (fmt->group) {
+    case ZBAR_FMT_YUV_PACKED:
+	/* all supported packed formats are 4:2:2 */
+	return (img->width * 2);
+    case ZBAR_FMT_RGB_PACKED:
+	return (img->width * fmt->p.rgb.bpp);
+    default:
+	return (img->width);
+    }
+}
+
 void zbar_image_get_size(const zbar_image_t *img, unsigned *w, unsigned *h)
 {
     if (w)
@@ -125,6 +144,11 @@ void zbar_image_set_size(zbar_image_t *img, unsigned w, unsigned h)
     img->height = img->crop_h = h;
 }
 
+void zbar_image_set_stride(zbar_image_t *img, unsigned stride)
+{
+    img->stride = stride;
+}
+
 void zbar_image_set_crop(zbar_image_t *img, unsigned x, unsigned y, unsigned w,
 			 unsigned h)
 {
@@ -64,7 +64,9 @@ struct zbar_image_s {
     unsigned long datalen;   /* allocated/mapped size of data */
     unsigned crop_x, crop_y; /* crop rectangle */
     unsigned crop_w, crop_h;
-    void *userdata; /* user specified data associated w/image */
+    unsigned stride; /* bytes per line, 0 if lines are packed */
+    unsigned scale;  /* factor the size was reduced by when decoded */
+    void *userdata;  /* user specified data associated w/image */
 
     /* cleanup handler */
     zbar_image_cleanup_handler_t *cleanup;
@@ -98,8 +100,16 @@ typedef struct zbar_format_def_s {
     } p;
 } zbar_format_def_t;
 
+/* 8-bit luminance samples of an image, read in place */
+typedef struct zbar_luma_s {
+    const uint8_t *data; /* sample at the top left corner */
+    unsigned step;	 /* bytes between horizontally adjacent samples */
+    unsigned stride;	 /* bytes between vertically adjacent samples */
+} zbar_luma_t;
+
 extern int _zbar_best_format(uint32_t, uint32_t *, const uint32_t *);
 extern const zbar_format_def_t *_zbar_format_lookup(uint32_t);
+extern int _zbar_image_luma(const zbar_image_t *, zbar_luma_t *);
 extern void _zbar_image_free(zbar_image_t *);
 
 #ifdef DEBUG_SVG
@@ -136,6 +146,14 @@ static inline void _zbar_image_copy_size(zbar_image_t *dst,
     dst->crop_h = src->crop_h;
 }
 
+/* distance in bytes between vertically adjacent samples
+ * of an 8-bit luminance plane
+ */
+static inline unsigned _zbar_image_stride(const zbar_image_t *img)
+{
+    return ((img->stride) ? img->stride : img->width);
+}
+
 static inline zbar_image_t *_zbar_image_copy(const zbar_image_t *src,
 					     int inverted)
 {
@@ -148,6 +166,7 @@ static inline zbar_image_t *_zbar_image_copy(const zbar_image_t *src,
     dst		= zbar_image_create();
     dst->format = src->format;
     _zbar_image_copy_size(dst, src);
+    dst->stride	 = src->stride;
     dst->datalen = src->datalen;
     dst->data	 = malloc(src->datalen);
     assert(dst->data);
@@ -47,30 +47,42 @@
 #include "sqcode.h"
 #endif
 #include "img_scanner.h"
+#include "pool.h"
 #include "svg.h"
 
 #if 1
-#define ASSERT_POS assert(p == data + x + y * (intptr_t)w)
+#define ASSERT_POS assert(p == data + x * step + y * (intptr_t)stride)
 #else
 #define ASSERT_POS
 #endif
 
-/* FIXME cache setting configurability */
-
-/* time interval for which two images are considered "nearby"
+/* default time interval for which two images are considered "nearby"
  */
 #define CACHE_PROXIMITY 1000 /* ms */
 
-/* time that a result must *not* be detected before
+/* default time that a result must *not* be detected before
  * it will be reported again
  */
 #define CACHE_HYSTERESIS 2000 /* ms */
 
-/* time after which cache entries are invalidated
+/* default time after which cache entries are invalidated
  */
 #define CACHE_TIMEOUT (CACHE_HYSTERESIS * 2) /* ms */
 
-#define NUM_SCN_CFGS (ZBAR_CFG_Y_DENSITY - ZBAR_CFG_X_DENSITY + 1)
+/* default QR scratch memory kept between images: enough for the finder
+ * lines and centers of a busy 2 megapixel frame
+ */
+#define QR_SCRATCH (4 << 20) /* bytes */
+
+/* most threads a scan or QR decode is split across
+ * (each scan thread takes two scanner clones)
+ */
+#define SCAN_THREADS_MAX 64
+
+/* initial number of cache hash buckets (power of 2) */
+#define CACHE_BUCKETS 64
+
+#define NUM_SCN_CFGS (ZBAR_CFG_JPEG_SCALE - ZBAR_CFG_X_DENSITY + 1)
 
 #define CFG(iscn, cfg)	    ((iscn)->configs[(cfg)-ZBAR_CFG_X_DENSITY])
 #define TEST_CFG(iscn, cfg) (((iscn)->config >> ((cfg)-ZBAR_CFG_POSITION)) & 1)
@@ -83,12 +95,29 @@
 #endif
 
 #define RECYCLE_BUCKETS 5
+#define RECYCLE_SETS	8
 
 typedef struct recycle_bucket_s {
     int nsyms;
     zbar_symbol_t *head;
 } recycle_bucket_t;
 
+/* one band of a parallel scan pass */
+typedef struct scan_band_s {
+    zbar_image_scanner_t *iscn; /* private band scanner */
+    int vert;			/* 0 to scan rows, 1 to scan columns */
+    int start, end;		/* first scan line and end of band */
+    int rev;			/* first scan line runs backwards */
+    int warmup;			/* rescan preceding line to prime decoder */
+} scan_band_t;
+
+/* one thread of a batch scan */
+typedef struct scan_batch_s {
+    zbar_image_scanner_t *iscn; /* private batch scanner */
+    int nsyms;			/* symbols found by this thread */
+    int err;			/* images this thread failed to scan */
+} scan_batch_t;
+
 /* image scanner state */
 struct zbar_image_scanner_s {
     zbar_scanner_t *scn;   /* associated linear intensity scanner */
@@ -96,6 +125,14 @@ struct zbar_image_scanner_s {
 #if ENABLE_QRCODE == 1
     qr_reader *qr; /* QR Code 2D reader */
 #endif
+
+    /* inverted (light on dark) symbols */
+    int inverted;	       /* decoding both polarities */
+    zbar_decoder_t *dcode_inv; /* decoder for inverted edges */
+    zbar_symbol_t *inv_syms;   /* its symbols, kept apart (stacked) */
+#if ENABLE_QRCODE == 1
+    qr_reader *qr_inv; /* QR Code reader for inverted finder lines */
+#endif
 #if ENABLE_SQCODE == 1
     sq_reader *sq; /* SQ Code 2D reader */
 #endif
@@ -106,13 +143,20 @@ struct zbar_image_scanner_s {
 
     unsigned long time;	     /* scan start time */
     zbar_image_t *img;	     /* currently scanning image *root* */
+    int discard;	     /* ignore decoder results */
     int dx, dy, du, umin, v; /* current scan direction */
     zbar_symbol_set_t *syms; /* previous decode results */
     /* recycled symbols in 4^n size buckets */
     recycle_bucket_t recycle[RECYCLE_BUCKETS];
+    /* recycled (empty) composite symbol sets */
+    zbar_symbol_set_t *recycle_sets[RECYCLE_SETS];
+    int nrecycle_sets;
 
     int enable_cache;	  /* current result cache state */
-    zbar_symbol_t *cache; /* inter-image result cache entries */
+    zbar_symbol_t *cache; /* inter-image result cache entries (oldest first) */
+    zbar_symbol_t *cache_tail;	 /* most recently updated cache entry */
+    zbar_symbol_t **cache_hash;	 /* cache entries hashed by type and data */
+    unsigned cache_size, ncache; /* number of hash buckets and entries */
 
     /* configuration settings */
     unsigned config; /* config flags */
@@ -120,6 +164,22 @@ struct zbar_image_scanner_s {
     int configs[NUM_SCN_CFGS];	  /* int valued configurations */
     int sym_configs[1][NUM_SYMS]; /* per-symbology configurations */
 
+    /* parallel band scanning */
+    zbar_pool_t *pool;	/* band worker threads */
+    int nbands;		/* allocated band scanners */
+    scan_band_t *bands; /* band scanner states */
+
+    /* batch image scanning */
+    zbar_pool_t *batch_pool;	 /* batch worker threads */
+    int nbatch;			 /* allocated batch scanners */
+    scan_batch_t *batch;	 /* batch scanner states (one per thread) */
+    zbar_image_t **batch_images; /* images of the current batch */
+
+    uint8_t *strip;	 /* transposed columns for vertical pass */
+    unsigned strip_size; /* allocated strip buffer size */
+
+    zbar_image_scanner_stats_t stats; /* processing counters and timings */
+
 #ifndef NO_STATS
     int stat_syms_new;
     int stat_iscn_syms_inuse, stat_iscn_syms_recycle;
@@ -157,20 +217,20 @@ void _zbar_image_scanner_recycle_syms(zbar_image_scanner_t *iscn,
 		if (_zbar_refcnt(&sym->syms->refcnt, -1))
 		    assert(0);
 		_zbar_image_scanner_recycle_syms(iscn, sym->syms->head);
-		sym->syms->head = NULL;
-		_zbar_symbol_set_free(sym->syms);
+		sym->syms->head = sym->syms->tail = NULL;
+		sym->syms->nsyms		  = 0;
+		if (iscn->nrecycle_sets < RECYCLE_SETS)
+		    iscn->recycle_sets[iscn->nrecycle_sets++] = sym->syms;
+		else
+		    _zbar_symbol_set_free(sym->syms);
 		sym->syms = NULL;
 	    }
-	    for (i = 0; i < RECYCLE_BUCKETS; i++)
+	    /* the last bucket also keeps larger buffers,
+	     * so big symbols are reused from frame to frame
+	     */
+	    for (i = 0; i < RECYCLE_BUCKETS - 1; i++)
 		if (sym->data_alloc < 1 << (i * 2))
 		    break;
-	    if (i == RECYCLE_BUCKETS) {
-		assert(sym->data);
-		free(sym->data);
-		sym->data	= NULL;
-		sym->data_alloc = 0;
-		i		= 0;
-	    }
 	    bucket = &iscn->recycle[i];
 	    /* FIXME cap bucket fill */
 	    bucket->nsyms++;
@@ -219,24 +279,85 @@ inline void zbar_image_scanner_recycle_image(zbar_image_scanner_t *iscn,
     }
 }
 
+extern void _zbar_scanner_collect_stats(zbar_scanner_t *,
+					zbar_image_scanner_stats_t *);
+extern void _zbar_decoder_collect_stats(zbar_decoder_t *,
+					zbar_image_scanner_stats_t *);
+
+void _zbar_image_scanner_add_time(zbar_image_scanner_t *iscn,
+				  zbar_scan_stage_t stage,
+				  unsigned long long ns)
+{
+    iscn->stats.total_ns[stage] += ns;
+    iscn->stats.last_ns[stage] += ns;
+}
+
+/* account time since start to a stage.  returns the current time */
+static inline unsigned long long scan_stage_done(zbar_image_scanner_t *iscn,
+						 zbar_scan_stage_t stage,
+						 unsigned long long start)
+{
+    unsigned long long now = _zbar_timer_now_ns();
+    _zbar_image_scanner_add_time(iscn, stage, now - start);
+    return (now);
+}
+
+/* gather counts from the linear scanner and decoders */
+static void scan_stats_collect(zbar_image_scanner_t *iscn)
+{
+    _zbar_scanner_collect_stats(iscn->scn, &iscn->stats);
+    _zbar_decoder_collect_stats(iscn->dcode, &iscn->stats);
+    if (iscn->dcode_inv)
+	_zbar_decoder_collect_stats(iscn->dcode_inv, &iscn->stats);
+}
+
+/* move statistics of a private band or batch scanner into the main
+ * scanner, as part of the current image (or batch)
+ */
+static void scan_stats_merge(zbar_image_scanner_t *iscn,
+			     zbar_image_scanner_t *src)
+{
+    zbar_image_scanner_stats_t *stats = &iscn->stats;
+    zbar_image_scanner_stats_t *sstats = &src->stats;
+    int i;
+
+    scan_stats_collect(src);
+    stats->frames += sstats->frames;
+    stats->symbols += sstats->symbols;
+    stats->edges += sstats->edges;
+    for (i = 0; i <= ZBAR_CODE128; i++)
+	stats->decodes[i] += sstats->decodes[i];
+    for (i = 0; i < ZBAR_STAGE_NUM; i++) {
+	stats->total_ns[i] += sstats->total_ns[i];
+	stats->last_ns[i] += sstats->total_ns[i];
+    }
+    memset(sstats, 0, sizeof(*sstats));
+}
+
 inline zbar_symbol_t *_zbar_image_scanner_alloc_sym(zbar_image_scanner_t *iscn,
 						    zbar_symbol_type_t type,
 						    int datalen)
 {
     /* recycle old or alloc new symbol */
     zbar_symbol_t *sym = NULL;
-    int i;
-    for (i = 0; i < RECYCLE_BUCKETS - 1; i++)
-	if (datalen <= 1 << (i * 2))
+    int i, j;
+    for (j = 0; j < RECYCLE_BUCKETS - 1; j++)
+	if (datalen < 1 << (j * 2))
 	    break;
 
-    for (; i > 0; i--)
-	if ((sym = iscn->recycle[i].head)) {
-	    STAT(sym_recycle[i]);
+    /* prefer a buffer of matching size or larger,
+     * then any symbol (data will be reallocated)
+     */
+    for (i = j; i < RECYCLE_BUCKETS; i++)
+	if ((sym = iscn->recycle[i].head))
 	    break;
-	}
+    if (!sym)
+	for (i = j - 1; i >= 0; i--)
+	    if ((sym = iscn->recycle[i].head))
+		break;
 
     if (sym) {
+	STAT(sym_recycle[i]);
 	iscn->recycle[i].head = sym->next;
 	sym->next	      = NULL;
 	assert(iscn->recycle[i].nsyms);
@@ -272,25 +393,126 @@ inline zbar_symbol_t *_zbar_image_scanner_alloc_sym(zbar_image_scanner_t *iscn,
     return (sym);
 }
 
+zbar_symbol_set_t *_zbar_image_scanner_alloc_syms(zbar_image_scanner_t *iscn)
+{
+    zbar_symbol_set_t *syms;
+    if (!iscn->nrecycle_sets)
+	return (_zbar_symbol_set_create());
+    syms = iscn->recycle_sets[--iscn->nrecycle_sets];
+    assert(!syms->refcnt && !syms->head);
+    _zbar_refcnt(&syms->refcnt, 1);
+    return (syms);
+}
+
+static inline unsigned cache_hash(const zbar_symbol_t *sym)
+{
+    /* FNV-1a */
+    unsigned h = 2166136261u ^ sym->type;
+    const unsigned char *data = (const unsigned char *)sym->data;
+    unsigned i;
+    for (i = 0; i < sym->datalen; i++)
+	h = (h ^ data[i]) * 16777619u;
+    return (h);
+}
+
+/* remove entry from the cache (but do not recycle it) */
+static inline void cache_unlink(zbar_image_scanner_t *iscn,
+				zbar_symbol_t *entry)
+{
+    zbar_symbol_t **chain =
+	&iscn->cache_hash[entry->cache_hash & (iscn->cache_size - 1)];
+    while (*chain != entry)
+	chain = &(*chain)->cache_chain;
+    *chain = entry->cache_chain;
+
+    if (entry->cache_prev)
+	entry->cache_prev->next = entry->next;
+    else
+	iscn->cache = entry->next;
+    if (entry->next)
+	entry->next->cache_prev = entry->cache_prev;
+    else
+	iscn->cache_tail = entry->cache_prev;
+    entry->next = entry->cache_chain = entry->cache_prev = NULL;
+    iscn->ncache--;
+}
+
+/* append entry to the cache, as most recently updated */
+static inline void cache_link(zbar_image_scanner_t *iscn, zbar_symbol_t *entry)
+{
+    zbar_symbol_t **chain =
+	&iscn->cache_hash[entry->cache_hash & (iscn->cache_size - 1)];
+    entry->cache_chain = *chain;
+    *chain	       = entry;
+
+    entry->next	      = NULL;
+    entry->cache_prev = iscn->cache_tail;
+    if (iscn->cache_tail)
+	iscn->cache_tail->next = entry;
+    else
+	iscn->cache = entry;
+    iscn->cache_tail = entry;
+    iscn->ncache++;
+}
+
+/* recycle all cache entries */
+static void cache_flush(zbar_image_scanner_t *iscn)
+{
+    if (iscn->cache) {
+	_zbar_image_scanner_recycle_syms(iscn, iscn->cache);
+	iscn->cache = iscn->cache_tail = NULL;
+    }
+    if (iscn->cache_hash)
+	memset(iscn->cache_hash, 0,
+	       iscn->cache_size * sizeof(zbar_symbol_t *));
+    iscn->ncache = 0;
+}
+
+/* double the number of hash buckets */
+static int cache_grow(zbar_image_scanner_t *iscn)
+{
+    unsigned size = (iscn->cache_size) ? iscn->cache_size * 2 : CACHE_BUCKETS;
+    zbar_symbol_t **hash = calloc(size, sizeof(zbar_symbol_t *));
+    zbar_symbol_t *entry;
+    if (!hash)
+	return (-1);
+    for (entry = iscn->cache; entry; entry = entry->next) {
+	zbar_symbol_t **chain = &hash[entry->cache_hash & (size - 1)];
+	entry->cache_chain    = *chain;
+	*chain		      = entry;
+    }
+    if (iscn->cache_hash)
+	free(iscn->cache_hash);
+    iscn->cache_hash = hash;
+    iscn->cache_size = size;
+    return (0);
+}
+
 static inline zbar_symbol_t *cache_lookup(zbar_image_scanner_t *iscn,
 					  zbar_symbol_t *sym)
 {
+    unsigned long timeout = CFG(iscn, ZBAR_CFG_CACHE_TIMEOUT);
+    zbar_symbol_t *entry;
+    unsigned h;
+
+    /* expire stale entries, which are kept in update order */
+    while (iscn->cache && (sym->time - iscn->cache->time) > timeout) {
+	entry = iscn->cache;
+	cache_unlink(iscn, entry);
+	_zbar_image_scanner_recycle_syms(iscn, entry);
+    }
+    if (!iscn->ncache)
+	return (NULL);
+
     /* search for matching entry in cache */
-    zbar_symbol_t **entry = &iscn->cache;
-    while (*entry) {
-	if ((*entry)->type == sym->type && (*entry)->datalen == sym->datalen &&
-	    !memcmp((*entry)->data, sym->data, sym->datalen))
+    h = sym->cache_hash = cache_hash(sym);
+    for (entry = iscn->cache_hash[h & (iscn->cache_size - 1)]; entry;
+	 entry = entry->cache_chain)
+	if (entry->cache_hash == h && entry->type == sym->type &&
+	    entry->datalen == sym->datalen &&
+	    !memcmp(entry->data, sym->data, sym->datalen))
 	    break;
-	if ((sym->time - (*entry)->time) > CACHE_TIMEOUT) {
-	    /* recycle stale cache entry */
-	    zbar_symbol_t *next = (*entry)->next;
-	    (*entry)->next	= NULL;
-	    _zbar_image_scanner_recycle_syms(iscn, *entry);
-	    *entry = next;
-	} else
-	    entry = &(*entry)->next;
-    }
-    return (*entry);
+    return (entry);
 }
 
 static inline void cache_sym(zbar_image_scanner_t *iscn, zbar_symbol_t *sym)
@@ -299,24 +521,29 @@ static inline void cache_sym(zbar_image_scanner_t *iscn, zbar_symbol_t *sym)
 	uint32_t age, near_thresh, far_thresh, dup;
 	zbar_symbol_t *entry = cache_lookup(iscn, sym);
 	if (!entry) {
+	    if (iscn->ncache >= iscn->cache_size && cache_grow(iscn)) {
+		sym->cache_count = 0;
+		return;
+	    }
 	    /* FIXME reuse sym */
 	    entry	     = _zbar_image_scanner_alloc_sym(iscn, sym->type,
 						     sym->datalen + 1);
 	    entry->configs   = sym->configs;
 	    entry->modifiers = sym->modifiers;
 	    memcpy(entry->data, sym->data, sym->datalen);
-	    entry->time	       = sym->time - CACHE_HYSTERESIS;
+	    entry->time	       = sym->time - CFG(iscn, ZBAR_CFG_CACHE_HYSTERESIS);
 	    entry->cache_count = 0;
-	    /* add to cache */
-	    entry->next = iscn->cache;
-	    iscn->cache = entry;
-	}
+	    entry->cache_hash  = cache_hash(sym);
+	} else
+	    cache_unlink(iscn, entry);
+	/* add to cache as most recent */
+	cache_link(iscn, entry);
 
 	/* consistency check and hysteresis */
 	age	    = sym->time - entry->time;
 	entry->time = sym->time;
-	near_thresh = (age < CACHE_PROXIMITY);
-	far_thresh  = (age >= CACHE_HYSTERESIS);
+	near_thresh = (age < CFG(iscn, ZBAR_CFG_CACHE_PROXIMITY));
+	far_thresh  = (age >= CFG(iscn, ZBAR_CFG_CACHE_HYSTERESIS));
 	dup	    = (entry->cache_count >= 0);
 	if ((!dup && !near_thresh) || far_thresh) {
 	    int type	       = sym->type;
@@ -359,12 +586,17 @@ extern qr_finder_line *_zbar_decoder_get_qr_finder_line(zbar_decoder_t *);
 #define PRINT_FIXED(val, prec) \
     ((val) >> (prec)), (1000 * ((val) & ((1 << (prec)) - 1)) / (1 << (prec)))
 
-static inline void qr_handler(zbar_image_scanner_t *iscn)
+static inline void qr_handler(zbar_image_scanner_t *iscn,
+			      zbar_decoder_t *dcode)
 {
     unsigned u;
     int vert;
-    qr_finder_line *line = _zbar_decoder_get_qr_finder_line(iscn->dcode);
+    unsigned long long start = 0;
+    qr_finder_line *line     = _zbar_decoder_get_qr_finder_line(dcode);
     assert(line);
+    /* finder lines are frequent, only read the clock when asked to */
+    if (TEST_CFG(iscn, ZBAR_CFG_QR_LINE_TIMES))
+	start = _zbar_timer_now_ns();
     u = zbar_scanner_get_edge(iscn->scn, line->pos[0], QR_FINDER_SUBPREC);
     line->boffs =
 	u - zbar_scanner_get_edge(iscn->scn, line->boffs, QR_FINDER_SUBPREC);
@@ -385,7 +617,10 @@ static inline void qr_handler(zbar_image_scanner_t *iscn)
     line->pos[vert]  = u;
     line->pos[!vert] = QR_FIXED(iscn->v, 1);
 
-    _zbar_qr_found_line(iscn->qr, vert, line);
+    _zbar_qr_found_line((dcode == iscn->dcode) ? iscn->qr : iscn->qr_inv, vert,
+			line);
+    if (start)
+	scan_stage_done(iscn, ZBAR_STAGE_QR_LINES, start);
 }
 #endif
 
@@ -403,14 +638,18 @@ static void symbol_handler(zbar_decoder_t *dcode)
 {
     zbar_image_scanner_t *iscn = zbar_decoder_get_userdata(dcode);
     zbar_symbol_type_t type    = zbar_decoder_get_type(dcode);
-    int x = 0, y = 0, dir;
+    int x = 0, y = 0, dir, inverted;
     const char *data;
     unsigned datalen;
     zbar_symbol_t *sym;
 
+    if (iscn->discard)
+	/* band warm up, reported by previous band */
+	return;
+
 #if ENABLE_QRCODE == 1
     if (type == ZBAR_QRCODE) {
-	qr_handler(iscn);
+	qr_handler(iscn, dcode);
 	return;
     }
 #else
@@ -439,8 +678,12 @@ static void symbol_handler(zbar_decoder_t *dcode)
     data    = zbar_decoder_get_data(dcode);
     datalen = zbar_decoder_get_data_length(dcode);
 
+    /* reads of each polarity only add to symbols of the same polarity */
+    inverted = (dcode != iscn->dcode);
+
     /* FIXME need better symbol matching */
-    for (sym = iscn->syms->head; sym; sym = sym->next)
+    for (sym = (inverted) ? iscn->inv_syms : iscn->syms->head; sym;
+	 sym = sym->next)
 	if (sym->type == type && sym->datalen == datalen &&
 	    !memcmp(sym->data, data, datalen)) {
 	    sym->quality++;
@@ -470,7 +713,12 @@ static void symbol_handler(zbar_decoder_t *dcode)
     if (dir)
 	sym->orient = (iscn->dy != 0) + ((iscn->du ^ dir) & 2);
 
-    _zbar_image_scanner_add_sym(iscn, sym);
+    if (inverted) {
+	/* reported by scan_inverted_merge() */
+	sym->next      = iscn->inv_syms;
+	iscn->inv_syms = sym;
+    } else
+	_zbar_image_scanner_add_sym(iscn, sym);
 }
 
 zbar_image_scanner_t *zbar_image_scanner_create()
@@ -498,6 +746,13 @@ zbar_image_scanner_t *zbar_image_scanner_create()
     /* apply default configuration */
     CFG(iscn, ZBAR_CFG_X_DENSITY) = 1;
     CFG(iscn, ZBAR_CFG_Y_DENSITY) = 1;
+    CFG(iscn, ZBAR_CFG_THREADS)	  = 1;
+    CFG(iscn, ZBAR_CFG_CACHE_PROXIMITY)	 = CACHE_PROXIMITY;
+    CFG(iscn, ZBAR_CFG_CACHE_HYSTERESIS) = CACHE_HYSTERESIS;
+    CFG(iscn, ZBAR_CFG_CACHE_TIMEOUT)	 = CACHE_TIMEOUT;
+    CFG(iscn, ZBAR_CFG_QR_THREADS)	 = 1;
+    CFG(iscn, ZBAR_CFG_QR_SCRATCH)	 = QR_SCRATCH;
+    CFG(iscn, ZBAR_CFG_JPEG_SCALE)	 = 1;
     zbar_image_scanner_set_config(iscn, 0, ZBAR_CFG_POSITION, 1);
     zbar_image_scanner_set_config(iscn, 0, ZBAR_CFG_UNCERTAINTY, 2);
     zbar_image_scanner_set_config(iscn, 0, ZBAR_CFG_TEST_INVERTED, 0);
@@ -512,6 +767,142 @@ zbar_image_scanner_t *zbar_image_scanner_create()
     return (iscn);
 }
 
+extern void _zbar_decoder_copy_config(zbar_decoder_t *, const zbar_decoder_t *);
+
+/* create a private scanner with the same configuration */
+static zbar_image_scanner_t *image_scanner_clone(zbar_image_scanner_t *iscn)
+{
+    zbar_image_scanner_t *clone = zbar_image_scanner_create();
+    if (!clone)
+	return (NULL);
+    _zbar_decoder_copy_config(clone->dcode, iscn->dcode);
+    clone->config     = iscn->config;
+    clone->ean_config = iscn->ean_config;
+    memcpy(clone->configs, iscn->configs, sizeof(clone->configs));
+    memcpy(clone->sym_configs, iscn->sym_configs, sizeof(clone->sym_configs));
+    CFG(clone, ZBAR_CFG_THREADS)    = 1;
+    CFG(clone, ZBAR_CFG_QR_THREADS) = 1;
+    return (clone);
+}
+
+/* prepare to decode inverted symbols in the same pass as normal ones,
+ * if enabled
+ */
+static void scan_polarity_init(zbar_image_scanner_t *iscn)
+{
+    int inverted = TEST_CFG(iscn, ZBAR_CFG_TEST_INVERTED);
+    if (inverted && !iscn->dcode_inv) {
+	iscn->dcode_inv = zbar_decoder_create();
+	if (iscn->dcode_inv) {
+	    zbar_decoder_set_userdata(iscn->dcode_inv, iscn);
+	    zbar_decoder_set_handler(iscn->dcode_inv, symbol_handler);
+	}
+    }
+#if ENABLE_QRCODE == 1
+    if (inverted && !iscn->qr_inv)
+	iscn->qr_inv = _zbar_qr_create();
+    if (!iscn->qr_inv)
+	inverted = 0;
+#endif
+    if (!iscn->dcode_inv)
+	inverted = 0;
+
+    if (inverted) {
+#if ENABLE_QRCODE == 1
+	_zbar_qr_reset(iscn->qr_inv);
+#endif
+	/* follow normal decoder configuration */
+	_zbar_decoder_copy_config(iscn->dcode_inv, iscn->dcode);
+	zbar_decoder_new_scan(iscn->dcode);
+    }
+    if (inverted != iscn->inverted)
+	/* edges are decoded at the end of each scan line */
+	zbar_scanner_enable_edges(iscn->scn, inverted);
+    iscn->inverted = inverted;
+}
+
+static void scan_bands_free(zbar_image_scanner_t *iscn)
+{
+    int i;
+    for (i = 0; i < iscn->nbands; i++)
+	zbar_image_scanner_destroy(iscn->bands[i].iscn);
+    if (iscn->bands)
+	free(iscn->bands);
+    iscn->bands	 = NULL;
+    iscn->nbands = 0;
+    if (iscn->pool)
+	_zbar_pool_destroy(iscn->pool);
+    iscn->pool = NULL;
+}
+
+/* allocate band scanners and worker threads for nthreads parallel
+ * scans along each axis.  returns the number of bands available
+ */
+static int scan_bands_alloc(zbar_image_scanner_t *iscn, int nthreads)
+{
+    int nbands = nthreads * 2;
+    if (iscn->nbands < nbands) {
+	scan_band_t *bands = realloc(iscn->bands, nbands * sizeof(*bands));
+	if (!bands)
+	    return (iscn->nbands);
+	iscn->bands = bands;
+	while (iscn->nbands < nbands) {
+	    zbar_image_scanner_t *clone = image_scanner_clone(iscn);
+	    if (!clone)
+		break;
+	    clone->syms = _zbar_symbol_set_create();
+	    iscn->bands[iscn->nbands++].iscn = clone;
+	}
+    }
+    if (!iscn->pool)
+	iscn->pool = _zbar_pool_create(nthreads - 1);
+    return (iscn->nbands);
+}
+
+static void scan_batch_free(zbar_image_scanner_t *iscn)
+{
+    int i;
+    if (iscn->batch_pool)
+	_zbar_pool_destroy(iscn->batch_pool);
+    iscn->batch_pool = NULL;
+    for (i = 0; i < iscn->nbatch; i++)
+	zbar_image_scanner_destroy(iscn->batch[i].iscn);
+    if (iscn->batch)
+	free(iscn->batch);
+    iscn->batch	 = NULL;
+    iscn->nbatch = 0;
+}
+
+/* allocate batch scanners and worker threads for nthreads parallel
+ * image scans.  returns the number of threads available
+ */
+static int scan_batch_alloc(zbar_image_scanner_t *iscn, int nthreads)
+{
+    if (iscn->batch_pool &&
+	_zbar_pool_get_size(iscn->batch_pool) + 1 != nthreads) {
+	/* thread count changed, scanners are kept */
+	_zbar_pool_destroy(iscn->batch_pool);
+	iscn->batch_pool = NULL;
+    }
+    if (iscn->nbatch < nthreads) {
+	scan_batch_t *batch = realloc(iscn->batch, nthreads * sizeof(*batch));
+	if (!batch)
+	    return (iscn->nbatch);
+	iscn->batch = batch;
+	while (iscn->nbatch < nthreads) {
+	    zbar_image_scanner_t *clone = image_scanner_clone(iscn);
+	    if (!clone)
+		break;
+	    iscn->batch[iscn->nbatch++].iscn = clone;
+	}
+    }
+    if (nthreads > iscn->nbatch)
+	nthreads = iscn->nbatch;
+    if (!iscn->batch_pool && nthreads > 1)
+	iscn->batch_pool = _zbar_pool_create(nthreads - 1);
+    return (_zbar_pool_get_size(iscn->batch_pool) + 1);
+}
+
 #ifndef NO_STATS
 static inline void dump_stats(const zbar_image_scanner_t *iscn)
 {
@@ -545,6 +936,16 @@ void zbar_image_scanner_destroy(zbar_image_scanner_t *iscn)
     if (iscn->dcode)
 	zbar_decoder_destroy(iscn->dcode);
     iscn->dcode = NULL;
+    if (iscn->dcode_inv)
+	zbar_decoder_destroy(iscn->dcode_inv);
+    iscn->dcode_inv = NULL;
+    scan_bands_free(iscn);
+    scan_batch_free(iscn);
+    if (iscn->strip)
+	free(iscn->strip);
+    cache_flush(iscn);
+    if (iscn->cache_hash)
+	free(iscn->cache_hash);
     for (i = 0; i < RECYCLE_BUCKETS; i++) {
 	zbar_symbol_t *sym, *next;
 	for (sym = iscn->recycle[i].head; sym; sym = next) {
@@ -552,11 +953,17 @@ void zbar_image_scanner_destroy(zbar_image_scanner_t *iscn)
 	    _zbar_symbol_free(sym);
 	}
     }
+    while (iscn->nrecycle_sets)
+	_zbar_symbol_set_free(iscn->recycle_sets[--iscn->nrecycle_sets]);
 #if ENABLE_QRCODE == 1
     if (iscn->qr) {
 	_zbar_qr_destroy(iscn->qr);
 	iscn->qr = NULL;
     }
+    if (iscn->qr_inv) {
+	_zbar_qr_destroy(iscn->qr_inv);
+	iscn->qr_inv = NULL;
+    }
 #endif
 #if ENABLE_SQCODE == 1
     if (iscn->sq) {
@@ -578,10 +985,38 @@ zbar_image_scanner_set_data_handler(zbar_image_scanner_t *iscn,
     return (result);
 }
 
+/* check the range of an int valued scanner configuration */
+static inline int scan_config_valid(zbar_config_t cfg, int val)
+{
+    switch (cfg) {
+    case ZBAR_CFG_THREADS:
+    case ZBAR_CFG_QR_THREADS:
+	return (val >= 1 && val <= SCAN_THREADS_MAX);
+    case ZBAR_CFG_CACHE_PROXIMITY:
+    case ZBAR_CFG_CACHE_HYSTERESIS:
+    case ZBAR_CFG_CACHE_TIMEOUT:
+    case ZBAR_CFG_QR_SCRATCH:
+	return (val >= 0);
+    case ZBAR_CFG_JPEG_SCALE:
+	return (val >= 1);
+    default:
+	return (1);
+    }
+}
+
 int zbar_image_scanner_set_config(zbar_image_scanner_t *iscn,
 				  zbar_symbol_type_t sym, zbar_config_t cfg,
 				  int val)
 {
+    int i;
+    /* keep band and batch scanners in sync */
+    if (cfg != ZBAR_CFG_THREADS && cfg != ZBAR_CFG_QR_THREADS) {
+	for (i = 0; i < iscn->nbands; i++)
+	    zbar_image_scanner_set_config(iscn->bands[i].iscn, sym, cfg, val);
+	for (i = 0; i < iscn->nbatch; i++)
+	    zbar_image_scanner_set_config(iscn->batch[i].iscn, sym, cfg, val);
+    }
+
     if ((sym == 0 || sym == ZBAR_COMPOSITE) && cfg == ZBAR_CFG_ENABLE) {
 	iscn->ean_config = !!val;
 	if (sym)
@@ -592,7 +1027,7 @@ int zbar_image_scanner_set_config(zbar_image_scanner_t *iscn,
 	return (zbar_decoder_set_config(iscn->dcode, sym, cfg, val));
 
     if (cfg < ZBAR_CFG_POSITION) {
-	int c, i;
+	int c;
 	if (cfg > ZBAR_CFG_UNCERTAINTY)
 	    return (1);
 	c = cfg - ZBAR_CFG_UNCERTAINTY;
@@ -609,7 +1044,12 @@ int zbar_image_scanner_set_config(zbar_image_scanner_t *iscn,
     if (sym > ZBAR_PARTIAL)
 	return (1);
 
-    if (cfg >= ZBAR_CFG_X_DENSITY && cfg <= ZBAR_CFG_Y_DENSITY) {
+    if (cfg >= ZBAR_CFG_X_DENSITY && cfg <= ZBAR_CFG_JPEG_SCALE) {
+	if (!scan_config_valid(cfg, val))
+	    return (1);
+	if (cfg == ZBAR_CFG_THREADS && CFG(iscn, cfg) != val)
+	    /* reallocated by next scan */
+	    scan_bands_free(iscn);
 	CFG(iscn, cfg) = val;
 	return (0);
     }
@@ -657,7 +1097,7 @@ int zbar_image_scanner_get_config(zbar_image_scanner_t *iscn,
 	return 0;
     }
 
-    if (cfg <= ZBAR_CFG_Y_DENSITY) {
+    if (cfg <= ZBAR_CFG_JPEG_SCALE) {
 	*val = CFG(iscn, cfg);
 	return 0;
     }
@@ -667,11 +1107,8 @@ int zbar_image_scanner_get_config(zbar_image_scanner_t *iscn,
 
 void zbar_image_scanner_enable_cache(zbar_image_scanner_t *iscn, int enable)
 {
-    if (iscn->cache) {
-	/* recycle all cached syms */
-	_zbar_image_scanner_recycle_syms(iscn, iscn->cache);
-	iscn->cache = NULL;
-    }
+    /* recycle all cached syms */
+    cache_flush(iscn);
     iscn->enable_cache = (enable) ? 1 : 0;
 }
 
@@ -681,6 +1118,13 @@ zbar_image_scanner_get_results(const zbar_image_scanner_t *iscn)
     return (iscn->syms);
 }
 
+extern zbar_symbol_type_t _zbar_scanner_decode_edges(zbar_scanner_t *,
+						     zbar_decoder_t *,
+						     const zbar_edge_t *,
+						     unsigned);
+extern zbar_symbol_type_t _zbar_scanner_decode_inverted(zbar_scanner_t *,
+							zbar_decoder_t *);
+
 static inline void quiet_border(zbar_image_scanner_t *iscn)
 {
     /* flush scanner pipeline */
@@ -688,6 +1132,17 @@ static inline void quiet_border(zbar_image_scanner_t *iscn)
     zbar_scanner_flush(scn);
     zbar_scanner_flush(scn);
     zbar_scanner_new_scan(scn);
+
+    if (iscn->inverted) {
+	/* decode the line edges in both polarities */
+	const zbar_edge_t *edges;
+	unsigned n = zbar_scanner_get_edges(scn, &edges);
+	_zbar_scanner_decode_edges(scn, iscn->dcode, edges, n);
+	zbar_decoder_new_scan(iscn->dcode);
+
+	_zbar_scanner_decode_inverted(scn, iscn->dcode_inv);
+	zbar_decoder_new_scan(iscn->dcode_inv);
+    }
 }
 
 #ifdef HAVE_DBUS
@@ -858,27 +1313,447 @@ static void zbar_send_code_via_dbus(zbar_image_scanner_t *iscn,
 }
 #endif
 
-#define movedelta(dx, dy)                \
-    do {                                 \
-	x += (dx);                       \
-	y += (dy);                       \
-	p += (dx) + ((uintptr_t)(dy)*w); \
+/* columns transposed at once for the vertical pass */
+#define SCAN_STRIP_COLS 32
+
+#define movedelta(dx, dy)                          \
+    do {                                           \
+	x += (dx);                                 \
+	y += (dy);                                 \
+	p += (dx)*step + ((uintptr_t)(dy)*stride); \
     } while (0);
 
+/* offset of the first scan line, centering the lines in the crop area */
+static inline int scan_border(int len, int density)
+{
+    int border = (((len - 1) % density) + 1) / 2;
+    if (border > len / 2)
+	border = len / 2;
+    return (border);
+}
+
+/* density of the scan lines across an image that was decoded at reduced
+ * size, so that they fall on the lines scanned at full size
+ */
+static inline int scan_density(const zbar_image_scanner_t *iscn,
+			       const zbar_image_t *img, zbar_config_t cfg)
+{
+    int density = CFG(iscn, cfg);
+    int scale	= img->scale;
+    if (density > 0 && scale > 1)
+	density = (density > scale) ? density / scale : 1;
+    return (density);
+}
+
+/* map the locations of symbols found in an image that was decoded at
+ * reduced size to the centers of the matching full size pixels
+ */
+static void scan_scale_points(zbar_symbol_t *sym, int scale)
+{
+    for (; sym; sym = sym->next) {
+	unsigned i;
+	for (i = 0; i < sym->npts; i++) {
+	    sym->pts[i].x = sym->pts[i].x * scale + scale / 2;
+	    sym->pts[i].y = sym->pts[i].y * scale + scale / 2;
+	}
+	if (sym->syms)
+	    scan_scale_points(sym->syms->head, scale);
+    }
+}
+
+/* scan rows from y up to (not including) cy1, alternating direction
+ * starting left to right (or right to left if rev is set)
+ */
+static void scan_rows(zbar_image_scanner_t *iscn, const zbar_image_t *img,
+		      int y, int cy1, int density, int rev)
+{
+    zbar_scanner_t *scn = iscn->scn;
+    int cx0 = img->crop_x, cx1 = img->crop_x + img->crop_w;
+    int x		= (rev) ? cx1 - 1 : cx0;
+    int n, step;
+    const uint8_t *data, *p;
+    unsigned stride;
+    zbar_luma_t luma;
+
+    /* format already checked by _zbar_scan_image() */
+    _zbar_image_luma(img, &luma);
+    data   = luma.data;
+    step   = luma.step;
+    stride = luma.stride;
+    p	   = data + x * step + y * (intptr_t)stride;
+
+    iscn->dy = 0;
+    iscn->v  = y;
+    while (y < cy1) {
+	if (!rev) {
+	    zprintf(128, "img_x+: %04d,%04d @%p\n", x, y, p);
+	    svg_path_start("vedge", 1. / 32, 0, y + 0.5);
+	    iscn->dx = iscn->du = 1;
+	    iscn->umin		= cx0;
+	    n = cx1 - x;
+	    zbar_scan_row(scn, p, n, step);
+	    movedelta(n, 0);
+	    ASSERT_POS;
+	    quiet_border(iscn);
+	    svg_path_end();
+
+	    movedelta(-1, density);
+	} else {
+	    zprintf(128, "img_x-: %04d,%04d @%p\n", x, y, p);
+	    svg_path_start("vedge", -1. / 32, img->width, y + 0.5);
+	    iscn->dx = iscn->du = -1;
+	    iscn->umin		= cx1;
+	    n = x - cx0 + 1;
+	    zbar_scan_row(scn, p, n, -step);
+	    movedelta(-n, 0);
+	    ASSERT_POS;
+	    quiet_border(iscn);
+	    svg_path_end();
+
+	    movedelta(1, density);
+	}
+	iscn->v = y;
+	rev	= !rev;
+    }
+}
+
+/* gather up to ncols columns, density apart starting at x, into
+ * consecutive rows of the strip buffer.  returns NULL if no buffer
+ */
+static const uint8_t *scan_strip(zbar_image_scanner_t *iscn,
+				 const zbar_image_t *img,
+				 const zbar_luma_t *luma, int x, int ncols,
+				 int density)
+{
+    unsigned w = luma->stride, h = img->crop_h;
+    const uint8_t *p = luma->data + x * luma->step + img->crop_y * w;
+    int dx	     = density * luma->step;
+    uint8_t *strip;
+    int y, i;
+
+    if (iscn->strip_size < ncols * h) {
+	if (iscn->strip)
+	    free(iscn->strip);
+	iscn->strip_size = SCAN_STRIP_COLS * h;
+	iscn->strip	 = malloc(iscn->strip_size);
+	if (!iscn->strip) {
+	    iscn->strip_size = 0;
+	    return (NULL);
+	}
+    }
+
+    /* read image rows sequentially, each only once per strip */
+    strip = iscn->strip;
+    for (y = 0; y < h; y++, p += w)
+	for (i = 0; i < ncols; i++)
+	    strip[i * h + y] = p[i * dx];
+    return (strip);
+}
+
+/* scan columns from x up to (not including) cx1, alternating direction
+ * starting top to bottom (or bottom to top if rev is set).
+ * columns are transposed in strips to avoid walking the image with
+ * a stride of a whole row
+ */
+static void scan_cols(zbar_image_scanner_t *iscn, const zbar_image_t *img,
+		      int x, int cx1, int density, int rev)
+{
+    zbar_scanner_t *scn = iscn->scn;
+    int cy0 = img->crop_y, cy1 = img->crop_y + img->crop_h;
+    int h		  = img->crop_h;
+    const uint8_t *strip  = NULL;
+    int ncols = 0, i = 0;
+    zbar_luma_t luma;
+
+    _zbar_image_luma(img, &luma);
+    iscn->dx = 0;
+    iscn->v  = x;
+    while (x < cx1) {
+	const uint8_t *p;
+	int step;
+	if (i == ncols) {
+	    /* transpose next strip */
+	    ncols = (cx1 - x + density - 1) / density;
+	    if (ncols > SCAN_STRIP_COLS)
+		ncols = SCAN_STRIP_COLS;
+	    strip = scan_strip(iscn, img, &luma, x, ncols, density);
+	    i	  = 0;
+	}
+	if (strip) {
+	    p	 = strip + i * h;
+	    step = 1;
+	} else {
+	    p	 = luma.data + x * luma.step + cy0 * luma.stride;
+	    step = luma.stride;
+	}
+	i++;
+
+	if (!rev) {
+	    zprintf(128, "img_y+: %04d,%04d @%p\n", x, cy0, p);
+	    svg_path_start("vedge", 1. / 32, 0, x + 0.5);
+	    iscn->dy = iscn->du = 1;
+	    iscn->umin		= cy0;
+	    zbar_scan_row(scn, p, h, step);
+	} else {
+	    zprintf(128, "img_y-: %04d,%04d @%p\n", x, cy1 - 1, p);
+	    svg_path_start("vedge", -1. / 32, img->height, x + 0.5);
+	    iscn->dy = iscn->du = -1;
+	    iscn->umin		= cy1;
+	    zbar_scan_row(scn, p + (h - 1) * step, h, -step);
+	}
+	quiet_border(iscn);
+	svg_path_end();
+
+	x += density;
+	iscn->v = x;
+	rev	= !rev;
+    }
+}
+
+/* divide the scan lines from start to end into (at most) nsplit bands
+ * of consecutive lines.  returns the number of bands
+ */
+static int scan_bands_split(scan_band_t *band, int vert, int start, int end,
+			    int density, int nsplit)
+{
+    int i, nlines;
+    if (density <= 0 || start >= end)
+	return (0);
+    nlines = (end - start + density - 1) / density;
+    if (nsplit > nlines)
+	nsplit = nlines;
+    for (i = 0; i < nsplit; i++) {
+	int l0	    = nlines * i / nsplit;
+	int l1	    = nlines * (i + 1) / nsplit;
+	band->vert  = vert;
+	band->start = start + l0 * density;
+	band->end   = (i + 1 < nsplit) ? start + l1 * density : end;
+	/* preserve the serial zig-zag order */
+	band->rev    = l0 & 1;
+	band->warmup = (l0 > 0);
+	band++;
+    }
+    return (nsplit);
+}
+
+/* pool job: scan one band with its private scanner */
+static void scan_band(void *arg, int i, int slot)
+{
+    zbar_image_scanner_t *iscn = arg;
+    const scan_band_t *band    = &iscn->bands[i];
+    zbar_image_scanner_t *bscn = band->iscn;
+    unsigned long long start   = _zbar_timer_now_ns();
+
+    bscn->time = iscn->time;
+#if ENABLE_QRCODE == 1
+    _zbar_qr_reset(bscn->qr);
+#endif
+    zbar_scanner_new_scan(bscn->scn);
+    scan_polarity_init(bscn);
+
+    if (!band->vert) {
+	int density = scan_density(iscn, iscn->img, ZBAR_CFG_Y_DENSITY);
+	if (band->warmup) {
+	    /* symbols may span scan lines (eg, EAN halves) */
+	    bscn->discard = 1;
+	    scan_rows(bscn, iscn->img, band->start - density, band->start,
+		      density, !band->rev);
+	    bscn->discard = 0;
+	}
+	scan_rows(bscn, iscn->img, band->start, band->end, density, band->rev);
+	bscn->dx = 0;
+    } else {
+	int density = scan_density(iscn, iscn->img, ZBAR_CFG_X_DENSITY);
+	if (band->warmup) {
+	    bscn->discard = 1;
+	    scan_cols(bscn, iscn->img, band->start - density, band->start,
+		      density, !band->rev);
+	    bscn->discard = 0;
+	}
+	scan_cols(bscn, iscn->img, band->start, band->end, density, band->rev);
+	bscn->dy = 0;
+    }
+    scan_stage_done(bscn, (band->vert) ? ZBAR_STAGE_VSCAN : ZBAR_STAGE_HSCAN,
+		    start);
+}
+
+/* results are stacked, restore discovery order */
+static zbar_symbol_t *sym_list_reverse(zbar_symbol_t *sym)
+{
+    zbar_symbol_t *next, *prev = NULL;
+    for (; sym; sym = next) {
+	next	  = sym->next;
+	sym->next = prev;
+	prev	  = sym;
+    }
+    return (prev);
+}
+
+/* find a symbol with the same type and data in a list */
+static zbar_symbol_t *sym_list_find(zbar_symbol_t *dup,
+				    const zbar_symbol_t *sym)
+{
+    for (; dup; dup = dup->next)
+	if (dup->type == sym->type && dup->datalen == sym->datalen &&
+	    !memcmp(dup->data, sym->data, sym->datalen))
+	    break;
+    return (dup);
+}
+
+/* add the reads of a band symbol to the same symbol in a list, or
+ * return a copy of it from the main scanner's pool
+ */
+static zbar_symbol_t *scan_band_merge_sym(zbar_image_scanner_t *iscn,
+					  zbar_symbol_t *head,
+					  const zbar_symbol_t *sym)
+{
+    zbar_symbol_t *dup = sym_list_find(head, sym);
+    unsigned i;
+
+    if (dup) {
+	/* same symbol seen by an earlier band */
+	dup->quality += sym->quality;
+	for (i = 0; i < sym->npts; i++)
+	    sym_add_point(dup, sym->pts[i].x, sym->pts[i].y);
+	return (NULL);
+    }
+
+    dup		   = _zbar_image_scanner_alloc_sym(iscn, sym->type,
+						   sym->datalen + 1);
+    dup->configs   = sym->configs;
+    dup->modifiers = sym->modifiers;
+    dup->orient	   = sym->orient;
+    dup->quality   = sym->quality;
+    memcpy(dup->data, sym->data, sym->datalen + 1);
+    for (i = 0; i < sym->npts; i++)
+	sym_add_point(dup, sym->pts[i].x, sym->pts[i].y);
+    return (dup);
+}
+
+/* move band results into the main scanner as if they had been found
+ * by a serial scan
+ */
+static void scan_band_merge(zbar_image_scanner_t *iscn, scan_band_t *band)
+{
+    zbar_image_scanner_t *bscn = band->iscn;
+    zbar_symbol_set_t *bsyms   = bscn->syms;
+    zbar_symbol_t *sym, *dup;
+
+#if ENABLE_QRCODE == 1
+    _zbar_qr_merge_lines(iscn->qr, bscn->qr);
+    if (iscn->inverted && bscn->inverted)
+	_zbar_qr_merge_lines(iscn->qr_inv, bscn->qr_inv);
+#endif
+
+    bsyms->head = sym_list_reverse(bsyms->head);
+    for (sym = bsyms->head; sym; sym = sym->next)
+	if ((dup = scan_band_merge_sym(iscn, iscn->syms->head, sym)))
+	    _zbar_image_scanner_add_sym(iscn, dup);
+
+    _zbar_image_scanner_recycle_syms(bscn, bsyms->head);
+    bsyms->head = bsyms->tail = NULL;
+    bsyms->nsyms	      = 0;
+
+    /* inverted reads stay apart until scan_inverted_merge() */
+    bscn->inv_syms = sym_list_reverse(bscn->inv_syms);
+    for (sym = bscn->inv_syms; sym; sym = sym->next)
+	if ((dup = scan_band_merge_sym(iscn, iscn->inv_syms, sym))) {
+	    dup->next	   = iscn->inv_syms;
+	    iscn->inv_syms = dup;
+	}
+    _zbar_image_scanner_recycle_syms(bscn, bscn->inv_syms);
+    bscn->inv_syms = NULL;
+
+    scan_stats_merge(iscn, bscn);
+}
+
+/* scan both axes in parallel bands.
+ * returns -1 if too few band scanners could be allocated
+ */
+static int scan_image_bands(zbar_image_scanner_t *iscn, zbar_image_t *img)
+{
+    int nthreads = CFG(iscn, ZBAR_CFG_THREADS);
+    int nbands = 0, density, i;
+
+    if (scan_bands_alloc(iscn, nthreads) < nthreads * 2)
+	nthreads = iscn->nbands / 2;
+    if (nthreads < 2)
+	return (-1);
+
+    density = scan_density(iscn, img, ZBAR_CFG_Y_DENSITY);
+    if (density > 0)
+	nbands += scan_bands_split(
+	    iscn->bands + nbands, 0,
+	    img->crop_y + scan_border(img->crop_h, density),
+	    img->crop_y + img->crop_h, density, nthreads);
+
+    density = scan_density(iscn, img, ZBAR_CFG_X_DENSITY);
+    if (density > 0)
+	nbands += scan_bands_split(
+	    iscn->bands + nbands, 1,
+	    img->crop_x + scan_border(img->crop_w, density),
+	    img->crop_x + img->crop_w, density, nthreads);
+
+    _zbar_pool_run(iscn->pool, scan_band, iscn, nbands);
+
+    for (i = 0; i < nbands; i++)
+	scan_band_merge(iscn, &iscn->bands[i]);
+    return (0);
+}
+
+/* report the 1D symbols read from inverted edges.  one also read
+ * normally is reported once, with the reads of the polarity that saw
+ * it more often, so stray reads of a normal symbol by the inverted
+ * decoder (or the reverse) never change its quality or location
+ */
+static void scan_inverted_merge(zbar_image_scanner_t *iscn)
+{
+    zbar_symbol_t *sym, *next;
+
+    sym		   = sym_list_reverse(iscn->inv_syms);
+    iscn->inv_syms = NULL;
+    for (; sym; sym = next) {
+	zbar_symbol_t *dup = sym_list_find(iscn->syms->head, sym);
+	next		   = sym->next;
+	sym->next	   = NULL;
+	if (!dup) {
+	    _zbar_image_scanner_add_sym(iscn, sym);
+	    continue;
+	}
+	if (sym->quality > dup->quality) {
+	    /* the inverted reads win: swap them into the reported symbol */
+	    point_t *pts       = dup->pts;
+	    unsigned pts_alloc = dup->pts_alloc;
+	    dup->pts	       = sym->pts;
+	    dup->pts_alloc     = sym->pts_alloc;
+	    dup->npts	       = sym->npts;
+	    sym->pts	       = pts;
+	    sym->pts_alloc     = pts_alloc;
+	    dup->configs       = sym->configs;
+	    dup->modifiers     = sym->modifiers;
+	    dup->orient	       = sym->orient;
+	    dup->quality       = sym->quality;
+	}
+	_zbar_image_scanner_recycle_syms(iscn, sym);
+    }
+}
+
 static void *_zbar_scan_image(zbar_image_scanner_t *iscn, zbar_image_t *img)
 {
     zbar_symbol_set_t *syms;
-    const uint8_t *data;
     zbar_scanner_t *scn = iscn->scn;
+    zbar_luma_t luma;
     unsigned w, h, cx1, cy1;
     int density;
     char filter;
     int nean, naddon;
+    unsigned long long start;
 
     /* timestamp image
      * FIXME prefer video timestamp
      */
     iscn->time = _zbar_timer_now();
+    memset(iscn->stats.last_ns, 0, sizeof(iscn->stats.last_ns));
 
 #if ENABLE_QRCODE == 1
     _zbar_qr_reset(iscn->qr);
@@ -888,9 +1763,11 @@ static void *_zbar_scan_image(zbar_image_scanner_t *iscn, zbar_image_t *img)
     _zbar_sq_reset(iscn->sq);
 #endif
 
-    /* image must be in grayscale format */
-    if (img->format != fourcc('Y', '8', '0', '0') &&
-	img->format != fourcc('G', 'R', 'E', 'Y'))
+    /* luminance must be readable in place */
+    if (_zbar_image_luma(img, &luma))
+	return NULL;
+    /* lines may be padded, but not overlap */
+    if (luma.stride < img->width * luma.step)
 	return NULL;
     iscn->img = img;
 
@@ -911,139 +1788,62 @@ static void *_zbar_scan_image(zbar_image_scanner_t *iscn, zbar_image_t *img)
     assert(cx1 <= w);
     cy1 = img->crop_y + img->crop_h;
     assert(cy1 <= h);
-    data = img->data;
 
     zbar_image_write_png(img, "debug.png");
     svg_open("debug.svg", 0, 0, w, h);
     svg_image("debug.png", w, h);
 
     zbar_scanner_new_scan(scn);
-
-    density = CFG(iscn, ZBAR_CFG_Y_DENSITY);
-    if (density > 0) {
-	const uint8_t *p = data;
-	int x = 0, y = 0;
-
-	int border = (((img->crop_h - 1) % density) + 1) / 2;
-	if (border > img->crop_h / 2)
-	    border = img->crop_h / 2;
-	border += img->crop_y;
-	assert(border <= h);
-	svg_group_start("scanner", 0, 1, 1, 0, 0);
-	iscn->dy = 0;
-
-	movedelta(img->crop_x, border);
-	iscn->v = y;
-
-	while (y < cy1) {
-	    int cx0 = img->crop_x;
-	    ;
-	    zprintf(128, "img_x+: %04d,%04d @%p\n", x, y, p);
-	    svg_path_start("vedge", 1. / 32, 0, y + 0.5);
-	    iscn->dx = iscn->du = 1;
-	    iscn->umin		= cx0;
-	    while (x < cx1) {
-		uint8_t d = *p;
-		movedelta(1, 0);
-		zbar_scan_y(scn, d);
-	    }
-	    ASSERT_POS;
-	    quiet_border(iscn);
-	    svg_path_end();
-
-	    movedelta(-1, density);
-	    iscn->v = y;
-	    if (y >= cy1)
-		break;
-
-	    zprintf(128, "img_x-: %04d,%04d @%p\n", x, y, p);
-	    svg_path_start("vedge", -1. / 32, w, y + 0.5);
-	    iscn->dx = iscn->du = -1;
-	    iscn->umin		= cx1;
-	    while (x >= cx0) {
-		uint8_t d = *p;
-		movedelta(-1, 0);
-		zbar_scan_y(scn, d);
-	    }
-	    ASSERT_POS;
-	    quiet_border(iscn);
-	    svg_path_end();
-
-	    movedelta(1, density);
-	    iscn->v = y;
+    scan_polarity_init(iscn);
+
+    if (CFG(iscn, ZBAR_CFG_THREADS) < 2 || scan_image_bands(iscn, img)) {
+	start	= _zbar_timer_now_ns();
+	density = scan_density(iscn, img, ZBAR_CFG_Y_DENSITY);
+	if (density > 0) {
+	    int border = img->crop_y + scan_border(img->crop_h, density);
+	    assert(border <= h);
+	    svg_group_start("scanner", 0, 1, 1, 0, 0);
+	    scan_rows(iscn, img, border, cy1, density, 0);
+	    svg_group_end();
 	}
-	svg_group_end();
-    }
-    iscn->dx = 0;
-
-    density = CFG(iscn, ZBAR_CFG_X_DENSITY);
-    if (density > 0) {
-	const uint8_t *p = data;
-	int x = 0, y = 0;
-
-	int border = (((img->crop_w - 1) % density) + 1) / 2;
-	if (border > img->crop_w / 2)
-	    border = img->crop_w / 2;
-	border += img->crop_x;
-	assert(border <= w);
-	svg_group_start("scanner", 90, 1, -1, 0, 0);
-	movedelta(border, img->crop_y);
-	iscn->v = x;
-
-	while (x < cx1) {
-	    int cy0 = img->crop_y;
-	    zprintf(128, "img_y+: %04d,%04d @%p\n", x, y, p);
-	    svg_path_start("vedge", 1. / 32, 0, x + 0.5);
-	    iscn->dy = iscn->du = 1;
-	    iscn->umin		= cy0;
-	    while (y < cy1) {
-		uint8_t d = *p;
-		movedelta(0, 1);
-		zbar_scan_y(scn, d);
-	    }
-	    ASSERT_POS;
-	    quiet_border(iscn);
-	    svg_path_end();
-
-	    movedelta(density, -1);
-	    iscn->v = x;
-	    if (x >= cx1)
-		break;
-
-	    zprintf(128, "img_y-: %04d,%04d @%p\n", x, y, p);
-	    svg_path_start("vedge", -1. / 32, h, x + 0.5);
-	    iscn->dy = iscn->du = -1;
-	    iscn->umin		= cy1;
-	    while (y >= cy0) {
-		uint8_t d = *p;
-		movedelta(0, -1);
-		zbar_scan_y(scn, d);
-	    }
-	    ASSERT_POS;
-	    quiet_border(iscn);
-	    svg_path_end();
-
-	    movedelta(density, 1);
-	    iscn->v = x;
+	iscn->dx = 0;
+	start	 = scan_stage_done(iscn, ZBAR_STAGE_HSCAN, start);
+
+	density = scan_density(iscn, img, ZBAR_CFG_X_DENSITY);
+	if (density > 0) {
+	    int border = img->crop_x + scan_border(img->crop_w, density);
+	    assert(border <= w);
+	    svg_group_start("scanner", 90, 1, -1, 0, 0);
+	    scan_cols(iscn, img, border, cx1, density, 0);
+	    svg_group_end();
 	}
-	svg_group_end();
+	scan_stage_done(iscn, ZBAR_STAGE_VSCAN, start);
     }
+    scan_inverted_merge(iscn);
+    density   = scan_density(iscn, img, ZBAR_CFG_X_DENSITY);
     iscn->dy  = 0;
     iscn->img = NULL;
 
 #if ENABLE_QRCODE == 1
-    _zbar_qr_decode(iscn->qr, iscn, img);
+    _zbar_qr_decode(iscn->qr, iscn, img, 0);
+    if (iscn->inverted)
+	_zbar_qr_decode(iscn->qr_inv, iscn, img, 1);
 #endif
 
 #if ENABLE_SQCODE == 1
+    start = _zbar_timer_now_ns();
     sq_handler(iscn);
-    _zbar_sq_decode(iscn->sq, iscn, img);
+    _zbar_sq_decode(iscn->sq, iscn, img, 0);
+    if (iscn->inverted)
+	_zbar_sq_decode(iscn->sq, iscn, img, 1);
+    scan_stage_done(iscn, ZBAR_STAGE_SQ_DECODE, start);
 #endif
 
     /* FIXME tmp hack to filter bad EAN results */
     /* FIXME tmp hack to merge simple case EAN add-ons */
     filter = (!iscn->enable_cache &&
-	      (density == 1 || CFG(iscn, ZBAR_CFG_Y_DENSITY) == 1));
+	      (density == 1 ||
+	       scan_density(iscn, img, ZBAR_CFG_Y_DENSITY) == 1));
     nean   = 0;
     naddon = 0;
     if (syms->nsyms) {
@@ -1107,7 +1907,7 @@ static void *_zbar_scan_image(zbar_image_scanner_t *iscn, zbar_image_t *img)
 	    ean_sym =
 		_zbar_image_scanner_alloc_sym(iscn, ZBAR_COMPOSITE, datalen);
 	    ean_sym->orient = ean->orient;
-	    ean_sym->syms   = _zbar_symbol_set_create();
+	    ean_sym->syms   = _zbar_image_scanner_alloc_syms(iscn);
 	    memcpy(ean_sym->data, ean->data, ean->datalen);
 	    memcpy(ean_sym->data + ean->datalen, addon->data,
 		   addon->datalen + 1);
@@ -1117,31 +1917,24 @@ static void *_zbar_scan_image(zbar_image_scanner_t *iscn, zbar_image_t *img)
 	    _zbar_image_scanner_add_sym(iscn, ean_sym);
 	}
     }
+
+    if (img->scale > 1)
+	scan_scale_points(syms->head, img->scale);
+
+    iscn->stats.frames++;
+    iscn->stats.symbols += syms->nsyms;
+    scan_stats_collect(iscn);
     return syms;
 }
 
 int zbar_scan_image(zbar_image_scanner_t *iscn, zbar_image_t *img)
 {
     zbar_symbol_set_t *syms;
-    zbar_image_t *inv = NULL;
 
     syms = _zbar_scan_image(iscn, img);
     if (!syms)
 	return -1;
 
-    if (!syms->nsyms && TEST_CFG(iscn, ZBAR_CFG_TEST_INVERTED)) {
-	inv = _zbar_image_copy(img, 1);
-	if (inv) {
-	    if (iscn->cache) {
-		/* recycle all cached syms, if any */
-		_zbar_image_scanner_recycle_syms(iscn, iscn->cache);
-		iscn->cache = NULL;
-	    }
-	    syms = _zbar_scan_image(iscn, inv);
-	    _zbar_image_swap_symbols(img, inv);
-	}
-    }
-
     if (syms->nsyms && iscn->handler)
 	iscn->handler(img, iscn->userdata);
 #ifdef HAVE_DBUS
@@ -1151,12 +1944,67 @@ int zbar_scan_image(zbar_image_scanner_t *iscn, zbar_image_t *img)
 
     svg_close();
 
-    if (inv)
-	zbar_image_destroy(inv);
-
     return (syms->nsyms);
 }
 
+/* pool job: scan one image of a batch with the calling thread's scanner */
+static void scan_batch(void *arg, int i, int slot)
+{
+    zbar_image_scanner_t *iscn = arg;
+    scan_batch_t *batch	       = &iscn->batch[slot];
+    int n		       = zbar_scan_image(batch->iscn,
+						 iscn->batch_images[i]);
+    if (n < 0)
+	batch->err++;
+    else
+	batch->nsyms += n;
+}
+
+int zbar_scan_images(zbar_image_scanner_t *iscn, zbar_image_t **images,
+		     int nimages, int nthreads)
+{
+    int i, nsyms = 0, err = 0;
+    if (nimages <= 0)
+	return (0);
+    if (nthreads < 1)
+	nthreads = 1;
+    if (nthreads > nimages)
+	nthreads = nimages;
+
+    nthreads = scan_batch_alloc(iscn, nthreads);
+    if (nthreads < 1)
+	return (-1);
+
+    for (i = 0; i < nthreads; i++) {
+	scan_batch_t *batch    = &iscn->batch[i];
+	batch->iscn->handler  = iscn->handler;
+	batch->iscn->userdata = iscn->userdata;
+	batch->nsyms	      = 0;
+	batch->err	      = 0;
+    }
+
+    iscn->batch_images = images;
+    _zbar_pool_run(iscn->batch_pool, scan_batch, iscn, nimages);
+    iscn->batch_images = NULL;
+
+    memset(iscn->stats.last_ns, 0, sizeof(iscn->stats.last_ns));
+    for (i = 0; i < nthreads; i++) {
+	nsyms += iscn->batch[i].nsyms;
+	err += iscn->batch[i].err;
+	scan_stats_merge(iscn, iscn->batch[i].iscn);
+    }
+    return ((err) ? -1 : nsyms);
+}
+
+int zbar_image_scanner_get_stats(const zbar_image_scanner_t *iscn,
+				 zbar_image_scanner_stats_t *stats)
+{
+    if (!stats)
+	return (1);
+    *stats = iscn->stats;
+    return (0);
+}
+
 int zbar_image_scanner_request_dbus(zbar_image_scanner_t *scanner,
 				    int req_dbus_enabled)
 {
@@ -29,9 +29,15 @@
 
 extern zbar_symbol_t *_zbar_image_scanner_alloc_sym(zbar_image_scanner_t *,
 						    zbar_symbol_type_t, int);
+extern zbar_symbol_set_t *
+_zbar_image_scanner_alloc_syms(zbar_image_scanner_t *);
 extern void _zbar_image_scanner_add_sym(zbar_image_scanner_t *,
 					zbar_symbol_t *);
 extern void _zbar_image_scanner_recycle_syms(zbar_image_scanner_t *,
 					     zbar_symbol_t *);
 
+/* account time spent in a processing stage */
+extern void _zbar_image_scanner_add_time(zbar_image_scanner_t *,
+					 zbar_scan_stage_t, unsigned long long);
+
 #endif
@@ -193,9 +193,16 @@ void _zbar_convert_jpeg_to_y(zbar_image_t *dst, const zbar_format_def_t *dstfmt,
      */
     cinfo->out_color_space = JCS_GRAYSCALE;
 
-    /* FIXME set scaling based on dst->{width,height}
-     * then pass bigger buffer...
+    /* when a smaller image is asked for, let the IDCT reduce the size
+     * by 1/2 or 1/4 instead of decoding it all
      */
+    cinfo->scale_num   = 1;
+    cinfo->scale_denom = 1;
+    while (cinfo->scale_denom < 4 && dst->width && dst->height &&
+	   cinfo->image_width >= dst->width * cinfo->scale_denom * 2 &&
+	   cinfo->image_height >= dst->height * cinfo->scale_denom * 2)
+	cinfo->scale_denom *= 2;
+    dst->scale = cinfo->scale_denom;
 
     jpeg_start_decompress(cinfo);
 
@@ -213,9 +220,9 @@ void _zbar_convert_jpeg_to_y(zbar_image_t *dst, const zbar_format_def_t *dstfmt,
     unsigned long datalen = (cinfo->output_width * cinfo->output_height *
 			     cinfo->out_color_components);
 
-    zprintf(24, "dst=%dx%d %lx src=%dx%d %lx dct=%x\n", dst->width, dst->height,
-	    dst->datalen, src->width, src->height, src->datalen,
-	    cinfo->dct_method);
+    zprintf(24, "dst=%dx%d %lx src=%dx%d %lx dct=%x scale=1/%d\n", dst->width,
+	    dst->height, dst->datalen, src->width, src->height, src->datalen,
+	    cinfo->dct_method, cinfo->scale_denom);
     if (!dst->data) {
 	dst->datalen = datalen;
 	dst->data    = malloc(dst->datalen);
@@ -0,0 +1,170 @@
+/*------------------------------------------------------------------------
+ *  This file is part of the ZBar Bar Code Reader.
+ *
+ *  The ZBar Bar Code Reader is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Lesser Public License as
+ *  published by the Free Software Foundation; either version 2.1 of
+ *  the License, or (at your option) any later version.
+ *
+ *  The ZBar Bar Code Reader is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ *  of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser Public License
+ *  along with the ZBar Bar Code Reader; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301  USA
+ *
+ *  http://sourceforge.net/projects/zbar
+ *------------------------------------------------------------------------*/
+
+#include "config.h"
+#include <stdlib.h> /* calloc, free */
+
+#include "error.h"
+#include "event.h"
+#include "mutex.h"
+#include "pool.h"
+#include "thread.h"
+
+typedef struct pool_worker_s {
+    zbar_pool_t *pool;	  /* owning pool */
+    zbar_thread_t thread; /* worker thread state */
+} pool_worker_t;
+
+struct zbar_pool_s {
+    zbar_mutex_t mutex;	    /* shared state lock */
+    zbar_event_t done;	    /* batch completion notification */
+    int nworkers;	    /* number of running workers */
+    pool_worker_t *workers; /* worker thread states */
+
+    /* current batch */
+    zbar_pool_job_t *job; /* job callback */
+    void *arg;		  /* job callback argument */
+    int njobs, next;	  /* total and next unclaimed job */
+    int busy;		  /* workers that have not finished the batch */
+    unsigned batch;	  /* batch sequence number */
+};
+
+#ifdef HAVE_THREADS
+
+/* claim and run jobs until the batch is exhausted.  lock must be held */
+static void pool_work(zbar_pool_t *pool, int slot)
+{
+    while (pool->next < pool->njobs) {
+	int job = pool->next++;
+	_zbar_mutex_unlock(&pool->mutex);
+	pool->job(pool->arg, job, slot);
+	_zbar_mutex_lock(&pool->mutex);
+    }
+}
+
+static ZTHREAD pool_thread(void *arg)
+{
+    pool_worker_t *worker = arg;
+    zbar_pool_t *pool	  = worker->pool;
+    zbar_thread_t *thread = &worker->thread;
+    unsigned batch;
+
+    _zbar_mutex_lock(&pool->mutex);
+    _zbar_thread_init(thread);
+    batch = pool->batch;
+
+    while (thread->started) {
+	if (batch == pool->batch) {
+	    _zbar_event_wait(&thread->notify, &pool->mutex, NULL);
+	    continue;
+	}
+	batch = pool->batch;
+	pool_work(pool, worker - pool->workers + 1);
+	if (!--pool->busy)
+	    _zbar_event_trigger(&pool->done);
+    }
+
+    thread->running = 0;
+    _zbar_event_trigger(&thread->activity);
+    _zbar_mutex_unlock(&pool->mutex);
+    return (0);
+}
+
+#endif
+
+zbar_pool_t *_zbar_pool_create(int nthreads)
+{
+    zbar_pool_t *pool = calloc(1, sizeof(zbar_pool_t));
+    if (!pool)
+	return (NULL);
+
+#ifdef HAVE_THREADS
+    if (nthreads > 0 && !_zbar_mutex_init(&pool->mutex)) {
+	int i;
+	_zbar_event_init(&pool->done);
+	pool->workers = calloc(nthreads, sizeof(pool_worker_t));
+	for (i = 0; pool->workers && i < nthreads; i++) {
+	    pool_worker_t *worker = &pool->workers[pool->nworkers];
+	    worker->pool	  = pool;
+	    if (_zbar_thread_start(&worker->thread, pool_thread, worker,
+				   &pool->mutex)) {
+		zprintf(1, "unable to start pool thread %d\n", i);
+		break;
+	    }
+	    pool->nworkers++;
+	}
+    }
+#endif
+    return (pool);
+}
+
+void _zbar_pool_destroy(zbar_pool_t *pool)
+{
+    if (!pool)
+	return;
+#ifdef HAVE_THREADS
+    if (pool->workers) {
+	int i;
+	_zbar_mutex_lock(&pool->mutex);
+	for (i = 0; i < pool->nworkers; i++)
+	    _zbar_thread_stop(&pool->workers[i].thread, &pool->mutex);
+	_zbar_mutex_unlock(&pool->mutex);
+	free(pool->workers);
+	_zbar_event_destroy(&pool->done);
+	_zbar_mutex_destroy(&pool->mutex);
+    }
+#endif
+    free(pool);
+}
+
+int _zbar_pool_get_size(const zbar_pool_t *pool)
+{
+    return ((pool) ? pool->nworkers : 0);
+}
+
+void _zbar_pool_run(zbar_pool_t *pool, zbar_pool_job_t *job, void *arg,
+		    int njobs)
+{
+    int i;
+    if (!pool || !pool->nworkers || njobs < 2) {
+	for (i = 0; i < njobs; i++)
+	    job(arg, i, 0);
+	return;
+    }
+
+#ifdef HAVE_THREADS
+    _zbar_mutex_lock(&pool->mutex);
+    pool->job	= job;
+    pool->arg	= arg;
+    pool->njobs = njobs;
+    pool->next	= 0;
+    pool->busy	= pool->nworkers;
+    pool->batch++;
+    for (i = 0; i < pool->nworkers; i++)
+	_zbar_event_trigger(&pool->workers[i].thread.notify);
+
+    /* caller helps out while waiting */
+    pool_work(pool, 0);
+    while (pool->busy)
+	_zbar_event_wait(&pool->done, &pool->mutex, NULL);
+    _zbar_mutex_unlock(&pool->mutex);
+#endif
+}
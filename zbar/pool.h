@@ -0,0 +1,53 @@
+/*------------------------------------------------------------------------
+ *  This file is part of the ZBar Bar Code Reader.
+ *
+ *  The ZBar Bar Code Reader is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Lesser Public License as
+ *  published by the Free Software Foundation; either version 2.1 of
+ *  the License, or (at your option) any later version.
+ *
+ *  The ZBar Bar Code Reader is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ *  of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser Public License
+ *  along with the ZBar Bar Code Reader; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301  USA
+ *
+ *  http://sourceforge.net/projects/zbar
+ *------------------------------------------------------------------------*/
+#ifndef _ZBAR_POOL_H_
+#define _ZBAR_POOL_H_
+
+/* simple fork/join worker pool
+ */
+
+#include "config.h"
+
+/* job callback, called once for each index 0 <= job < njobs.
+ * jobs from one batch may run concurrently on any pool thread.
+ * slot identifies the calling thread (0 for the caller of
+ * _zbar_pool_run, 1..n for workers), so jobs may use per-thread state
+ */
+typedef void(zbar_pool_job_t)(void *arg, int job, int slot);
+
+typedef struct zbar_pool_s zbar_pool_t;
+
+/* create a pool with the specified number of worker threads.  the
+ * calling thread also participates in each batch, so a pool of size
+ * n-1 runs up to n jobs in parallel.  without thread support the pool
+ * has no workers and all jobs run serially in the caller
+ */
+extern zbar_pool_t *_zbar_pool_create(int nthreads);
+extern void _zbar_pool_destroy(zbar_pool_t *pool);
+
+/* number of worker threads actually started */
+extern int _zbar_pool_get_size(const zbar_pool_t *pool);
+
+/* run a batch of jobs and wait for all of them to complete */
+extern void _zbar_pool_run(zbar_pool_t *pool, zbar_pool_job_t *job, void *arg,
+			   int njobs);
+
+#endif
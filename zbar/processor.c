@@ -50,6 +50,31 @@ static inline int proc_open(zbar_processor_t *proc)
     return (_zbar_processor_open(proc, "zbar barcode reader", width, height));
 }
 
+/* largest factor a JPEG frame may be reduced by while it is decoded,
+ * without scanning fewer lines of it than the configured density
+ */
+static inline int proc_jpeg_scale(zbar_processor_t *proc,
+				  const zbar_image_t *img)
+{
+    const zbar_format_def_t *fmt = _zbar_format_lookup(img->format);
+    int max = 1, density, scale = 1;
+    if (!fmt || fmt->group != ZBAR_FMT_JPEG)
+	return (1);
+    zbar_image_scanner_get_config(proc->scanner, ZBAR_PARTIAL,
+				  ZBAR_CFG_JPEG_SCALE, &max);
+    if (!zbar_image_scanner_get_config(proc->scanner, ZBAR_PARTIAL,
+				       ZBAR_CFG_X_DENSITY, &density) &&
+	density > 0 && density < max)
+	max = density;
+    if (!zbar_image_scanner_get_config(proc->scanner, ZBAR_PARTIAL,
+				       ZBAR_CFG_Y_DENSITY, &density) &&
+	density > 0 && density < max)
+	max = density;
+    while (scale < 4 && scale * 2 <= max)
+	scale *= 2;
+    return (scale);
+}
+
 /* API lock is already held */
 int _zbar_process_image(zbar_processor_t *proc, zbar_image_t *img)
 {
@@ -58,7 +83,8 @@ int _zbar_process_image(zbar_processor_t *proc, zbar_image_t *img)
     if (img) {
 	uint32_t format;
 	zbar_image_t *tmp;
-	int nsyms;
+	zbar_luma_t luma;
+	int nsyms, scale;
 	if (proc->dumping) {
 	    zbar_image_write(proc->window->image, "zbar");
 	    proc->dumping = 0;
@@ -72,7 +98,23 @@ int _zbar_process_image(zbar_processor_t *proc, zbar_image_t *img)
 	/* FIXME locking all other interfaces while processing is conservative
          * but easier for now and we don't expect this to take long...
          */
-	tmp = zbar_image_convert(img, fourcc('Y', '8', '0', '0'));
+	/* luminance is scanned in place when the format allows it */
+	if (!_zbar_image_luma(img, &luma))
+	    tmp = img;
+	else if ((scale = proc_jpeg_scale(proc, img)) > 1) {
+	    /* the scanner maps symbol locations back to full size */
+	    tmp = zbar_image_convert_resize(img, fourcc('Y', '8', '0', '0'),
+					    img->width / scale,
+					    img->height / scale);
+	    if (tmp && tmp->scale > 1) {
+		scale = tmp->scale;
+		zbar_image_set_crop(tmp, img->crop_x / scale,
+				    img->crop_y / scale,
+				    (img->crop_w + scale - 1) / scale,
+				    (img->crop_h + scale - 1) / scale);
+	    }
+	} else
+	    tmp = zbar_image_convert(img, fourcc('Y', '8', '0', '0'));
 	if (!tmp)
 	    goto error;
 
@@ -82,9 +124,10 @@ int _zbar_process_image(zbar_processor_t *proc, zbar_image_t *img)
 	}
 	zbar_image_scanner_recycle_image(proc->scanner, img);
 	nsyms = zbar_scan_image(proc->scanner, tmp);
-	_zbar_image_swap_symbols(img, tmp);
-
-	zbar_image_destroy(tmp);
+	if (tmp != img) {
+	    _zbar_image_swap_symbols(img, tmp);
+	    zbar_image_destroy(tmp);
+	}
 	tmp = NULL;
 	if (nsyms < 0)
 	    goto error;
@@ -208,7 +251,7 @@ static ZTHREAD proc_video_thread(void *arg)
 
 	/* blocking capture image from video */
 	_zbar_mutex_unlock(&proc->mutex);
-	img = zbar_video_next_image(proc->video);
+	img = zbar_video_borrow_image(proc->video);
 	_zbar_mutex_lock(&proc->mutex);
 
 	if (!img && !proc->streaming)
@@ -224,7 +267,7 @@ static ZTHREAD proc_video_thread(void *arg)
 	if (thread->started && proc->streaming)
 	    _zbar_process_image(proc, img);
 
-	zbar_image_destroy(img);
+	zbar_video_return_image(proc->video, img);
 
 	_zbar_mutex_lock(&proc->mutex);
 	/* release API lock */
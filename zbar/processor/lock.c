@@ -166,7 +166,7 @@ static inline int proc_wait_unthreaded(zbar_processor_t *proc,
 	int reltime;
 	/* FIXME lax w/the locking (though shouldn't matter...) */
 	if (blocking) {
-	    zbar_image_t *img = zbar_video_next_image(proc->video);
+	    zbar_image_t *img = zbar_video_borrow_image(proc->video);
 	    if (!img) {
 		rc = -1;
 		break;
@@ -175,7 +175,7 @@ static inline int proc_wait_unthreaded(zbar_processor_t *proc,
 	    /* FIXME reacquire API lock! (refactor w/video thread?) */
 	    _zbar_mutex_lock(&proc->mutex);
 	    _zbar_process_image(proc, img);
-	    zbar_image_destroy(img);
+	    zbar_video_return_image(proc->video, img);
 	    _zbar_mutex_unlock(&proc->mutex);
 	}
 	reltime = _zbar_timer_check(timeout);
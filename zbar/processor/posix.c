@@ -181,7 +181,7 @@ static int proc_video_handler(zbar_processor_t *proc, int i)
     zbar_image_t *img = NULL;
     if (proc->streaming) {
 	/* not expected to block */
-	img = zbar_video_next_image(proc->video);
+	img = zbar_video_borrow_image(proc->video);
 	if (img)
 	    _zbar_process_image(proc, img);
     }
@@ -190,7 +190,7 @@ static int proc_video_handler(zbar_processor_t *proc, int i)
     _zbar_processor_unlock(proc, 0);
     _zbar_mutex_unlock(&proc->mutex);
     if (img)
-	zbar_image_destroy(img);
+	zbar_video_return_image(proc->video, img);
     return (0);
 }
 
@@ -58,7 +58,12 @@ void _zbar_qr_reset(qr_reader *reader);
 
 int _zbar_qr_found_line(qr_reader *reader, int direction,
 			const qr_finder_line *line);
+/* append finder lines collected by another reader (in order) */
+int _zbar_qr_merge_lines(qr_reader *reader, const qr_reader *src);
+/* decode using the collected finder lines.
+ * if inverted is set, they were found in the inverted image
+ */
 int _zbar_qr_decode(qr_reader *reader, zbar_image_scanner_t *iscn,
-		    zbar_image_t *img);
+		    zbar_image_t *img, int inverted);
 
 #endif
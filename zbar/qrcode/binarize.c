@@ -9,6 +9,11 @@
 #include <string.h>
 #include "image.h"
 #include "util.h"
+#if defined(QR_BINARIZE_X86)
+#include <immintrin.h>
+#elif defined(QR_BINARIZE_NEON)
+#include <arm_neon.h>
+#endif
 
 #if 0
 /*Binarization based on~\cite{GPP06}.
@@ -517,82 +522,427 @@ void qr_binarize(unsigned char *_img,int _width,int _height){
    detected and decoded successfully than the Sauvola or Gatos binarization
    methods.*/
 
+/*The thresholder works one row at a time: the (scalar) sliding window sums
+   along the row are computed first, after which both the comparison of each
+   pixel against its threshold and the update of the column sums for the next
+   row are independent for every column, and are done by the row kernels
+   below, vectorized where the CPU allows.
+  All kernels produce bit-identical results.*/
+
+/*Marks the pixels of a row darker (or, if _invert is set, lighter) than the
+   mean of their window.
+  _m holds the sums over the window of each pixel, which has 1<<_shift
+   pixels.*/
+static void qr_threshold_row_c(unsigned char *_mask, const unsigned char *_row,
+			       const unsigned *_m, int _width, int _shift,
+			       int _invert)
+{
+    int x;
+    /*Perform the test against the threshold T = (m/n)-D,
+       where n=windw*windh and D=3.
+      For an inverted image, (255-g)<T' with T'=255-(m/n)-D is the same
+       as g>(m/n)+D.*/
+    if (!_invert)
+	for (x = 0; x < _width; x++)
+	    _mask[x] = -((unsigned)_row[x] + 3 << _shift < _m[x]) & 0xFF;
+    else
+	for (x = 0; x < _width; x++)
+	    _mask[x] = -(_m[x] + (3 << _shift) < (unsigned)_row[x] << _shift) &
+		       0xFF;
+}
+
+/*Slides the column sums down one row, removing the pixels of _sub and adding
+   those of _add.*/
+static void qr_col_sums_update_c(unsigned *_col_sums, const unsigned char *_sub,
+				 const unsigned char *_add, int _width)
+{
+    int x;
+    for (x = 0; x < _width; x++) {
+	_col_sums[x] -= _sub[x];
+	_col_sums[x] += _add[x];
+    }
+}
+
+#if defined(QR_BINARIZE_X86)
+/*All the sums involved stay below 1<<24, so signed 32-bit compares work.*/
+__attribute__((target("sse2"))) static void
+qr_threshold_row_sse2(unsigned char *_mask, const unsigned char *_row,
+		      const unsigned *_m, int _width, int _shift, int _invert)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i bias = _mm_set1_epi32(3 << _shift);
+    __m128i cnt	 = _mm_cvtsi32_si128(_shift);
+    int x;
+    for (x = 0; x + 16 <= _width; x += 16) {
+	__m128i g  = _mm_loadu_si128((const __m128i *)(_row + x));
+	__m128i lo = _mm_unpacklo_epi8(g, zero);
+	__m128i hi = _mm_unpackhi_epi8(g, zero);
+	__m128i t[4];
+	int i;
+	t[0] = _mm_unpacklo_epi16(lo, zero);
+	t[1] = _mm_unpackhi_epi16(lo, zero);
+	t[2] = _mm_unpacklo_epi16(hi, zero);
+	t[3] = _mm_unpackhi_epi16(hi, zero);
+	for (i = 0; i < 4; i++) {
+	    __m128i m  = _mm_loadu_si128((const __m128i *)(_m + x + 4 * i));
+	    __m128i gs = _mm_sll_epi32(t[i], cnt);
+	    if (!_invert)
+		t[i] = _mm_cmpgt_epi32(m, _mm_add_epi32(gs, bias));
+	    else
+		t[i] = _mm_cmpgt_epi32(gs, _mm_add_epi32(m, bias));
+	}
+	_mm_storeu_si128((__m128i *)(_mask + x),
+			 _mm_packs_epi16(_mm_packs_epi32(t[0], t[1]),
+					 _mm_packs_epi32(t[2], t[3])));
+    }
+    qr_threshold_row_c(_mask + x, _row + x, _m + x, _width - x, _shift,
+		       _invert);
+}
+
+__attribute__((target("sse2"))) static void
+qr_col_sums_update_sse2(unsigned *_col_sums, const unsigned char *_sub,
+			const unsigned char *_add, int _width)
+{
+    __m128i zero = _mm_setzero_si128();
+    int x;
+    for (x = 0; x + 16 <= _width; x += 16) {
+	__m128i a = _mm_loadu_si128((const __m128i *)(_add + x));
+	__m128i s = _mm_loadu_si128((const __m128i *)(_sub + x));
+	__m128i d[2];
+	int i;
+	/*The differences fit in 16 bits, sign-extend them to 32.*/
+	d[0] = _mm_sub_epi16(_mm_unpacklo_epi8(a, zero),
+			     _mm_unpacklo_epi8(s, zero));
+	d[1] = _mm_sub_epi16(_mm_unpackhi_epi8(a, zero),
+			     _mm_unpackhi_epi8(s, zero));
+	for (i = 0; i < 4; i++) {
+	    __m128i *c = (__m128i *)(_col_sums + x + 4 * i);
+	    __m128i e  = (i & 1) ? _mm_unpackhi_epi16(d[i >> 1], d[i >> 1]) :
+				   _mm_unpacklo_epi16(d[i >> 1], d[i >> 1]);
+	    _mm_storeu_si128(c, _mm_add_epi32(_mm_loadu_si128(c),
+					      _mm_srai_epi32(e, 16)));
+	}
+    }
+    qr_col_sums_update_c(_col_sums + x, _sub + x, _add + x, _width - x);
+}
+
+__attribute__((target("avx2"))) static void
+qr_threshold_row_avx2(unsigned char *_mask, const unsigned char *_row,
+		      const unsigned *_m, int _width, int _shift, int _invert)
+{
+    __m256i bias = _mm256_set1_epi32(3 << _shift);
+    __m128i cnt	 = _mm_cvtsi32_si128(_shift);
+    int x;
+    for (x = 0; x + 16 <= _width; x += 16) {
+	__m128i g = _mm_loadu_si128((const __m128i *)(_row + x));
+	__m256i t[2];
+	__m256i p;
+	int i;
+	t[0] = _mm256_cvtepu8_epi32(g);
+	t[1] = _mm256_cvtepu8_epi32(_mm_srli_si128(g, 8));
+	for (i = 0; i < 2; i++) {
+	    __m256i m  = _mm256_loadu_si256((const __m256i *)(_m + x + 8 * i));
+	    __m256i gs = _mm256_sll_epi32(t[i], cnt);
+	    if (!_invert)
+		t[i] = _mm256_cmpgt_epi32(m, _mm256_add_epi32(gs, bias));
+	    else
+		t[i] = _mm256_cmpgt_epi32(gs, _mm256_add_epi32(m, bias));
+	}
+	/*Packing works within 128-bit lanes, so restore the order in between.*/
+	p = _mm256_permute4x64_epi64(_mm256_packs_epi32(t[0], t[1]), 0xD8);
+	_mm_storeu_si128((__m128i *)(_mask + x),
+			 _mm_packs_epi16(_mm256_castsi256_si128(p),
+					 _mm256_extracti128_si256(p, 1)));
+    }
+    qr_threshold_row_c(_mask + x, _row + x, _m + x, _width - x, _shift,
+		       _invert);
+}
+
+__attribute__((target("avx2"))) static void
+qr_col_sums_update_avx2(unsigned *_col_sums, const unsigned char *_sub,
+			const unsigned char *_add, int _width)
+{
+    int x;
+    for (x = 0; x + 8 <= _width; x += 8) {
+	__m256i *c = (__m256i *)(_col_sums + x);
+	__m256i a  = _mm256_cvtepu8_epi32(
+	     _mm_loadl_epi64((const __m128i *)(_add + x)));
+	__m256i s = _mm256_cvtepu8_epi32(
+	    _mm_loadl_epi64((const __m128i *)(_sub + x)));
+	_mm256_storeu_si256(c, _mm256_add_epi32(_mm256_loadu_si256(c),
+						_mm256_sub_epi32(a, s)));
+    }
+    qr_col_sums_update_c(_col_sums + x, _sub + x, _add + x, _width - x);
+}
+#endif
+
+#if defined(QR_BINARIZE_NEON)
+static void qr_threshold_row_neon(unsigned char *_mask,
+				  const unsigned char *_row, const unsigned *_m,
+				  int _width, int _shift, int _invert)
+{
+    uint32x4_t bias = vdupq_n_u32(3U << _shift);
+    int32x4_t sh    = vdupq_n_s32(_shift);
+    int x;
+    for (x = 0; x + 16 <= _width; x += 16) {
+	uint8x16_t g  = vld1q_u8(_row + x);
+	uint16x8_t lo = vmovl_u8(vget_low_u8(g));
+	uint16x8_t hi = vmovl_u8(vget_high_u8(g));
+	uint32x4_t t[4];
+	int i;
+	t[0] = vmovl_u16(vget_low_u16(lo));
+	t[1] = vmovl_u16(vget_high_u16(lo));
+	t[2] = vmovl_u16(vget_low_u16(hi));
+	t[3] = vmovl_u16(vget_high_u16(hi));
+	for (i = 0; i < 4; i++) {
+	    uint32x4_t m  = vld1q_u32(_m + x + 4 * i);
+	    uint32x4_t gs = vshlq_u32(t[i], sh);
+	    if (!_invert)
+		t[i] = vcltq_u32(vaddq_u32(gs, bias), m);
+	    else
+		t[i] = vcltq_u32(vaddq_u32(m, bias), gs);
+	}
+	vst1q_u8(_mask + x,
+		 vcombine_u8(vmovn_u16(vcombine_u16(vmovn_u32(t[0]),
+						    vmovn_u32(t[1]))),
+			     vmovn_u16(vcombine_u16(vmovn_u32(t[2]),
+						    vmovn_u32(t[3])))));
+    }
+    qr_threshold_row_c(_mask + x, _row + x, _m + x, _width - x, _shift,
+		       _invert);
+}
+
+static void qr_col_sums_update_neon(unsigned *_col_sums,
+				    const unsigned char *_sub,
+				    const unsigned char *_add, int _width)
+{
+    int x;
+    for (x = 0; x + 8 <= _width; x += 8) {
+	int16x8_t d = vreinterpretq_s16_u16(
+	    vsubl_u8(vld1_u8(_add + x), vld1_u8(_sub + x)));
+	int32x4_t c0 = vreinterpretq_s32_u32(vld1q_u32(_col_sums + x));
+	int32x4_t c1 = vreinterpretq_s32_u32(vld1q_u32(_col_sums + x + 4));
+	c0	     = vaddq_s32(c0, vmovl_s16(vget_low_s16(d)));
+	c1	     = vaddq_s32(c1, vmovl_s16(vget_high_s16(d)));
+	vst1q_u32(_col_sums + x, vreinterpretq_u32_s32(c0));
+	vst1q_u32(_col_sums + x + 4, vreinterpretq_u32_s32(c1));
+    }
+    qr_col_sums_update_c(_col_sums + x, _sub + x, _add + x, _width - x);
+}
+#endif
+
+void qr_binarizer_init(qr_binarizer *_bin)
+{
+    memset(_bin, 0, sizeof(*_bin));
+    _bin->threshold_row	  = qr_threshold_row_c;
+    _bin->col_sums_update = qr_col_sums_update_c;
+#if defined(QR_BINARIZE_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+	_bin->threshold_row   = qr_threshold_row_avx2;
+	_bin->col_sums_update = qr_col_sums_update_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+	_bin->threshold_row   = qr_threshold_row_sse2;
+	_bin->col_sums_update = qr_col_sums_update_sse2;
+    }
+#elif defined(QR_BINARIZE_NEON)
+    _bin->threshold_row	  = qr_threshold_row_neon;
+    _bin->col_sums_update = qr_col_sums_update_neon;
+#endif
+}
+
+void qr_binarizer_clear(qr_binarizer *_bin)
+{
+    free(_bin->mask);
+    free(_bin->sums);
+    free(_bin->tiles);
+    free(_bin->col_sums);
+    free(_bin->col_sums_ty);
+    free(_bin->lines);
+    free(_bin->line_y);
+}
+
+/*Grows one of the buffers kept by the binarizer to hold at least _n elements
+   of _elsz bytes.
+  Return: 0 on success, or a negative value on allocation failure.*/
+static int qr_binarizer_reserve(void **_buf, size_t *_sz, size_t _n,
+				size_t _elsz)
+{
+    if (*_sz < _n) {
+	free(*_buf);
+	*_buf = malloc(_n * _elsz);
+	*_sz  = *_buf ? _n : 0;
+	if (!*_buf)
+	    return -1;
+    }
+    return 0;
+}
+
+/*Returns the samples of line _y from column _x0 to _x1-1, one per byte.
+  Interleaved samples are gathered into _buf, other lines are read in place.*/
+static const unsigned char *qr_binarizer_span(const qr_binarizer *_bin,
+					      unsigned char *_buf, int _y,
+					      int _x0, int _x1)
+{
+    const unsigned char *src;
+    int x;
+    src = _bin->img + _y * _bin->stride + _x0 * _bin->step;
+    if (_bin->step == 1)
+	return src;
+    for (x = _x0; x < _x1; x++, src += _bin->step)
+	_buf[x - _x0] = *src;
+    return _buf;
+}
+
+/*Returns a whole line for the full image pass.
+  Lines of interleaved images are gathered into a ring of the last nlines
+   lines, so each one is only gathered once while the window passes over it.*/
+static const unsigned char *qr_binarizer_line(qr_binarizer *_bin, int _y)
+{
+    unsigned char *line;
+    int slot;
+    if (_bin->step == 1)
+	return _bin->img + _y * _bin->stride;
+    slot = _y % _bin->nlines;
+    line = _bin->lines + (size_t)slot * _bin->width;
+    if (_bin->line_y[slot] != _y) {
+	qr_binarizer_span(_bin, line, _y, 0, _bin->width);
+	_bin->line_y[slot] = _y;
+    }
+    return line;
+}
+
 /*A simplified adaptive thresholder.
   This compares the current pixel value to the mean value of a (large) window
-   surrounding it.*/
-unsigned char *qr_binarize(const unsigned char *_img, int _width, int _height)
+   surrounding it.
+  The window of a pixel at (x,y) spans columns x-windw/2 to x+windw/2-1 and
+   rows y-windh/2 to y+windh/2-1, with coordinates outside the image clamped to
+   its edges.*/
+int qr_binarize(qr_binarizer *_bin, const unsigned char *_img, int _width,
+		int _height, int _step, int _stride, int _invert, int _lazy)
 {
-    unsigned char *mask = NULL;
-    if (_width > 0 && _height > 0) {
-	unsigned *col_sums;
-	int logwindw;
-	int logwindh;
-	int windw;
-	int windh;
-	int y0offs;
-	int y1offs;
-	unsigned g;
-	int x;
-	int y;
-	mask = (unsigned char *)malloc(_width * _height * sizeof(*mask));
-	/*We keep the window size fairly large to ensure it doesn't fit completely
-       inside the center of a finder pattern of a version 1 QR code at full
-       resolution.*/
-	for (logwindw = 4; logwindw < 8 && (1 << logwindw) < (_width + 7 >> 3);
-	     logwindw++)
-	    ;
-	for (logwindh = 4; logwindh < 8 && (1 << logwindh) < (_height + 7 >> 3);
-	     logwindh++)
-	    ;
-	windw	 = 1 << logwindw;
-	windh	 = 1 << logwindh;
-	col_sums = (unsigned *)malloc(_width * sizeof(*col_sums));
-	/*Initialize sums down each column.*/
+    const unsigned char *line;
+    unsigned char *mask;
+    unsigned *col_sums;
+    unsigned *row_sums;
+    int logwindw;
+    int logwindh;
+    int windw;
+    int windh;
+    unsigned g;
+    int x;
+    int y;
+    _bin->lazy = 0;
+    if (_width <= 0 || _height <= 0)
+	return 0;
+    /*The buffers are kept across calls, and only grow.*/
+    if (qr_binarizer_reserve((void **)&_bin->mask, &_bin->mask_sz,
+			     (size_t)_width * _height, 1) < 0)
+	return -1;
+    if (_bin->sums_sz < _width) {
+	free(_bin->sums);
+	_bin->sums_sz = _width;
+	_bin->sums    = (unsigned *)malloc(2 * _width * sizeof(*_bin->sums));
+	if (!_bin->sums) {
+	    _bin->sums_sz = 0;
+	    return -1;
+	}
+    }
+    /*We keep the window size fairly large to ensure it doesn't fit completely
+     inside the center of a finder pattern of a version 1 QR code at full
+     resolution.*/
+    for (logwindw = 4; logwindw < 8 && (1 << logwindw) < (_width + 7 >> 3);
+	 logwindw++)
+	;
+    for (logwindh = 4; logwindh < 8 && (1 << logwindh) < (_height + 7 >> 3);
+	 logwindh++)
+	;
+    _bin->img	   = _img;
+    _bin->width	   = _width;
+    _bin->height   = _height;
+    _bin->step	   = _step;
+    _bin->stride   = _stride;
+    _bin->invert   = _invert;
+    _bin->logwindw = logwindw;
+    _bin->logwindh = logwindh;
+    if (_lazy) {
+	size_t ntiles;
+	_bin->ntilesw = (_width - 1 >> QR_BIN_TILE_LOG) + 1;
+	ntiles = (size_t)_bin->ntilesw * ((_height - 1 >> QR_BIN_TILE_LOG) + 1);
+	if (qr_binarizer_reserve((void **)&_bin->tiles, &_bin->tiles_sz, ntiles,
+				 1) < 0 ||
+	    qr_binarizer_reserve((void **)&_bin->col_sums, &_bin->col_sums_sz,
+				 (size_t)_width << QR_BIN_TILE_LOG,
+				 sizeof(*_bin->col_sums)) < 0 ||
+	    qr_binarizer_reserve((void **)&_bin->col_sums_ty,
+				 &_bin->col_sums_ty_sz, _bin->ntilesw,
+				 sizeof(*_bin->col_sums_ty)) < 0) {
+	    return -1;
+	}
+	memset(_bin->tiles, 0, ntiles);
+	for (x = 0; x < _bin->ntilesw; x++)
+	    _bin->col_sums_ty[x] = -1;
+	_bin->lazy = 1;
+	return 0;
+    }
+    mask     = _bin->mask;
+    col_sums = _bin->sums;
+    row_sums = _bin->sums + _width;
+    windw    = 1 << logwindw;
+    windh    = 1 << logwindh;
+    if (_step != 1) {
+	/*Every line read while the window passes over it fits in the ring.*/
+	_bin->nlines = windh + 1;
+	if (qr_binarizer_reserve((void **)&_bin->lines, &_bin->lines_sz,
+				 (size_t)_bin->nlines * _width, 1) < 0 ||
+	    qr_binarizer_reserve((void **)&_bin->line_y, &_bin->line_y_sz,
+				 _bin->nlines, sizeof(*_bin->line_y)) < 0) {
+	    return -1;
+	}
+	for (y = 0; y < _bin->nlines; y++)
+	    _bin->line_y[y] = -1;
+    }
+    /*Initialize sums down each column.*/
+    line = qr_binarizer_line(_bin, 0);
+    for (x = 0; x < _width; x++) {
+	g	    = line[x];
+	col_sums[x] = (g << logwindh - 1) + g;
+    }
+    for (y = 1; y < (windh >> 1); y++) {
+	line = qr_binarizer_line(_bin, QR_MINI(y, _height - 1));
 	for (x = 0; x < _width; x++) {
-	    g		= _img[x];
-	    col_sums[x] = (g << logwindh - 1) + g;
+	    g = line[x];
+	    col_sums[x] += g;
 	}
-	for (y = 1; y < (windh >> 1); y++) {
-	    y1offs = QR_MINI(y, _height - 1) * _width;
-	    for (x = 0; x < _width; x++) {
-		g = _img[y1offs + x];
-		col_sums[x] += g;
-	    }
+    }
+    for (y = 0; y < _height; y++) {
+	unsigned m;
+	int x0;
+	int x1;
+	/*Initialize the sum over the window.*/
+	m = (col_sums[0] << logwindw - 1) + col_sums[0];
+	for (x = 1; x < (windw >> 1); x++) {
+	    x1 = QR_MINI(x, _width - 1);
+	    m += col_sums[x1];
 	}
-	for (y = 0; y < _height; y++) {
-	    unsigned m;
-	    int x0;
-	    int x1;
-	    /*Initialize the sum over the window.*/
-	    m = (col_sums[0] << logwindw - 1) + col_sums[0];
-	    for (x = 1; x < (windw >> 1); x++) {
-		x1 = QR_MINI(x, _width - 1);
-		m += col_sums[x1];
-	    }
-	    for (x = 0; x < _width; x++) {
-		/*Perform the test against the threshold T = (m/n)-D,
-           where n=windw*windh and D=3.*/
-		g		     = _img[y * _width + x];
-		mask[y * _width + x] = -(g + 3 << logwindw + logwindh < m) &
-				       0xFF;
-		/*Update the window sum.*/
-		if (x + 1 < _width) {
-		    x0 = QR_MAXI(0, x - (windw >> 1));
-		    x1 = QR_MINI(x + (windw >> 1), _width - 1);
-		    m += col_sums[x1] - col_sums[x0];
-		}
-	    }
-	    /*Update the column sums.*/
-	    if (y + 1 < _height) {
-		y0offs = QR_MAXI(0, y - (windh >> 1)) * _width;
-		y1offs = QR_MINI(y + (windh >> 1), _height - 1) * _width;
-		for (x = 0; x < _width; x++) {
-		    col_sums[x] -= _img[y0offs + x];
-		    col_sums[x] += _img[y1offs + x];
-		}
+	/*Compute the window sum for every pixel of the row.*/
+	for (x = 0; x < _width; x++) {
+	    row_sums[x] = m;
+	    if (x + 1 < _width) {
+		x0 = QR_MAXI(0, x - (windw >> 1));
+		x1 = QR_MINI(x + (windw >> 1), _width - 1);
+		m += col_sums[x1] - col_sums[x0];
 	    }
 	}
-	free(col_sums);
+	_bin->threshold_row(mask + y * _width, qr_binarizer_line(_bin, y),
+			    row_sums, _width, logwindw + logwindh, _invert);
+	/*Update the column sums.*/
+	if (y + 1 < _height)
+	    _bin->col_sums_update(
+		col_sums, qr_binarizer_line(_bin, QR_MAXI(0, y - (windh >> 1))),
+		qr_binarizer_line(_bin,
+				  QR_MINI(y + (windh >> 1), _height - 1)),
+		_width);
     }
 #if defined(QR_DEBUG)
     {
@@ -602,7 +952,124 @@ unsigned char *qr_binarize(const unsigned char *_img, int _width, int _height)
 	fclose(fout);
     }
 #endif
-    return (mask);
+    return 0;
+}
+
+/*Computes the column sums of one tile for lazy binarization.
+  These are the same sums the full image pass slides down the image, but only
+   the rows of one band of tiles are kept, and they replace whatever band that
+   column of tiles held before.*/
+static void qr_binarize_tile_sums(qr_binarizer *_bin, int _tx, int _ty)
+{
+    unsigned char buf[2][1 << QR_BIN_TILE_LOG];
+    unsigned *col_sums;
+    int width;
+    int height;
+    int windh;
+    int x0;
+    int x1;
+    int y0;
+    int y1;
+    int x;
+    int y;
+    col_sums = _bin->col_sums;
+    width    = _bin->width;
+    height   = _bin->height;
+    windh    = 1 << _bin->logwindh;
+    x0	     = _tx << QR_BIN_TILE_LOG;
+    x1	     = QR_MINI(x0 + (1 << QR_BIN_TILE_LOG), width);
+    y0	     = _ty << QR_BIN_TILE_LOG;
+    y1	     = QR_MINI(y0 + (1 << QR_BIN_TILE_LOG), height);
+    if (_ty > 0 && _bin->col_sums_ty[_tx] == _ty - 1) {
+	/*Slide down from the last row of the band above, which is cheaper than
+       summing the whole window height.*/
+	unsigned *row;
+	row = col_sums + x0;
+	memcpy(row, row + ((1 << QR_BIN_TILE_LOG) - 1) * width,
+	       (x1 - x0) * sizeof(*row));
+	y = y0 - 1;
+	_bin->col_sums_update(
+	    row,
+	    qr_binarizer_span(_bin, buf[0], QR_MAXI(0, y - (windh >> 1)), x0,
+			      x1),
+	    qr_binarizer_span(_bin, buf[1],
+			      QR_MINI(y + (windh >> 1), height - 1), x0, x1),
+	    x1 - x0);
+    } else {
+	unsigned *row;
+	row = col_sums + x0;
+	memset(row, 0, (x1 - x0) * sizeof(*row));
+	for (y = y0 - (windh >> 1); y < y0 + (windh >> 1); y++) {
+	    const unsigned char *line;
+	    line = qr_binarizer_span(_bin, buf[0], QR_CLAMPI(0, y, height - 1),
+				     x0, x1);
+	    for (x = x0; x < x1; x++)
+		row[x - x0] += line[x - x0];
+	}
+    }
+    for (y = y0; y + 1 < y1; y++) {
+	unsigned *row;
+	row = col_sums + (y + 1 - y0) * width + x0;
+	memcpy(row, row - width, (x1 - x0) * sizeof(*row));
+	_bin->col_sums_update(
+	    row,
+	    qr_binarizer_span(_bin, buf[0], QR_MAXI(0, y - (windh >> 1)), x0,
+			      x1),
+	    qr_binarizer_span(_bin, buf[1],
+			      QR_MINI(y + (windh >> 1), height - 1), x0, x1),
+	    x1 - x0);
+    }
+    _bin->col_sums_ty[_tx] = _ty;
+}
+
+void qr_binarize_tile(qr_binarizer *_bin, int _tx, int _ty)
+{
+    unsigned char buf[1 << QR_BIN_TILE_LOG];
+    unsigned *col_sums;
+    unsigned *row_sums;
+    int width;
+    int windw;
+    int cx0;
+    int cx1;
+    int x0;
+    int x1;
+    int y0;
+    int y1;
+    int x;
+    int y;
+    col_sums = _bin->col_sums;
+    row_sums = _bin->sums + _bin->width;
+    width    = _bin->width;
+    windw    = 1 << _bin->logwindw;
+    x0	     = _tx << QR_BIN_TILE_LOG;
+    x1	     = QR_MINI(x0 + (1 << QR_BIN_TILE_LOG), width);
+    y0	     = _ty << QR_BIN_TILE_LOG;
+    y1	     = QR_MINI(y0 + (1 << QR_BIN_TILE_LOG), _bin->height);
+    /*Make sure the column sums under every window in the tile are available.*/
+    cx0 = QR_MAXI(0, x0 - (windw >> 1)) >> QR_BIN_TILE_LOG;
+    cx1 = QR_MINI(x1 - 1 + (windw >> 1), width - 1) >> QR_BIN_TILE_LOG;
+    for (x = cx0; x <= cx1; x++)
+	if (_bin->col_sums_ty[x] != _ty)
+	    qr_binarize_tile_sums(_bin, x, _ty);
+    for (y = y0; y < y1; y++) {
+	const unsigned *row;
+	unsigned m;
+	row = col_sums + (y - y0) * width;
+	/*Initialize the sum over the window of the first pixel.*/
+	m = 0;
+	for (x = x0 - (windw >> 1); x < x0 + (windw >> 1); x++)
+	    m += row[QR_CLAMPI(0, x, width - 1)];
+	for (x = x0; x < x1; x++) {
+	    row_sums[x - x0] = m;
+	    m += row[QR_MINI(x + (windw >> 1), width - 1)] -
+		 row[QR_MAXI(0, x - (windw >> 1))];
+	}
+	_bin->threshold_row(_bin->mask + y * width + x0,
+			    qr_binarizer_span(_bin, buf, y, x0, x1), row_sums,
+			    x1 - x0, _bin->logwindw + _bin->logwindh,
+			    _bin->invert);
+    }
+    _bin->tiles[_ty * _bin->ntilesw + _tx] |= QR_BIN_TILE_MASK;
 }
 #endif
 
@@ -612,6 +1079,7 @@ unsigned char *qr_binarize(const unsigned char *_img, int _width, int _height)
 
 int main(int _argc, char **_argv)
 {
+    qr_binarizer bin;
     unsigned char *img;
     int width;
     int height;
@@ -633,7 +1101,9 @@ int main(int _argc, char **_argv)
 	image_read_png(&img, &width, &height, fin);
 	fclose(fin);
     }
-    qr_binarize(img, width, height);
+    qr_binarizer_init(&bin);
+    qr_binarize(&bin, img, width, height, 1, width, 0, 0);
+    qr_binarizer_clear(&bin);
     /*{
     FILE *fout;
     fout=fopen("binary.png","wb");
@@ -11,7 +11,102 @@ void qr_image_cross_masking_median_filter(unsigned char *_img, int _width,
 
 void qr_wiener_filter(unsigned char *_img, int _width, int _height);
 
-/*Binarizes a grayscale image.*/
-unsigned char *qr_binarize(const unsigned char *_img, int _width, int _height);
+#include <stddef.h>
+#include "simd.h"
+
+#if defined(ZBAR_SIMD_X86)
+#define QR_BINARIZE_X86 (1)
+#elif defined(ZBAR_SIMD_NEON)
+#define QR_BINARIZE_NEON (1)
+#endif
+
+typedef struct qr_binarizer qr_binarizer;
+
+/*The binarizer can threshold the image lazily, in square tiles of this size
+   (log2), computing each one the first time a pixel in it is read.*/
+#define QR_BIN_TILE_LOG (5)
+
+/*Tile state flags.*/
+/*The mask of the tile has been computed.*/
+#define QR_BIN_TILE_MASK (1)
+
+/*The state kept by the binarizer between images.*/
+struct qr_binarizer {
+    /*The mask of the last binarized image.*/
+    unsigned char *mask;
+    size_t mask_sz;
+    /*The column and row window sums, sums_sz entries each.*/
+    unsigned *sums;
+    int sums_sz;
+    /*The row kernels best suited to this CPU.*/
+    void (*threshold_row)(unsigned char *_mask, const unsigned char *_row,
+			  const unsigned *_m, int _width, int _shift,
+			  int _invert);
+    void (*col_sums_update)(unsigned *_col_sums, const unsigned char *_sub,
+			    const unsigned char *_add, int _width);
+    /*The image being binarized, and its parameters.*/
+    const unsigned char *img;
+    int width;
+    int height;
+    int step;
+    int stride;
+    int invert;
+    int logwindw;
+    int logwindh;
+    /*Whether tiles are only computed on first access.*/
+    int lazy;
+    /*The number of tiles in each row.*/
+    int ntilesw;
+    /*The state of each tile.*/
+    unsigned char *tiles;
+    size_t tiles_sz;
+    /*The sums over the window height down each column, for the rows of a
+       single band of tiles, and the band held by each column of tiles (or -1).
+      Each column of tiles keeps the sums of the last band it was asked for, so
+       this stays a few lines no matter how tall the image is.*/
+    unsigned *col_sums;
+    size_t col_sums_sz;
+    int *col_sums_ty;
+    size_t col_sums_ty_sz;
+    /*The last nlines lines of an image with interleaved samples, gathered one
+       sample per byte for the row kernels, and the line held in each slot.*/
+    unsigned char *lines;
+    size_t lines_sz;
+    int *line_y;
+    size_t line_y_sz;
+    int nlines;
+};
+
+void qr_binarizer_init(qr_binarizer *_bin);
+void qr_binarizer_clear(qr_binarizer *_bin);
+
+/*Binarizes a grayscale image.
+  Samples of the source image are _step bytes apart and its lines start
+   _stride bytes apart, while the mask is always packed _width bytes per line.
+  Interleaved samples (_step>1) are read in place, a few lines at a time.
+  The mask is owned by _bin, and is only valid until the next call.
+  If _invert is set, light pixels are marked instead of dark ones, exactly as
+   if the image had been inverted first.
+  If _lazy is set, nothing is computed yet: pixels must then be read with
+   qr_binarizer_get(), and _img must stay valid until the last such call.
+  Return: 0 on success, or a negative value on allocation failure.*/
+int qr_binarize(qr_binarizer *_bin, const unsigned char *_img, int _width,
+		int _height, int _step, int _stride, int _invert, int _lazy);
+
+/*Computes the mask of one tile.*/
+void qr_binarize_tile(qr_binarizer *_bin, int _tx, int _ty);
+
+/*Retrieves a pixel of the mask, which must lie inside the image.*/
+static inline unsigned char qr_binarizer_get(qr_binarizer *_bin, int _x,
+					     int _y)
+{
+    if (_bin->lazy) {
+	int tx = _x >> QR_BIN_TILE_LOG;
+	int ty = _y >> QR_BIN_TILE_LOG;
+	if (!(_bin->tiles[ty * _bin->ntilesw + tx] & QR_BIN_TILE_MASK))
+	    qr_binarize_tile(_bin, tx, ty);
+    }
+    return _bin->mask[_y * _bin->width + _x];
+}
 
 #endif
@@ -15,17 +15,32 @@
 #include "binarize.h"
 #include "error.h"
 #include "image.h"
+#include "img_scanner.h"
 #include "isaac.h"
+#include "pool.h"
 #include "qrcode.h"
 #include "rs.h"
 #include "svg.h"
+#include "timer.h"
 #include "util.h"
 
 #include "qrdec.h"
 
+/*Runs of module centers are projected with double-precision vector division,
+   which is part of the baseline instruction set of x86-64 (SSE2) and of
+   AArch64.*/
+#if defined(__SSE2__)
+#define QR_PROJECT_SSE2 (1)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define QR_PROJECT_NEON (1)
+#include <arm_neon.h>
+#endif
+
 typedef int qr_line[3];
 
 typedef struct qr_finder_cluster qr_finder_cluster;
+typedef struct qr_finder_row qr_finder_row;
 typedef struct qr_finder_edge_pt qr_finder_edge_pt;
 typedef struct qr_finder_center qr_finder_center;
 
@@ -33,6 +48,8 @@ typedef struct qr_aff qr_aff;
 typedef struct qr_hom qr_hom;
 
 typedef struct qr_finder qr_finder;
+typedef struct qr_arena qr_arena;
+typedef struct qr_worker qr_worker;
 
 typedef struct qr_hom_cell qr_hom_cell;
 typedef struct qr_sampling_grid qr_sampling_grid;
@@ -63,23 +80,240 @@ typedef struct qr_finder_lines {
     int nlines, clines;
 } qr_finder_lines;
 
+/*Scratch memory for a task, such as locating the finder centers in an image,
+   or trying one configuration of them.
+  It is handed out from a single block kept between tasks, and nothing is
+   freed until the task is done.
+  When the block runs out, more memory is allocated on the side, and the block
+   is regrown afterwards to hold everything the task needed (up to a limit),
+   so that the next task like it allocates nothing.*/
+struct qr_arena {
+    /*The block, its size, and the number of bytes of it handed out.*/
+    unsigned char *buf;
+    size_t size;
+    size_t top;
+    /*The memory allocated on the side, each linked to the one before.*/
+    void *spill;
+    /*The number of bytes handed out for this task.*/
+    size_t used;
+    /*The largest block to keep between tasks.*/
+    size_t limit;
+};
+
+/*The alignment of the memory handed out by an arena.*/
+#define QR_ARENA_ALIGN (16)
+
+/*The state used to decode a code from a configuration of finder centers.
+  The reader has one, and one more for each thread when candidate codes are
+   decoded in parallel.*/
+struct qr_worker {
+    /*The GF(256) representation used in Reed-Solomon decoding (shared).*/
+    const rs_gf256 *gf;
+    /*The random number generator used by RANSAC.*/
+    isaac_ctx isaac;
+    /*Time spent in Reed-Solomon decoding, in ns.*/
+    unsigned long long rs_ns;
+    /*Time spent trying configurations on a pool thread, in ns.*/
+    unsigned long long busy_ns;
+    /*Private copies of the edge points of the centers being tried, since
+     trying a configuration reorders them.*/
+    qr_finder_edge_pt *edge_pts;
+    int cedge_pts;
+    /*The scratch memory for trying one configuration.*/
+    qr_arena arena;
+    /*The memory of the codes this worker decoded in the current image, which
+     is only taken back once their text has been extracted.*/
+    qr_arena results;
+};
+
+/*A code decoded in the last frame, which we expect to find near the same place
+   in the next one.*/
+typedef struct qr_track qr_track;
+
+struct qr_track {
+    /*The code data, including the finder centers it was sampled from and the
+     bits read.
+    The bounding box is in image coordinates, as returned to the user.*/
+    qr_code_data qrdata;
+    /*How far each of the finder centers moved since the frame before, in
+     subpixels.*/
+    qr_point motion[3];
+};
+
 struct qr_reader {
     /*The GF(256) representation used in Reed-Solomon decoding.*/
     rs_gf256 gf;
-    /*The random number generator used by RANSAC.*/
-    isaac_ctx isaac;
+    /*The state used to decode codes serially.*/
+    qr_worker worker;
     /* current finder state, horizontal and vertical lines */
     qr_finder_lines finder_lines[2];
+    /*The binarized image and its scratch space, reused between images.*/
+    qr_binarizer bin;
+    /*The scratch memory for locating and matching finder centers.*/
+    qr_arena arena;
+    /*The codes decoded in the current image, kept to reuse the array.*/
+    qr_code_data_list qrlist;
+    /*The threads used to decode candidate codes in parallel, if any, and the
+     state of each (including the calling thread).*/
+    zbar_pool_t *pool;
+    qr_worker *workers;
+    int nworkers;
+    /*The character set converters used to extract the text.*/
+    qr_text_cds *cds;
+    /*The codes decoded in the last frame, when tracking them.*/
+    qr_track *tracks;
+    int ntracks;
+    /*The size of the frame they were found in.*/
+    int track_width;
+    int track_height;
 };
 
+/*Returns _sz bytes of scratch memory from the arena, which stay valid until
+   the next call to qr_arena_reset().
+  Return: The memory, or NULL if it could not be allocated.*/
+static void *qr_arena_alloc(qr_arena *_arena, size_t _sz)
+{
+    unsigned char *p;
+    /*Round up to a multiple of the alignment, handing out at least that much
+     even when asked for nothing, so that it is never mistaken for a
+     failure.*/
+    _sz = (_sz > 0 ? _sz : 1) + QR_ARENA_ALIGN - 1 &
+	  ~(size_t)(QR_ARENA_ALIGN - 1);
+    _arena->used += _sz;
+    if (_arena->size - _arena->top >= _sz) {
+	p = _arena->buf + _arena->top;
+	_arena->top += _sz;
+	return p;
+    }
+    p = (unsigned char *)malloc(QR_ARENA_ALIGN + _sz);
+    if (!p)
+	return NULL;
+    *(void **)p	  = _arena->spill;
+    _arena->spill = p;
+    return p + QR_ARENA_ALIGN;
+}
+
+/*Returns zeroed scratch memory for _n elements of _sz bytes each.*/
+static void *qr_arena_calloc(qr_arena *_arena, size_t _n, size_t _sz)
+{
+    void *p;
+    p = qr_arena_alloc(_arena, _n * _sz);
+    if (p)
+	memset(p, 0, _n * _sz);
+    return p;
+}
+
+/*Moves an array of _n elements of _sz bytes to a larger one with room for _m
+   elements.*/
+static void *qr_arena_grow(qr_arena *_arena, void *_p, size_t _n, size_t _m,
+			   size_t _sz)
+{
+    void *p;
+    p = qr_arena_alloc(_arena, _m * _sz);
+    /*The old array is NULL when it was still empty.*/
+    if (p && _n > 0)
+	memcpy(p, _p, _n * _sz);
+    return p;
+}
+
+static void qr_arena_free_spill(qr_arena *_arena)
+{
+    while (_arena->spill) {
+	void *next;
+	next = *(void **)_arena->spill;
+	free(_arena->spill);
+	_arena->spill = next;
+    }
+}
+
+/*Takes back all the scratch memory handed out for a task.*/
+static void qr_arena_reset(qr_arena *_arena)
+{
+    size_t size;
+    qr_arena_free_spill(_arena);
+    size = _arena->used < _arena->limit ? _arena->used : _arena->limit;
+    if (size > _arena->size || _arena->size > _arena->limit) {
+	free(_arena->buf);
+	_arena->buf  = size > 0 ? (unsigned char *)malloc(size) : NULL;
+	_arena->size = _arena->buf != NULL ? size : 0;
+    }
+    _arena->top	 = 0;
+    _arena->used = 0;
+}
+
+static void qr_arena_clear(qr_arena *_arena)
+{
+    qr_arena_free_spill(_arena);
+    free(_arena->buf);
+}
+
 /*Initializes a client reader handle.*/
 static void qr_reader_init(qr_reader *reader)
 {
     /*time_t now;
       now=time(NULL);
       isaac_init(&_reader->isaac,&now,sizeof(now));*/
-    isaac_init(&reader->isaac, NULL, 0);
+    isaac_init(&reader->worker.isaac, NULL, 0);
     rs_gf256_init(&reader->gf, QR_PPOLY);
+    reader->worker.gf = &reader->gf;
+    qr_binarizer_init(&reader->bin);
+    reader->cds = qr_text_cds_alloc();
+}
+
+static void qr_reader_threads_free(qr_reader *reader)
+{
+    int i;
+    if (reader->pool)
+	_zbar_pool_destroy(reader->pool);
+    reader->pool = NULL;
+    for (i = 0; i < reader->nworkers; i++) {
+	free(reader->workers[i].edge_pts);
+	qr_arena_clear(&reader->workers[i].arena);
+	qr_arena_clear(&reader->workers[i].results);
+    }
+    free(reader->workers);
+    reader->workers  = NULL;
+    reader->nworkers = 0;
+}
+
+/*Sets up the threads used to decode candidate codes in parallel.
+  Return: The number of threads available (including the caller).*/
+static int qr_reader_threads_alloc(qr_reader *reader, int nthreads)
+{
+    int i;
+    if (nthreads < 2)
+	nthreads = 0;
+    if (nthreads == reader->nworkers)
+	return (QR_MAXI(reader->nworkers, 1));
+    qr_reader_threads_free(reader);
+    if (!nthreads)
+	return (1);
+    reader->pool = _zbar_pool_create(nthreads - 1);
+    nthreads	 = _zbar_pool_get_size(reader->pool) + 1;
+    reader->workers = (qr_worker *)calloc(nthreads, sizeof(*reader->workers));
+    if (nthreads < 2 || !reader->workers) {
+	qr_reader_threads_free(reader);
+	return (1);
+    }
+    for (i = 0; i < nthreads; i++) {
+	reader->workers[i].gf		 = &reader->gf;
+	reader->workers[i].arena.limit	 = reader->worker.arena.limit;
+	reader->workers[i].results.limit = reader->worker.results.limit;
+    }
+    reader->nworkers = nthreads;
+    return (nthreads);
+}
+
+static void qr_code_data_clear(qr_code_data *_qrdata);
+
+static void qr_reader_tracks_clear(qr_reader *reader)
+{
+    int i;
+    for (i = 0; i < reader->ntracks; i++)
+	qr_code_data_clear(&reader->tracks[i].qrdata);
+    free(reader->tracks);
+    reader->tracks  = NULL;
+    reader->ntracks = 0;
 }
 
 /*Allocates a client reader handle.*/
@@ -99,6 +333,14 @@ void _zbar_qr_destroy(qr_reader *reader)
 	free(reader->finder_lines[0].lines);
     if (reader->finder_lines[1].lines)
 	free(reader->finder_lines[1].lines);
+    qr_binarizer_clear(&reader->bin);
+    qr_arena_clear(&reader->arena);
+    qr_arena_clear(&reader->worker.arena);
+    qr_arena_clear(&reader->worker.results);
+    qr_reader_threads_free(reader);
+    free(reader->qrlist.qrdata);
+    qr_text_cds_free(reader->cds);
+    qr_reader_tracks_clear(reader);
     free(reader);
 }
 
@@ -117,6 +359,14 @@ struct qr_finder_cluster {
     int nlines;
 };
 
+/*A scan line with finder lines on it.*/
+struct qr_finder_row {
+    /*The coordinate of the scan line.*/
+    int pos;
+    /*The index of the first finder line on it.*/
+    int start;
+};
+
 /*A point on the edge of a finder pattern.
   These are obtained from the endpoints of the lines crossing this particular
    pattern.*/
@@ -147,78 +397,204 @@ struct qr_finder_center {
     int nedge_pts;
 };
 
-static int qr_finder_vline_cmp(const void *_a, const void *_b)
+/*Sorts finder lines by the scan line they were found on, with ties broken by
+   their position along it, in linear time.
+  The lines usually arrive in scan line order already, but if they do not, a
+   counting sort on the scan line coordinate puts them in that order.
+  The lines found on one scan line are in order along it, or in reverse order
+   when it was scanned backwards, so they only need to be reversed.
+  _arena:  The scratch memory to use.
+  _lines:  The lines to sort.
+  _nlines: The number of lines.
+  _v:      0 for horizontal lines, or 1 for vertical lines.
+  Return: The list of the scan lines with any lines on them, in order,
+           followed by an entry that starts at _nlines, allocated from
+           _arena.*/
+static qr_finder_row *qr_finder_lines_sort(qr_arena *_arena,
+					   qr_finder_line *_lines, int _nlines,
+					   int _v)
+{
+    qr_finder_row *rows;
+    int nrows;
+    int i;
+    int r;
+    for (i = 1; i < _nlines; i++)
+	if (_lines[i].pos[1 - _v] < _lines[i - 1].pos[1 - _v])
+	    break;
+    if (i < _nlines) {
+	qr_finder_line *sorted;
+	int *starts;
+	int npos;
+	npos = 0;
+	for (i = 0; i < _nlines; i++)
+	    npos = QR_MAXI(npos, _lines[i].pos[1 - _v] + 1);
+	starts = (int *)qr_arena_calloc(_arena, npos, sizeof(*starts));
+	for (i = 0; i < _nlines; i++)
+	    starts[_lines[i].pos[1 - _v]]++;
+	for (r = i = 0; r < npos; r++) {
+	    int n;
+	    n	      = starts[r];
+	    starts[r] = i;
+	    i += n;
+	}
+	sorted = (qr_finder_line *)qr_arena_alloc(_arena,
+						  _nlines * sizeof(*sorted));
+	for (i = 0; i < _nlines; i++)
+	    sorted[starts[_lines[i].pos[1 - _v]]++] = _lines[i];
+	memcpy(_lines, sorted, _nlines * sizeof(*_lines));
+    }
+    nrows = 0;
+    for (i = 0; i < _nlines; i++)
+	nrows += !i || _lines[i].pos[1 - _v] != _lines[i - 1].pos[1 - _v];
+    rows = (qr_finder_row *)qr_arena_alloc(_arena, (nrows + 1) * sizeof(*rows));
+    for (i = r = 0; i < _nlines; i++)
+	if (!i || _lines[i].pos[1 - _v] != _lines[i - 1].pos[1 - _v]) {
+	    rows[r].pos	  = _lines[i].pos[1 - _v];
+	    rows[r].start = i;
+	    r++;
+	}
+    rows[nrows].pos   = INT_MAX;
+    rows[nrows].start = _nlines;
+    for (r = 0; r < nrows; r++) {
+	int i0;
+	int i1;
+	i0 = rows[r].start;
+	i1 = rows[r + 1].start - 1;
+	if (i0 < i1 && _lines[i0].pos[_v] > _lines[i1].pos[_v]) {
+	    for (; i0 < i1; i0++, i1--) {
+		qr_finder_line t;
+		t	   = _lines[i0];
+		_lines[i0] = _lines[i1];
+		_lines[i1] = t;
+	    }
+	}
+	/*An insertion sort, in case they were not in order after all.*/
+	for (i = rows[r].start + 1; i < rows[r + 1].start; i++) {
+	    qr_finder_line t;
+	    int j;
+	    t = _lines[i];
+	    for (j = i; j > rows[r].start && _lines[j - 1].pos[_v] > t.pos[_v];
+		 j--) {
+		_lines[j] = _lines[j - 1];
+	    }
+	    _lines[j] = t;
+	}
+    }
+    return rows;
+}
+
+/*Finds the next line to add to a cluster.
+  This returns the same line as scanning the sorted list of lines from _j for
+   the first unmarked one that is close enough to the last line in the
+   cluster, stopping at the first one too far away across the scan lines.
+  Instead of scanning every line in between, though, it only looks at the
+   lines on each scan line within the clustering threshold along it.
+  _lines: The sorted list of lines.
+  _rows:  The scan lines with any lines on them, as returned by
+           qr_finder_lines_sort().
+  _mark:  The lines already used in other clusters.
+  _r:     The index of the scan line to start from, which must not come after
+           the one _j is on.
+          This returns the index of the scan line the next line is on.
+  _j:     The index of the first line to consider.
+  _a:     The last line in the cluster.
+  _v:     0 for horizontal lines, or 1 for vertical lines.
+  Return: The index of the next line, or -1 if there is none.*/
+static int qr_finder_cluster_next(const qr_finder_line *_lines,
+				  const qr_finder_row *_rows,
+				  const unsigned char *_mark, int *_r, int _j,
+				  const qr_finder_line *_a, int _v)
 {
-    const qr_finder_line *a;
-    const qr_finder_line *b;
-    a = (const qr_finder_line *)_a;
-    b = (const qr_finder_line *)_b;
-    return ((a->pos[0] > b->pos[0]) - (a->pos[0] < b->pos[0]) << 1) +
-	   (a->pos[1] > b->pos[1]) - (a->pos[1] < b->pos[1]);
+    int thresh;
+    int r;
+    /*The clustering threshold is proportional to the size of the lines, since
+     minor noise in large areas can interrupt patterns more easily at high
+     resolutions.*/
+    thresh = _a->len + 7 >> 2;
+    for (r = *_r; _rows[r].pos - _a->pos[1 - _v] <= thresh; r++) {
+	int lo;
+	int hi;
+	lo = QR_MAXI(_rows[r].start, _j);
+	hi = _rows[r + 1].start;
+	/*Find the first line on this scan line that is close enough along it.*/
+	while (lo < hi) {
+	    int mid;
+	    mid = lo + hi >> 1;
+	    if (_lines[mid].pos[_v] < _a->pos[_v] - thresh)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	for (; lo < _rows[r + 1].start &&
+	       _lines[lo].pos[_v] <= _a->pos[_v] + thresh;
+	     lo++) {
+	    const qr_finder_line *b;
+	    if (_mark[lo])
+		continue;
+	    b = _lines + lo;
+	    if (abs(_a->pos[_v] + _a->len - b->pos[_v] - b->len) > thresh)
+		continue;
+	    if (_a->boffs > 0 && b->boffs > 0 &&
+		abs(_a->pos[_v] - _a->boffs - b->pos[_v] + b->boffs) >
+		    thresh) {
+		continue;
+	    }
+	    if (_a->eoffs > 0 && b->eoffs > 0 &&
+		abs(_a->pos[_v] + _a->len + _a->eoffs - b->pos[_v] - b->len -
+		    b->eoffs) > thresh) {
+		continue;
+	    }
+	    *_r = r;
+	    return lo;
+	}
+    }
+    return -1;
 }
 
 /*Clusters adjacent lines into groups that are large enough to be crossing a
    finder pattern (relative to their length).
+  _arena:     The scratch memory to use.
   _clusters:  The buffer in which to store the clusters found.
   _neighbors: The buffer used to store the lists of lines in each cluster.
-  _lines:     The list of lines to cluster.
-              Horizontal lines must be sorted in ascending order by Y
-               coordinate, with ties broken by X coordinate.
-              Vertical lines must be sorted in ascending order by X coordinate,
-               with ties broken by Y coordinate.
+  _lines:     The list of lines to cluster, sorted by qr_finder_lines_sort().
   _nlines:    The number of lines in the set of lines to cluster.
+  _rows:      The scan lines with any lines on them.
   _v:         0 for horizontal lines, or 1 for vertical lines.
   Return: The number of clusters.*/
-static int qr_finder_cluster_lines(qr_finder_cluster *_clusters,
+static int qr_finder_cluster_lines(qr_arena *_arena,
+				   qr_finder_cluster *_clusters,
 				   qr_finder_line **_neighbors,
-				   qr_finder_line *_lines, int _nlines, int _v)
+				   qr_finder_line *_lines, int _nlines,
+				   const qr_finder_row *_rows, int _v)
 {
     unsigned char *mark;
     qr_finder_line **neighbors;
     int nneighbors;
     int nclusters;
+    int ri;
     int i;
     /*TODO: Kalman filters!*/
-    mark      = (unsigned char *)calloc(_nlines, sizeof(*mark));
+    mark      = (unsigned char *)qr_arena_calloc(_arena, _nlines, sizeof(*mark));
     neighbors = _neighbors;
     nclusters = 0;
-    for (i = 0; i < _nlines - 1; i++)
+    for (i = ri = 0; i < _nlines - 1; i++) {
+	if (_rows[ri + 1].start <= i)
+	    ri++;
 	if (!mark[i]) {
 	    int len;
+	    int r;
 	    int j;
 	    nneighbors	 = 1;
 	    neighbors[0] = _lines + i;
 	    len		 = _lines[i].len;
-	    for (j = i + 1; j < _nlines; j++)
-		if (!mark[j]) {
-		    const qr_finder_line *a;
-		    const qr_finder_line *b;
-		    int thresh;
-		    a = neighbors[nneighbors - 1];
-		    b = _lines + j;
-		    /*The clustering threshold is proportional to the size of the lines,
-         since minor noise in large areas can interrupt patterns more easily
-         at high resolutions.*/
-		    thresh = a->len + 7 >> 2;
-		    if (abs(a->pos[1 - _v] - b->pos[1 - _v]) > thresh)
-			break;
-		    if (abs(a->pos[_v] - b->pos[_v]) > thresh)
-			continue;
-		    if (abs(a->pos[_v] + a->len - b->pos[_v] - b->len) > thresh)
-			continue;
-		    if (a->boffs > 0 && b->boffs > 0 &&
-			abs(a->pos[_v] - a->boffs - b->pos[_v] + b->boffs) >
-			    thresh) {
-			continue;
-		    }
-		    if (a->eoffs > 0 && b->eoffs > 0 &&
-			abs(a->pos[_v] + a->len + a->eoffs - b->pos[_v] -
-			    b->len - b->eoffs) > thresh) {
-			continue;
-		    }
-		    neighbors[nneighbors++] = _lines + j;
-		    len += b->len;
-		}
+	    for (r = ri, j = i + 1;; j++) {
+		j = qr_finder_cluster_next(_lines, _rows, mark, &r, j,
+					   neighbors[nneighbors - 1], _v);
+		if (j < 0)
+		    break;
+		neighbors[nneighbors++] = _lines + j;
+		len += _lines[j].len;
+	    }
 	    /*We require at least three lines to form a cluster, which eliminates a
        large number of false positives, saving considerable decoding time.
       This should still be sufficient for 1-pixel codes with no noise.*/
@@ -238,7 +614,7 @@ static int qr_finder_cluster_lines(qr_finder_cluster *_clusters,
 		nclusters++;
 	    }
 	}
-    free(mark);
+    }
     return nclusters;
 }
 
@@ -309,6 +685,7 @@ static int qr_finder_lines_are_crossing(const qr_finder_line *_hline,
 
 /*Finds horizontal clusters that cross corresponding vertical clusters,
    presumably corresponding to a finder center.
+  _arena:      The scratch memory to use.
   _center:     The buffer in which to store putative finder centers.
   _edge_pts:   The buffer to use for the edge point lists for each finder
                 center.
@@ -317,7 +694,8 @@ static int qr_finder_lines_are_crossing(const qr_finder_line *_hline,
   _vclusters:  The clusters of vertical lines crossing finder patterns.
   _nvclusters: The number of vertical line clusters.
   Return: The number of putative finder centers.*/
-static int qr_finder_find_crossings(qr_finder_center *_centers,
+static int qr_finder_find_crossings(qr_arena *_arena,
+				    qr_finder_center *_centers,
 				    qr_finder_edge_pt *_edge_pts,
 				    qr_finder_cluster *_hclusters,
 				    int _nhclusters,
@@ -331,12 +709,12 @@ static int qr_finder_find_crossings(qr_finder_center *_centers,
     int ncenters;
     int i;
     int j;
-    hneighbors =
-	(qr_finder_cluster **)malloc(_nhclusters * sizeof(*hneighbors));
-    vneighbors =
-	(qr_finder_cluster **)malloc(_nvclusters * sizeof(*vneighbors));
-    hmark    = (unsigned char *)calloc(_nhclusters, sizeof(*hmark));
-    vmark    = (unsigned char *)calloc(_nvclusters, sizeof(*vmark));
+    hneighbors = (qr_finder_cluster **)qr_arena_alloc(
+	_arena, _nhclusters * sizeof(*hneighbors));
+    vneighbors = (qr_finder_cluster **)qr_arena_alloc(
+	_arena, _nvclusters * sizeof(*vneighbors));
+    hmark = (unsigned char *)qr_arena_calloc(_arena, _nhclusters, sizeof(*hmark));
+    vmark = (unsigned char *)qr_arena_calloc(_arena, _nvclusters, sizeof(*vmark));
     ncenters = 0;
     /*TODO: This may need some re-working.
     We should be finding groups of clusters such that _all_ horizontal lines in
@@ -402,10 +780,6 @@ static int qr_finder_find_crossings(qr_finder_center *_centers,
 		_edge_pts += nedge_pts;
 	    }
 	}
-    free(vmark);
-    free(hmark);
-    free(vneighbors);
-    free(hneighbors);
     /*Sort the centers by decreasing numbers of edge points.*/
     qsort(_centers, ncenters, sizeof(*_centers), qr_finder_center_cmp);
     return ncenters;
@@ -420,11 +794,9 @@ static int qr_finder_find_crossings(qr_finder_center *_centers,
    qr_finder_find_crossings() will filter most of them out.
   Where horizontal and vertical clusters cross, a prospective finder center is
    returned.
-  _centers:  Returns a pointer to a freshly-allocated list of finder centers.
-             This must be freed by the caller.
-  _edge_pts: Returns a pointer to a freshly-allocated list of edge points
-              around those centers.
-             This must be freed by the caller.
+  _centers:  Returns a pointer to a list of finder centers.
+  _edge_pts: Returns a pointer to a list of edge points around those centers.
+             Both are allocated from the reader's scratch memory.
   _img:      The binary image to search.
   _width:    The width of the image.
   _height:   The height of the image.
@@ -437,33 +809,40 @@ static int qr_finder_centers_locate(qr_finder_center **_centers,
     int nhlines		   = reader->finder_lines[0].nlines;
     qr_finder_line *vlines = reader->finder_lines[1].lines;
     int nvlines		   = reader->finder_lines[1].nlines;
+    qr_arena *arena	   = &reader->arena;
 
     qr_finder_line **hneighbors;
     qr_finder_cluster *hclusters;
+    qr_finder_row *hrows;
     int nhclusters;
     qr_finder_line **vneighbors;
     qr_finder_cluster *vclusters;
+    qr_finder_row *vrows;
     int nvclusters;
     int ncenters;
 
-    /*Cluster the detected lines.*/
-    hneighbors = (qr_finder_line **)malloc(nhlines * sizeof(*hneighbors));
+    /*Cluster the detected lines.
+    We need horizontal lines to be sorted by Y coordinate, with ties broken by
+     X coordinate, and vertical lines by X coordinate, with ties broken by Y
+     coordinate.
+    Rows are scanned in alternating directions and columns are scanned after
+     all the rows, so sort the lines we found here.*/
+    hrows      = qr_finder_lines_sort(arena, hlines, nhlines, 0);
+    hneighbors = (qr_finder_line **)qr_arena_alloc(
+	arena, nhlines * sizeof(*hneighbors));
     /*We require more than one line per cluster, so there are at most nhlines/2.*/
-    hclusters =
-	(qr_finder_cluster *)malloc((nhlines >> 1) * sizeof(*hclusters));
-    nhclusters =
-	qr_finder_cluster_lines(hclusters, hneighbors, hlines, nhlines, 0);
-    /*We need vertical lines to be sorted by X coordinate, with ties broken by Y
-     coordinate, for clustering purposes.
-    We scan the image in the opposite order for cache efficiency, so sort the
-     lines we found here.*/
-    qsort(vlines, nvlines, sizeof(*vlines), qr_finder_vline_cmp);
-    vneighbors = (qr_finder_line **)malloc(nvlines * sizeof(*vneighbors));
+    hclusters  = (qr_finder_cluster *)qr_arena_alloc(
+	arena, (nhlines >> 1) * sizeof(*hclusters));
+    nhclusters = qr_finder_cluster_lines(arena, hclusters, hneighbors, hlines,
+					 nhlines, hrows, 0);
+    vrows      = qr_finder_lines_sort(arena, vlines, nvlines, 1);
+    vneighbors = (qr_finder_line **)qr_arena_alloc(
+	arena, nvlines * sizeof(*vneighbors));
     /*We require more than one line per cluster, so there are at most nvlines/2.*/
-    vclusters =
-	(qr_finder_cluster *)malloc((nvlines >> 1) * sizeof(*vclusters));
-    nvclusters =
-	qr_finder_cluster_lines(vclusters, vneighbors, vlines, nvlines, 1);
+    vclusters  = (qr_finder_cluster *)qr_arena_alloc(
+	arena, (nvlines >> 1) * sizeof(*vclusters));
+    nvclusters = qr_finder_cluster_lines(arena, vclusters, vneighbors, vlines,
+					 nvlines, vrows, 1);
     /*Find line crossings among the clusters.*/
     if (nhclusters >= 3 && nvclusters >= 3) {
 	qr_finder_edge_pt *edge_pts;
@@ -476,19 +855,16 @@ static int qr_finder_centers_locate(qr_finder_center **_centers,
 	for (i = 0; i < nvclusters; i++)
 	    nedge_pts += vclusters[i].nlines;
 	nedge_pts <<= 1;
-	edge_pts  = (qr_finder_edge_pt *)malloc(nedge_pts * sizeof(*edge_pts));
-	centers	  = (qr_finder_center *)malloc(QR_MINI(nhclusters, nvclusters) *
-					       sizeof(*centers));
-	ncenters  = qr_finder_find_crossings(centers, edge_pts, hclusters,
+	edge_pts  = (qr_finder_edge_pt *)qr_arena_alloc(
+	    arena, nedge_pts * sizeof(*edge_pts));
+	centers	  = (qr_finder_center *)qr_arena_alloc(
+	    arena, QR_MINI(nhclusters, nvclusters) * sizeof(*centers));
+	ncenters  = qr_finder_find_crossings(arena, centers, edge_pts, hclusters,
 					     nhclusters, vclusters, nvclusters);
 	*_centers = centers;
 	*_edge_pts = edge_pts;
     } else
 	ncenters = 0;
-    free(vclusters);
-    free(vneighbors);
-    free(hclusters);
-    free(hneighbors);
     return ncenters;
 }
 
@@ -1194,8 +1570,8 @@ static void qr_finder_ransac(qr_finder *_f, const qr_aff *_hom,
 
 /*Perform a least-squares line fit to an edge of a finder pattern using the
    inliers found by RANSAC.*/
-static int qr_line_fit_finder_edge(qr_line _l, const qr_finder *_f, int _e,
-				   int _res)
+static int qr_line_fit_finder_edge(qr_arena *_arena, qr_line _l,
+				   const qr_finder *_f, int _e, int _res)
 {
     qr_finder_edge_pt *edge_pts;
     qr_point *pts;
@@ -1207,7 +1583,7 @@ static int qr_line_fit_finder_edge(qr_line _l, const qr_finder *_f, int _e,
     /*We could write a custom version of qr_line_fit_points that accesses
      edge_pts directly, but this saves on code size and doesn't measurably slow
      things down.*/
-    pts	     = (qr_point *)malloc(npts * sizeof(*pts));
+    pts	     = (qr_point *)qr_arena_alloc(_arena, npts * sizeof(*pts));
     edge_pts = _f->edge_pts[_e];
     for (i = 0; i < npts; i++) {
 	pts[i][0] = edge_pts[i].pos[0];
@@ -1217,7 +1593,6 @@ static int qr_line_fit_finder_edge(qr_line _l, const qr_finder *_f, int _e,
     /*Make sure the center of the finder pattern lies in the positive halfspace
      of the line.*/
     qr_line_orient(_l, _f->c->pos[0], _f->c->pos[1]);
-    free(pts);
     return 0;
 }
 
@@ -1226,9 +1601,9 @@ static int qr_line_fit_finder_edge(qr_line _l, const qr_finder *_f, int _e,
   Unlike a normal edge fit, we guarantee that this one succeeds by creating at
    least one point on each edge using the estimated module size if it has no
    inliers.*/
-static void qr_line_fit_finder_pair(qr_line _l, const qr_aff *_aff,
-				    const qr_finder *_f0, const qr_finder *_f1,
-				    int _e)
+static void qr_line_fit_finder_pair(qr_arena *_arena, qr_line _l,
+				    const qr_aff *_aff, const qr_finder *_f0,
+				    const qr_finder *_f1, int _e)
 {
     qr_point *pts;
     int npts;
@@ -1243,7 +1618,7 @@ static void qr_line_fit_finder_pair(qr_line _l, const qr_aff *_aff,
      edge_pts directly, but this saves on code size and doesn't measurably slow
      things down.*/
     npts = QR_MAXI(n0, 1) + QR_MAXI(n1, 1);
-    pts	 = (qr_point *)malloc(npts * sizeof(*pts));
+    pts	 = (qr_point *)qr_arena_alloc(_arena, npts * sizeof(*pts));
     if (n0 > 0) {
 	edge_pts = _f0->edge_pts[_e];
 	for (i = 0; i < n0; i++) {
@@ -1273,10 +1648,9 @@ static void qr_line_fit_finder_pair(qr_line _l, const qr_aff *_aff,
     qr_line_fit_points(_l, pts, npts, _aff->res);
     /*Make sure at least one finder center lies in the positive halfspace.*/
     qr_line_orient(_l, _f0->c->pos[0], _f0->c->pos[1]);
-    free(pts);
 }
 
-static int qr_finder_quick_crossing_check(const unsigned char *_img, int _width,
+static int qr_finder_quick_crossing_check(qr_binarizer *_img, int _width,
 					  int _height, int _x0, int _y0,
 					  int _x1, int _y1, int _v)
 {
@@ -1291,9 +1665,10 @@ static int qr_finder_quick_crossing_check(const unsigned char *_img, int _width,
 	_x1 >= _width || _y1 < 0 || _y1 >= _height) {
 	return -1;
     }
-    if ((!_img[_y0 * _width + _x0]) != _v || (!_img[_y1 * _width + _x1]) != _v)
+    if ((!qr_binarizer_get(_img, _x0, _y0)) != _v ||
+	(!qr_binarizer_get(_img, _x1, _y1)) != _v)
 	return 1;
-    if ((!_img[(_y0 + _y1 >> 1) * _width + (_x0 + _x1 >> 1)]) == _v)
+    if ((!qr_binarizer_get(_img, _x0 + _x1 >> 1, _y0 + _y1 >> 1)) == _v)
 	return -1;
     return 0;
 }
@@ -1303,7 +1678,7 @@ static int qr_finder_quick_crossing_check(const unsigned char *_img, int _width,
   All coordinates, which are NOT in subpel resolution, must lie inside the
    image, and the endpoints are already assumed to have the value !_v.
   The returned value is in subpel resolution.*/
-static int qr_finder_locate_crossing(const unsigned char *_img, int _width,
+static int qr_finder_locate_crossing(qr_binarizer *_img, int _width,
 				     int _height, int _x0, int _y0, int _x1,
 				     int _y1, int _v, qr_point _p)
 {
@@ -1338,7 +1713,7 @@ static int qr_finder_locate_crossing(const unsigned char *_img, int _width,
 	    x0[1 - steep] += step[1 - steep];
 	    err -= dx[steep];
 	}
-	if ((!_img[x0[1] * _width + x0[0]]) != _v)
+	if ((!qr_binarizer_get(_img, x0[0], x0[1])) != _v)
 	    break;
     }
     /*Find the last crossing from _v to !_v.*/
@@ -1352,7 +1727,7 @@ static int qr_finder_locate_crossing(const unsigned char *_img, int _width,
 	    x1[1 - steep] -= step[1 - steep];
 	    err -= dx[steep];
 	}
-	if ((!_img[x1[1] * _width + x1[0]]) != _v)
+	if ((!qr_binarizer_get(_img, x1[0], x1[1])) != _v)
 	    break;
     }
     /*Return the midpoint of the _v segment.*/
@@ -1408,13 +1783,13 @@ static int qr_hamming_dist(unsigned _y1, unsigned _y2, int _maxdiff)
 
 /*Retrieve a bit (guaranteed to be 0 or 1) from the image, given coordinates in
    subpel resolution which have not been bounds checked.*/
-static int qr_img_get_bit(const unsigned char *_img, int _width, int _height,
+static int qr_img_get_bit(qr_binarizer *_img, int _width, int _height,
 			  int _x, int _y)
 {
     _x >>= QR_FINDER_SUBPREC;
     _y >>= QR_FINDER_SUBPREC;
-    return _img[QR_CLAMPI(0, _y, _height - 1) * _width +
-		QR_CLAMPI(0, _x, _width - 1)] != 0;
+    return qr_binarizer_get(_img, QR_CLAMPI(0, _x, _width - 1),
+			    QR_CLAMPI(0, _y, _height - 1)) != 0;
 }
 
 #if defined(QR_DEBUG)
@@ -1422,8 +1797,8 @@ static int qr_img_get_bit(const unsigned char *_img, int _width, int _height,
 
 static void qr_finder_dump_aff_undistorted(qr_finder *_ul, qr_finder *_ur,
 					   qr_finder *_dl, qr_aff *_aff,
-					   const unsigned char *_img,
-					   int _width, int _height)
+					   qr_binarizer *_img, int _width,
+					   int _height)
 {
     unsigned char *gimg;
     FILE *fout;
@@ -1446,9 +1821,7 @@ static void qr_finder_dump_aff_undistorted(qr_finder *_ul, qr_finder *_ur,
 	    qr_point p;
 	    qr_aff_project(p, _aff, (j - 64) << lpsz, (i - 64) << lpsz);
 	    gimg[i * dim + j] =
-		_img[QR_CLAMPI(0, p[1] >> QR_FINDER_SUBPREC, _height - 1) *
-			 _width +
-		     QR_CLAMPI(0, p[0] >> QR_FINDER_SUBPREC, _width - 1)];
+		-qr_img_get_bit(_img, _width, _height, p[0], p[1]) & 0xFF;
 	}
     {
 	min = (_ur->o[0] - 7 * _ur->size[0] >> lpsz) + 64;
@@ -1514,8 +1887,8 @@ static void qr_finder_dump_aff_undistorted(qr_finder *_ul, qr_finder *_ur,
 
 static void qr_finder_dump_hom_undistorted(qr_finder *_ul, qr_finder *_ur,
 					   qr_finder *_dl, qr_hom *_hom,
-					   const unsigned char *_img,
-					   int _width, int _height)
+					   qr_binarizer *_img, int _width,
+					   int _height)
 {
     unsigned char *gimg;
     FILE *fout;
@@ -1538,9 +1911,7 @@ static void qr_finder_dump_hom_undistorted(qr_finder *_ul, qr_finder *_ur,
 	    qr_point p;
 	    qr_hom_project(p, _hom, (j - 128) << lpsz, (i - 128) << lpsz);
 	    gimg[i * dim + j] =
-		_img[QR_CLAMPI(0, p[1] >> QR_FINDER_SUBPREC, _height - 1) *
-			 _width +
-		     QR_CLAMPI(0, p[0] >> QR_FINDER_SUBPREC, _width - 1)];
+		-qr_img_get_bit(_img, _width, _height, p[0], p[1]) & 0xFF;
 	}
     {
 	min = (_ur->o[0] - 7 * _ur->size[0] >> lpsz) + 128;
@@ -1816,6 +2187,155 @@ static void qr_hom_cell_fproject(qr_point _p, const qr_hom_cell *_cell, int _x,
     }
 }
 
+/*Finishes the projection of a run of _n points spaced evenly in homogeneous
+   coordinates, starting at (_x,_y,_w) and stepping by (_dx,_dy,_dw).
+  This gives exactly the same results as qr_hom_cell_fproject() on each point.
+  The quotients are computed in double precision, four at a time: a quotient of
+   two 32-bit integers that is not itself an integer is at least 1/_w away from
+   one, which is far more than the rounding error, so truncating it is exact.*/
+static void qr_hom_cell_fproject_run(qr_point *_p, const qr_hom_cell *_cell,
+				     int _x, int _y, int _w, int _dx, int _dy,
+				     int _dw, int _n)
+{
+    int i;
+    i = 0;
+#if defined(QR_PROJECT_SSE2)
+    {
+	__m128i x;
+	__m128i y;
+	__m128i w;
+	__m128i x0;
+	__m128i y0;
+	x0 = _mm_set1_epi32(_cell->x0);
+	y0 = _mm_set1_epi32(_cell->y0);
+	x  = _mm_set_epi32(_x + 3 * _dx, _x + 2 * _dx, _x + _dx, _x);
+	y  = _mm_set_epi32(_y + 3 * _dy, _y + 2 * _dy, _y + _dy, _y);
+	w  = _mm_set_epi32(_w + 3 * _dw, _w + 2 * _dw, _w + _dw, _w);
+	for (; i + 4 <= _n; i += 4) {
+	    __m128i s;
+	    __m128i h;
+	    __m128i px;
+	    __m128i py;
+	    __m128d wlo;
+	    __m128d whi;
+	    __m128i nx;
+	    __m128i ny;
+	    __m128i ax;
+	    __m128i ay;
+	    __m128i aw;
+	    /*Make the denominators positive.*/
+	    s  = _mm_srai_epi32(w, 31);
+	    ax = _mm_sub_epi32(_mm_xor_si128(x, s), s);
+	    ay = _mm_sub_epi32(_mm_xor_si128(y, s), s);
+	    aw = _mm_sub_epi32(_mm_xor_si128(w, s), s);
+	    /*Round half away from zero, like QR_DIVROUND().*/
+	    h  = _mm_srai_epi32(aw, 1);
+	    s  = _mm_srai_epi32(ax, 31);
+	    nx = _mm_add_epi32(ax, _mm_xor_si128(_mm_add_epi32(h, s), s));
+	    s  = _mm_srai_epi32(ay, 31);
+	    ny = _mm_add_epi32(ay, _mm_xor_si128(_mm_add_epi32(h, s), s));
+	    wlo = _mm_cvtepi32_pd(aw);
+	    whi = _mm_cvtepi32_pd(_mm_shuffle_epi32(aw, 0xEE));
+	    px	= _mm_unpacklo_epi64(
+		 _mm_cvttpd_epi32(_mm_div_pd(_mm_cvtepi32_pd(nx), wlo)),
+		 _mm_cvttpd_epi32(_mm_div_pd(
+		     _mm_cvtepi32_pd(_mm_shuffle_epi32(nx, 0xEE)), whi)));
+	    py = _mm_unpacklo_epi64(
+		_mm_cvttpd_epi32(_mm_div_pd(_mm_cvtepi32_pd(ny), wlo)),
+		_mm_cvttpd_epi32(_mm_div_pd(
+		    _mm_cvtepi32_pd(_mm_shuffle_epi32(ny, 0xEE)), whi)));
+	    px = _mm_add_epi32(px, x0);
+	    py = _mm_add_epi32(py, y0);
+	    _mm_storeu_si128((__m128i *)_p[i], _mm_unpacklo_epi32(px, py));
+	    _mm_storeu_si128((__m128i *)_p[i + 2], _mm_unpackhi_epi32(px, py));
+	    /*Points at infinity are handled by the scalar code.*/
+	    if (_mm_movemask_epi8(_mm_cmpeq_epi32(w, _mm_setzero_si128()))) {
+		int k;
+		for (k = 0; k < 4; k++) {
+		    qr_hom_cell_fproject(_p[i + k], _cell, _x + k * _dx,
+					 _y + k * _dy, _w + k * _dw);
+		}
+	    }
+	    x = _mm_add_epi32(x, _mm_set1_epi32(4 * _dx));
+	    y = _mm_add_epi32(y, _mm_set1_epi32(4 * _dy));
+	    w = _mm_add_epi32(w, _mm_set1_epi32(4 * _dw));
+	    _x += 4 * _dx;
+	    _y += 4 * _dy;
+	    _w += 4 * _dw;
+	}
+    }
+#elif defined(QR_PROJECT_NEON)
+    {
+	int32x4_t x;
+	int32x4_t y;
+	int32x4_t w;
+	int32x4_t x0;
+	int32x4_t y0;
+	static const int32_t STEPS[4] = { 0, 1, 2, 3 };
+	x  = vmlaq_n_s32(vdupq_n_s32(_x), vld1q_s32(STEPS), _dx);
+	y  = vmlaq_n_s32(vdupq_n_s32(_y), vld1q_s32(STEPS), _dy);
+	w  = vmlaq_n_s32(vdupq_n_s32(_w), vld1q_s32(STEPS), _dw);
+	x0 = vdupq_n_s32(_cell->x0);
+	y0 = vdupq_n_s32(_cell->y0);
+	for (; i + 4 <= _n; i += 4) {
+	    int32x4x2_t pt;
+	    int32x4_t s;
+	    int32x4_t h;
+	    int32x4_t nx;
+	    int32x4_t ny;
+	    int32x4_t ax;
+	    int32x4_t ay;
+	    int32x4_t aw;
+	    float64x2_t wlo;
+	    float64x2_t whi;
+	    s  = vshrq_n_s32(w, 31);
+	    ax = vsubq_s32(veorq_s32(x, s), s);
+	    ay = vsubq_s32(veorq_s32(y, s), s);
+	    aw = vsubq_s32(veorq_s32(w, s), s);
+	    h  = vshrq_n_s32(aw, 1);
+	    s  = vshrq_n_s32(ax, 31);
+	    nx = vaddq_s32(ax, veorq_s32(vaddq_s32(h, s), s));
+	    s  = vshrq_n_s32(ay, 31);
+	    ny = vaddq_s32(ay, veorq_s32(vaddq_s32(h, s), s));
+	    wlo = vcvtq_f64_s64(vmovl_s32(vget_low_s32(aw)));
+	    whi = vcvtq_f64_s64(vmovl_high_s32(aw));
+	    pt.val[0] = vcombine_s32(
+		vmovn_s64(vcvtq_s64_f64(vdivq_f64(
+		    vcvtq_f64_s64(vmovl_s32(vget_low_s32(nx))), wlo))),
+		vmovn_s64(vcvtq_s64_f64(
+		    vdivq_f64(vcvtq_f64_s64(vmovl_high_s32(nx)), whi))));
+	    pt.val[1] = vcombine_s32(
+		vmovn_s64(vcvtq_s64_f64(vdivq_f64(
+		    vcvtq_f64_s64(vmovl_s32(vget_low_s32(ny))), wlo))),
+		vmovn_s64(vcvtq_s64_f64(
+		    vdivq_f64(vcvtq_f64_s64(vmovl_high_s32(ny)), whi))));
+	    pt.val[0] = vaddq_s32(pt.val[0], x0);
+	    pt.val[1] = vaddq_s32(pt.val[1], y0);
+	    vst2q_s32(_p[i], pt);
+	    if (vmaxvq_u32(vceqq_s32(w, vdupq_n_s32(0)))) {
+		int k;
+		for (k = 0; k < 4; k++) {
+		    qr_hom_cell_fproject(_p[i + k], _cell, _x + k * _dx,
+					 _y + k * _dy, _w + k * _dw);
+		}
+	    }
+	    x = vaddq_s32(x, vdupq_n_s32(4 * _dx));
+	    y = vaddq_s32(y, vdupq_n_s32(4 * _dy));
+	    w = vaddq_s32(w, vdupq_n_s32(4 * _dw));
+	    _x += 4 * _dx;
+	    _y += 4 * _dy;
+	    _w += 4 * _dw;
+	}
+    }
+#endif
+    for (; i < _n; i++) {
+	qr_hom_cell_fproject(_p[i], _cell, _x, _y, _w);
+	_x += _dx;
+	_y += _dy;
+	_w += _dw;
+    }
+}
+
 static void qr_hom_cell_project(qr_point _p, const qr_hom_cell *_cell, int _u,
 				int _v, int _res)
 {
@@ -1833,8 +2353,8 @@ static void qr_hom_cell_project(qr_point _p, const qr_hom_cell *_cell, int _u,
 /*Retrieves the bits corresponding to the alignment pattern template centered
    at the given location in the original image (at subpel precision).*/
 static unsigned qr_alignment_pattern_fetch(qr_point _p[5][5], int _x0, int _y0,
-					   const unsigned char *_img,
-					   int _width, int _height)
+					   qr_binarizer *_img, int _width,
+					   int _height)
 {
     unsigned v;
     int i;
@@ -1857,7 +2377,7 @@ static unsigned qr_alignment_pattern_fetch(qr_point _p[5][5], int _x0, int _y0,
 /*Searches for an alignment pattern near the given location.*/
 static int qr_alignment_pattern_search(qr_point _p, const qr_hom_cell *_cell,
 				       int _u, int _v, int _r,
-				       const unsigned char *_img, int _width,
+				       qr_binarizer *_img, int _width,
 				       int _height)
 {
     qr_point c[4];
@@ -2090,10 +2610,10 @@ static int qr_alignment_pattern_search(qr_point _p, const qr_hom_cell *_cell,
     return 0;
 }
 
-static int qr_hom_fit(qr_hom *_hom, qr_finder *_ul, qr_finder *_ur,
-		      qr_finder *_dl, qr_point _p[4], const qr_aff *_aff,
-		      isaac_ctx *_isaac, const unsigned char *_img, int _width,
-		      int _height)
+static int qr_hom_fit(qr_arena *_arena, qr_hom *_hom, qr_finder *_ul,
+		      qr_finder *_ur, qr_finder *_dl, qr_point _p[4],
+		      const qr_aff *_aff, isaac_ctx *_isaac, qr_binarizer *_img,
+		      int _width, int _height)
 {
     qr_point *b;
     int nb;
@@ -2149,14 +2669,14 @@ static int qr_hom_fit(qr_hom *_hom, qr_finder *_ul, qr_finder *_ur,
      the other two finder patterns aren't, something is wrong.*/
     qr_finder_ransac(_ul, _aff, _isaac, 0);
     qr_finder_ransac(_dl, _aff, _isaac, 0);
-    qr_line_fit_finder_pair(l[0], _aff, _ul, _dl, 0);
+    qr_line_fit_finder_pair(_arena, l[0], _aff, _ul, _dl, 0);
     if (qr_line_eval(l[0], _dl->c->pos[0], _dl->c->pos[1]) < 0 ||
 	qr_line_eval(l[0], _ur->c->pos[0], _ur->c->pos[1]) < 0) {
 	return -1;
     }
     qr_finder_ransac(_ul, _aff, _isaac, 2);
     qr_finder_ransac(_ur, _aff, _isaac, 2);
-    qr_line_fit_finder_pair(l[2], _aff, _ul, _ur, 2);
+    qr_line_fit_finder_pair(_arena, l[2], _aff, _ul, _ur, 2);
     if (qr_line_eval(l[2], _dl->c->pos[0], _dl->c->pos[1]) < 0 ||
 	qr_line_eval(l[2], _ur->c->pos[0], _ur->c->pos[1]) < 0) {
 	return -1;
@@ -2176,7 +2696,7 @@ static int qr_hom_fit(qr_hom *_hom, qr_finder *_ul, qr_finder *_ur,
     At the end, we re-fit the line using all such sample points found.*/
     drv = _ur->size[1] >> 1;
     qr_finder_ransac(_ur, _aff, _isaac, 1);
-    if (qr_line_fit_finder_edge(l[1], _ur, 1, _aff->res) >= 0) {
+    if (qr_line_fit_finder_edge(_arena, l[1], _ur, 1, _aff->res) >= 0) {
 	if (qr_line_eval(l[1], _ul->c->pos[0], _ul->c->pos[1]) < 0 ||
 	    qr_line_eval(l[1], _dl->c->pos[0], _dl->c->pos[1]) < 0) {
 	    return -1;
@@ -2191,7 +2711,7 @@ static int qr_hom_fit(qr_hom *_hom, qr_finder *_ul, qr_finder *_ur,
     rv	= _ur->o[1] - 2 * drv;
     dbu = _dl->size[0] >> 1;
     qr_finder_ransac(_dl, _aff, _isaac, 3);
-    if (qr_line_fit_finder_edge(l[3], _dl, 3, _aff->res) >= 0) {
+    if (qr_line_fit_finder_edge(_arena, l[3], _dl, 3, _aff->res) >= 0) {
 	if (qr_line_eval(l[3], _ul->c->pos[0], _ul->c->pos[1]) < 0 ||
 	    qr_line_eval(l[3], _ur->c->pos[0], _ur->c->pos[1]) < 0) {
 	    return -1;
@@ -2207,13 +2727,13 @@ static int qr_hom_fit(qr_hom *_hom, qr_finder *_ul, qr_finder *_ur,
     /*Set up the initial point lists.*/
     nr = rlastfit = _ur->ninliers[1];
     cr		  = nr + (_dl->o[1] - rv + drv - 1) / drv;
-    r		  = (qr_point *)malloc(cr * sizeof(*r));
+    r		  = (qr_point *)qr_arena_alloc(_arena, cr * sizeof(*r));
     for (i = 0; i < _ur->ninliers[1]; i++) {
 	memcpy(r[i], _ur->edge_pts[1][i].pos, sizeof(r[i]));
     }
     nb = blastfit = _dl->ninliers[3];
     cb		  = nb + (_ur->o[0] - bu + dbu - 1) / dbu;
-    b		  = (qr_point *)malloc(cb * sizeof(*b));
+    b		  = (qr_point *)qr_arena_alloc(_arena, cb * sizeof(*b));
     for (i = 0; i < _dl->ninliers[3]; i++) {
 	memcpy(b[i], _dl->edge_pts[3][i].pos, sizeof(b[i]));
     }
@@ -2257,7 +2777,7 @@ static int qr_hom_fit(qr_hom *_hom, qr_finder *_ul, qr_finder *_ur,
 	    y1 = ry - dryj >> _aff->res + QR_FINDER_SUBPREC;
 	    if (nr >= cr) {
 		cr = cr << 1 | 1;
-		r  = (qr_point *)realloc(r, cr * sizeof(*r));
+		r  = (qr_point *)qr_arena_grow(_arena, r, nr, cr, sizeof(*r));
 	    }
 	    ret = qr_finder_quick_crossing_check(_img, _width, _height, x0, y0,
 						 x1, y1, 1);
@@ -2307,7 +2827,7 @@ static int qr_hom_fit(qr_hom *_hom, qr_finder *_ul, qr_finder *_ur,
 	    y1 = by - dbyj >> _aff->res + QR_FINDER_SUBPREC;
 	    if (nb >= cb) {
 		cb = cb << 1 | 1;
-		b  = (qr_point *)realloc(b, cb * sizeof(*b));
+		b  = (qr_point *)qr_arena_grow(_arena, b, nb, cb, sizeof(*b));
 	    }
 	    ret = qr_finder_quick_crossing_check(_img, _width, _height, x0, y0,
 						 x1, y1, 1);
@@ -2369,7 +2889,6 @@ static int qr_hom_fit(qr_hom *_hom, qr_finder *_ul, qr_finder *_ur,
 	l[1][1] = -_aff->fwd[0][1] + round >> shift;
 	l[1][2] = -(l[1][0] * p[0] + l[1][1] * p[1]);
     }
-    free(r);
     if (nb > 1)
 	qr_line_fit_points(l[3], b, nb, _aff->res);
     else {
@@ -2382,7 +2901,6 @@ static int qr_hom_fit(qr_hom *_hom, qr_finder *_ul, qr_finder *_ur,
 	l[3][1] = -_aff->fwd[0][0] + round >> shift;
 	l[3][2] = -(l[1][0] * p[0] + l[1][1] * p[1]);
     }
-    free(b);
     for (i = 0; i < 4; i++) {
 	if (qr_line_isect(_p[i], l[i & 1], l[2 + (i >> 1)]) < 0)
 	    return -1;
@@ -2527,7 +3045,7 @@ static unsigned bch18_6_encode(unsigned _x){
 
 /*Reads the version bits near a finder module and decodes the version number.*/
 static int qr_finder_version_decode(qr_finder *_f, const qr_hom *_hom,
-				    const unsigned char *_img, int _width,
+				    qr_binarizer *_img, int _width,
 				    int _height, int _dir)
 {
     qr_point q;
@@ -2606,7 +3124,7 @@ static int qr_finder_version_decode(qr_finder *_f, const qr_hom *_hom,
 /*Reads the format info bits near the finder modules and decodes them.*/
 static int qr_finder_fmt_info_decode(qr_finder *_ul, qr_finder *_ur,
 				     qr_finder *_dl, const qr_hom *_hom,
-				     const unsigned char *_img, int _width,
+				     qr_binarizer *_img, int _width,
 				     int _height)
 {
     qr_point p;
@@ -2810,12 +3328,14 @@ static inline void qr_svg_points(const char *cls, qr_point *p, int n)
   _img:      The binary input image.
   _width:    The width of the input image.
   _height:   The height of the input image.
+  The grid is allocated from _arena.
   Return: 0 on success, or a negative value on error.*/
-static void qr_sampling_grid_init(qr_sampling_grid *_grid, int _version,
+static void qr_sampling_grid_init(qr_arena *_arena, qr_sampling_grid *_grid,
+				  int _version,
 				  const qr_point _ul_pos,
 				  const qr_point _ur_pos,
 				  const qr_point _dl_pos, qr_point _p[4],
-				  const unsigned char *_img, int _width,
+				  qr_binarizer *_img, int _width,
 				  int _height)
 {
     qr_hom_cell base_cell;
@@ -2831,14 +3351,14 @@ static void qr_sampling_grid_init(qr_sampling_grid *_grid, int _version,
 		     _p[3][0], _p[3][1]);
     /*Allocate the array of cells.*/
     _grid->ncells   = nalign - 1;
-    _grid->cells[0] = (qr_hom_cell *)malloc((nalign - 1) * (nalign - 1) *
-					    sizeof(*_grid->cells[0]));
+    _grid->cells[0] = (qr_hom_cell *)qr_arena_alloc(
+	_arena, (nalign - 1) * (nalign - 1) * sizeof(*_grid->cells[0]));
     for (i = 1; i < _grid->ncells; i++)
 	_grid->cells[i] = _grid->cells[i - 1] + _grid->ncells;
     /*Initialize the function pattern mask.*/
-    _grid->fpmask =
-	(unsigned *)calloc(dim, (dim + QR_INT_BITS - 1 >> QR_INT_LOGBITS) *
-				    sizeof(*_grid->fpmask));
+    _grid->fpmask = (unsigned *)qr_arena_calloc(
+	_arena, dim,
+	(dim + QR_INT_BITS - 1 >> QR_INT_LOGBITS) * sizeof(*_grid->fpmask));
     /*Mask out the finder patterns (and separators and format info bits).*/
     qr_sampling_grid_fp_mask_rect(_grid, dim, 0, 0, 9, 9);
     qr_sampling_grid_fp_mask_rect(_grid, dim, 0, dim - 8, 9, 8);
@@ -2860,8 +3380,8 @@ static void qr_sampling_grid_init(qr_sampling_grid *_grid, int _version,
 	qr_point *p;
 	int j;
 	int k;
-	q = (qr_point *)malloc(nalign * nalign * sizeof(*q));
-	p = (qr_point *)malloc(nalign * nalign * sizeof(*p));
+	q = (qr_point *)qr_arena_alloc(_arena, nalign * nalign * sizeof(*q));
+	p = (qr_point *)qr_arena_alloc(_arena, nalign * nalign * sizeof(*p));
 	/*Initialize the alignment pattern position list.*/
 	align_pos[0]	      = 6;
 	align_pos[nalign - 1] = dim - 7;
@@ -2961,8 +3481,6 @@ static void qr_sampling_grid_init(qr_sampling_grid *_grid, int _version,
 	    }
 	}
 	qr_svg_points("align", p, nalign * nalign);
-	free(q);
-	free(p);
     }
     /*Set the limits over which each cell is used.*/
     memcpy(_grid->cell_limits, align_pos + 1,
@@ -2995,15 +3513,9 @@ static void qr_sampling_grid_init(qr_sampling_grid *_grid, int _version,
      transitions to the ideal grid locations.*/
 }
 
-static void qr_sampling_grid_clear(qr_sampling_grid *_grid)
-{
-    free(_grid->fpmask);
-    free(_grid->cells[0]);
-}
-
 #if defined(QR_DEBUG)
 static void qr_sampling_grid_dump(qr_sampling_grid *_grid, int _version,
-				  const unsigned char *_img, int _width,
+				  qr_binarizer *_img, int _width,
 				  int _height)
 {
     unsigned char *gimg;
@@ -3051,9 +3563,7 @@ static void qr_sampling_grid_dump(qr_sampling_grid *_grid, int _version,
 		    (cell->fwd[2][2] << QR_ALIGN_SUBPREC);
 		qr_hom_cell_fproject(p, cell, x, y, w);
 		gimg[i * dim + j] =
-		    _img[QR_CLAMPI(0, p[1] >> QR_FINDER_SUBPREC, _height - 1) *
-			     _width +
-			 QR_CLAMPI(0, p[0] >> QR_FINDER_SUBPREC, _width - 1)];
+		    -qr_img_get_bit(_img, _width, _height, p[0], p[1]) & 0xFF;
 	    }
 	}
     for (v = 0; v < 17 + (_version << 2); v++)
@@ -3210,9 +3720,11 @@ static void qr_data_mask_fill(unsigned *_mask, int _dim, int _pattern)
 
 static void qr_sampling_grid_sample(const qr_sampling_grid *_grid,
 				    unsigned *_data_bits, int _dim,
-				    int _fmt_info, const unsigned char *_img,
+				    int _fmt_info, qr_binarizer *_img,
 				    int _width, int _height)
 {
+    /*The projected centers of one column of a cell.*/
+    qr_point p[17 + (40 << 2)];
     int stride;
     int u0;
     int u1;
@@ -3250,27 +3762,22 @@ static void qr_sampling_grid_sample(const qr_sampling_grid *_grid,
 	    y0 = cell->fwd[1][0] * du + cell->fwd[1][1] * dv + cell->fwd[1][2];
 	    w0 = cell->fwd[2][0] * du + cell->fwd[2][1] * dv + cell->fwd[2][2];
 	    for (u = u0; u < u1; u++) {
-		int x;
-		int y;
-		int w;
 		int v;
-		x = x0;
-		y = y0;
-		w = w0;
+		/*Project the whole column of the cell at once, which is cheaper than
+		   skipping the modules in the function pattern one by one.*/
+		qr_hom_cell_fproject_run(p, cell, x0, y0, w0, cell->fwd[0][1],
+					 cell->fwd[1][1], cell->fwd[2][1],
+					 v1 - v0);
 		for (v = v0; v < v1; v++) {
-		    /*Skip doing all the divisions and bounds checks if the bit is in the
-             function pattern.*/
+		    /*Skip the bounds checks and the lookup if the bit is in the
+		       function pattern.*/
 		    if (!qr_sampling_grid_is_in_fp(_grid, _dim, u, v)) {
-			qr_point p;
-			qr_hom_cell_fproject(p, cell, x, y, w);
 			_data_bits[u * stride + (v >> QR_INT_LOGBITS)] ^=
-			    qr_img_get_bit(_img, _width, _height, p[0], p[1])
+			    qr_img_get_bit(_img, _width, _height, p[v - v0][0],
+					   p[v - v0][1])
 			    << (v & QR_INT_BITS - 1);
-			svg_path_moveto(SVG_ABS, p[0], p[1]);
+			svg_path_moveto(SVG_ABS, p[v - v0][0], p[v - v0][1]);
 		    }
-		    x += cell->fwd[0][1];
-		    y += cell->fwd[1][1];
-		    w += cell->fwd[2][1];
 		}
 		x0 += cell->fwd[0][0];
 		y0 += cell->fwd[1][0];
@@ -3453,15 +3960,18 @@ static const unsigned char QR_ALNUM_TABLE[45] = {
     'U', 'V', 'W', 'X', 'Y', 'Z', ' ', '$', '%', '*', '+', '-', '.', '/', ':'
 };
 
-static int qr_code_data_parse(qr_code_data *_qrdata, int _version,
-			      const unsigned char *_data, int _ndata)
+/*Parses the corrected data of a code.
+  The entries and their data are allocated from _arena, and are not freed on
+   failure: they are taken back with the rest of the arena.*/
+static int qr_code_data_parse(qr_code_data *_qrdata, qr_arena *_arena,
+			      int _version, const unsigned char *_data,
+			      int _ndata)
 {
     qr_pack_buf qpb;
     unsigned self_parity;
     int centries;
     int len_bits_idx;
-    /*Entries are stored directly in the struct during parsing.
-    Caller cleans up any allocated data on failure.*/
+    /*Entries are stored directly in the struct during parsing.*/
     _qrdata->entries  = NULL;
     _qrdata->nentries = 0;
     _qrdata->sa_size  = 0;
@@ -3481,13 +3991,16 @@ static int qr_code_data_parse(qr_code_data *_qrdata, int _version,
 	    break;
 	if (_qrdata->nentries >= centries) {
 	    centries	     = centries << 1 | 1;
-	    _qrdata->entries = (qr_code_data_entry *)realloc(
-		_qrdata->entries, centries * sizeof(*_qrdata->entries));
+	    _qrdata->entries = (qr_code_data_entry *)qr_arena_grow(
+		_arena, _qrdata->entries, _qrdata->nentries, centries,
+		sizeof(*_qrdata->entries));
+	    if (_qrdata->entries == NULL) {
+		_qrdata->nentries = 0;
+		return -1;
+	    }
 	}
 	entry	    = _qrdata->entries + _qrdata->nentries++;
 	entry->mode = mode;
-	/*Set the buffer to NULL, because if parsing fails, we might try to free it
-       on clean-up.*/
 	entry->payload.data.buf = NULL;
 	switch (mode) {
 	    /*The number of bits used to encode the character count for each version
@@ -3513,7 +4026,9 @@ static int qr_code_data_parse(qr_code_data *_qrdata, int _version,
 		10 * count + 7 * (rem >> 1 & 1) + 4 * (rem & 1))
 		return -1;
 	    entry->payload.data.buf = buf =
-		(unsigned char *)malloc(len * sizeof(*buf));
+		(unsigned char *)qr_arena_alloc(_arena, len * sizeof(*buf));
+	    if (buf == NULL)
+		return -1;
 	    entry->payload.data.len = len;
 	    /*Read groups of 3 digits encoded in 10 bits.*/
 	    while (count-- > 0) {
@@ -3570,7 +4085,9 @@ static int qr_code_data_parse(qr_code_data *_qrdata, int _version,
 	    if (qr_pack_buf_avail(&qpb) < 11 * count + 6 * rem)
 		return -1;
 	    entry->payload.data.buf = buf =
-		(unsigned char *)malloc(len * sizeof(*buf));
+		(unsigned char *)qr_arena_alloc(_arena, len * sizeof(*buf));
+	    if (buf == NULL)
+		return -1;
 	    entry->payload.data.len = len;
 	    /*Read groups of two characters encoded in 11 bits.*/
 	    while (count-- > 0) {
@@ -3627,7 +4144,9 @@ static int qr_code_data_parse(qr_code_data *_qrdata, int _version,
 	    if (qr_pack_buf_avail(&qpb) < len << 3)
 		return -1;
 	    entry->payload.data.buf = buf =
-		(unsigned char *)malloc(len * sizeof(*buf));
+		(unsigned char *)qr_arena_alloc(_arena, len * sizeof(*buf));
+	    if (buf == NULL)
+		return -1;
 	    entry->payload.data.len = len;
 	    while (len-- > 0) {
 		c = qr_pack_buf_read(&qpb, 8);
@@ -3685,7 +4204,9 @@ static int qr_code_data_parse(qr_code_data *_qrdata, int _version,
 	    if (qr_pack_buf_avail(&qpb) < 13 * len)
 		return -1;
 	    entry->payload.data.buf = buf =
-		(unsigned char *)malloc(2 * len * sizeof(*buf));
+		(unsigned char *)qr_arena_alloc(_arena, 2 * len * sizeof(*buf));
+	    if (buf == NULL)
+		return -1;
 	    entry->payload.data.len = 2 * len;
 	    /*Decode 2-byte SJIS characters encoded in 13 bits.*/
 	    while (len-- > 0) {
@@ -3731,11 +4252,12 @@ static int qr_code_data_parse(qr_code_data *_qrdata, int _version,
      because we can just do it here instead.*/
     _qrdata->self_parity = ((self_parity >> 8) ^ self_parity) & 0xFF;
     /*Success.*/
-    _qrdata->entries = (qr_code_data_entry *)realloc(
-	_qrdata->entries, _qrdata->nentries * sizeof(*_qrdata->entries));
     return 0;
 }
 
+/*Frees a copy made by qr_code_data_copy() without an arena.
+  The codes decoded from an image live in the results arena of their worker,
+   and are not cleared.*/
 static void qr_code_data_clear(qr_code_data *_qrdata)
 {
     int i;
@@ -3745,6 +4267,63 @@ static void qr_code_data_clear(qr_code_data *_qrdata)
 	}
     }
     free(_qrdata->entries);
+    free(_qrdata->bits);
+}
+
+/*Allocates _sz bytes from _arena, or with malloc() if _arena is NULL.*/
+static void *qr_code_data_alloc(qr_arena *_arena, size_t _sz)
+{
+    return _arena != NULL ? qr_arena_alloc(_arena, _sz) : malloc(_sz);
+}
+
+/*Makes a deep copy of the parsed data of a code.
+  _arena: The arena to allocate the copy from, or NULL to allocate it with
+           malloc(), so that it outlives the image and must be freed with
+           qr_code_data_clear().
+  _nbits: The number of sampled bits to copy, or 0 to leave them out.
+  Return: 0 on success, or a negative value on allocation failure.*/
+static int qr_code_data_copy(qr_code_data *_dst, qr_arena *_arena,
+			     const qr_code_data *_src, int _nbits)
+{
+    int i;
+    *_dst	  = *_src;
+    _dst->entries = NULL;
+    _dst->bits	  = NULL;
+    _dst->nentries = 0;
+    if (_src->nentries > 0) {
+	_dst->entries = (qr_code_data_entry *)qr_code_data_alloc(
+	    _arena, _src->nentries * sizeof(*_dst->entries));
+	if (_dst->entries == NULL)
+	    return -1;
+    }
+    for (i = 0; i < _src->nentries; i++) {
+	qr_code_data_entry *entry;
+	entry  = _dst->entries + i;
+	*entry = _src->entries[i];
+	if (QR_MODE_HAS_DATA(entry->mode)) {
+	    entry->payload.data.buf = (unsigned char *)qr_code_data_alloc(
+		_arena, QR_MAXI(entry->payload.data.len, 1));
+	    if (entry->payload.data.buf == NULL) {
+		if (_arena == NULL)
+		    qr_code_data_clear(_dst);
+		return -1;
+	    }
+	    memcpy(entry->payload.data.buf, _src->entries[i].payload.data.buf,
+		   entry->payload.data.len);
+	}
+	_dst->nentries++;
+    }
+    if (_nbits > 0 && _src->bits != NULL) {
+	_dst->bits = (unsigned *)qr_code_data_alloc(
+	    _arena, _nbits * sizeof(*_dst->bits));
+	if (_dst->bits == NULL) {
+	    if (_arena == NULL)
+		qr_code_data_clear(_dst);
+	    return -1;
+	}
+	memcpy(_dst->bits, _src->bits, _nbits * sizeof(*_dst->bits));
+    }
+    return 0;
 }
 
 void qr_code_data_list_init(qr_code_data_list *_qrlist)
@@ -3753,11 +4332,10 @@ void qr_code_data_list_init(qr_code_data_list *_qrlist)
     _qrlist->nqrdata = _qrlist->cqrdata = 0;
 }
 
+/*Frees the list itself; the data of its codes lives in the results arenas of
+   the workers that decoded them.*/
 void qr_code_data_list_clear(qr_code_data_list *_qrlist)
 {
-    int i;
-    for (i = 0; i < _qrlist->nqrdata; i++)
-	qr_code_data_clear(_qrlist->qrdata + i);
     free(_qrlist->qrdata);
     qr_code_data_list_init(_qrlist);
 }
@@ -3854,25 +4432,19 @@ static const unsigned char QR_RS_NBLOCKS[40][4] = {
     { 25, 49, 68, 81 }
 };
 
-/*Attempts to fully decode a QR code.
-  _qrdata:   Returns the parsed code data.
-  _gf:       Used for Reed-Solomon error correction.
-  _ul_pos:   The location of the UL finder pattern.
-  _ur_pos:   The location of the UR finder pattern.
-  _dl_pos:   The location of the DL finder pattern.
-  _version:  The (decoded) version number.
-  _fmt_info: The decoded format info.
-  _img:      The binary input image.
-  _width:    The width of the input image.
-  _height:   The height of the input image.
+/*Corrects the bits sampled from a QR code and parses its data.
+  _qrdata:    Returns the parsed code data.
+  _worker:    Used for Reed-Solomon error correction.
+  _version:   The (decoded) version number.
+  _fmt_info:  The decoded format info.
+  _data_bits: The bits read by qr_sampling_grid_sample().
+  _fp_mask:   The function pattern mask of the sampling grid.
   Return: 0 on success, or a negative value on error.*/
-static int qr_code_decode(qr_code_data *_qrdata, const rs_gf256 *_gf,
-			  const qr_point _ul_pos, const qr_point _ur_pos,
-			  const qr_point _dl_pos, int _version, int _fmt_info,
-			  const unsigned char *_img, int _width, int _height)
+static int qr_code_correct(qr_code_data *_qrdata, qr_worker *_worker,
+			   int _version, int _fmt_info,
+			   const unsigned *_data_bits,
+			   const unsigned *_fp_mask)
 {
-    qr_sampling_grid grid;
-    unsigned *data_bits;
     unsigned char **blocks;
     unsigned char *block_data;
     int nblocks;
@@ -3882,20 +4454,9 @@ static int qr_code_decode(qr_code_data *_qrdata, const rs_gf256 *_gf,
     int ecc_level;
     int ndata;
     int npar;
-    int dim;
     int ret;
     int i;
-    /*Read the bits out of the image.*/
-    qr_sampling_grid_init(&grid, _version, _ul_pos, _ur_pos, _dl_pos,
-			  _qrdata->bbox, _img, _width, _height);
-#if defined(QR_DEBUG)
-    qr_sampling_grid_dump(&grid, _version, _img, _width, _height);
-#endif
-    dim	      = 17 + (_version << 2);
-    data_bits = (unsigned *)malloc(
-	dim * (dim + QR_INT_BITS - 1 >> QR_INT_LOGBITS) * sizeof(*data_bits));
-    qr_sampling_grid_sample(&grid, data_bits, dim, _fmt_info, _img, _width,
-			    _height);
+    unsigned long long start;
     /*Group those bits into Reed-Solomon codewords.*/
     ecc_level  = (_fmt_info >> 3) ^ 1;
     nblocks    = QR_RS_NBLOCKS[_version - 1][ecc_level];
@@ -3903,26 +4464,26 @@ static int qr_code_decode(qr_code_data *_qrdata, const rs_gf256 *_gf,
     ncodewords = qr_code_ncodewords(_version);
     block_sz   = ncodewords / nblocks;
     nshort_blocks = nblocks - (ncodewords % nblocks);
-    blocks	  = (unsigned char **)malloc(nblocks * sizeof(*blocks));
-    block_data	  = (unsigned char *)malloc(ncodewords * sizeof(*block_data));
+    blocks	  = (unsigned char **)qr_arena_alloc(&_worker->arena,
+						     nblocks * sizeof(*blocks));
+    block_data	  = (unsigned char *)qr_arena_alloc(
+	&_worker->arena, ncodewords * sizeof(*block_data));
     blocks[0]	  = block_data;
     for (i = 1; i < nblocks; i++)
 	blocks[i] = blocks[i - 1] + block_sz + (i > nshort_blocks);
     qr_samples_unpack(blocks, nblocks, block_sz - npar, nshort_blocks,
-		      data_bits, grid.fpmask, dim);
-    qr_sampling_grid_clear(&grid);
-    free(blocks);
-    free(data_bits);
+		      _data_bits, _fp_mask, 17 + (_version << 2));
     /*Perform the error correction.*/
     ndata      = 0;
     ncodewords = 0;
     ret	       = 0;
+    start      = _zbar_timer_now_ns();
     for (i = 0; i < nblocks; i++) {
 	int block_szi;
 	int ndatai;
 	block_szi = block_sz + (i >= nshort_blocks);
-	ret = rs_correct(_gf, QR_M0, block_data + ncodewords, block_szi, npar,
-			 NULL, 0);
+	ret = rs_correct(_worker->gf, QR_M0, block_data + ncodewords,
+			 block_szi, npar, NULL, 0);
 	zprintf(1, "Number of errors corrected: %i%s\n", ret,
 		ret < 0 ? " (data irrecoverable)" : "");
 	/*For version 1 symbols and version 2-L and 3-L symbols, we aren't allowed
@@ -3944,17 +4505,87 @@ static int qr_code_decode(qr_code_data *_qrdata, const rs_gf256 *_gf,
 	ncodewords += block_szi;
 	ndata += ndatai;
     }
+    _worker->rs_ns += _zbar_timer_now_ns() - start;
     /*Parse the corrected bitstream.*/
     if (ret >= 0) {
-	ret = qr_code_data_parse(_qrdata, _version, block_data, ndata);
+	ret = qr_code_data_parse(_qrdata, &_worker->results, _version,
+				 block_data, ndata);
 	/*We could return any partially decoded data, but then we'd have to have
        API support for that; a mode ignoring ECC errors might also be useful.*/
-	if (ret < 0)
-	    qr_code_data_clear(_qrdata);
 	_qrdata->version   = _version;
 	_qrdata->ecc_level = ecc_level;
     }
-    free(block_data);
+    return ret;
+}
+
+/*Attempts to fully decode a QR code.
+  _qrdata:   Returns the parsed code data.
+             On input, its bbox contains the estimated positions of the four
+              corner modules.
+  _worker:   Used for Reed-Solomon error correction.
+  _ul_pos:   The location of the UL finder pattern.
+  _ur_pos:   The location of the UR finder pattern.
+  _dl_pos:   The location of the DL finder pattern.
+  _version:  The (decoded) version number.
+  _fmt_info: The decoded format info.
+  _img:      The binary input image.
+  _width:    The width of the input image.
+  _height:   The height of the input image.
+  _prev:     The same code decoded in a previous frame, or NULL.
+             If the bits sampled from the image are exactly the ones it was
+              decoded from, its data is copied instead of being corrected and
+              parsed again.
+  Return: 0 on success, or a negative value on error.*/
+static int qr_code_decode(qr_code_data *_qrdata, qr_worker *_worker,
+			  const qr_point _ul_pos, const qr_point _ur_pos,
+			  const qr_point _dl_pos, int _version, int _fmt_info,
+			  qr_binarizer *_img, int _width, int _height,
+			  const qr_code_data *_prev)
+{
+    qr_sampling_grid grid;
+    qr_point corners[4];
+    unsigned *data_bits;
+    int nbits;
+    int dim;
+    int ret;
+    _qrdata->bits = NULL;
+    memcpy(corners, _qrdata->bbox, sizeof(corners));
+    /*Read the bits out of the image.*/
+    qr_sampling_grid_init(&_worker->arena, &grid, _version, _ul_pos, _ur_pos,
+			  _dl_pos, _qrdata->bbox, _img, _width, _height);
+#if defined(QR_DEBUG)
+    qr_sampling_grid_dump(&grid, _version, _img, _width, _height);
+#endif
+    dim	      = 17 + (_version << 2);
+    nbits     = dim * (dim + QR_INT_BITS - 1 >> QR_INT_LOGBITS);
+    data_bits = (unsigned *)qr_arena_alloc(&_worker->arena,
+					   nbits * sizeof(*data_bits));
+    qr_sampling_grid_sample(&grid, data_bits, dim, _fmt_info, _img, _width,
+			    _height);
+    if (_prev != NULL && _prev->bits != NULL && _prev->version == _version &&
+	_prev->fmt_info == _fmt_info &&
+	!memcmp(data_bits, _prev->bits, nbits * sizeof(*data_bits))) {
+	qr_point bbox[4];
+	memcpy(bbox, _qrdata->bbox, sizeof(bbox));
+	ret = qr_code_data_copy(_qrdata, &_worker->results, _prev, 0);
+	memcpy(_qrdata->bbox, bbox, sizeof(bbox));
+    } else {
+	ret = qr_code_correct(_qrdata, _worker, _version, _fmt_info, data_bits,
+			      grid.fpmask);
+    }
+    if (ret < 0)
+	return ret;
+    /*Keep the bits with the code, to compare with the next frame's.*/
+    _qrdata->bits = (unsigned *)qr_arena_alloc(&_worker->results,
+					       nbits * sizeof(*_qrdata->bits));
+    if (!_qrdata->bits)
+	return -1;
+    memcpy(_qrdata->bits, data_bits, nbits * sizeof(*_qrdata->bits));
+    memcpy(_qrdata->centers[0], _ul_pos, sizeof(_qrdata->centers[0]));
+    memcpy(_qrdata->centers[1], _ur_pos, sizeof(_qrdata->centers[1]));
+    memcpy(_qrdata->centers[2], _dl_pos, sizeof(_qrdata->centers[2]));
+    memcpy(_qrdata->corners, corners, sizeof(corners));
+    _qrdata->fmt_info = _fmt_info;
     return ret;
 }
 
@@ -3962,9 +4593,9 @@ static int qr_code_decode(qr_code_data *_qrdata, const rs_gf256 *_gf,
    configuration.
   _c: On input, the three finder centers to consider in any order.
   Return: The detected version number, or a negative value on error.*/
-static int qr_reader_try_configuration(qr_reader *_reader,
+static int qr_reader_try_configuration(qr_worker *_worker,
 				       qr_code_data *_qrdata,
-				       const unsigned char *_img, int _width,
+				       qr_binarizer *_img, int _width,
 				       int _height, qr_finder_center *_c[3])
 {
     int ci[7];
@@ -3972,6 +4603,8 @@ static int qr_reader_try_configuration(qr_reader *_reader,
     int ccw;
     int i0;
     int i;
+    /*Nothing from the configuration tried before is still in use.*/
+    qr_arena_reset(&_worker->arena);
     /*Sort the points in counter-clockwise order.*/
     ccw = qr_point_ccw(_c[0]->pos, _c[1]->pos, _c[2]->pos);
     /*Colinear points can't be the corners of a quadrilateral.*/
@@ -4046,8 +4679,8 @@ static int qr_reader_try_configuration(qr_reader *_reader,
 #endif
 	/*If we made it this far, upgrade the affine homography to a full
        homography.*/
-	if (qr_hom_fit(&hom, &ul, &ur, &dl, bbox, &aff, &_reader->isaac, _img,
-		       _width, _height) < 0) {
+	if (qr_hom_fit(&_worker->arena, &hom, &ul, &ur, &dl, bbox, &aff,
+		       &_worker->isaac, _img, _width, _height) < 0) {
 	    continue;
 	}
 	memcpy(_qrdata->bbox, bbox, sizeof(bbox));
@@ -4124,10 +4757,10 @@ static int qr_reader_try_configuration(qr_reader *_reader,
         qr_line            l0;
         int               *p;
         t=LINE_TESTS[j];
-        qr_finder_ransac(f[t[0]],&aff,&_reader->isaac,t[1]);
+        qr_finder_ransac(f[t[0]],&aff,&_worker->isaac,t[1]);
         /*We may not have enough points to fit a line accurately here.
           If not, we just skip the test.*/
-        if(qr_line_fit_finder_edge(l0,f[t[0]],t[1],res)<0)continue;
+        if(qr_line_fit_finder_edge(&_worker->arena,l0,f[t[0]],t[1],res)<0)continue;
         p=f[t[2]]->c->pos;
         if(qr_line_eval(l0,p[0],p[1])*t[3]<0)break;
         p=f[t[4]]->c->pos;
@@ -4182,9 +4815,9 @@ static int qr_reader_try_configuration(qr_reader *_reader,
 	fmt_info = qr_finder_fmt_info_decode(&ul, &ur, &dl, &hom, _img, _width,
 					     _height);
 	if (fmt_info < 0 ||
-	    qr_code_decode(_qrdata, &_reader->gf, ul.c->pos, ur.c->pos,
-			   dl.c->pos, ur_version, fmt_info, _img, _width,
-			   _height) < 0) {
+	    qr_code_decode(_qrdata, _worker, ul.c->pos, ur.c->pos, dl.c->pos,
+			   ur_version, fmt_info, _img, _width, _height,
+			   NULL) < 0) {
 	    /*The code may be flipped.
         Try again, swapping the UR and DL centers.
         We should get a valid version either way, so it's relatively cheap to
@@ -4212,9 +4845,9 @@ static int qr_reader_try_configuration(qr_reader *_reader,
 	    QR_SWAP2I(bbox[1][0], bbox[2][0]);
 	    QR_SWAP2I(bbox[1][1], bbox[2][1]);
 	    memcpy(_qrdata->bbox, bbox, sizeof(bbox));
-	    if (qr_code_decode(_qrdata, &_reader->gf, ul.c->pos, dl.c->pos,
-			       ur.c->pos, ur_version, fmt_info, _img, _width,
-			       _height) < 0) {
+	    if (qr_code_decode(_qrdata, _worker, ul.c->pos, dl.c->pos, ur.c->pos,
+			       ur_version, fmt_info, _img, _width, _height,
+			       NULL) < 0) {
 		continue;
 	    }
 	}
@@ -4223,98 +4856,1004 @@ static int qr_reader_try_configuration(qr_reader *_reader,
     return -1;
 }
 
+/*The number of directions along which the width of each finder pattern is
+   measured, to match finder centers.*/
+#define QR_MATCH_NDIRS (8)
+
+/*Unit vectors evenly spaced over a half circle, with 8 bits of precision.*/
+static const short QR_MATCH_DIRS[QR_MATCH_NDIRS][2] = {
+    { 256, 0 },	 { 237, 98 },	{ 181, 181 },  { 98, 237 },
+    { 0, 256 },	 { -98, 237 },	{ -181, 181 }, { -237, 98 }
+};
+
+/*The bounds on the distance between two finder centers of the same code, in
+   units of the width of their finder patterns along the line joining them
+   (as spanned by the edge points, about 6 modules).
+  Adjacent centers of a version 1 code are a little over 2 widths apart, and
+   opposite ones of a version 40 code about 40; perspective may stretch
+   either.*/
+#define QR_MATCH_DIST_MIN (1)
+#define QR_MATCH_DIST_MAX (48)
+/*The largest ratio between the widths of two finder patterns of a code.*/
+#define QR_MATCH_WIDTH_RATIO (3)
+/*Measured this way, the three sides of a code are roughly the same length,
+   since a finder pattern is also wider along its diagonal.
+  This is the largest ratio allowed between them, in quarters.*/
+#define QR_MATCH_SIDE_RATIO (8)
+/*The fractional bits of the distances above.*/
+#define QR_MATCH_BITS (4)
+/*The number of closest centers each center is first tried with.
+  Neighboring codes in a grid of labels can easily be closer than the other
+   centers of the same code.*/
+#define QR_MATCH_NNEAR (8)
+
+/*The widths of a finder pattern, as used to match finder centers.*/
+typedef struct qr_finder_widths qr_finder_widths;
+
+struct qr_finder_widths {
+    /*The width of the edge points along each direction.*/
+    int w[QR_MATCH_NDIRS];
+    /*The largest of them.*/
+    int maxw;
+};
+
+static void qr_finder_widths_init(qr_finder_widths *_fw,
+				  const qr_finder_center *_c)
+{
+    int d;
+    _fw->maxw = 0;
+    for (d = 0; d < QR_MATCH_NDIRS; d++) {
+	int pmin;
+	int pmax;
+	int i;
+	pmin = INT_MAX;
+	pmax = INT_MIN;
+	for (i = 0; i < _c->nedge_pts; i++) {
+	    int p;
+	    p = (_c->edge_pts[i].pos[0] - _c->pos[0]) * QR_MATCH_DIRS[d][0] +
+		(_c->edge_pts[i].pos[1] - _c->pos[1]) * QR_MATCH_DIRS[d][1];
+	    pmin = QR_MINI(pmin, p);
+	    pmax = QR_MAXI(pmax, p);
+	}
+	_fw->w[d]  = pmax - pmin + 128 >> 8;
+	_fw->maxw = QR_MAXI(_fw->maxw, _fw->w[d]);
+    }
+}
+
+/*Computes the distance between two finder centers, in units of the width of
+   their finder patterns along the line joining them, with QR_MATCH_BITS of
+   precision.
+  Return: The distance, or a negative value if the patterns are too different
+   in size to be part of the same code.*/
+static int qr_finder_match_dist(const qr_finder_center *_a,
+				const qr_finder_widths *_fwa,
+				const qr_finder_center *_b,
+				const qr_finder_widths *_fwb)
+{
+    unsigned bestp;
+    int best;
+    int dx;
+    int dy;
+    int w;
+    int d;
+    if (_fwa->maxw > QR_MATCH_WIDTH_RATIO * _fwb->maxw ||
+	_fwb->maxw > QR_MATCH_WIDTH_RATIO * _fwa->maxw) {
+	return -1;
+    }
+    dx = _b->pos[0] - _a->pos[0];
+    dy = _b->pos[1] - _a->pos[1];
+    /*Use the widths along the closest direction.*/
+    bestp = 0;
+    best  = 0;
+    for (d = 0; d < QR_MATCH_NDIRS; d++) {
+	unsigned p;
+	p = abs(dx * QR_MATCH_DIRS[d][0] + dy * QR_MATCH_DIRS[d][1]);
+	if (p > bestp) {
+	    bestp = p;
+	    best  = d;
+	}
+    }
+    w = _fwa->w[best] + _fwb->w[best];
+    if (w <= 0)
+	return -1;
+    return (qr_ihypot(dx, dy) << QR_MATCH_BITS + 1) / w;
+}
+
+/*Returns whether two finder centers might belong to the same code, given the
+   distance between them computed by qr_finder_match_dist().*/
+static int qr_finder_match_dist_ok(int _d)
+{
+    return _d >= QR_MATCH_DIST_MIN << QR_MATCH_BITS &&
+	   _d <= QR_MATCH_DIST_MAX << QR_MATCH_BITS;
+}
+
+/*A finder center that might be paired with the one being matched.*/
+typedef struct qr_finder_match qr_finder_match;
+
+struct qr_finder_match {
+    /*The index of the center.*/
+    int ci;
+    /*Its distance as computed by qr_finder_match_dist().*/
+    int d;
+};
+
+static int qr_finder_match_cmp(const void *_a, const void *_b)
+{
+    const qr_finder_match *a;
+    const qr_finder_match *b;
+    a = (const qr_finder_match *)_a;
+    b = (const qr_finder_match *)_b;
+    return ((a->d > b->d) - (a->d < b->d) << 1) + (a->ci > b->ci) -
+	   (a->ci < b->ci);
+}
+
+/*A uniform grid over the finder centers, used to find those close to a given
+   one.*/
+typedef struct qr_finder_grid qr_finder_grid;
+
+struct qr_finder_grid {
+    /*The log2 of the size of a cell, in subpel units.*/
+    int log_cell;
+    int ncols;
+    int nrows;
+    /*The index of the first center in each cell in cis (one extra entry marks
+     the end of the last cell).*/
+    int *cell_starts;
+    /*The indices of the centers, sorted by cell.*/
+    int *cis;
+};
+
+static int qr_finder_grid_cell(const qr_finder_grid *_grid, int _x, int _y)
+{
+    _x = QR_CLAMPI(0, _x >> _grid->log_cell, _grid->ncols - 1);
+    _y = QR_CLAMPI(0, _y >> _grid->log_cell, _grid->nrows - 1);
+    return _y * _grid->ncols + _x;
+}
+
+/*Indexes the centers with at least two edge points: with fewer, their module
+   size cannot be estimated along both axes, so they can never be matched.*/
+static int qr_finder_grid_init(qr_arena *_arena, qr_finder_grid *_grid,
+			       const qr_finder_center *_centers, int _ncenters,
+			       int _width, int _height)
+{
+    int ncells;
+    int n;
+    int i;
+    for (i = n = 0; i < _ncenters; i++)
+	n += _centers[i].nedge_pts >= 2;
+    /*Aim for about one center per cell.*/
+    _grid->log_cell = QR_MAXI(QR_FINDER_SUBPREC + 3,
+			      QR_FINDER_SUBPREC +
+				  (qr_ilog(_width * _height / QR_MAXI(n, 1)) >> 1));
+    _grid->ncols =
+	((_width << QR_FINDER_SUBPREC) >> _grid->log_cell) + 1;
+    _grid->nrows =
+	((_height << QR_FINDER_SUBPREC) >> _grid->log_cell) + 1;
+    ncells	       = _grid->ncols * _grid->nrows;
+    _grid->cell_starts = (int *)qr_arena_calloc(_arena, ncells + 1,
+						sizeof(*_grid->cell_starts));
+    _grid->cis	       = (int *)qr_arena_alloc(_arena, n * sizeof(*_grid->cis));
+    if (!_grid->cell_starts || !_grid->cis)
+	return -1;
+    /*Counting sort by cell.*/
+    for (i = 0; i < _ncenters; i++)
+	if (_centers[i].nedge_pts >= 2)
+	    _grid->cell_starts[qr_finder_grid_cell(_grid, _centers[i].pos[0],
+						   _centers[i].pos[1]) +
+			       1]++;
+    for (i = 0; i < ncells; i++)
+	_grid->cell_starts[i + 1] += _grid->cell_starts[i];
+    for (i = 0; i < _ncenters; i++)
+	if (_centers[i].nedge_pts >= 2) {
+	    int c;
+	    c = qr_finder_grid_cell(_grid, _centers[i].pos[0],
+				    _centers[i].pos[1]);
+	    _grid->cis[_grid->cell_starts[c]++] = i;
+	}
+    for (i = ncells; i-- > 0;)
+	_grid->cell_starts[i + 1] = _grid->cell_starts[i];
+    _grid->cell_starts[0] = 0;
+    return 0;
+}
+
+/*The number of configurations tried per thread at a time when decoding
+   candidate codes in parallel.*/
+#define QR_MATCH_BATCH (4)
+/*The largest number of configurations with the same first center queued at a
+   time.*/
+#define QR_MATCH_NTRIALS (32)
+/*The result of a configuration that has not been tried yet.*/
+#define QR_TRIAL_PENDING (-2)
+
+/*A configuration of three finder centers to try.*/
+typedef struct qr_center_trial qr_center_trial;
+
+struct qr_center_trial {
+    /*The indices of the centers, the first one being the one they were
+     matched with.*/
+    int ci[3];
+    /*The result of qr_reader_try_configuration(), or QR_TRIAL_PENDING.*/
+    int ret;
+    /*The code data, if it succeeded.*/
+    qr_code_data qrdata;
+};
+
+/*The queued configurations with the same first center.*/
+typedef struct qr_center_span qr_center_span;
+
+struct qr_center_span {
+    /*The first center.*/
+    int ci;
+    /*The range of the configurations queued.*/
+    int t0;
+    int t1;
+    /*The number of configurations considered for this center so far.*/
+    int cursor;
+    /*The most configurations to queue at a time.*/
+    int chunk;
+    /*1 if all the configurations of this center have been queued, 0 if there
+     are more, or -1 if none have been queued yet.*/
+    int done;
+    /*The other centers of its first configuration, which it claims, or -1.*/
+    int claim[2];
+};
+
+/*The state of a search for codes among a set of finder centers.*/
+typedef struct qr_center_matcher qr_center_matcher;
+
+struct qr_center_matcher {
+    qr_reader *reader;
+    qr_code_data_list *qrlist;
+    qr_finder_center *centers;
+    int ncenters;
+    qr_binarizer *img;
+    int width;
+    int height;
+    /*Whether each center is used: 1 if part of a code found, 2 if inside it.*/
+    unsigned char *mark;
+    /*The widths of each finder pattern.*/
+    qr_finder_widths *fws;
+    /*The centers that might be matched with the current one.*/
+    qr_finder_match *matches;
+    qr_finder_grid grid;
+    /*The number of configurations that failed since the last code found.*/
+    int nfailures;
+    int nfailures_max;
+    /*The threads used to try configurations in parallel, or NULL.*/
+    zbar_pool_t *pool;
+    /*The number of configurations to try in each batch.*/
+    int batch_sz;
+    /*The queued configurations.*/
+    qr_center_trial *trials;
+    int ntrials;
+    int ctrials;
+    /*The number of them not tried yet.*/
+    int npending;
+    /*The window of centers whose configurations are queued, in the order a
+     serial search goes through them.*/
+    qr_center_span *spans;
+    int head;
+    int tail;
+    /*The next center to add to the window.*/
+    int next;
+    /*The number of centers queued earlier in the window that claim each
+     center as part of their first configuration.*/
+    unsigned char *claimed;
+};
+
+/*Adds the centers after _ci in one cell of the grid that might belong to the
+   same code as it to the list of matches.
+  Return: The new number of matches.*/
+static int qr_center_matcher_scan_cell(qr_center_matcher *_m, int _ci, int _x,
+				       int _y, int _n)
+{
+    const qr_finder_grid *grid;
+    int cell;
+    int i;
+    grid = &_m->grid;
+    if (_x < 0 || _x >= grid->ncols || _y < 0 || _y >= grid->nrows)
+	return _n;
+    cell = _y * grid->ncols + _x;
+    for (i = grid->cell_starts[cell]; i < grid->cell_starts[cell + 1]; i++) {
+	int cj;
+	int d;
+	cj = grid->cis[i];
+	if (cj <= _ci)
+	    continue;
+	d = qr_finder_match_dist(_m->centers + _ci, _m->fws + _ci,
+				 _m->centers + cj, _m->fws + cj);
+	if (qr_finder_match_dist_ok(d)) {
+	    _m->matches[_n].ci	= cj;
+	    _m->matches[_n++].d = d;
+	}
+    }
+    return _n;
+}
+
+/*Collects the _nmax closest centers after _ci that might belong to the same
+   code as it, sorted by increasing distance.
+  The grid cells are visited in rings of increasing size around _ci, stopping
+   as soon as no center in the remaining ones can be closer than those found.
+  Return: The number of centers found.*/
+static int qr_center_matcher_find(qr_center_matcher *_m, int _ci, int _nmax)
+{
+    const qr_finder_center *c;
+    const qr_finder_grid *grid;
+    int maxw;
+    int cx;
+    int cy;
+    int rmax;
+    int r;
+    int n;
+    c	 = _m->centers + _ci;
+    grid = &_m->grid;
+    maxw = _m->fws[_ci].maxw;
+    cx	 = QR_CLAMPI(0, c->pos[0] >> grid->log_cell, grid->ncols - 1);
+    cy	 = QR_CLAMPI(0, c->pos[1] >> grid->log_cell, grid->nrows - 1);
+    /*The farthest a matching center can be, given the widest pattern it can
+     have.*/
+    rmax = (QR_MATCH_DIST_MAX * (1 + QR_MATCH_WIDTH_RATIO) * maxw >> 1) >>
+	       grid->log_cell;
+    rmax = QR_MINI(rmax + 1, QR_MAXI(grid->ncols, grid->nrows));
+    n	 = 0;
+    for (r = 0; r <= rmax; r++) {
+	int x;
+	int y;
+	int x0;
+	int x1;
+	int y0;
+	int y1;
+	x0 = QR_MAXI(cx - r, 0);
+	x1 = QR_MINI(cx + r, grid->ncols - 1);
+	y0 = QR_MAXI(cy - r + 1, 0);
+	y1 = QR_MINI(cy + r - 1, grid->nrows - 1);
+	for (x = x0; x <= x1; x++) {
+	    n = qr_center_matcher_scan_cell(_m, _ci, x, cy - r, n);
+	    if (r > 0)
+		n = qr_center_matcher_scan_cell(_m, _ci, x, cy + r, n);
+	}
+	for (y = y0; y <= y1; y++) {
+	    n = qr_center_matcher_scan_cell(_m, _ci, cx - r, y, n);
+	    n = qr_center_matcher_scan_cell(_m, _ci, cx + r, y, n);
+	}
+	if (n >= _nmax) {
+	    int dmin;
+	    /*Every center in the rings left is at least r cells away, and its
+	       pattern no more than QR_MATCH_WIDTH_RATIO times wider.*/
+	    dmin = ((r << grid->log_cell) << QR_MATCH_BITS + 1) /
+		   ((1 + QR_MATCH_WIDTH_RATIO) * QR_MAXI(maxw, 1));
+	    qsort(_m->matches, n, sizeof(*_m->matches), qr_finder_match_cmp);
+	    if (_m->matches[_nmax - 1].d < dmin)
+		return _nmax;
+	}
+    }
+    qsort(_m->matches, n, sizeof(*_m->matches), qr_finder_match_cmp);
+    return QR_MINI(n, _nmax);
+}
+
 void qr_reader_match_centers(qr_reader *_reader, qr_code_data_list *_qrlist,
 			     qr_finder_center *_centers, int _ncenters,
-			     const unsigned char *_img, int _width, int _height)
+			     qr_binarizer *_img, int _width, int _height);
+
+/*Adds a code found from three finder centers, and looks for codes inside it.*/
+static void qr_center_matcher_add(qr_center_matcher *_m,
+				  qr_code_data *_qrdata, int _i, int _j,
+				  int _k)
 {
-    /*The number of centers should be small, so an O(n^3) exhaustive search of
-     which ones go together should be reasonable.*/
+    qr_code_data_list *qrlist;
+    qr_finder_center *centers;
     unsigned char *mark;
-    int nfailures_max;
-    int nfailures;
+    int ninside;
+    int l;
+    qrlist  = _m->qrlist;
+    centers = _m->centers;
+    mark    = _m->mark;
+    /*Add the data to the list.*/
+    qr_code_data_list_add(qrlist, _qrdata);
+    /*Convert the bounding box we're returning to the user to normal image
+     coordinates.*/
+    for (l = 0; l < 4; l++) {
+	qrlist->qrdata[qrlist->nqrdata - 1].bbox[l][0] >>= QR_FINDER_SUBPREC;
+	qrlist->qrdata[qrlist->nqrdata - 1].bbox[l][1] >>= QR_FINDER_SUBPREC;
+    }
+    /*Mark these centers as used.*/
+    mark[_i] = mark[_j] = mark[_k] = 1;
+    /*Find any other finder centers located inside this code.*/
+    for (l = ninside = 0; l < _m->ncenters; l++)
+	if (!mark[l]) {
+	    if (qr_point_ccw(_qrdata->bbox[0], _qrdata->bbox[1],
+			     centers[l].pos) >= 0 &&
+		qr_point_ccw(_qrdata->bbox[1], _qrdata->bbox[3],
+			     centers[l].pos) >= 0 &&
+		qr_point_ccw(_qrdata->bbox[3], _qrdata->bbox[2],
+			     centers[l].pos) >= 0 &&
+		qr_point_ccw(_qrdata->bbox[2], _qrdata->bbox[0],
+			     centers[l].pos) >= 0) {
+		mark[l] = 2;
+		ninside++;
+	    }
+	}
+    if (ninside >= 3) {
+	/*We might have a "Double QR": a code inside a code.
+	  Copy the relevant centers to a new array and do a search confined to
+	   that subset.*/
+	qr_finder_center *inside;
+	inside = (qr_finder_center *)qr_arena_alloc(&_m->reader->arena,
+						    ninside * sizeof(*inside));
+	for (l = ninside = 0; l < _m->ncenters; l++) {
+	    if (mark[l] == 2)
+		*&inside[ninside++] = *&centers[l];
+	}
+	qr_reader_match_centers(_m->reader, qrlist, inside, ninside, _m->img,
+				_m->width, _m->height);
+    }
+    /*Mark _all_ such centers used: codes cannot partially overlap.*/
+    for (l = 0; l < _m->ncenters; l++)
+	if (mark[l] == 2)
+	    mark[l] = 1;
+    _m->nfailures = 0;
+}
+
+/*Makes room to queue _n more configurations, dropping those that are no
+   longer in the window.
+  Return: 0 on success, or a negative value on error.*/
+static int qr_center_matcher_reserve(qr_center_matcher *_m, int _n)
+{
+    qr_center_trial *trials;
+    int ctrials;
+    int nlive;
+    int s;
+    if (_m->ntrials + _n <= _m->ctrials)
+	return 0;
+    for (nlive = 0, s = _m->head; s < _m->tail; s++)
+	nlive += _m->spans[s].t1 - _m->spans[s].t0;
+    ctrials = QR_MAXI(_m->ctrials, nlive + _n << 1);
+    trials  = (qr_center_trial *)qr_arena_alloc(&_m->reader->arena,
+						ctrials * sizeof(*trials));
+    if (!trials)
+	return -1;
+    _m->ntrials = 0;
+    for (s = _m->head; s < _m->tail; s++) {
+	qr_center_span *span;
+	span = _m->spans + s;
+	/*Spans with nothing queued may predate the first array.*/
+	if (span->t1 > span->t0)
+	    memcpy(trials + _m->ntrials, _m->trials + span->t0,
+		   (span->t1 - span->t0) * sizeof(*trials));
+	span->t1 = _m->ntrials + span->t1 - span->t0;
+	span->t0 = _m->ntrials;
+	_m->ntrials = span->t1;
+    }
+    _m->trials	= trials;
+    _m->ctrials = ctrials;
+    return 0;
+}
+
+/*Releases the configurations queued for a span that have not been used.*/
+static void qr_center_matcher_span_clear(qr_center_matcher *_m,
+					 qr_center_span *_span)
+{
+    int t;
+    for (t = _span->t0; t < _span->t1; t++) {
+	qr_center_trial *trial;
+	trial = _m->trials + t;
+	if (trial->ret == QR_TRIAL_PENDING)
+	    _m->npending--;
+    }
+    _span->t0 = _span->t1;
+}
+
+/*Queues the next plausible configurations with the first center of _span,
+   replacing those queued before.
+  _nmatches: Only the configurations with the _nmatches closest centers
+              are queued.
+  _nskip:    The configurations with the _nskip closest centers are skipped
+              (they have already been tried).*/
+static void qr_center_matcher_queue(qr_center_matcher *_m,
+				    qr_center_span *_span, int _nmatches,
+				    int _nskip)
+{
+    const qr_finder_match *matches;
+    const unsigned char *mark;
+    int nmatches;
+    int n;
+    int mj;
+    int mk;
+    qr_center_matcher_span_clear(_m, _span);
+    _span->done = 1;
+    if (qr_center_matcher_reserve(_m, _span->chunk) < 0)
+	return;
+    _span->t0 = _span->t1 = _m->ntrials;
+    matches		  = _m->matches;
+    mark		  = _m->mark;
+    nmatches		  = qr_center_matcher_find(_m, _span->ci, _nmatches);
+    n			  = 0;
+    for (mj = 0; mj < nmatches; mj++) {
+	int j;
+	j = matches[mj].ci;
+	for (mk = QR_MAXI(mj + 1, _nskip); mk < nmatches; mk++) {
+	    qr_center_trial *trial;
+	    int dmin;
+	    int dmax;
+	    int djk;
+	    int k;
+	    k = matches[mk].ci;
+	    /*The matches are sorted, so all the remaining ones are too far.*/
+	    if (matches[mk].d * 4 > QR_MATCH_SIDE_RATIO * matches[mj].d)
+		break;
+	    djk = qr_finder_match_dist(_m->centers + j, _m->fws + j,
+				       _m->centers + k, _m->fws + k);
+	    if (!qr_finder_match_dist_ok(djk))
+		continue;
+	    dmin = QR_MINI(matches[mj].d, djk);
+	    dmax = QR_MAXI(matches[mk].d, djk);
+	    if (dmax * 4 > QR_MATCH_SIDE_RATIO * dmin)
+		continue;
+	    if (n++ < _span->cursor || mark[j] || mark[k])
+		continue;
+	    if (_span->t1 - _span->t0 >= _span->chunk) {
+		_span->cursor = n - 1;
+		_span->done   = 0;
+		_m->ntrials   = _span->t1;
+		return;
+	    }
+	    trial	 = _m->trials + _span->t1++;
+	    trial->ci[0] = _span->ci;
+	    trial->ci[1] = j;
+	    trial->ci[2] = k;
+	    trial->ret	 = QR_TRIAL_PENDING;
+	    _m->npending++;
+	}
+    }
+    _span->cursor = n;
+    _m->ntrials	  = _span->t1;
+}
+
+/*Removes the span at the head of the window.*/
+static void qr_center_matcher_pop(qr_center_matcher *_m)
+{
+    qr_center_span *span;
+    span = _m->spans + _m->head++;
+    qr_center_matcher_span_clear(_m, span);
+    if (span->claim[0] >= 0) {
+	_m->claimed[span->claim[0]]--;
+	_m->claimed[span->claim[1]]--;
+    }
+}
+
+/*Pool job: tries one configuration of the window, if it is still pending.
+  It works on private copies of the centers, and resets the random number
+   generator first, so that the result does not depend on which thread tries
+   it, or on what was tried before.*/
+static void qr_center_matcher_job(void *_arg, int _t, int _slot)
+{
+    qr_center_matcher *m;
+    qr_center_trial *trial;
+    qr_worker *worker;
+    qr_finder_center c[3];
+    qr_finder_center *pc[3];
+    unsigned long long start;
+    int nedge_pts;
+    int l;
+    m	  = (qr_center_matcher *)_arg;
+    trial = m->trials + _t;
+    if (trial->ret != QR_TRIAL_PENDING)
+	return;
+    /*The centers cannot change while the batch runs, and this would be
+       skipped anyway.*/
+    if (m->mark[trial->ci[0]] || m->mark[trial->ci[1]] ||
+	m->mark[trial->ci[2]]) {
+	trial->ret = -1;
+	return;
+    }
+    worker = m->reader->workers + _slot;
+    start  = _zbar_timer_now_ns();
+    for (nedge_pts = l = 0; l < 3; l++)
+	nedge_pts += m->centers[trial->ci[l]].nedge_pts;
+    if (nedge_pts > worker->cedge_pts) {
+	qr_finder_edge_pt *edge_pts;
+	edge_pts = (qr_finder_edge_pt *)realloc(
+	    worker->edge_pts, nedge_pts * sizeof(*edge_pts));
+	if (!edge_pts) {
+	    trial->ret = -1;
+	    return;
+	}
+	worker->edge_pts  = edge_pts;
+	worker->cedge_pts = nedge_pts;
+    }
+    for (nedge_pts = l = 0; l < 3; l++) {
+	c[l] = m->centers[trial->ci[l]];
+	memcpy(worker->edge_pts + nedge_pts, c[l].edge_pts,
+	       c[l].nedge_pts * sizeof(*c[l].edge_pts));
+	c[l].edge_pts = worker->edge_pts + nedge_pts;
+	nedge_pts += c[l].nedge_pts;
+	pc[l] = c + l;
+    }
+    isaac_init(&worker->isaac, NULL, 0);
+    trial->ret = qr_reader_try_configuration(worker, &trial->qrdata, m->img,
+					     m->width, m->height, pc);
+    worker->busy_ns += _zbar_timer_now_ns() - start;
+}
+
+/*Goes through the configurations queued for _span in order, trying those that
+   have not been tried yet, and skipping those with centers that have been used
+   since they were queued.
+  Return: 0 if the search should stop, since too many configurations failed,
+           or 1 otherwise.*/
+static int qr_center_matcher_replay(qr_center_matcher *_m,
+				    qr_center_span *_span)
+{
+    const unsigned char *mark;
+    int t;
+    mark = _m->mark;
+    for (t = _span->t0; t < _span->t1; t++) {
+	qr_center_trial *trial;
+	trial = _m->trials + t;
+	if (mark[trial->ci[0]] || mark[trial->ci[1]] || mark[trial->ci[2]])
+	    continue;
+	if (trial->ret == QR_TRIAL_PENDING) {
+	    qr_finder_center *c[3];
+	    c[0]       = _m->centers + trial->ci[0];
+	    c[1]       = _m->centers + trial->ci[1];
+	    c[2]       = _m->centers + trial->ci[2];
+	    trial->ret = qr_reader_try_configuration(
+		&_m->reader->worker, &trial->qrdata, _m->img, _m->width,
+		_m->height, c);
+	    _m->npending--;
+	}
+	if (trial->ret >= 0) {
+	    /*The list takes ownership of the code data.*/
+	    trial->ret = -1;
+	    qr_center_matcher_add(_m, &trial->qrdata, trial->ci[0],
+				  trial->ci[1], trial->ci[2]);
+	} else if (++_m->nfailures > _m->nfailures_max)
+	    return 0;
+    }
+    return 1;
+}
+
+/*Runs one pass of the search over all the centers.
+  _nmatches: Only the configurations with the _nmatches closest centers
+              are tried.
+  _nskip:    The configurations with the _nskip closest centers are skipped.
+  The configurations are queued in the order a serial search would try them,
+   and then replayed in that order, so the same codes are found.
+  Without threads, configurations are only tried as they are replayed.
+  With threads, the window of queued centers is extended until there are
+   enough configurations pending to keep all the threads busy, and they are all
+   tried in parallel first.
+  Since the first configuration of a center is usually a code when it is tried
+   at all, only that one is queued at first, and the centers it uses are
+   skipped (deferred) rather than tried for nothing.
+  More configurations are queued as needed, twice as many each time.*/
+static void qr_center_matcher_run(qr_center_matcher *_m, int _nmatches,
+				  int _nskip)
+{
+    _m->head = _m->tail = _m->next = 0;
+    _m->ntrials = _m->npending = 0;
+    while (_m->nfailures <= _m->nfailures_max) {
+	qr_center_span *span;
+	/*Extend the window.*/
+	while (_m->next < _m->ncenters && _m->npending < _m->batch_sz) {
+	    int ci;
+	    ci = _m->next++;
+	    if (_m->mark[ci] || _m->centers[ci].nedge_pts < 2)
+		continue;
+	    span	  = _m->spans + _m->tail++;
+	    span->ci	  = ci;
+	    span->t0	  = span->t1 = _m->ntrials;
+	    span->cursor  = 0;
+	    span->chunk	  = _m->pool ? 1 : QR_MATCH_NTRIALS;
+	    span->done	  = -1;
+	    span->claim[0] = span->claim[1] = -1;
+	    if (_m->claimed[ci])
+		continue;
+	    qr_center_matcher_queue(_m, span, _nmatches, _nskip);
+	    if (_m->pool && span->t1 > span->t0) {
+		span->claim[0] = _m->trials[span->t0].ci[1];
+		span->claim[1] = _m->trials[span->t0].ci[2];
+		_m->claimed[span->claim[0]]++;
+		_m->claimed[span->claim[1]]++;
+	    }
+	}
+	if (_m->head >= _m->tail)
+	    break;
+	if (_m->pool && _m->npending > 0) {
+	    _zbar_pool_run(_m->pool, qr_center_matcher_job, _m, _m->ntrials);
+	    _m->npending = 0;
+	}
+	/*Go through the window in order, as far as the configurations have
+	   been tried.*/
+	while (_m->head < _m->tail) {
+	    span = _m->spans + _m->head;
+	    if (_m->mark[span->ci]) {
+		qr_center_matcher_pop(_m);
+		continue;
+	    }
+	    if (span->done < 0) {
+		qr_center_matcher_queue(_m, span, _nmatches, _nskip);
+		if (span->t1 > span->t0)
+		    break;
+	    }
+	    if (!qr_center_matcher_replay(_m, span))
+		break;
+	    if (!_m->mark[span->ci] && !span->done) {
+		span->chunk = QR_MINI(span->chunk << 1, QR_MATCH_NTRIALS);
+		qr_center_matcher_queue(_m, span, _nmatches, _nskip);
+		break;
+	    }
+	    qr_center_matcher_pop(_m);
+	}
+    }
+    while (_m->head < _m->tail)
+	qr_center_matcher_pop(_m);
+}
+
+void qr_reader_match_centers(qr_reader *_reader, qr_code_data_list *_qrlist,
+			     qr_finder_center *_centers, int _ncenters,
+			     qr_binarizer *_img, int _width, int _height)
+{
+    /*Rather than trying every triple of centers, which is O(n^3), we only try
+     those whose arrangement is plausible for a code, found with a grid index.
+    Each center is tried with the closest ones first, so that when a code is
+     found, its centers usually get marked as used before many other
+     configurations are tried with them.
+    A first pass only tries each center with a few of the closest ones, which
+     finds most codes quickly, even when there are enough spurious centers to
+     make the complete search give up early.
+    Triples are still considered with the first center in the original order,
+     as the centers are sorted by reliability.*/
+    qr_center_matcher m;
+    qr_arena *arena;
     int i;
-    int j;
-    int k;
-    mark	  = (unsigned char *)calloc(_ncenters, sizeof(*mark));
-    nfailures_max = QR_MAXI(8192, _width * _height >> 9);
-    nfailures	  = 0;
+    m.reader   = _reader;
+    m.qrlist   = _qrlist;
+    m.centers  = _centers;
+    m.ncenters = _ncenters;
+    m.img      = _img;
+    m.width    = _width;
+    m.height   = _height;
+    m.pool     = _reader->nworkers > 1 ? _reader->pool : NULL;
+    m.batch_sz = m.pool ? QR_MATCH_BATCH * _reader->nworkers : 1;
+    m.trials   = NULL;
+    m.ntrials  = 0;
+    m.ctrials  = 0;
+    arena      = &_reader->arena;
+    m.mark     = (unsigned char *)qr_arena_calloc(arena, _ncenters,
+						  sizeof(*m.mark));
+    m.claimed  = (unsigned char *)qr_arena_calloc(arena, _ncenters,
+						  sizeof(*m.claimed));
+    m.fws      = (qr_finder_widths *)qr_arena_alloc(arena,
+						    _ncenters * sizeof(*m.fws));
+    m.matches  = (qr_finder_match *)qr_arena_alloc(
+	arena, _ncenters * sizeof(*m.matches));
+    m.spans    = (qr_center_span *)qr_arena_alloc(arena,
+						  _ncenters * sizeof(*m.spans));
+    if (m.mark && m.claimed && m.fws && m.matches && m.spans &&
+	qr_finder_grid_init(&_reader->arena, &m.grid, _centers, _ncenters,
+			    _width, _height) >= 0) {
+	for (i = 0; i < _ncenters; i++)
+	    qr_finder_widths_init(m.fws + i, _centers + i);
+	/*The first pass is bounded, so its failures are not counted.*/
+	m.nfailures_max = INT_MAX;
+	m.nfailures	= 0;
+	qr_center_matcher_run(&m, QR_MATCH_NNEAR, 0);
+	m.nfailures_max = QR_MAXI(8192, _width * _height >> 9);
+	m.nfailures	= 0;
+	qr_center_matcher_run(&m, _ncenters, QR_MATCH_NNEAR);
+    }
+}
+
+/*The number of words of bits sampled from a code of the given version.*/
+static int qr_code_nbits(int _version)
+{
+    int dim;
+    dim = 17 + (_version << 2);
+    return dim * (dim + QR_INT_BITS - 1 >> QR_INT_LOGBITS);
+}
+
+/*Finds the finder center nearest to where one is predicted to be.
+  _p:  The predicted position.
+  _r2: The squared distance within which to look.
+  Return: The index of the nearest center, or -1 if none is close enough.*/
+static int qr_finder_center_nearest(const qr_finder_center *_centers,
+				    int _ncenters, const qr_point _p, int _r2)
+{
+    int best;
+    int i;
+    best = -1;
     for (i = 0; i < _ncenters; i++) {
-	/*TODO: We might be able to accelerate this step significantly by
-       considering the remaining finder centers in a more intelligent order,
-       based on the first finder center we just chose.*/
-	for (j = i + 1; !mark[i] && j < _ncenters; j++) {
-	    for (k = j + 1; !mark[j] && k < _ncenters; k++)
-		if (!mark[k]) {
-		    qr_finder_center *c[3];
-		    qr_code_data qrdata;
-		    int version;
-		    c[0]    = _centers + i;
-		    c[1]    = _centers + j;
-		    c[2]    = _centers + k;
-		    version = qr_reader_try_configuration(_reader, &qrdata,
-							  _img, _width, _height,
-							  c);
-		    if (version >= 0) {
-			int ninside;
-			int l;
-			/*Add the data to the list.*/
-			qr_code_data_list_add(_qrlist, &qrdata);
-			/*Convert the bounding box we're returning to the user to normal
-             image coordinates.*/
-			for (l = 0; l < 4; l++) {
-			    _qrlist->qrdata[_qrlist->nqrdata - 1].bbox[l][0] >>=
-				QR_FINDER_SUBPREC;
-			    _qrlist->qrdata[_qrlist->nqrdata - 1].bbox[l][1] >>=
-				QR_FINDER_SUBPREC;
-			}
-			/*Mark these centers as used.*/
-			mark[i] = mark[j] = mark[k] = 1;
-			/*Find any other finder centers located inside this code.*/
-			for (l = ninside = 0; l < _ncenters; l++)
-			    if (!mark[l]) {
-				if (qr_point_ccw(qrdata.bbox[0], qrdata.bbox[1],
-						 _centers[l].pos) >= 0 &&
-				    qr_point_ccw(qrdata.bbox[1], qrdata.bbox[3],
-						 _centers[l].pos) >= 0 &&
-				    qr_point_ccw(qrdata.bbox[3], qrdata.bbox[2],
-						 _centers[l].pos) >= 0 &&
-				    qr_point_ccw(qrdata.bbox[2], qrdata.bbox[0],
-						 _centers[l].pos) >= 0) {
-				    mark[l] = 2;
-				    ninside++;
-				}
-			    }
-			if (ninside >= 3) {
-			    /*We might have a "Double QR": a code inside a code.
-              Copy the relevant centers to a new array and do a search confined
-               to that subset.*/
-			    qr_finder_center *inside;
-			    inside = (qr_finder_center *)malloc(
-				ninside * sizeof(*inside));
-			    for (l = ninside = 0; l < _ncenters; l++) {
-				if (mark[l] == 2)
-				    *&inside[ninside++] = *&_centers[l];
-			    }
-			    qr_reader_match_centers(_reader, _qrlist, inside,
-						    ninside, _img, _width,
-						    _height);
-			    free(inside);
-			}
-			/*Mark _all_ such centers used: codes cannot partially overlap.*/
-			for (l = 0; l < _ncenters; l++)
-			    if (mark[l] == 2)
-				mark[l] = 1;
-			nfailures = 0;
-		    } else if (++nfailures > nfailures_max) {
-			/*Give up.
-            We're unlikely to find a valid code in all this clutter, and we
-             could spent quite a lot of time trying.*/
-			i = j = k = _ncenters;
-		    }
-		}
+	int dx;
+	int dy;
+	int d2;
+	dx = _centers[i].pos[0] - _p[0];
+	dy = _centers[i].pos[1] - _p[1];
+	d2 = dx * dx + dy * dy;
+	if (d2 < _r2) {
+	    best = i;
+	    _r2	 = d2;
+	}
+    }
+    return best;
+}
+
+/*Looks for the codes decoded in the last frame again, and adds those found to
+   the list.
+  Each finder center is predicted to have kept moving the way it did in the
+   last frame, and is then snapped to the nearest center found in this frame
+   within a few modules.
+  The code is sampled there directly, skipping the search for its
+   configuration, and when the bits read from the image have not changed, the
+   error correction as well.
+  The finder centers inside the codes found are removed from the list, since
+   codes cannot overlap.
+  Return: The number of codes found.
+          The motion of each is left in the first tracks, for
+           qr_reader_tracks_update().*/
+static int qr_reader_track(qr_reader *_reader, qr_code_data_list *_qrlist,
+			   qr_finder_center *_centers, int *_ncenters,
+			   qr_binarizer *_img, int _width, int _height)
+{
+    int ntracked;
+    int i;
+    if (_width != _reader->track_width || _height != _reader->track_height)
+	qr_reader_tracks_clear(_reader);
+    for (i = ntracked = 0; i < _reader->ntracks; i++) {
+	qr_track *track;
+	qr_code_data qrdata;
+	qr_point motion[3];
+	qr_point c[3];
+	int ncenters;
+	int dim;
+	int dx;
+	int dy;
+	int r2;
+	int j;
+	int k;
+	track = _reader->tracks + i;
+	/*Look within 3 modules of the predicted centers: the finder patterns are
+	   7 modules wide, and those of different codes are farther apart.*/
+	dim = 17 + (track->qrdata.version << 2) - 7;
+	dx  = track->qrdata.centers[1][0] - track->qrdata.centers[0][0];
+	dy  = track->qrdata.centers[1][1] - track->qrdata.centers[0][1];
+	r2  = (dx * dx + dy * dy) / (dim * dim) * 9;
+	for (k = 0; k < 3; k++) {
+	    c[k][0] = track->qrdata.centers[k][0] + track->motion[k][0];
+	    c[k][1] = track->qrdata.centers[k][1] + track->motion[k][1];
+	    j	    = qr_finder_center_nearest(_centers, *_ncenters, c[k], r2);
+	    if (j >= 0)
+		memcpy(c[k], _centers[j].pos, sizeof(c[k]));
+	    motion[k][0] = c[k][0] - track->qrdata.centers[k][0];
+	    motion[k][1] = c[k][1] - track->qrdata.centers[k][1];
+	}
+	/*Move the corners along with the finder centers next to them.*/
+	for (j = 0; j < 2; j++) {
+	    qrdata.bbox[0][j] = track->qrdata.corners[0][j] + motion[0][j];
+	    qrdata.bbox[1][j] = track->qrdata.corners[1][j] + motion[1][j];
+	    qrdata.bbox[2][j] = track->qrdata.corners[2][j] + motion[2][j];
+	    qrdata.bbox[3][j] = track->qrdata.corners[3][j] + motion[1][j] +
+				motion[2][j] - motion[0][j];
+	}
+	qr_arena_reset(&_reader->worker.arena);
+	if (!qr_point_ccw(c[0], c[1], c[2]) ||
+	    qr_code_decode(&qrdata, &_reader->worker, c[0], c[1], c[2],
+			   track->qrdata.version, track->qrdata.fmt_info, _img,
+			   _width, _height, &track->qrdata) < 0) {
+	    qr_code_data_clear(&track->qrdata);
+	    memset(&track->qrdata, 0, sizeof(track->qrdata));
+	    continue;
+	}
+	qr_code_data_clear(&track->qrdata);
+	memset(&track->qrdata, 0, sizeof(track->qrdata));
+	memcpy(_reader->tracks[ntracked++].motion, motion, sizeof(motion));
+	/*Drop the finder centers inside the code.*/
+	for (j = ncenters = 0; j < *_ncenters; j++) {
+	    if (qr_point_ccw(qrdata.bbox[0], qrdata.bbox[1],
+			     _centers[j].pos) < 0 ||
+		qr_point_ccw(qrdata.bbox[1], qrdata.bbox[3],
+			     _centers[j].pos) < 0 ||
+		qr_point_ccw(qrdata.bbox[3], qrdata.bbox[2],
+			     _centers[j].pos) < 0 ||
+		qr_point_ccw(qrdata.bbox[2], qrdata.bbox[0],
+			     _centers[j].pos) < 0) {
+		_centers[ncenters++] = _centers[j];
+	    }
+	}
+	*_ncenters = ncenters;
+	for (k = 0; k < 4; k++) {
+	    qrdata.bbox[k][0] >>= QR_FINDER_SUBPREC;
+	    qrdata.bbox[k][1] >>= QR_FINDER_SUBPREC;
+	}
+	qr_code_data_list_add(_qrlist, &qrdata);
+    }
+    _reader->ntracks = ntracked;
+    return ntracked;
+}
+
+/*Replaces the tracked codes with those found in this frame.
+  _ntracked: The number of codes at the start of the list that were found by
+              qr_reader_track().*/
+static void qr_reader_tracks_update(qr_reader *_reader,
+				    const qr_code_data_list *_qrlist,
+				    int _ntracked, int _width, int _height)
+{
+    qr_track *tracks;
+    int ntracks;
+    int i;
+    tracks = NULL;
+    if (_qrlist->nqrdata > 0)
+	tracks = (qr_track *)malloc(_qrlist->nqrdata * sizeof(*tracks));
+    for (i = ntracks = 0; tracks != NULL && i < _qrlist->nqrdata; i++) {
+	const qr_code_data *qrdata;
+	qrdata = _qrlist->qrdata + i;
+	if (qr_code_data_copy(&tracks[ntracks].qrdata, NULL, qrdata,
+			      qr_code_nbits(qrdata->version)) < 0) {
+	    continue;
 	}
+	if (i < _ntracked) {
+	    memcpy(tracks[ntracks].motion, _reader->tracks[i].motion,
+		   sizeof(tracks[ntracks].motion));
+	} else
+	    memset(tracks[ntracks].motion, 0, sizeof(tracks[ntracks].motion));
+	ntracks++;
+    }
+    qr_reader_tracks_clear(_reader);
+    _reader->tracks	  = tracks;
+    _reader->ntracks	  = ntracks;
+    _reader->track_width  = _width;
+    _reader->track_height = _height;
+}
+
+/*Sets the most scratch memory to keep between images in each arena, and for the
+   finder lines in each direction.*/
+static void qr_reader_scratch_limit(qr_reader *_reader, size_t _limit)
+{
+    int i;
+    _reader->arena.limit	  = _limit;
+    _reader->worker.arena.limit	  = _limit;
+    _reader->worker.results.limit = _limit;
+    for (i = 0; i < _reader->nworkers; i++) {
+	_reader->workers[i].arena.limit	  = _limit;
+	_reader->workers[i].results.limit = _limit;
+    }
+}
+
+/*Takes back the scratch memory used for an image, keeping what the limit
+   allows for the next one.*/
+static void qr_reader_scratch_trim(qr_reader *_reader)
+{
+    size_t limit;
+    int dir;
+    int i;
+    qr_arena_reset(&_reader->arena);
+    qr_arena_reset(&_reader->worker.arena);
+    qr_arena_reset(&_reader->worker.results);
+    for (i = 0; i < _reader->nworkers; i++) {
+	qr_arena_reset(&_reader->workers[i].arena);
+	qr_arena_reset(&_reader->workers[i].results);
+    }
+    limit = _reader->arena.limit;
+    for (dir = 0; dir < 2; dir++) {
+	qr_finder_lines *lines;
+	int clines;
+	lines = _reader->finder_lines + dir;
+	if (lines->clines * sizeof(*lines->lines) <= limit)
+	    continue;
+	clines = (int)(limit / sizeof(*lines->lines));
+	lines->nlines = QR_MINI(lines->nlines, clines);
+	if (clines > 0) {
+	    qr_finder_line *p;
+	    p = (qr_finder_line *)realloc(lines->lines,
+					  clines * sizeof(*lines->lines));
+	    if (!p)
+		continue;
+	    lines->lines = p;
+	} else {
+	    free(lines->lines);
+	    lines->lines = NULL;
+	}
+	lines->clines = clines;
     }
-    free(mark);
 }
 
 int _zbar_qr_found_line(qr_reader *reader, int dir, const qr_finder_line *line)
@@ -4333,6 +5872,17 @@ int _zbar_qr_found_line(qr_reader *reader, int dir, const qr_finder_line *line)
     return (0);
 }
 
+int _zbar_qr_merge_lines(qr_reader *reader, const qr_reader *src)
+{
+    int dir, i;
+    for (dir = 0; dir < 2; dir++) {
+	const qr_finder_lines *lines = &src->finder_lines[dir];
+	for (i = 0; i < lines->nlines; i++)
+	    _zbar_qr_found_line(reader, dir, lines->lines + i);
+    }
+    return (0);
+}
+
 static inline void qr_svg_centers(const qr_finder_center *centers, int ncenters)
 {
     int i, j;
@@ -4352,44 +5902,97 @@ static inline void qr_svg_centers(const qr_finder_center *centers, int ncenters)
 }
 
 int _zbar_qr_decode(qr_reader *reader, zbar_image_scanner_t *iscn,
-		    zbar_image_t *img)
+		    zbar_image_t *img, int inverted)
 {
     int nqrdata			= 0, ncenters;
     qr_finder_edge_pt *edge_pts = NULL;
     qr_finder_center *centers	= NULL;
+    unsigned long long start, now, rs_ns, busy_ns;
+    int lazy = 0, nthreads = 1, track = 0, ntracked = 0, scratch = 0, i;
+    zbar_luma_t luma;
 
+    zbar_image_scanner_get_config(iscn, ZBAR_PARTIAL, ZBAR_CFG_QR_TRACK,
+				  &track);
     if (reader->finder_lines[0].nlines < 9 ||
-	reader->finder_lines[1].nlines < 9)
+	reader->finder_lines[1].nlines < 9) {
+	qr_reader_tracks_clear(reader);
 	return (0);
+    }
+
+    zbar_image_scanner_get_config(iscn, ZBAR_PARTIAL, ZBAR_CFG_QR_SCRATCH,
+				  &scratch);
+    qr_reader_scratch_limit(reader, QR_MAXI(scratch, 0));
 
     svg_group_start("finder", 0, 1. / (1 << QR_FINDER_SUBPREC), 0, 0, 0);
 
+    start    = _zbar_timer_now_ns();
     ncenters = qr_finder_centers_locate(&centers, &edge_pts, reader, 0, 0);
+    now	     = _zbar_timer_now_ns();
+    _zbar_image_scanner_add_time(iscn, ZBAR_STAGE_QR_CENTERS, now - start);
 
     zprintf(14, "%dx%d finders, %d centers:\n", reader->finder_lines[0].nlines,
 	    reader->finder_lines[1].nlines, ncenters);
     qr_svg_centers(centers, ncenters);
 
-    if (ncenters >= 3) {
-	void *bin = qr_binarize(img->data, img->width, img->height);
+    /* with lazy binarization, tiles are timed along with center matching.
+     * tiles are not binarized lazily when several threads read them
+     */
+    zbar_image_scanner_get_config(iscn, ZBAR_PARTIAL, ZBAR_CFG_QR_THREADS,
+				  &nthreads);
+    nthreads = qr_reader_threads_alloc(reader, nthreads);
+    if (nthreads < 2)
+	zbar_image_scanner_get_config(iscn, ZBAR_PARTIAL,
+				      ZBAR_CFG_LAZY_BINARIZE, &lazy);
+    if ((ncenters >= 3 || track && reader->ntracks > 0) &&
+	!_zbar_image_luma(img, &luma) &&
+	!qr_binarize(&reader->bin, luma.data, img->width, img->height,
+		     luma.step, luma.stride, inverted, lazy)) {
+	qr_code_data_list *qrlist;
+	qrlist		= &reader->qrlist;
+	qrlist->nqrdata = 0;
 
-	qr_code_data_list qrlist;
-	qr_code_data_list_init(&qrlist);
+	start = _zbar_timer_now_ns();
+	_zbar_image_scanner_add_time(iscn, ZBAR_STAGE_QR_BINARIZE, start - now);
 
-	qr_reader_match_centers(reader, &qrlist, centers, ncenters, bin,
-				img->width, img->height);
+	/*Code decoding is timed separately, and the time of the pool threads
+	   is added to that of the caller.*/
+	reader->worker.rs_ns = 0;
+	for (i = 0; i < reader->nworkers; i++)
+	    reader->workers[i].rs_ns = reader->workers[i].busy_ns = 0;
+	/* codes seen in the last frame are looked for where they were first */
+	if (track)
+	    ntracked = qr_reader_track(reader, qrlist, centers, &ncenters,
+				       &reader->bin, img->width, img->height);
+	if (ncenters >= 3)
+	    qr_reader_match_centers(reader, qrlist, centers, ncenters,
+				    &reader->bin, img->width, img->height);
+	now	= _zbar_timer_now_ns();
+	rs_ns	= reader->worker.rs_ns;
+	busy_ns = 0;
+	for (i = 0; i < reader->nworkers; i++) {
+	    rs_ns += reader->workers[i].rs_ns;
+	    if (i > 0)
+		busy_ns += reader->workers[i].busy_ns;
+	}
+	_zbar_image_scanner_add_time(iscn, ZBAR_STAGE_QR_CENTERS,
+				     now - start + busy_ns - rs_ns);
+	_zbar_image_scanner_add_time(iscn, ZBAR_STAGE_QR_RS, rs_ns);
 
-	if (qrlist.nqrdata > 0)
-	    nqrdata = qr_code_data_list_extract_text(&qrlist, iscn, img);
+	if (qrlist->nqrdata > 0 && reader->cds != NULL)
+	    nqrdata = qr_code_data_list_extract_text(qrlist, reader->cds,
+						     iscn, img);
+	_zbar_image_scanner_add_time(iscn, ZBAR_STAGE_QR_TEXT,
+				     _zbar_timer_now_ns() - now);
 
-	qr_code_data_list_clear(&qrlist);
-	free(bin);
-    }
+	if (track)
+	    qr_reader_tracks_update(reader, qrlist, ntracked, img->width,
+				    img->height);
+	else
+	    qr_reader_tracks_clear(reader);
+    } else
+	qr_reader_tracks_clear(reader);
     svg_group_end();
 
-    if (centers)
-	free(centers);
-    if (edge_pts)
-	free(edge_pts);
+    qr_reader_scratch_trim(reader);
     return (nqrdata);
 }
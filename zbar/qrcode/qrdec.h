@@ -11,6 +11,7 @@
 typedef struct qr_code_data_entry qr_code_data_entry;
 typedef struct qr_code_data qr_code_data;
 typedef struct qr_code_data_list qr_code_data_list;
+typedef struct qr_text_cds qr_text_cds;
 
 typedef enum qr_mode
 {
@@ -140,6 +141,14 @@ struct qr_code_data {
     Points appear in the order up-left, up-right, down-left, down-right,
      relative to the orientation of the QR code.*/
     qr_point bbox[4];
+    /*The finder pattern centers the code was sampled from (UL, UR, DL), the
+     estimated positions of its four corner modules, its format information,
+     and the bits sampled from the image.
+    These are used to find the code again in the next frame.*/
+    qr_point centers[3];
+    qr_point corners[4];
+    int fmt_info;
+    unsigned *bits;
 };
 
 struct qr_code_data_list {
@@ -148,6 +157,13 @@ struct qr_code_data_list {
     int cqrdata;
 };
 
+/*Allocates a cache of character set converters for
+   qr_code_data_list_extract_text().
+  The converters are opened as they are first needed, and stay open until the
+   cache is freed.*/
+qr_text_cds *qr_text_cds_alloc(void);
+void qr_text_cds_free(qr_text_cds *_cds);
+
 /*Extract symbol data from a list of QR codes and attach to the image.
   All text is converted to UTF-8.
   For binary/byte mode QR codes: if configured with ZBAR_CFG_BINARY,
@@ -161,6 +177,7 @@ struct qr_code_data_list {
   Return: The number of symbols which were successfully extracted from the
    codes; this will be at most the number of codes.*/
 int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
+				   qr_text_cds *_cds,
 				   zbar_image_scanner_t *iscn,
 				   zbar_image_t *img);
 
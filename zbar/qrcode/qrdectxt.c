@@ -21,30 +21,228 @@
 
 #define ENC_LIST_SIZE 4
 
-static int text_is_ascii(const unsigned char *_text, int _len)
+/*The encodings we try when the code does not specify one, in their initial
+   order of preference.*/
+enum
 {
+    QR_ENC_SJIS,
+    QR_ENC_LATIN1,
+    QR_ENC_BIG5,
+    QR_ENC_UTF8
+};
+
+static const char *const QR_ENC_NAMES[ENC_LIST_SIZE] = {
+    /*This one is often used, even though the standard does not say so.*/
+    "SJIS",
+    /*This is the encoding the standard says is the default.*/
+    "ISO8859-1", "BIG-5",
+    /*Never opened: UTF-8 is validated and copied without iconv().*/
+    "UTF-8"
+};
+
+/*Character set converters, kept open between calls.
+  iconv_open() looks up (and may load) a conversion module every time it is
+   called, which is easily more expensive than the conversion itself for the
+   short payloads found in QR codes.
+  Each converter is opened the first time it is needed.*/
+struct qr_text_cds {
+    /*The converters for the auto-detected encodings, indexed by QR_ENC_*.*/
+    iconv_t enc_cds[ENC_LIST_SIZE];
+    /*The converters for the ECI designators, indexed by ECI value.*/
+    iconv_t eci_cds[QR_ECI_UTF8 + 1];
+    /*Bit masks of the converters we have already tried to open.*/
+    unsigned enc_opened;
+    unsigned eci_opened;
+    /*Scratch buffers kept between images: the marks of the codes already
+     extracted, and the bytes waiting to be converted.*/
+    unsigned char *mark;
+    size_t cmark;
+    char *bytebuf;
+    size_t cbytebuf;
+};
+
+qr_text_cds *qr_text_cds_alloc(void)
+{
+    qr_text_cds *cds;
     int i;
-    for (i = 0; i < _len; i++)
-	if (_text[i] >= 0x80)
-	    return 0;
-    return 1;
+    cds = (qr_text_cds *)calloc(1, sizeof(*cds));
+    if (cds == NULL)
+	return NULL;
+    for (i = 0; i < ENC_LIST_SIZE; i++)
+	cds->enc_cds[i] = (iconv_t)-1;
+    for (i = 0; i <= QR_ECI_UTF8; i++)
+	cds->eci_cds[i] = (iconv_t)-1;
+    return cds;
 }
 
-static int text_is_latin1(const unsigned char *_text, int _len)
+void qr_text_cds_free(qr_text_cds *_cds)
 {
     int i;
+    if (_cds == NULL)
+	return;
+    for (i = 0; i < ENC_LIST_SIZE; i++)
+	if (_cds->enc_cds[i] != (iconv_t)-1)
+	    iconv_close(_cds->enc_cds[i]);
+    for (i = 0; i <= QR_ECI_UTF8; i++)
+	if (_cds->eci_cds[i] != (iconv_t)-1)
+	    iconv_close(_cds->eci_cds[i]);
+    free(_cds->mark);
+    free(_cds->bytebuf);
+    free(_cds);
+}
+
+/*Makes a scratch buffer at least _sz bytes long.
+  Return: The buffer, or NULL if it could not be grown.*/
+static void *qr_text_scratch(void *_buf, size_t *_cbuf, size_t _sz)
+{
+    void **buf;
+    void *p;
+    buf = (void **)_buf;
+    if (*_cbuf >= _sz)
+	return *buf;
+    p = realloc(*buf, _sz);
+    if (p == NULL)
+	return NULL;
+    *buf   = p;
+    *_cbuf = _sz;
+    return p;
+}
+
+/*Returns a converter in its initial shift state, opening it if needed.*/
+static iconv_t qr_text_cd_get(iconv_t *_cd, unsigned *_opened, int _idx,
+			      const char *_enc)
+{
+    if (!(*_opened & 1U << _idx)) {
+	*_cd = iconv_open("UTF-8", _enc);
+	*_opened |= 1U << _idx;
+    } else if (*_cd != (iconv_t)-1)
+	iconv(*_cd, NULL, NULL, NULL, NULL);
+    return *_cd;
+}
+
+/*Gets the name of the character set specified by an ECI designator.
+  Return: The name, or NULL if it is not an encoding we recognize.*/
+static const char *qr_eci_name(unsigned _eci, char _buf[16])
+{
+    if (_eci <= QR_ECI_ISO8859_16 && _eci != 14) {
+	if (_eci != QR_ECI_GLI0 && _eci != QR_ECI_CP437) {
+	    sprintf(_buf, "ISO8859-%i", QR_MAXI(_eci, 3) - 2);
+	    return _buf;
+	}
+	/*Note that CP437 requires an iconv compiled with
+       --enable-extra-encodings, and thus may not be available.*/
+	return "CP437";
+    } else if (_eci == QR_ECI_SJIS)
+	return "SJIS";
+    else if (_eci == QR_ECI_UTF8)
+	return "UTF-8";
+    return NULL;
+}
+
+/*The high bit of every byte in a word.*/
+#define TEXT_HIGH_BITS ((size_t)-1 / 0xFF * 0x80)
+
+/*Returns the length of the run of 7-bit characters at the start of the text.
+  This checks a machine word at a time, so the scan costs little for the
+   typical payload (a URL or plain text).*/
+static size_t text_ascii_len(const unsigned char *_text, size_t _len)
+{
+    size_t i;
+    for (i = 0; i + sizeof(size_t) <= _len; i += sizeof(size_t)) {
+	size_t w;
+	memcpy(&w, _text + i, sizeof(w));
+	if (w & TEXT_HIGH_BITS)
+	    break;
+    }
+    while (i < _len && _text[i] < 0x80)
+	i++;
+    return i;
+}
+
+static int text_is_ascii(const unsigned char *_text, size_t _len)
+{
+    return text_ascii_len(_text, _len) == _len;
+}
+
+static int text_is_latin1(const unsigned char *_text, size_t _len)
+{
+    size_t i;
     for (i = 0; i < _len; i++) {
+	i += text_ascii_len(_text + i, _len - i);
 	/*The following line fails to compile correctly with gcc 3.4.4 on ARM with
        any optimizations enabled.*/
-	if (_text[i] >= 0x80 && _text[i] < 0xA0)
+	if (i < _len && _text[i] < 0xA0)
 	    return 0;
     }
     return 1;
 }
 
-static int text_is_big5(const unsigned char *_text, int _len)
+/*Checks for well-formed UTF-8: no overlong forms, surrogates, or code points
+   above U+10FFFF.
+  This is slightly stricter than glibc's iconv(), which also passes through the
+   obsolete 5- and 6-byte forms, but those are not valid UTF-8 output either.*/
+static int text_is_utf8(const unsigned char *_text, size_t _len)
 {
-    int i;
+    size_t i;
+    for (i = 0; i < _len; i++) {
+	unsigned lo;
+	unsigned hi;
+	int n;
+	int c;
+	i += text_ascii_len(_text + i, _len - i);
+	if (i >= _len)
+	    break;
+	c  = _text[i];
+	lo = 0x80;
+	hi = 0xBF;
+	if (c < 0xC2)
+	    return 0;
+	else if (c < 0xE0)
+	    n = 1;
+	else if (c < 0xF0) {
+	    n = 2;
+	    if (c == 0xE0)
+		lo = 0xA0;
+	    else if (c == 0xED)
+		hi = 0x9F;
+	} else if (c < 0xF5) {
+	    n = 3;
+	    if (c == 0xF0)
+		lo = 0x90;
+	    else if (c == 0xF4)
+		hi = 0x8F;
+	} else
+	    return 0;
+	if (_len - i <= (size_t)n)
+	    return 0;
+	if (_text[i + 1] < lo || _text[i + 1] > hi)
+	    return 0;
+	for (i += 2; --n > 0; i++)
+	    if ((_text[i] & 0xC0) != 0x80)
+		return 0;
+	i--;
+    }
+    return 1;
+}
+
+/*Appends UTF-8 text to the output after checking that it is valid.
+  This replaces a UTF-8 to UTF-8 iconv() conversion.
+  Return: 0 on success, or -1 if the text was not valid UTF-8 or did not fit.*/
+static int text_copy_utf8(const char *_in, size_t _inleft, char **_out,
+			  size_t *_outleft)
+{
+    if (_inleft > *_outleft ||
+	!text_is_utf8((const unsigned char *)_in, _inleft))
+	return -1;
+    memcpy(*_out, _in, _inleft);
+    *_out += _inleft;
+    *_outleft -= _inleft;
+    return 0;
+}
+
+static int text_is_big5(const unsigned char *_text, size_t _len)
+{
+    size_t i;
     for (i = 0; i < _len; i++) {
 	if (_text[i] == 0xFF)
 	    return 0;
@@ -62,7 +260,7 @@ static int text_is_big5(const unsigned char *_text, int _len)
     return 1;
 }
 
-static void enc_list_mtf(iconv_t _enc_list[ENC_LIST_SIZE], iconv_t _enc)
+static void enc_list_mtf(int _enc_list[ENC_LIST_SIZE], int _enc)
 {
     int i;
     for (i = 0; i < ENC_LIST_SIZE; i++)
@@ -76,13 +274,10 @@ static void enc_list_mtf(iconv_t _enc_list[ENC_LIST_SIZE], iconv_t _enc)
 }
 
 int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
+				   qr_text_cds *_cds,
 				   zbar_image_scanner_t *iscn,
 				   zbar_image_t *img)
 {
-    iconv_t sjis_cd;
-    iconv_t utf8_cd;
-    iconv_t latin1_cd;
-    iconv_t big5_cd;
     const qr_code_data *qrdata;
     int nqrdata;
     unsigned char *mark;
@@ -93,22 +288,17 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
 				  &raw_binary);
     qrdata  = _qrlist->qrdata;
     nqrdata = _qrlist->nqrdata;
-    mark    = (unsigned char *)calloc(nqrdata, sizeof(*mark));
-    ntext   = 0;
-    /*This is the encoding the standard says is the default.*/
-    latin1_cd = iconv_open("UTF-8", "ISO8859-1");
-    /*But this one is often used, as well.*/
-    sjis_cd = iconv_open("UTF-8", "SJIS");
-    /*This is a trivial conversion just to check validity without extra code.*/
-    utf8_cd = iconv_open("UTF-8", "UTF-8");
-    /* add support for big5 encoding. */
-    big5_cd = iconv_open("UTF-8", "BIG-5");
+    mark    = (unsigned char *)qr_text_scratch(&_cds->mark, &_cds->cmark,
+					      nqrdata * sizeof(*mark));
+    if (mark == NULL)
+	return 0;
+    memset(mark, 0, nqrdata * sizeof(*mark));
+    ntext = 0;
     for (i = 0; i < nqrdata; i++)
 	if (!mark[i]) {
 	    const qr_code_data *qrdataj;
 	    const qr_code_data_entry *entry;
-	    iconv_t enc_list[ENC_LIST_SIZE];
-	    iconv_t eci_cd;
+	    int enc_list[ENC_LIST_SIZE];
 	    int sa[16];
 	    int sa_size;
 	    char *sa_text;
@@ -192,8 +382,15 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
 		    }
 		}
 
-	    /*Step 2: Convert the entries.*/
-	    sa_text  = (char *)malloc((sa_ctext + 1) * sizeof(*sa_text));
+	    /*Step 2: Convert the entries.
+	      A lone code is converted straight into the data of its symbol,
+	       which keeps its buffer when recycled.*/
+	    if (sa_size == 1) {
+		syms	= _zbar_image_scanner_alloc_sym(iscn, ZBAR_QRCODE,
+							sa_ctext + 1);
+		sa_text = syms->data;
+	    } else
+		sa_text = (char *)malloc((sa_ctext + 1) * sizeof(*sa_text));
 	    sa_ntext = 0;
 	    /*Add the encoded Application Indicator for FNC1 in the second position.*/
 	    if (fnc1 == MOD(ZBAR_MOD_AIM)) {
@@ -209,18 +406,20 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
 		    sa_text[sa_ntext++] = (char)(fnc1_2ai - 100);
 	    }
 	    eci		= -1;
-	    enc_list[0] = sjis_cd;
-	    enc_list[1] = latin1_cd;
-	    enc_list[2] = big5_cd;
-	    enc_list[3] = utf8_cd;
-	    eci_cd	= (iconv_t)-1;
-	    err		= 0;
-
-	    bytebuf_text  = (char *)malloc((sa_ctext + 1) * sizeof(*sa_text));
+	    enc_list[0] = QR_ENC_SJIS;
+	    enc_list[1] = QR_ENC_LATIN1;
+	    enc_list[2] = QR_ENC_BIG5;
+	    enc_list[3] = QR_ENC_UTF8;
+
+	    bytebuf_text  = (char *)qr_text_scratch(
+		 &_cds->bytebuf, &_cds->cbytebuf,
+		 (sa_ctext + 1) * sizeof(*bytebuf_text));
 	    bytebuf_ntext = 0;
+	    err		  = bytebuf_text == NULL;
 
 	    for (j = 0; j < sa_size && !err; j++, sym = &(*sym)->next) {
-		*sym = _zbar_image_scanner_alloc_sym(iscn, ZBAR_QRCODE, 0);
+		if (*sym == NULL)
+		    *sym = _zbar_image_scanner_alloc_sym(iscn, ZBAR_QRCODE, 0);
 		(*sym)->datalen = sa_ntext;
 		if (sa[j] < 0) {
 		    /* generic placeholder for unfinished results */
@@ -283,10 +482,12 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
 				    sa_ntext += inleft;
 				    bytebuf_ntext = 0;
 				} else {
+				    int done;
 				    int ei;
+				    done = 0;
 				    /*If there was data encoded in kanji mode, assume it's SJIS.*/
 				    if (has_kanji)
-					enc_list_mtf(enc_list, sjis_cd);
+					enc_list_mtf(enc_list, QR_ENC_SJIS);
 				    /*Otherwise check for the UTF-8 BOM.
                 UTF-8 is rarely specified with ECI, and few decoders
                  currently support doing so, so this is the best way for
@@ -295,38 +496,34 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
 					     in[0] == (char)0xEF &&
 					     in[1] == (char)0xBB &&
 					     in[2] == (char)0xBF) {
-					in += 3;
-					inleft -= 3;
-					/*Actually try converting (to check validity).*/
-					err = utf8_cd == (iconv_t)-1 ||
-					      iconv(utf8_cd, &in, &inleft, &out,
-						    &outleft) == (size_t)-1;
-					if (!err) {
-					    sa_ntext = out - sa_text;
-					    enc_list_mtf(enc_list, utf8_cd);
-					    continue;
-					}
-					in	= bytebuf_text;
-					inleft	= bytebuf_ntext;
-					out	= sa_text + sa_ntext;
-					outleft = sa_ctext - sa_ntext;
+					/*Actually check the text for validity.*/
+					done = text_copy_utf8(in + 3, inleft - 3,
+							      &out, &outleft) >= 0;
+					if (done)
+					    enc_list_mtf(enc_list, QR_ENC_UTF8);
 				    }
 				    /*If the text is 8-bit clean, prefer UTF-8 over SJIS, since
-                 SJIS will corrupt the backslashes used for DoCoMo formats.*/
+                 SJIS will corrupt the backslashes used for DoCoMo formats.
+                Such text is already valid UTF-8, so copy it directly.*/
 				    else if (text_is_ascii((unsigned char *)in,
 							   inleft)) {
-					enc_list_mtf(enc_list, utf8_cd);
+					memcpy(out, in, inleft);
+					out += inleft;
+					outleft -= inleft;
+					done = 1;
+					enc_list_mtf(enc_list, QR_ENC_UTF8);
 				    }
 				    /* Check if it's big5 encoding. */
 				    else if (text_is_big5((unsigned char *)in,
 							  inleft)) {
-					enc_list_mtf(enc_list, big5_cd);
+					enc_list_mtf(enc_list, QR_ENC_BIG5);
 				    }
 
 				    /*Try our list of encodings.*/
-				    for (ei = 0; ei < ENC_LIST_SIZE; ei++)
-					if (enc_list[ei] != (iconv_t)-1) {
-					    /*According to the 2005 version of the standard,
+				    for (ei = 0; !done && ei < ENC_LIST_SIZE;
+					 ei++) {
+					iconv_t cd;
+					/*According to the 2005 version of the standard,
                    ISO/IEC 8859-1 (one hyphen) is supposed to be used, but
                    reality is not always so (and in the 2000 version of the
                    standard, it was JIS8/SJIS that was the default).
@@ -337,42 +534,63 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
                    number of seldom-used control code characters there.
                   So if we see any of those characters, move this
                    conversion to the end of the list.*/
-					    if (ei < 3 &&
-						enc_list[ei] == latin1_cd &&
-						!text_is_latin1(
-						    (unsigned char *)in,
-						    inleft)) {
-						int ej;
-						for (ej = ei + 1;
-						     ej < ENC_LIST_SIZE; ej++)
-						    enc_list[ej - 1] =
-							enc_list[ej];
-						enc_list[3] = latin1_cd;
-					    }
-					    err = iconv(enc_list[ei], &in,
-							&inleft, &out,
+					if (ei < 3 &&
+					    enc_list[ei] == QR_ENC_LATIN1 &&
+					    !text_is_latin1((unsigned char *)in,
+							    inleft)) {
+					    int ej;
+					    for (ej = ei + 1; ej < ENC_LIST_SIZE;
+						 ej++)
+						enc_list[ej - 1] = enc_list[ej];
+					    enc_list[3] = QR_ENC_LATIN1;
+					}
+					if (enc_list[ei] == QR_ENC_UTF8)
+					    err = text_copy_utf8(in, inleft, &out,
+								 &outleft) < 0;
+					else {
+					    cd = qr_text_cd_get(
+						_cds->enc_cds + enc_list[ei],
+						&_cds->enc_opened, enc_list[ei],
+						QR_ENC_NAMES[enc_list[ei]]);
+					    if (cd == (iconv_t)-1)
+						continue;
+					    err = iconv(cd, &in, &inleft, &out,
 							&outleft) == (size_t)-1;
-					    if (!err) {
-						sa_ntext = out - sa_text;
-						enc_list_mtf(enc_list,
-							     enc_list[ei]);
-						break;
-					    }
-					    in	    = bytebuf_text;
-					    inleft  = bytebuf_ntext;
-					    out	    = sa_text + sa_ntext;
-					    outleft = sa_ctext - sa_ntext;
 					}
+					if (!err) {
+					    enc_list_mtf(enc_list, enc_list[ei]);
+					    done = 1;
+					    break;
+					}
+					in	= bytebuf_text;
+					inleft	= bytebuf_ntext;
+					out	= sa_text + sa_ntext;
+					outleft = sa_ctext - sa_ntext;
+				    }
+				    if (done) {
+					sa_ntext = out - sa_text;
+					err	 = 0;
+				    }
 				}
 			    }
 			    /*We were actually given a character set; use it.
               The spec says that in this case, data should be treated as if it
                came from the given character set even when encoded in kanji
                mode.*/
-			    else {
-				err = eci_cd == (iconv_t)-1 ||
-				      iconv(eci_cd, &in, &inleft, &out,
-					    &outleft) == (size_t)-1;
+			    else if (eci == QR_ECI_UTF8) {
+				err = text_copy_utf8(in, inleft, &out, &outleft) <
+				      0;
+				if (!err)
+				    sa_ntext = out - sa_text;
+			    } else {
+				char buf[16];
+				iconv_t cd;
+				cd  = qr_text_cd_get(_cds->eci_cds + eci,
+						     &_cds->eci_opened, eci,
+						     qr_eci_name(eci, buf));
+				err = cd == (iconv_t)-1 ||
+				      iconv(cd, &in, &inleft, &out, &outleft) ==
+					  (size_t)-1;
 				if (!err)
 				    sa_ntext = out - sa_text;
 			    }
@@ -447,31 +665,14 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
 		    } break;
 		    /*Check to see if a character set was specified.*/
 		    case QR_MODE_ECI: {
-			const char *enc;
 			char buf[16];
 			unsigned cur_eci;
 			cur_eci = entry->payload.eci;
-			if (cur_eci <= QR_ECI_ISO8859_16 && cur_eci != 14) {
-			    if (cur_eci != QR_ECI_GLI0 &&
-				cur_eci != QR_ECI_CP437) {
-				sprintf(buf, "ISO8859-%i",
-					QR_MAXI(cur_eci, 3) - 2);
-				enc = buf;
-			    }
-			    /*Note that CP437 requires an iconv compiled with
-                 --enable-extra-encodings, and thus may not be available.*/
-			    else
-				enc = "CP437";
-			} else if (cur_eci == QR_ECI_SJIS)
-			    enc = "SJIS";
-			else if (cur_eci == QR_ECI_UTF8)
-			    enc = "UTF-8";
 			/*Don't know what this ECI code specifies, but not an encoding that
                we recognize.*/
-			else
+			if (qr_eci_name(cur_eci, buf) == NULL)
 			    continue;
-			eci    = cur_eci;
-			eci_cd = iconv_open("UTF-8", enc);
+			eci = cur_eci;
 		    } break;
 		    /*Silence stupid compiler warnings.*/
 		    default:
@@ -479,23 +680,14 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
 		    }
 		}
 		/*If eci should be reset between codes, do so.*/
-		if (eci <= QR_ECI_GLI1) {
+		if (eci <= QR_ECI_GLI1)
 		    eci = -1;
-		    if (eci_cd != (iconv_t)-1) {
-			iconv_close(eci_cd);
-			eci_cd = (iconv_t)-1;
-		    }
-		}
 	    }
 
-	    free(bytebuf_text);
-
-	    if (eci_cd != (iconv_t)-1)
-		iconv_close(eci_cd);
 	    if (!err) {
 		zbar_symbol_t *sa_sym;
 		sa_text[sa_ntext++] = '\0';
-		if (sa_ctext + 1 > sa_ntext) {
+		if (sa_size > 1 && sa_ctext + 1 > sa_ntext) {
 		    sa_text =
 			(char *)realloc(sa_text, sa_ntext * sizeof(*sa_text));
 		}
@@ -510,7 +702,7 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
 		    /* create "virtual" container symbol for composite result */
 		    sa_sym =
 			_zbar_image_scanner_alloc_sym(iscn, ZBAR_QRCODE, 0);
-		    sa_sym->syms       = _zbar_symbol_set_create();
+		    sa_sym->syms       = _zbar_image_scanner_alloc_syms(iscn);
 		    sa_sym->syms->head = syms;
 
 		    /* fixup data references */
@@ -549,25 +741,19 @@ int qr_code_data_list_extract_text(const qr_code_data_list *_qrlist,
 			sym_add_point(sa_sym, xmax, ymin);
 		    }
 		}
-		sa_sym->data	   = sa_text;
-		sa_sym->data_alloc = sa_ntext;
-		sa_sym->datalen	   = sa_ntext - 1;
-		sa_sym->modifiers  = fnc1;
+		if (sa_size > 1) {
+		    sa_sym->data       = sa_text;
+		    sa_sym->data_alloc = sa_ntext;
+		}
+		sa_sym->datalen	  = sa_ntext - 1;
+		sa_sym->modifiers = fnc1;
 
 		_zbar_image_scanner_add_sym(iscn, sa_sym);
 	    } else {
 		_zbar_image_scanner_recycle_syms(iscn, syms);
-		free(sa_text);
+		if (sa_size > 1)
+		    free(sa_text);
 	    }
 	}
-    if (utf8_cd != (iconv_t)-1)
-	iconv_close(utf8_cd);
-    if (sjis_cd != (iconv_t)-1)
-	iconv_close(sjis_cd);
-    if (latin1_cd != (iconv_t)-1)
-	iconv_close(latin1_cd);
-    if (big5_cd != (iconv_t)-1)
-	iconv_close(big5_cd);
-    free(mark);
     return ntext;
 }
@@ -7,6 +7,11 @@
 #include "rs.h"
 #include <stdlib.h>
 #include <string.h>
+#if defined(RS_X86)
+#include <immintrin.h>
+#elif defined(RS_NEON)
+#include <arm_neon.h>
+#endif
 
 /*Reed-Solomon encoder and decoder.
   Original implementation (C) Henry Minsky (hqm@ua.com, hqm@ai.mit.edu),
@@ -26,6 +31,8 @@
 
 /*Galois Field arithmetic in GF(2**8).*/
 
+static void rs_syndrome_init(rs_gf256 *_gf);
+
 void rs_gf256_init(rs_gf256 *_gf, unsigned _ppoly)
 {
     unsigned p;
@@ -41,6 +48,7 @@ void rs_gf256_init(rs_gf256 *_gf, unsigned _ppoly)
 	_gf->log[_gf->exp[i]] = i;
     /*Note that we rely on the fact that _gf->log[0]=0 below.*/
     _gf->log[0] = 0;
+    rs_syndrome_init(_gf);
 }
 
 /*Multiplication in GF(2**8) using logarithms.*/
@@ -411,8 +419,13 @@ static void rs_poly_mult(const rs_gf256 *_gf, unsigned char *_p, int _dp1,
 /*Decoding.*/
 
 /*Computes the syndrome of a codeword.*/
-static void rs_calc_syndrome(const rs_gf256 *_gf, int _m0, unsigned char *_s,
-			     int _npar, const unsigned char *_data, int _ndata)
+/*The syndromes are S_j=sum_i _data[i]*alpha**((j+_m0)*e_i), where
+   e_i=(_ndata-1)-i.
+  This evaluates them by Horner's rule, one syndrome at a time.
+  It is only used for codes with too many parity bytes for the tables.*/
+static void rs_calc_syndrome_horner(const rs_gf256 *_gf, int _m0,
+				    unsigned char *_s, int _npar,
+				    const unsigned char *_data, int _ndata)
 {
     int i;
     int j;
@@ -427,6 +440,156 @@ static void rs_calc_syndrome(const rs_gf256 *_gf, int _m0, unsigned char *_s,
     }
 }
 
+/*The table-driven versions instead go through the codeword once, adding each
+   non-zero byte's contribution to all the syndromes.
+  Scaling the byte by alpha**(_m0*e_i) first leaves the factors alpha**(j*e_i),
+   which come straight from the pow table.*/
+static unsigned rs_syndrome_scale(const rs_gf256 *_gf, int _m0, unsigned _d,
+				  int _e)
+{
+    return _m0 ? _gf->exp[_gf->log[_d] + _m0 * _e % 255] : _d;
+}
+
+static void rs_calc_syndrome_c(const rs_gf256 *_gf, int _m0, unsigned char *_s,
+			       int _npar, const unsigned char *_data,
+			       int _ndata)
+{
+    int i;
+    int j;
+    if (_npar > RS_NPAR_MAX_VEC) {
+	rs_calc_syndrome_horner(_gf, _m0, _s, _npar, _data, _ndata);
+	return;
+    }
+    memset(_s, 0, _npar * sizeof(*_s));
+    for (i = 0; i < _ndata; i++)
+	if (_data[i]) {
+	    const unsigned char *lo;
+	    const unsigned char *hi;
+	    const unsigned char *pow;
+	    unsigned d;
+	    int e;
+	    e	= _ndata - 1 - i;
+	    d	= rs_syndrome_scale(_gf, _m0, _data[i], e);
+	    lo	= _gf->mul_lo[d];
+	    hi	= _gf->mul_hi[d];
+	    pow = _gf->pow[e];
+	    for (j = 0; j < _npar; j++)
+		_s[j] ^= lo[pow[j] & 0xF] ^ hi[pow[j] >> 4];
+	}
+}
+
+#if defined(RS_X86)
+__attribute__((target("ssse3"))) static void
+rs_calc_syndrome_ssse3(const rs_gf256 *_gf, int _m0, unsigned char *_s,
+		       int _npar, const unsigned char *_data, int _ndata)
+{
+    unsigned char s[RS_NPAR_MAX_VEC];
+    __m128i mask = _mm_set1_epi8(0xF);
+    __m128i s0	 = _mm_setzero_si128();
+    __m128i s1	 = _mm_setzero_si128();
+    int i;
+    if (_npar > RS_NPAR_MAX_VEC) {
+	rs_calc_syndrome_horner(_gf, _m0, _s, _npar, _data, _ndata);
+	return;
+    }
+    for (i = 0; i < _ndata; i++)
+	if (_data[i]) {
+	    __m128i lo;
+	    __m128i hi;
+	    __m128i p;
+	    unsigned d;
+	    int e;
+	    e  = _ndata - 1 - i;
+	    d  = rs_syndrome_scale(_gf, _m0, _data[i], e);
+	    lo = _mm_loadu_si128((const __m128i *)_gf->mul_lo[d]);
+	    hi = _mm_loadu_si128((const __m128i *)_gf->mul_hi[d]);
+	    p  = _mm_loadu_si128((const __m128i *)_gf->pow[e]);
+	    s0 = _mm_xor_si128(
+		s0, _mm_xor_si128(
+			_mm_shuffle_epi8(lo, _mm_and_si128(p, mask)),
+			_mm_shuffle_epi8(
+			    hi, _mm_and_si128(_mm_srli_epi16(p, 4), mask))));
+	    if (_npar > 16) {
+		p  = _mm_loadu_si128((const __m128i *)(_gf->pow[e] + 16));
+		s1 = _mm_xor_si128(
+		    s1,
+		    _mm_xor_si128(
+			_mm_shuffle_epi8(lo, _mm_and_si128(p, mask)),
+			_mm_shuffle_epi8(
+			    hi, _mm_and_si128(_mm_srli_epi16(p, 4), mask))));
+	    }
+	}
+    _mm_storeu_si128((__m128i *)s, s0);
+    _mm_storeu_si128((__m128i *)(s + 16), s1);
+    memcpy(_s, s, _npar * sizeof(*_s));
+}
+#endif
+
+#if defined(RS_NEON)
+static void rs_calc_syndrome_neon(const rs_gf256 *_gf, int _m0,
+				  unsigned char *_s, int _npar,
+				  const unsigned char *_data, int _ndata)
+{
+    unsigned char s[RS_NPAR_MAX_VEC];
+    uint8x16_t mask = vdupq_n_u8(0xF);
+    uint8x16_t s0   = vdupq_n_u8(0);
+    uint8x16_t s1   = vdupq_n_u8(0);
+    int i;
+    if (_npar > RS_NPAR_MAX_VEC) {
+	rs_calc_syndrome_horner(_gf, _m0, _s, _npar, _data, _ndata);
+	return;
+    }
+    for (i = 0; i < _ndata; i++)
+	if (_data[i]) {
+	    uint8x16_t lo;
+	    uint8x16_t hi;
+	    uint8x16_t p;
+	    unsigned d;
+	    int e;
+	    e  = _ndata - 1 - i;
+	    d  = rs_syndrome_scale(_gf, _m0, _data[i], e);
+	    lo = vld1q_u8(_gf->mul_lo[d]);
+	    hi = vld1q_u8(_gf->mul_hi[d]);
+	    p  = vld1q_u8(_gf->pow[e]);
+	    s0 = veorq_u8(s0, veorq_u8(vqtbl1q_u8(lo, vandq_u8(p, mask)),
+				       vqtbl1q_u8(hi, vshrq_n_u8(p, 4))));
+	    if (_npar > 16) {
+		p  = vld1q_u8(_gf->pow[e] + 16);
+		s1 = veorq_u8(s1, veorq_u8(vqtbl1q_u8(lo, vandq_u8(p, mask)),
+					   vqtbl1q_u8(hi, vshrq_n_u8(p, 4))));
+	    }
+	}
+    vst1q_u8(s, s0);
+    vst1q_u8(s + 16, s1);
+    memcpy(_s, s, _npar * sizeof(*_s));
+}
+#endif
+
+/*Fills in the syndrome tables and picks the kernel for this CPU.*/
+static void rs_syndrome_init(rs_gf256 *_gf)
+{
+    int a;
+    int n;
+    int e;
+    int j;
+    for (a = 0; a < 256; a++)
+	for (n = 0; n < 16; n++) {
+	    _gf->mul_lo[a][n] = rs_gmul(_gf, a, n);
+	    _gf->mul_hi[a][n] = rs_gmul(_gf, a, n << 4);
+	}
+    for (e = 0; e < 255; e++)
+	for (j = 0; j < RS_NPAR_MAX_VEC; j++)
+	    _gf->pow[e][j] = _gf->exp[j * e % 255];
+    _gf->calc_syndrome = rs_calc_syndrome_c;
+#if defined(RS_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3"))
+	_gf->calc_syndrome = rs_calc_syndrome_ssse3;
+#elif defined(RS_NEON)
+    _gf->calc_syndrome = rs_calc_syndrome_neon;
+#endif
+}
+
 /*Berlekamp-Peterson and Berlekamp-Massey Algorithms for error-location,
    modified to handle known erasures, from \cite{CC81}, p. 205.
   This finds the coefficients of the error locator polynomial.
@@ -577,7 +740,7 @@ int rs_correct(const rs_gf256 *_gf, int _m0, unsigned char *_data, int _ndata,
     if (_nerasures > _npar)
 	return -1;
     /*Compute the syndrome values.*/
-    rs_calc_syndrome(_gf, _m0, s, _npar, _data, _ndata);
+    (*_gf->calc_syndrome)(_gf, _m0, s, _npar, _data, _ndata);
     /*Check for a non-zero value.*/
     for (i = 0; i < _npar; i++)
 	if (s[i]) {
@@ -828,6 +991,51 @@ int main(void)
 }
 #endif
 
+#if defined(RS_TEST_SYNDROME)
+#include <stdio.h>
+#include <stdlib.h>
+
+/*Check the table-driven syndromes against Horner's rule.*/
+int main(void)
+{
+    rs_gf256 gf;
+    int nfailures;
+    int k;
+    rs_gf256_init(&gf, QR_PPOLY);
+    srand(0);
+    nfailures = 0;
+    for (k = 0; k < 64 * 1024; k++) {
+	unsigned char data[255];
+	unsigned char s0[255];
+	unsigned char s1[255];
+	unsigned char s2[255];
+	int ndata;
+	int npar;
+	int m0;
+	int i;
+	ndata = rand() % 255 + 1;
+	npar  = rand() % ndata;
+	if (npar > 40)
+	    npar = rand() % 40;
+	m0 = k & 1 ? rand() % 255 : QR_M0;
+	for (i = 0; i < ndata; i++)
+	    data[i] = rand() & 3 ? rand() & 0xFF : 0;
+	rs_calc_syndrome_horner(&gf, m0, s0, npar, data, ndata);
+	rs_calc_syndrome_c(&gf, m0, s1, npar, data, ndata);
+	(*gf.calc_syndrome)(&gf, m0, s2, npar, data, ndata);
+	for (i = 0; i < npar; i++)
+	    if (s1[i] != s0[i] || s2[i] != s0[i]) {
+		printf("Syndrome %i of %i (%i bytes, m0=%i): 0x%02X 0x%02X "
+		       "0x%02X\n",
+		       i, npar, ndata, m0, s0[i], s1[i], s2[i]);
+		nfailures++;
+		break;
+	    }
+    }
+    return nfailures > 0;
+}
+#endif
+
 #if defined(RS_TEST_ROOTS)
 #include <stdio.h>
 
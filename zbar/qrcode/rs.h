@@ -7,6 +7,8 @@
 #if !defined(_qrcode_rs_H)
 #define _qrcode_rs_H (1)
 
+#include "simd.h"
+
 /*This is one of 16 irreducible primitive polynomials of degree 8:
     x**8+x**4+x**3+x**2+1.
   Under such a polynomial, x (i.e., 0x02) is a generator of GF(2**8).
@@ -27,8 +29,25 @@
 /*The index to start the generator polynomial from (0...254).*/
 #define QR_M0 (0)
 
+/*The NEON syndrome kernel needs the AArch64 table lookups.*/
+#if defined(ZBAR_SIMD_X86)
+#define RS_X86 (1)
+#elif defined(ZBAR_SIMD_NEON) && defined(__aarch64__)
+#define RS_NEON (1)
+#endif
+
+/*The largest number of parity bytes whose syndromes are computed with the
+   split-nibble tables.
+  QR codes use at most 30 parity bytes per block.*/
+#define RS_NPAR_MAX_VEC (32)
+
 typedef struct rs_gf256 rs_gf256;
 
+/*Computes the _npar syndromes of an _ndata byte codeword.*/
+typedef void (*rs_syndrome_func)(const rs_gf256 *_gf, int _m0,
+				 unsigned char *_s, int _npar,
+				 const unsigned char *_data, int _ndata);
+
 struct rs_gf256 {
     /*A logarithm table in GF(2**8).*/
     unsigned char log[256];
@@ -37,6 +56,17 @@ struct rs_gf256 {
     The extra 256 entries are used to do arithmetic mod 255, since some extra
      table lookups are generally faster than doing the modulus.*/
     unsigned char exp[511];
+    /*Split-nibble multiplication tables: mul_lo[a][n] contains a*n and
+     mul_hi[a][n] contains a*(n<<4), so that a*b is
+     mul_lo[a][b&0xF]^mul_hi[a][b>>4].
+    These are the shape a byte shuffle instruction can look up 16 at a time.*/
+    unsigned char mul_lo[256][16];
+    unsigned char mul_hi[256][16];
+    /*The syndrome evaluation points raised to each codeword position:
+     pow[e][j] contains x^(j*e).*/
+    unsigned char pow[255][RS_NPAR_MAX_VEC];
+    /*The syndrome kernel selected for this CPU.*/
+    rs_syndrome_func calc_syndrome;
 };
 
 /*Initialize discrete logarithm tables for GF(2**8) using a given primitive
@@ -67,6 +67,14 @@ struct zbar_scanner_s {
     zbar_decoder_t *decoder; /* associated bar width decoder */
     unsigned y1_min_thresh;  /* minimum threshold */
 
+    int collect;	       /* edge list mode */
+    zbar_edge_t *edges;	       /* edges collected for current scan line */
+    unsigned num_edges, max_edges;
+    unsigned long nedges; /* edges found since last collected */
+    unsigned end_edge;	  /* position of the end of the collected line */
+    char dark_start;	  /* collected line starts dark */
+    char dark_end;	  /* collected line ends dark */
+
     unsigned x; /* relative scan position of next sample */
     int y0[4];	/* short circular buffer of average intensities */
 
@@ -80,7 +88,7 @@ struct zbar_scanner_s {
 
 zbar_scanner_t *zbar_scanner_create(zbar_decoder_t *dcode)
 {
-    zbar_scanner_t *scn = malloc(sizeof(zbar_scanner_t));
+    zbar_scanner_t *scn = calloc(1, sizeof(zbar_scanner_t));
     scn->decoder	= dcode;
     scn->y1_min_thresh	= ZBAR_SCANNER_THRESH_MIN;
     zbar_scanner_reset(scn);
@@ -89,12 +97,15 @@ zbar_scanner_t *zbar_scanner_create(zbar_decoder_t *dcode)
 
 void zbar_scanner_destroy(zbar_scanner_t *scn)
 {
+    if (scn->edges)
+	free(scn->edges);
     free(scn);
 }
 
 zbar_symbol_type_t zbar_scanner_reset(zbar_scanner_t *scn)
 {
     memset(&scn->x, 0, sizeof(zbar_scanner_t) - offsetof(zbar_scanner_t, x));
+    scn->num_edges = 0;
     scn->y1_thresh = scn->y1_min_thresh;
     if (scn->decoder)
 	zbar_decoder_reset(scn->decoder);
@@ -124,6 +135,136 @@ zbar_color_t zbar_scanner_get_color(const zbar_scanner_t *scn)
     return ((scn->y1_sign <= 0) ? ZBAR_SPACE : ZBAR_BAR);
 }
 
+void zbar_scanner_enable_edges(zbar_scanner_t *scn, int enable)
+{
+    scn->collect   = (enable) ? 1 : 0;
+    scn->num_edges = 0;
+}
+
+unsigned zbar_scanner_get_edges(const zbar_scanner_t *scn,
+				const zbar_edge_t **edges)
+{
+    if (edges)
+	*edges = scn->edges;
+    return (scn->num_edges);
+}
+
+/* decode edges with any decoder (eg, one of opposite polarity) */
+zbar_symbol_type_t _zbar_scanner_decode_edges(zbar_scanner_t *scn,
+					      zbar_decoder_t *dcode,
+					      const zbar_edge_t *edges,
+					      unsigned n)
+{
+    zbar_symbol_type_t edge = ZBAR_NONE;
+    unsigned last_edge = scn->last_edge, width = scn->width;
+
+    for (; n; n--, edges++) {
+	zbar_symbol_type_t tmp;
+	/* handlers query edge position from the scanner */
+	scn->last_edge = edges->pos;
+	scn->width     = edges->width;
+	tmp	       = zbar_decode_width(dcode, edges->width);
+	if (tmp < 0 || tmp > edge)
+	    edge = tmp;
+    }
+
+    scn->last_edge = last_edge;
+    scn->width	   = width;
+    return (edge);
+}
+
+/* add edge count to image scanner statistics and restart counting */
+void _zbar_scanner_collect_stats(zbar_scanner_t *scn,
+				 zbar_image_scanner_stats_t *stats)
+{
+    stats->edges += scn->nedges;
+    scn->nedges = 0;
+}
+
+zbar_symbol_type_t zbar_scanner_decode_edges(zbar_scanner_t *scn,
+					     const zbar_edge_t *edges,
+					     unsigned n)
+{
+    if (!scn->decoder)
+	return (ZBAR_NONE);
+    return (_zbar_scanner_decode_edges(scn, scn->decoder, edges, n));
+}
+
+/* decode the collected edges as the scanner would have found them on
+ * the inverted line.  lines are taken to start and end light: the quiet
+ * zone of a light end is not measured, while a dark end gets an extra
+ * zero width space at the start, or its width measured at the end.
+ * the ends are swapped, and the edges in between kept
+ */
+zbar_symbol_type_t _zbar_scanner_decode_inverted(zbar_scanner_t *scn,
+						 zbar_decoder_t *dcode)
+{
+    zbar_symbol_type_t edge = ZBAR_NONE, tmp;
+    unsigned last_edge = scn->last_edge, width = scn->width;
+    unsigned start = (1 << ZBAR_FIXED) + ROUND, end = scn->end_edge;
+    const zbar_edge_t *e = scn->edges;
+    unsigned n = scn->num_edges, i;
+
+    /* skip the leading space and trailing bar of dark ends,
+     * and the final (zero width) flush
+     */
+    if (scn->dark_start) {
+	e++;
+	n--;
+    }
+    if (n < 1 + scn->dark_end + 1)
+	return (ZBAR_NONE);
+    n -= 1 + scn->dark_end;
+
+    if (!scn->dark_start) {
+	scn->last_edge = start;
+	scn->width     = 0;
+	edge	       = zbar_decode_width(dcode, 0);
+    }
+    for (i = 0; i < n; i++) {
+	scn->last_edge = e[i].pos;
+	scn->width     = e[i].width;
+	if (!i)
+	    scn->width = (scn->dark_start) ? 0 : e[i].pos - start;
+	tmp = zbar_decode_width(dcode, scn->width);
+	if (tmp < 0 || tmp > edge)
+	    edge = tmp;
+    }
+    if (!scn->dark_end) {
+	scn->width     = end - scn->last_edge;
+	scn->last_edge = end;
+	tmp	       = zbar_decode_width(dcode, scn->width);
+	if (tmp < 0 || tmp > edge)
+	    edge = tmp;
+    }
+    scn->width = 0;
+    tmp	       = zbar_decode_width(dcode, 0);
+    if (tmp < 0 || tmp > edge)
+	edge = tmp;
+
+    scn->last_edge = last_edge;
+    scn->width	   = width;
+    return (edge);
+}
+
+/* append an edge to the list for the current scan line */
+static inline zbar_symbol_type_t collect_edge(zbar_scanner_t *scn)
+{
+    zbar_edge_t *e;
+    if (scn->num_edges >= scn->max_edges) {
+	unsigned size = (scn->max_edges) ? scn->max_edges * 2 : 256;
+	e	      = realloc(scn->edges, size * sizeof(zbar_edge_t));
+	if (!e)
+	    return (ZBAR_NONE);
+	scn->edges     = e;
+	scn->max_edges = size;
+    }
+    e	     = &scn->edges[scn->num_edges++];
+    e->pos   = scn->last_edge;
+    e->width = scn->width;
+    return (ZBAR_PARTIAL);
+}
+
 static inline unsigned calc_thresh(zbar_scanner_t *scn)
 {
     /* threshold 1st to improve noise rejection */
@@ -152,9 +293,11 @@ static inline unsigned calc_thresh(zbar_scanner_t *scn)
 
 static inline zbar_symbol_type_t process_edge(zbar_scanner_t *scn, int y1)
 {
-    if (!scn->y1_sign)
+    if (!scn->y1_sign) {
+	/* line starts dark, with an empty space */
 	scn->last_edge = scn->cur_edge = (1 << ZBAR_FIXED) + ROUND;
-    else if (!scn->last_edge)
+	scn->dark_start			= 1;
+    } else if (!scn->last_edge)
 	scn->last_edge = scn->cur_edge;
 
     scn->width = scn->cur_edge - scn->last_edge;
@@ -163,12 +306,15 @@ static inline zbar_symbol_type_t process_edge(zbar_scanner_t *scn, int y1)
 	     scn->cur_edge & ((1 << ZBAR_FIXED) - 1), scn->width,
 	     ((y1 > 0) ? "SPACE" : "BAR"));
     scn->last_edge = scn->cur_edge;
+    scn->nedges++;
 
 #if DEBUG_SVG > 1
     svg_path_moveto(SVG_ABS, scn->last_edge - (1 << ZBAR_FIXED) - ROUND, 0);
 #endif
 
     /* pass to decoder */
+    if (scn->collect)
+	return (collect_edge(scn));
     if (scn->decoder)
 	return (zbar_decode_width(scn->decoder, scn->width));
     return (ZBAR_PARTIAL);
@@ -180,9 +326,13 @@ inline zbar_symbol_type_t zbar_scanner_flush(zbar_scanner_t *scn)
     if (!scn->y1_sign)
 	return (ZBAR_NONE);
 
-    x = (scn->x << ZBAR_FIXED) + ROUND;
+    x		  = (scn->x << ZBAR_FIXED) + ROUND;
+    scn->end_edge = x;
 
     if (scn->cur_edge != x || scn->y1_sign > 0) {
+	if (scn->cur_edge == x)
+	    /* line ends dark, measure it */
+	    scn->dark_end = 1;
 	zbar_symbol_type_t edge = process_edge(scn, -scn->y1_sign);
 	dbprintf(1, "flush0:");
 	scn->cur_edge = x;
@@ -191,6 +341,8 @@ inline zbar_symbol_type_t zbar_scanner_flush(zbar_scanner_t *scn)
     }
 
     scn->y1_sign = scn->width = 0;
+    if (scn->collect)
+	return (collect_edge(scn));
     if (scn->decoder)
 	return (zbar_decode_width(scn->decoder, 0));
     return (ZBAR_PARTIAL);
@@ -208,43 +360,16 @@ zbar_symbol_type_t zbar_scanner_new_scan(zbar_scanner_t *scn)
     /* reset scanner and associated decoder */
     memset(&scn->x, 0, sizeof(zbar_scanner_t) - offsetof(zbar_scanner_t, x));
     scn->y1_thresh = scn->y1_min_thresh;
-    if (scn->decoder)
+    if (scn->decoder && !scn->collect)
 	zbar_decoder_new_scan(scn->decoder);
     return (edge);
 }
 
-zbar_symbol_type_t zbar_scan_y(zbar_scanner_t *scn, int y)
+/* check for an edge at x-1, given the differentials there */
+static inline zbar_symbol_type_t scan_edge(zbar_scanner_t *scn, int y1_1,
+					   int y2_1, int y2_2)
 {
-    /* FIXME calc and clip to max y range... */
-    /* retrieve short value history */
-    register int x    = scn->x;
-    register int y0_1 = scn->y0[(x - 1) & 3];
-    register int y0_0 = y0_1;
-    register int y0_2, y0_3, y1_1, y2_1, y2_2;
-    zbar_symbol_type_t edge;
-    if (x) {
-	/* update weighted moving average */
-	y0_0 += ((int)((y - y0_1) * EWMA_WEIGHT)) >> ZBAR_FIXED;
-	scn->y0[x & 3] = y0_0;
-    } else
-	y0_0 = y0_1 = scn->y0[0] = scn->y0[1] = scn->y0[2] = scn->y0[3] = y;
-    y0_2 = scn->y0[(x - 2) & 3];
-    y0_3 = scn->y0[(x - 3) & 3];
-    /* 1st differential @ x-1 */
-    y1_1 = y0_1 - y0_2;
-    {
-	register int y1_2 = y0_2 - y0_3;
-	if ((abs(y1_1) < abs(y1_2)) && ((y1_1 >= 0) == (y1_2 >= 0)))
-	    y1_1 = y1_2;
-    }
-
-    /* 2nd differentials @ x-1 & x-2 */
-    y2_1 = y0_0 - (y0_1 * 2) + y0_2;
-    y2_2 = y0_1 - (y0_2 * 2) + y0_3;
-
-    dbprintf(1, "scan: x=%d y=%d y0=%d y1=%d y2=%d", x, y, y0_1, y1_1, y2_1);
-
-    edge = ZBAR_NONE;
+    zbar_symbol_type_t edge = ZBAR_NONE;
     /* 2nd zero-crossing is 1st local min/max - could be edge */
     if ((!y2_1 || ((y2_1 > 0) ? y2_2 < 0 : y2_2 > 0)) &&
 	(calc_thresh(scn) <= abs(y1_1))) {
@@ -273,17 +398,120 @@ zbar_symbol_type_t zbar_scan_y(zbar_scanner_t *scn, int y)
 	    else if (y2_1)
 		/* interpolate zero crossing */
 		scn->cur_edge -= ((y2_1 << ZBAR_FIXED) + 1) / d;
-	    scn->cur_edge += x << ZBAR_FIXED;
+	    scn->cur_edge += scn->x << ZBAR_FIXED;
 	    dbprintf(1, "\n");
 	}
     } else
 	dbprintf(1, "\n");
+    return (edge);
+}
+
+zbar_symbol_type_t zbar_scan_y(zbar_scanner_t *scn, int y)
+{
+    /* FIXME calc and clip to max y range... */
+    /* retrieve short value history */
+    register int x    = scn->x;
+    register int y0_1 = scn->y0[(x - 1) & 3];
+    register int y0_0 = y0_1;
+    register int y0_2, y0_3, y1_1, y2_1, y2_2;
+    zbar_symbol_type_t edge;
+    if (x) {
+	/* update weighted moving average */
+	y0_0 += ((int)((y - y0_1) * EWMA_WEIGHT)) >> ZBAR_FIXED;
+	scn->y0[x & 3] = y0_0;
+    } else {
+	y0_0 = y0_1 = scn->y0[0] = scn->y0[1] = scn->y0[2] = scn->y0[3] = y;
+	/* start of a new scan line */
+	scn->num_edges	= 0;
+	scn->dark_start = scn->dark_end = 0;
+    }
+    y0_2 = scn->y0[(x - 2) & 3];
+    y0_3 = scn->y0[(x - 3) & 3];
+    /* 1st differential @ x-1 */
+    y1_1 = y0_1 - y0_2;
+    {
+	register int y1_2 = y0_2 - y0_3;
+	if ((abs(y1_1) < abs(y1_2)) && ((y1_1 >= 0) == (y1_2 >= 0)))
+	    y1_1 = y1_2;
+    }
+
+    /* 2nd differentials @ x-1 & x-2 */
+    y2_1 = y0_0 - (y0_1 * 2) + y0_2;
+    y2_2 = y0_1 - (y0_2 * 2) + y0_3;
+
+    dbprintf(1, "scan: x=%d y=%d y0=%d y1=%d y2=%d", x, y, y0_1, y1_1, y2_1);
+
+    edge = scan_edge(scn, y1_1, y2_1, y2_2);
     /* FIXME add fall-thru pass to decoder after heuristic "idle" period
        (eg, 6-8 * last width) */
     scn->x = x + 1;
     return (edge);
 }
 
+zbar_symbol_type_t zbar_scan_row(zbar_scanner_t *scn, const void *data,
+				 unsigned n, int stride)
+{
+    const unsigned char *p  = data;
+    zbar_symbol_type_t edge = ZBAR_NONE;
+    unsigned x, thresh = scn->y1_min_thresh;
+    int y0_1, y0_2, y0_3;
+
+    if (!n)
+	return (ZBAR_NONE);
+    if (!scn->x) {
+	/* first sample initializes history */
+	edge = zbar_scan_y(scn, *p);
+	p += stride;
+	n--;
+    }
+
+#ifdef DEBUG_SCANNER
+    /* keep per-sample trace */
+    for (; n; n--, p += stride) {
+	zbar_symbol_type_t tmp = zbar_scan_y(scn, *p);
+	if (tmp < 0 || tmp > edge)
+	    edge = tmp;
+    }
+#else
+    /* the moving average is inherently serial, so keep the whole state
+     * in registers and only touch the scanner for candidate edges,
+     * ie, where the 2nd differential crosses zero with enough slope
+     * to possibly pass the (never less than minimum) threshold
+     */
+    x	 = scn->x;
+    y0_1 = scn->y0[(x - 1) & 3];
+    y0_2 = scn->y0[(x - 2) & 3];
+    y0_3 = scn->y0[(x - 3) & 3];
+    for (; n; n--, p += stride, x++) {
+	int y0_0 = y0_1 + (((int)((*p - y0_1) * EWMA_WEIGHT)) >> ZBAR_FIXED);
+	int y1_1 = y0_1 - y0_2, y1_2 = y0_2 - y0_3;
+	int y2_1 = y0_0 - (y0_1 * 2) + y0_2;
+	int y2_2 = y0_1 - (y0_2 * 2) + y0_3;
+	if ((abs(y1_1) < abs(y1_2)) && ((y1_1 >= 0) == (y1_2 >= 0)))
+	    y1_1 = y1_2;
+
+	if ((!y2_1 || ((y2_1 > 0) ? y2_2 < 0 : y2_2 > 0)) &&
+	    abs(y1_1) >= thresh) {
+	    zbar_symbol_type_t tmp;
+	    scn->x = x;
+	    tmp	   = scan_edge(scn, y1_1, y2_1, y2_2);
+	    if (tmp < 0 || tmp > edge)
+		edge = tmp;
+	}
+	y0_3 = y0_2;
+	y0_2 = y0_1;
+	y0_1 = y0_0;
+    }
+
+    /* restore short value history */
+    scn->y0[(x - 1) & 3] = y0_1;
+    scn->y0[(x - 2) & 3] = y0_2;
+    scn->y0[(x - 3) & 3] = y0_3;
+    scn->x		 = x;
+#endif
+    return (edge);
+}
+
 /* undocumented API for drawing cutesy debug graphics */
 void zbar_scanner_get_state(const zbar_scanner_t *scn, unsigned *x,
 			    unsigned *cur_edge, unsigned *last_edge, int *y0,
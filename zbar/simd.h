@@ -0,0 +1,36 @@
+/*------------------------------------------------------------------------
+ *  This file is part of the ZBar Bar Code Reader.
+ *
+ *  The ZBar Bar Code Reader is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Lesser Public License as
+ *  published by the Free Software Foundation; either version 2.1 of
+ *  the License, or (at your option) any later version.
+ *
+ *  The ZBar Bar Code Reader is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ *  of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser Public License
+ *  along with the ZBar Bar Code Reader; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301  USA
+ *
+ *  http://sourceforge.net/projects/zbar
+ *------------------------------------------------------------------------*/
+#ifndef _ZBAR_SIMD_H_
+#define _ZBAR_SIMD_H_
+
+/* vector kernels must be usable on any CPU they are selected for at run
+ * time.  x86 kernels are compiled with target attributes and chosen
+ * with __builtin_cpu_supports(), which need gcc 5 or clang.  NEON is
+ * available wherever it is enabled at compile time
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (__GNUC__ >= 5 || defined(__clang__))
+#define ZBAR_SIMD_X86 (1)
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define ZBAR_SIMD_NEON (1)
+#endif
+
+#endif
@@ -9,6 +9,7 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "image.h"
 #include "img_scanner.h"
@@ -35,8 +36,22 @@ typedef struct {
     sq_point center;
 } sq_dot;
 
+/* luminance of the image being decoded, read in place */
+typedef struct {
+    unsigned width;
+    unsigned height;
+    zbar_luma_t luma;
+    unsigned char invert; /* 0xff to sample as if the image were inverted */
+} sq_image;
+
 struct sq_reader {
     bool enabled;
+
+    /* scratch space, kept between scans */
+    sq_point *border[4];     /* top, left, right and bottom borders */
+    size_t border_alloc[4];  /* allocated points of each border */
+    unsigned char *bits;     /* sampled data bits */
+    size_t bits_alloc;	     /* allocated bytes of bits */
 };
 
 /*Initializes a client reader handle.*/
@@ -48,7 +63,7 @@ static void sq_reader_init(sq_reader *reader)
 /*Allocates a client reader handle.*/
 sq_reader *_zbar_sq_create(void)
 {
-    sq_reader *reader = malloc(sizeof(sq_reader));
+    sq_reader *reader = calloc(1, sizeof(sq_reader));
     if (reader)
 	sq_reader_init(reader);
     return reader;
@@ -57,9 +72,32 @@ sq_reader *_zbar_sq_create(void)
 /*Frees a client reader handle.*/
 void _zbar_sq_destroy(sq_reader *reader)
 {
+    int i;
+    for (i = 0; i < 4; i++)
+	if (reader->border[i])
+	    free(reader->border[i]);
+    if (reader->bits)
+	free(reader->bits);
     free(reader);
 }
 
+/* make room for len points in border i, preserving its contents */
+static sq_point *sq_border(sq_reader *reader, int i, size_t len)
+{
+    if (len > reader->border_alloc[i]) {
+	size_t size = (reader->border_alloc[i]) ? reader->border_alloc[i] : 16;
+	sq_point *ptr;
+	while (size < len)
+	    size *= 2;
+	ptr = realloc(reader->border[i], size * sizeof(sq_point));
+	if (!ptr)
+	    return NULL;
+	reader->border[i]	= ptr;
+	reader->border_alloc[i] = size;
+    }
+    return reader->border[i];
+}
+
 /* reset finder state between scans */
 void _zbar_sq_reset(sq_reader *reader)
 {
@@ -80,14 +118,11 @@ static const char base64_table[] = {
     '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '/'
 };
 
-static char *base64_encode_buffer(const char *s, size_t size)
+/* encode size bytes from s into e, which must have room for
+ * (size + 2) / 3 * 4 + 1 characters
+ */
+static void base64_encode_buffer(char *e, const char *s, size_t size)
 {
-    char *e;
-    size_t encoded_size = (size + 2) / 3 * 4 + 1;
-    char *encoded	= malloc(encoded_size);
-    if (!encoded)
-	return NULL;
-    e = encoded;
     for (;;) {
 	unsigned char c = (*s >> 2) & 0x3f;
 	*e++		= base64_table[c];
@@ -114,22 +149,19 @@ static char *base64_encode_buffer(const char *s, size_t size)
 	    break;
     }
     *e = '\0';
-    return encoded;
 }
 
 static bool sq_extract_text(zbar_image_scanner_t *iscn, const char *buf,
 			    size_t len)
 {
-    size_t b64_len;
-    zbar_symbol_t *sym = _zbar_image_scanner_alloc_sym(iscn, ZBAR_SQCODE, 0);
-    sym->data	       = base64_encode_buffer(buf, len);
+    size_t b64_len     = (len + 2) / 3 * 4;
+    zbar_symbol_t *sym = _zbar_image_scanner_alloc_sym(iscn, ZBAR_SQCODE,
+						       b64_len + 1);
     if (!sym->data) {
 	_zbar_image_scanner_recycle_syms(iscn, sym);
 	return true;
     }
-    b64_len	    = (len + 2) / 3 * 4;
-    sym->data_alloc = b64_len + 1;
-    sym->datalen    = b64_len;
+    base64_encode_buffer(sym->data, buf, len);
     _zbar_image_scanner_add_sym(iscn, sym);
     return false;
 }
@@ -139,14 +171,18 @@ static bool is_black_color(const unsigned char c)
     return c <= 0x7f;
 }
 
-static bool is_black(zbar_image_t *img, int x, int y)
+static unsigned char sq_sample(const sq_image *img, int x, int y)
+{
+    return img->luma.data[y * img->luma.stride + x * img->luma.step] ^
+	   img->invert;
+}
+
+static bool is_black(const sq_image *img, int x, int y)
 {
-    const unsigned char *data;
     if (x < 0 || (unsigned)x >= img->width || y < 0 ||
 	(unsigned)y >= img->height)
 	return false;
-    data = img->data;
-    return is_black_color(data[y * img->width + x]);
+    return is_black_color(sq_sample(img, x, y));
 }
 
 static void set_dot_center(sq_dot *dot, float x, float y)
@@ -155,12 +191,11 @@ static void set_dot_center(sq_dot *dot, float x, float y)
     dot->center.y = y;
 }
 
-static void sq_scan_shape(zbar_image_t *img, sq_dot *dot, int start_x,
+static void sq_scan_shape(const sq_image *img, sq_dot *dot, int start_x,
 			  int start_y)
 {
     int x, y;
     unsigned x0, y0, width, height, x_sum, y_sum, total_weight;
-    const unsigned char *data;
     if (!is_black(img, start_x, start_y)) {
 	dot->type   = SHAPE_VOID;
 	dot->x0	    = start_x;
@@ -216,7 +251,6 @@ new_point:
     }
 
     /* Set dot center */
-    data	 = img->data;
     x_sum	 = 0;
     y_sum	 = 0;
     total_weight = 0;
@@ -226,7 +260,7 @@ new_point:
 	    unsigned char weight;
 	    if (!is_black(img, x, y))
 		continue;
-	    weight = 0xff - data[y * img->width + x];
+	    weight = 0xff - sq_sample(img, x, y);
 	    x_sum += weight * x;
 	    y_sum += weight * y;
 	    total_weight += weight;
@@ -246,7 +280,7 @@ static void set_middle_point(sq_point *middle, const sq_point *start,
     middle->y = (start->y + end->y) / 2;
 }
 
-bool find_left_dot(zbar_image_t *img, sq_dot *dot, unsigned *found_x,
+bool find_left_dot(const sq_image *img, sq_dot *dot, unsigned *found_x,
 		   unsigned *found_y)
 {
     int y, x;
@@ -262,7 +296,7 @@ bool find_left_dot(zbar_image_t *img, sq_dot *dot, unsigned *found_x,
     return false;
 }
 
-bool find_right_dot(zbar_image_t *img, sq_dot *dot, unsigned *found_x,
+bool find_right_dot(const sq_image *img, sq_dot *dot, unsigned *found_x,
 		    unsigned *found_y)
 {
     int y, x;
@@ -279,7 +313,7 @@ bool find_right_dot(zbar_image_t *img, sq_dot *dot, unsigned *found_x,
     return false;
 }
 
-bool find_bottom_dot(zbar_image_t *img, sq_dot *dot, unsigned *found_x,
+bool find_bottom_dot(const sq_image *img, sq_dot *dot, unsigned *found_x,
 		     unsigned *found_y)
 {
     int x, y;
@@ -298,8 +332,9 @@ bool find_bottom_dot(zbar_image_t *img, sq_dot *dot, unsigned *found_x,
 }
 
 int _zbar_sq_decode(sq_reader *reader, zbar_image_scanner_t *iscn,
-		    zbar_image_t *img)
+		    zbar_image_t *zimg, int inverted)
 {
+    sq_image image, *img = &image;
     unsigned scan_y, scan_x, y;
     sq_dot start_dot, top_left_dot, top_right_dot, bottom_left_dot,
 	bottom_right_dot, bottom_left2_dot;
@@ -307,16 +342,18 @@ int _zbar_sq_decode(sq_reader *reader, zbar_image_scanner_t *iscn,
     sq_point *top_border, *left_border, *right_border, *bottom_border;
     size_t border_len, cur_len, offset, bit_side_len, bit_len, byte_len, idx;
     float inc_x, inc_y;
-    void *ptr;
     char *buf;
 
     if (!reader->enabled)
 	return 0;
 
-    if (img->format != fourcc('Y', '8', '0', '0')) {
+    if (_zbar_image_luma(zimg, &image.luma)) {
 	fputs("Unexpected image format\n", stderr);
 	return 1;
     }
+    image.width	 = zimg->width;
+    image.height = zimg->height;
+    image.invert = inverted ? 0xff : 0;
 
     /* Starting pixel */
     for (scan_y = 0; scan_y < img->height; scan_y++) {
@@ -335,16 +372,13 @@ found_start:;
 
     error = true;
 
-    top_border	  = NULL;
-    left_border	  = NULL;
-    right_border  = NULL;
-    bottom_border = NULL;
+    top_border = NULL;
 
     if (start_corner) {
 	border_len = 0;
     } else {
 	border_len = 1;
-	top_border = malloc(sizeof(sq_point));
+	top_border = sq_border(reader, 0, 1);
 	if (!top_border)
 	    return 1;
 	top_border[0] = start_dot.center;
@@ -354,44 +388,40 @@ found_start:;
     while (find_left_dot(img, &top_left_dot, &scan_x, &scan_y)) {
 	sq_scan_shape(img, &top_left_dot, scan_x, scan_y);
 	if (top_left_dot.type != SHAPE_DOT)
-	    goto free_borders;
+	    goto done;
 	if (border_len) {
-	    void *ptr;
 	    size_t i;
 	    border_len += 2;
-	    ptr = realloc(top_border, border_len * sizeof(sq_point));
-	    if (!ptr)
-		goto free_borders;
-	    top_border = ptr;
+	    top_border = sq_border(reader, 0, border_len);
+	    if (!top_border)
+		goto done;
 	    for (i = border_len - 1; i >= 2; i--)
 		top_border[i] = top_border[i - 2];
 	    top_border[0] = top_left_dot.center;
 	    set_middle_point(&top_border[1], &top_border[0], &top_border[2]);
 	} else {
 	    border_len = 1;
-	    top_border = malloc(sizeof(sq_point));
+	    top_border = sq_border(reader, 0, 1);
 	    if (!top_border)
 		return 1;
 	    top_border[0] = top_left_dot.center;
 	}
     }
     if (top_left_dot.type != SHAPE_DOT)
-	goto free_borders;
+	goto done;
 
     top_right_dot = start_dot;
     if (!start_corner) {
 	while (find_right_dot(img, &top_right_dot, &scan_x, &scan_y)) {
-	    void *ptr;
 	    sq_scan_shape(img, &top_right_dot, scan_x, scan_y);
 	    if (top_right_dot.type == SHAPE_CORNER)
 		break;
 	    if (top_right_dot.type != SHAPE_DOT)
-		goto free_borders;
+		goto done;
 	    border_len += 2;
-	    ptr = realloc(top_border, border_len * sizeof(sq_point));
-	    if (!ptr)
-		goto free_borders;
-	    top_border		       = ptr;
+	    top_border = sq_border(reader, 0, border_len);
+	    if (!top_border)
+		goto done;
 	    top_border[border_len - 1] = top_right_dot.center;
 	    set_middle_point(&top_border[border_len - 2],
 			     &top_border[border_len - 3],
@@ -399,14 +429,13 @@ found_start:;
 	}
     }
     if (border_len < 3)
-	goto free_borders;
+	goto done;
     inc_x = top_border[border_len - 1].x - top_border[border_len - 3].x;
     inc_y = top_border[border_len - 1].y - top_border[border_len - 3].y;
     border_len += 3;
-    ptr = realloc(top_border, border_len * sizeof(sq_point));
-    if (!ptr)
-	goto free_borders;
-    top_border			 = ptr;
+    top_border = sq_border(reader, 0, border_len);
+    if (!top_border)
+	goto done;
     top_border[border_len - 3].x = top_border[border_len - 4].x + 0.5 * inc_x;
     top_border[border_len - 3].y = top_border[border_len - 4].y + 0.5 * inc_y;
     top_border[border_len - 2].x = top_border[border_len - 4].x + inc_x;
@@ -414,9 +443,9 @@ found_start:;
     top_border[border_len - 1].x = top_border[border_len - 4].x + 1.5 * inc_x;
     top_border[border_len - 1].y = top_border[border_len - 4].y + 1.5 * inc_y;
 
-    left_border = malloc(border_len * sizeof(sq_point));
+    left_border = sq_border(reader, 1, border_len);
     if (!left_border)
-	goto free_borders;
+	goto done;
     left_border[0] = top_border[0];
 
     bottom_left_dot = top_left_dot;
@@ -426,16 +455,16 @@ found_start:;
 	if (bottom_left_dot.type == SHAPE_CORNER)
 	    break;
 	if (bottom_left_dot.type != SHAPE_DOT)
-	    goto free_borders;
+	    goto done;
 	cur_len += 2;
 	if (cur_len > border_len)
-	    goto free_borders;
+	    goto done;
 	left_border[cur_len - 1] = bottom_left_dot.center;
 	set_middle_point(&left_border[cur_len - 2], &left_border[cur_len - 3],
 			 &left_border[cur_len - 1]);
     }
     if (cur_len != border_len - 3 || bottom_left_dot.type != SHAPE_CORNER)
-	goto free_borders;
+	goto done;
     inc_x = left_border[cur_len - 1].x - left_border[cur_len - 3].x;
     inc_y = left_border[cur_len - 1].y - left_border[cur_len - 3].y;
     left_border[border_len - 3].x = left_border[border_len - 4].x + 0.5 * inc_x;
@@ -445,25 +474,25 @@ found_start:;
     left_border[border_len - 1].x = left_border[border_len - 4].x + 1.5 * inc_x;
     left_border[border_len - 1].y = left_border[border_len - 4].y + 1.5 * inc_y;
 
-    right_border = malloc(border_len * sizeof(sq_point));
+    right_border = sq_border(reader, 2, border_len);
     if (!right_border)
-	goto free_borders;
+	goto done;
 
     bottom_right_dot = top_right_dot;
     cur_len	     = 3;
     while (find_bottom_dot(img, &bottom_right_dot, &scan_x, &scan_y)) {
 	sq_scan_shape(img, &bottom_right_dot, scan_x, scan_y);
 	if (bottom_right_dot.type != SHAPE_DOT)
-	    goto free_borders;
+	    goto done;
 	if (cur_len == 3) {
 	    cur_len++;
 	    if (cur_len > border_len)
-		goto free_borders;
+		goto done;
 	    right_border[cur_len - 1] = bottom_right_dot.center;
 	} else {
 	    cur_len += 2;
 	    if (cur_len > border_len)
-		goto free_borders;
+		goto done;
 	    right_border[cur_len - 1] = bottom_right_dot.center;
 	    set_middle_point(&right_border[cur_len - 2],
 			     &right_border[cur_len - 3],
@@ -481,9 +510,9 @@ found_start:;
     right_border[0].x = right_border[3].x - 1.5 * inc_x;
     right_border[0].y = right_border[3].y - 1.5 * inc_y;
 
-    bottom_border = malloc(border_len * sizeof(sq_point));
+    bottom_border = sq_border(reader, 3, border_len);
     if (!bottom_border)
-	goto free_borders;
+	goto done;
     bottom_border[border_len - 1] = right_border[border_len - 1];
 
     bottom_left2_dot = bottom_right_dot;
@@ -493,16 +522,16 @@ found_start:;
 	if (bottom_left2_dot.type == SHAPE_CORNER)
 	    break;
 	if (bottom_left2_dot.type != SHAPE_DOT)
-	    goto free_borders;
+	    goto done;
 	if (offset < 2)
-	    goto free_borders;
+	    goto done;
 	offset -= 2;
 	bottom_border[offset] = bottom_left2_dot.center;
 	set_middle_point(&bottom_border[offset + 1], &bottom_border[offset],
 			 &bottom_border[offset + 2]);
     }
     if (offset != 3 || bottom_left2_dot.type != SHAPE_CORNER)
-	goto free_borders;
+	goto done;
     inc_x	       = bottom_border[5].x - bottom_border[3].x;
     inc_y	       = bottom_border[5].y - bottom_border[3].y;
     bottom_border[2].x = bottom_border[3].x - 0.5 * inc_x;
@@ -514,16 +543,22 @@ found_start:;
 
     /* Size check */
     if (border_len < 8 + 2 * (1 + 2) || border_len > 65535)
-	goto free_borders;
+	goto done;
     bit_side_len = border_len - 2 * (1 + 2);
 
     bit_len = bit_side_len * bit_side_len;
     if (bit_len % 8)
-	goto free_borders;
+	goto done;
     byte_len = bit_len / 8;
-    buf	     = calloc(byte_len, sizeof(char));
-    if (!buf)
-	goto free_borders;
+    if (byte_len > reader->bits_alloc) {
+	unsigned char *bits = realloc(reader->bits, byte_len);
+	if (!bits)
+	    goto done;
+	reader->bits	   = bits;
+	reader->bits_alloc = byte_len;
+    }
+    buf = (char *)reader->bits;
+    memset(buf, 0, byte_len);
 
     idx = 0;
     for (y = 3; y <= border_len - 4; y++) {
@@ -547,14 +582,10 @@ found_start:;
 		    right_border[border_len - 1].y
 	    };
 
-	    const unsigned char *data = img->data;
-	    unsigned sample_x	      = top_left_source.x;
-	    unsigned sample_y	      = top_left_source.y;
 	    unsigned char top_left_color =
-		data[sample_y * img->width + sample_x];
-	    sample_x	       = bottom_right_source.x;
-	    sample_y	       = bottom_right_source.y;
-	    bottom_right_color = data[sample_y * img->width + sample_x];
+		sq_sample(img, top_left_source.x, top_left_source.y);
+	    bottom_right_color =
+		sq_sample(img, bottom_right_source.x, bottom_right_source.y);
 
 	    mixed_color =
 		((top_weight + left_weight) * top_left_color +
@@ -567,12 +598,7 @@ found_start:;
 	}
     }
     error = sq_extract_text(iscn, buf, byte_len);
-    free(buf);
 
-free_borders:
-    free(top_border);
-    free(left_border);
-    free(right_border);
-    free(bottom_border);
+done:
     return error ? 1 : 0;
 }
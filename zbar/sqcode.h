@@ -15,7 +15,8 @@ void _zbar_sq_destroy(sq_reader *reader);
 void _zbar_sq_reset(sq_reader *reader);
 
 int _zbar_sq_new_config(sq_reader *reader, unsigned config);
+/* decode the SQ code in img, or the light on dark one if inverted is set */
 int _zbar_sq_decode(sq_reader *reader, zbar_image_scanner_t *iscn,
-		    zbar_image_t *img);
+		    zbar_image_t *img, int inverted);
 
 #endif
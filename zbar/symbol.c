@@ -101,10 +101,30 @@ const char *zbar_get_config_name(zbar_config_t cfg)
 	return ("UNCERTAINTY");
     case ZBAR_CFG_POSITION:
 	return ("POSITION");
+    case ZBAR_CFG_LAZY_BINARIZE:
+	return ("LAZY_BINARIZE");
+    case ZBAR_CFG_QR_TRACK:
+	return ("QR_TRACK");
+    case ZBAR_CFG_QR_LINE_TIMES:
+	return ("QR_LINE_TIMES");
     case ZBAR_CFG_X_DENSITY:
 	return ("X_DENSITY");
     case ZBAR_CFG_Y_DENSITY:
 	return ("Y_DENSITY");
+    case ZBAR_CFG_THREADS:
+	return ("THREADS");
+    case ZBAR_CFG_CACHE_PROXIMITY:
+	return ("CACHE_PROXIMITY");
+    case ZBAR_CFG_CACHE_HYSTERESIS:
+	return ("CACHE_HYSTERESIS");
+    case ZBAR_CFG_CACHE_TIMEOUT:
+	return ("CACHE_TIMEOUT");
+    case ZBAR_CFG_QR_THREADS:
+	return ("QR_THREADS");
+    case ZBAR_CFG_QR_SCRATCH:
+	return ("QR_SCRATCH");
+    case ZBAR_CFG_JPEG_SCALE:
+	return ("JPEG_SCALE");
     default:
 	return ("");
     }
@@ -58,6 +58,9 @@ struct zbar_symbol_s {
     zbar_symbol_set_t *syms; /* components of composite result */
     unsigned long time;	     /* relative symbol capture time */
     int cache_count;	     /* cache state */
+    unsigned cache_hash;     /* inter-image cache hash of type and data */
+    zbar_symbol_t *cache_chain; /* next cache entry in same hash bucket */
+    zbar_symbol_t *cache_prev;	/* previous (older) cache entry */
     int quality;	     /* relative symbol reliability metric */
 };
 
@@ -71,8 +74,11 @@ extern void _zbar_symbol_set_free(zbar_symbol_set_t *);
 static inline void sym_add_point(zbar_symbol_t *sym, int x, int y)
 {
     int i = sym->npts;
-    if (++sym->npts >= sym->pts_alloc)
-	sym->pts = realloc(sym->pts, ++sym->pts_alloc * sizeof(point_t));
+    if (++sym->npts >= sym->pts_alloc) {
+	/* grow geometrically so recycled symbols settle quickly */
+	sym->pts_alloc = (sym->pts_alloc) ? sym->pts_alloc * 2 : 8;
+	sym->pts       = realloc(sym->pts, sym->pts_alloc * sizeof(point_t));
+    }
     sym->pts[i].x = x;
     sym->pts[i].y = y;
 }
@@ -24,6 +24,9 @@
 #define _ZBAR_TIMER_H_
 
 #include <time.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h> /* _POSIX_TIMERS */
+#endif
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h> /* gettimeofday */
 #endif
@@ -50,6 +53,18 @@ static inline int _zbar_timer_now()
     return (now.tv_sec * 1000 + now.tv_nsec / 1000000);
 }
 
+/* monotonic time in ns, for measuring intervals */
+static inline unsigned long long _zbar_timer_now_ns()
+{
+    struct timespec now;
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#else
+    clock_gettime(CLOCK_REALTIME, &now);
+#endif
+    return (now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
+
 static inline zbar_timer_t *_zbar_timer_init(zbar_timer_t *timer, int delay)
 {
     if (delay < 0)
@@ -86,6 +101,16 @@ static inline int _zbar_timer_now()
     return (timeGetTime());
 }
 
+static inline unsigned long long _zbar_timer_now_ns()
+{
+    LARGE_INTEGER now, freq;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return ((unsigned long long)(now.QuadPart / freq.QuadPart) * 1000000000ULL +
+	    (unsigned long long)(now.QuadPart % freq.QuadPart) * 1000000000ULL /
+		freq.QuadPart);
+}
+
 static inline zbar_timer_t *_zbar_timer_init(zbar_timer_t *timer, int delay)
 {
     if (delay < 0)
@@ -116,6 +141,13 @@ static inline int _zbar_timer_now()
     return (now.tv_sec * 1000 + now.tv_usec / 1000);
 }
 
+static inline unsigned long long _zbar_timer_now_ns()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec * 1000000000ULL + now.tv_usec * 1000ULL);
+}
+
 static inline zbar_timer_t *_zbar_timer_init(zbar_timer_t *timer, int delay)
 {
     if (delay < 0)
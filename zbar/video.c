@@ -54,6 +54,70 @@ static void _zbar_video_recycle_shadow(zbar_image_t *img)
     video_unlock(vdo);
 }
 
+/* copy a captured frame into a shadow image, which is recycled
+ * separately from the driver's buffers.  returns the copy w/one reference
+ */
+static zbar_image_t *video_shadow_image(zbar_video_t *vdo,
+					const zbar_image_t *src)
+{
+    zbar_image_t *img;
+    unsigned long datalen = vdo->datalen;
+    video_lock(vdo);
+    img = vdo->shadow_image;
+    if (img)
+	vdo->shadow_image = img->next;
+    vdo->copies++;
+    video_unlock(vdo);
+
+    if (!img) {
+	img = zbar_image_create();
+	if (!img)
+	    return (NULL);
+	img->data = malloc(vdo->datalen);
+	if (!img->data) {
+	    _zbar_image_free(img);
+	    return (NULL);
+	}
+	img->datalen = vdo->datalen;
+	img->src     = vdo;
+	img->srcidx  = -1;
+	img->cleanup = _zbar_video_recycle_shadow;
+    }
+    if (img->syms) {
+	zbar_symbol_set_ref(img->syms, -1);
+	img->syms = NULL;
+    }
+    img->refcnt = 1;
+    img->next	= NULL;
+    img->format = src->format;
+    _zbar_image_copy_size(img, src);
+    img->stride = src->stride;
+    img->scale	= src->scale;
+    img->seq	= src->seq;
+    if (datalen > src->datalen)
+	datalen = src->datalen;
+    memcpy((void *)img->data, src->data, datalen);
+    return (img);
+}
+
+zbar_image_t *_zbar_video_keep_image(zbar_image_t *img)
+{
+    zbar_video_t *vdo = img->src;
+    zbar_image_t *copy;
+    if (!vdo || img->srcidx < 0 || vdo->num_images >= 2) {
+	_zbar_image_refcnt(img, 1);
+	return (img);
+    }
+    /* the only driver buffer must be requeued for the next frame */
+    copy = video_shadow_image(vdo, img);
+    if (!copy)
+	return (NULL);
+    copy->syms = img->syms;
+    if (copy->syms)
+	zbar_symbol_set_ref(copy->syms, 1);
+    return (copy);
+}
+
 zbar_video_t *zbar_video_create()
 {
     zbar_video_t *vdo = calloc(1, sizeof(zbar_video_t));
@@ -104,10 +168,12 @@ void zbar_video_destroy(zbar_video_t *vdo)
 	vdo->shadow_image = img->next;
 	free((void *)img->data);
 	img->data = NULL;
-	free(img);
+	_zbar_image_free(img);
     }
     if (vdo->buf)
 	free(vdo->buf);
+    if (vdo->dmabufs)
+	free(vdo->dmabufs);
     if (vdo->formats)
 	free(vdo->formats);
     if (vdo->emu_formats)
@@ -205,13 +271,45 @@ int zbar_video_request_iomode(zbar_video_t *vdo, int iomode)
     if (vdo->intf != VIDEO_INVALID)
 	return (err_capture(vdo, SEV_ERROR, ZBAR_ERR_INVALID, __func__,
 			    "device already opened, unable to change iomode"));
-    if (iomode < 0 || iomode > VIDEO_USERPTR)
+    if (iomode < 0 || iomode > VIDEO_DMABUF)
 	return (err_capture(vdo, SEV_ERROR, ZBAR_ERR_INVALID, __func__,
 			    "invalid iomode requested"));
-    vdo->iomode = iomode;
+    vdo->iomode	       = iomode;
+    vdo->dmabuf_import = 0;
     return (0);
 }
 
+int zbar_video_request_dmabufs(zbar_video_t *vdo, const int *fds, int nfds)
+{
+    if (vdo->intf != VIDEO_INVALID)
+	return (err_capture(vdo, SEV_ERROR, ZBAR_ERR_INVALID, __func__,
+			    "device already opened, unable to change buffers"));
+    if (nfds < 1 || nfds > ZBAR_VIDEO_IMAGES_MAX)
+	return (err_capture_int(vdo, SEV_ERROR, ZBAR_ERR_INVALID, __func__,
+				"invalid number of dmabufs requested (%d)",
+				nfds));
+    if (!vdo->dmabufs) {
+	vdo->dmabufs = malloc(ZBAR_VIDEO_IMAGES_MAX * sizeof(int));
+	if (!vdo->dmabufs)
+	    return (err_capture(vdo, SEV_FATAL, ZBAR_ERR_NOMEM, __func__,
+				"unable to allocate dmabuf list"));
+    }
+    memcpy(vdo->dmabufs, fds, nfds * sizeof(int));
+    vdo->num_images    = nfds;
+    vdo->iomode	       = VIDEO_DMABUF;
+    vdo->dmabuf_import = 1;
+    return (0);
+}
+
+int zbar_image_get_dmabuf(const zbar_image_t *img)
+{
+    const zbar_video_t *vdo = img->src;
+    if (!vdo || vdo->iomode != VIDEO_DMABUF || !vdo->dmabufs ||
+	img->srcidx < 0 || img->srcidx >= vdo->num_images)
+	return (-1);
+    return (vdo->dmabufs[img->srcidx]);
+}
+
 int zbar_video_get_width(const zbar_video_t *vdo)
 {
     return (vdo->width);
@@ -231,7 +329,8 @@ static inline int video_init_images(zbar_video_t *vdo)
 {
     int i;
     assert(vdo->datalen);
-    if (vdo->iomode != VIDEO_MMAP) {
+    /* mmap and dmabuf frames were mapped by the driver interface */
+    if (vdo->iomode != VIDEO_MMAP && vdo->iomode != VIDEO_DMABUF) {
 	assert(!vdo->buf);
 	vdo->buflen = vdo->num_images * vdo->datalen;
 	vdo->buf    = calloc(1, vdo->buflen);
@@ -246,7 +345,7 @@ static inline int video_init_images(zbar_video_t *vdo)
 	zbar_image_t *img = vdo->images[i];
 	img->format	  = vdo->format;
 	zbar_image_set_size(img, vdo->width, vdo->height);
-	if (vdo->iomode != VIDEO_MMAP) {
+	if (vdo->iomode != VIDEO_MMAP && vdo->iomode != VIDEO_DMABUF) {
 	    unsigned long offset = i * vdo->datalen;
 	    img->datalen	 = vdo->datalen;
 	    img->data		 = (uint8_t *)vdo->buf + offset;
@@ -330,7 +429,7 @@ int zbar_video_enable(zbar_video_t *vdo, int enable)
     }
 }
 
-zbar_image_t *zbar_video_next_image(zbar_video_t *vdo)
+zbar_image_t *zbar_video_borrow_image(zbar_video_t *vdo)
 {
     unsigned frame;
     zbar_image_t *img;
@@ -345,40 +444,45 @@ zbar_image_t *zbar_video_next_image(zbar_video_t *vdo)
     frame = vdo->frame++;
     img	  = vdo->dq(vdo);
     if (img) {
-	img->seq = frame;
-	if (vdo->num_images < 2) {
-	    /* return a *copy* of the video image and immediately recycle
-             * the driver's buffer to avoid deadlocking the resources
-             */
-	    zbar_image_t *tmp = img;
-	    video_lock(vdo);
-	    img		      = vdo->shadow_image;
-	    vdo->shadow_image = (img) ? img->next : NULL;
-	    video_unlock(vdo);
-
-	    if (!img) {
-		img = zbar_image_create();
-		assert(img);
-		img->refcnt = 0;
-		img->src    = vdo;
-		/* recycle the shadow images */
-
-		img->format = vdo->format;
-		zbar_image_set_size(img, vdo->width, vdo->height);
-		img->datalen = vdo->datalen;
-		img->data    = malloc(vdo->datalen);
-	    }
-	    img->cleanup = _zbar_video_recycle_shadow;
-	    img->seq	 = frame;
-	    memcpy((void *)img->data, tmp->data, img->datalen);
-	    _zbar_video_recycle_image(tmp);
-	} else
-	    img->cleanup = _zbar_video_recycle_image;
+	img->seq     = frame;
+	img->cleanup = _zbar_video_recycle_image;
 	_zbar_image_refcnt(img, 1);
     }
     return (img);
 }
 
+zbar_image_t *zbar_video_next_image(zbar_video_t *vdo)
+{
+    zbar_image_t *img = zbar_video_borrow_image(vdo), *tmp;
+    if (!img || vdo->num_images >= 2)
+	return (img);
+
+    /* return a *copy* of the video image and immediately recycle
+     * the driver's buffer to avoid deadlocking the resources
+     */
+    tmp = img;
+    img = video_shadow_image(vdo, tmp);
+    zbar_image_destroy(tmp);
+    if (!img)
+	err_capture(vdo, SEV_FATAL, ZBAR_ERR_NOMEM, __func__,
+		    "unable to allocate frame copy");
+    return (img);
+}
+
+int zbar_video_return_image(zbar_video_t *vdo, zbar_image_t *img)
+{
+    if (img->src != vdo || img->srcidx < 0)
+	return (err_capture(vdo, SEV_ERROR, ZBAR_ERR_INVALID, __func__,
+			    "image was not borrowed from this video"));
+    _zbar_image_refcnt(img, -1);
+    return (0);
+}
+
+unsigned long zbar_video_get_copies(const zbar_video_t *vdo)
+{
+    return (vdo->copies);
+}
+
 /** @brief return if fun unsupported, otherwise continue */
 #define return_if_not_supported(fun, name)                            \
     {                                                                 \
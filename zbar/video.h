@@ -55,6 +55,7 @@ typedef enum video_iomode_e
     VIDEO_READWRITE = 1, /* standard system calls */
     VIDEO_MMAP,		 /* mmap interface */
     VIDEO_USERPTR,	 /* userspace buffers */
+    VIDEO_DMABUF,	 /* buffers shared as dmabuf file descriptors */
 } video_iomode_t;
 
 typedef struct video_state_s video_state_t;
@@ -68,6 +69,7 @@ struct zbar_video_s {
     video_iomode_t iomode;    /* video data transfer mode */
     unsigned initialized : 1; /* format selected and images mapped */
     unsigned active	 : 1; /* current streaming state */
+    unsigned dmabuf_import : 1; /* dmabufs supplied by the application */
 
     uint32_t format;	   /* selected fourcc */
     unsigned palette;	   /* v4l1 format index corresponding to format */
@@ -78,11 +80,17 @@ struct zbar_video_s {
 
     struct video_controls_s *controls; /* linked list of controls */
 
-    unsigned long datalen; /* size of image data for selected format */
-    unsigned long buflen;  /* total size of image data buffer */
-    void *buf;		   /* image data buffer */
+    unsigned long datalen;   /* size of image data for selected format */
+    unsigned long buflen;    /* total size of image data buffer */
+    void *buf;		     /* image data buffer */
+    int *dmabufs;	     /* dmabuf fd of each image (VIDEO_DMABUF) */
+    /* imported dmabufs synced for reading, one flag per buffer:
+     * each is only changed by the thread holding that buffer
+     */
+    char dmabuf_reading[ZBAR_VIDEO_IMAGES_MAX];
 
-    unsigned frame; /* frame count */
+    unsigned frame;	  /* frame count */
+    unsigned long copies; /* frames copied out of a driver buffer */
 
     zbar_mutex_t qlock;		/* lock image queue */
     int num_images;		/* number of allocated images */
@@ -177,6 +185,11 @@ static inline zbar_image_t *video_dq_image(zbar_video_t *vdo)
     return (img);
 }
 
+/* image to keep referenced in place of a captured frame,
+ * copied when holding the frame would stall capture
+ */
+extern zbar_image_t *_zbar_video_keep_image(zbar_image_t *);
+
 /* PAL interface */
 extern int _zbar_video_open(zbar_video_t *, const char *);
 
@@ -943,9 +943,9 @@ static int dshow_init(zbar_video_t *vdo, uint32_t fmt)
     // 4) dshow_nq (called from ) resets the data pointer of vdo->state->img (nullptr)
     // 5) dshow_dq returns vdo->state->img without data (nullptr)
     //
-    // now, we could deal with this special case, but zbar_video_next_image() makes a copy of the sample anyway when
-    // vdo->num_images==1 (thus VIDEO_MMAP won't save us anything); therefore rather use image buffers provided
-    // by zbar (see video_init_images())
+    // now, we could deal with this special case, but zbar_video_next_image() has to copy the sample anyway when
+    // vdo->num_images==1 and the previous frame is still held (thus VIDEO_MMAP won't save us anything); therefore
+    // rather use image buffers provided by zbar (see video_init_images())
     vdo->iomode = VIDEO_USERPTR;
     // keep zbar's default
     //vdo->num_images = ZBAR_VIDEO_IMAGES_MAX;
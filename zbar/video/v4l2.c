@@ -30,6 +30,7 @@
 #endif
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
 #ifdef HAVE_SYS_IOCTL_H
@@ -38,8 +39,10 @@
 #ifdef HAVE_SYS_MMAN_H
 #include <sys/mman.h>
 #endif
+#ifdef HAVE_LINUX_DMA_BUF_H
+#include <linux/dma-buf.h>
+#endif
 #ifdef HAVE_LIBV4L2_H
-#include <fcntl.h>
 #include <libv4l2.h>
 #else
 #define v4l2_close  close
@@ -62,6 +65,42 @@ typedef struct video_controls_priv_s {
     __u32 id;
 } video_controls_priv_t;
 
+/* buffer memory for the I/O mode.  dmabufs are exported from driver
+ * (mmap) buffers unless the application supplied its own
+ */
+static inline unsigned v4l2_memory(const zbar_video_t *vdo)
+{
+    if (vdo->iomode == VIDEO_MMAP)
+	return (V4L2_MEMORY_MMAP);
+#ifdef VIDIOC_EXPBUF
+    if (vdo->iomode == VIDEO_DMABUF)
+	return ((vdo->dmabuf_import) ? V4L2_MEMORY_DMABUF : V4L2_MEMORY_MMAP);
+#endif
+    return (V4L2_MEMORY_USERPTR);
+}
+
+#ifdef HAVE_LINUX_DMA_BUF_H
+/* bracket reading a frame from an application supplied dmabuf.
+ * a buffer is only ended after it was started.  called unlocked,
+ * the state of buffer i belongs to whoever dequeued it
+ */
+static void v4l2_dmabuf_sync(zbar_video_t *vdo, int i, __u64 flags)
+{
+    struct dma_buf_sync sync;
+    char reading = !(flags & DMA_BUF_SYNC_END);
+    if (vdo->dmabuf_reading[i] == reading)
+	return;
+    vdo->dmabuf_reading[i] = reading;
+    memset(&sync, 0, sizeof(sync));
+    sync.flags = flags | DMA_BUF_SYNC_READ;
+    if (ioctl(vdo->dmabufs[i], DMA_BUF_IOCTL_SYNC, &sync) < 0)
+	err_capture(vdo, SEV_WARNING, ZBAR_ERR_SYSTEM, __func__,
+		    "synchronizing dmabuf access (DMA_BUF_IOCTL_SYNC)");
+}
+#else
+#define v4l2_dmabuf_sync(vdo, i, flags)
+#endif
+
 static int v4l2_nq(zbar_video_t *vdo, zbar_image_t *img)
 {
     if (vdo->iomode == VIDEO_READWRITE)
@@ -72,16 +111,20 @@ static int v4l2_nq(zbar_video_t *vdo, zbar_image_t *img)
 
     struct v4l2_buffer vbuf;
     memset(&vbuf, 0, sizeof(vbuf));
-    vbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (vdo->iomode == VIDEO_MMAP) {
-	vbuf.memory = V4L2_MEMORY_MMAP;
-	vbuf.index  = img->srcidx;
-    } else {
-	vbuf.memory    = V4L2_MEMORY_USERPTR;
+    vbuf.type	= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    vbuf.memory = v4l2_memory(vdo);
+    vbuf.index	= img->srcidx; /* USERPTR: FIXME workaround broken drivers */
+    if (vbuf.memory == V4L2_MEMORY_USERPTR) {
 	vbuf.m.userptr = (unsigned long)img->data;
 	vbuf.length    = img->datalen;
-	vbuf.index     = img->srcidx; /* FIXME workaround broken drivers */
     }
+#ifdef VIDIOC_EXPBUF
+    else if (vbuf.memory == V4L2_MEMORY_DMABUF) {
+	v4l2_dmabuf_sync(vdo, img->srcidx, DMA_BUF_SYNC_END);
+	vbuf.m.fd   = vdo->dmabufs[img->srcidx];
+	vbuf.length = img->datalen;
+    }
+#endif
     if (v4l2_ioctl(vdo->fd, VIDIOC_QBUF, &vbuf) < 0)
 	return (err_capture(vdo, SEV_ERROR, ZBAR_ERR_SYSTEM, __func__,
 			    "queuing video buffer (VIDIOC_QBUF)"));
@@ -94,25 +137,24 @@ static zbar_image_t *v4l2_dq(zbar_video_t *vdo)
     int fd = vdo->fd;
 
     if (vdo->iomode != VIDEO_READWRITE) {
-	video_iomode_t iomode = vdo->iomode;
+	unsigned memory = v4l2_memory(vdo);
 	if (video_unlock(vdo))
 	    return (NULL);
 
 	struct v4l2_buffer vbuf;
 	memset(&vbuf, 0, sizeof(vbuf));
-	vbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	if (iomode == VIDEO_MMAP)
-	    vbuf.memory = V4L2_MEMORY_MMAP;
-	else
-	    vbuf.memory = V4L2_MEMORY_USERPTR;
+	vbuf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	vbuf.memory = memory;
 
 	if (v4l2_ioctl(fd, VIDIOC_DQBUF, &vbuf) < 0)
 	    return (NULL);
 
-	if (iomode == VIDEO_MMAP) {
+	if (memory != V4L2_MEMORY_USERPTR) {
 	    assert(vbuf.index >= 0);
 	    assert(vbuf.index < vdo->num_images);
 	    img = vdo->images[vbuf.index];
+	    if (memory != V4L2_MEMORY_MMAP)
+		v4l2_dmabuf_sync(vdo, vbuf.index, DMA_BUF_SYNC_START);
 	} else {
 	    /* reverse map pointer back to image (FIXME) */
 	    assert(vbuf.m.userptr >= (unsigned long)vdo->buf);
@@ -171,20 +213,29 @@ static int v4l2_cleanup(zbar_video_t *vdo)
 
     struct v4l2_requestbuffers rb;
     memset(&rb, 0, sizeof(rb));
-    rb.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (vdo->iomode == VIDEO_MMAP) {
-	rb.memory = V4L2_MEMORY_MMAP;
+    rb.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    rb.memory = v4l2_memory(vdo);
+    if (vdo->iomode == VIDEO_MMAP || vdo->iomode == VIDEO_DMABUF) {
 	int i;
 	for (i = 0; i < vdo->num_images; i++) {
 	    zbar_image_t *img = vdo->images[i];
-	    if (img->data && v4l2_munmap((void *)img->data, img->datalen))
+	    /* application dmabufs were mapped directly */
+	    if (img->data &&
+		((rb.memory == V4L2_MEMORY_MMAP) ?
+		     v4l2_munmap((void *)img->data, img->datalen) :
+		     munmap((void *)img->data, img->datalen)))
 		err_capture(vdo, SEV_WARNING, ZBAR_ERR_SYSTEM, __func__,
 			    "unmapping video frame buffers");
 	    img->data	 = NULL;
 	    img->datalen = 0;
+	    /* exported dmabufs are ours to close */
+	    if (vdo->dmabufs && !vdo->dmabuf_import &&
+		vdo->dmabufs[i] >= 0) {
+		close(vdo->dmabufs[i]);
+		vdo->dmabufs[i] = -1;
+	    }
 	}
-    } else
-	rb.memory = V4L2_MEMORY_USERPTR;
+    }
 
     /* requesting 0 buffers
      * should implicitly disable streaming
@@ -237,17 +288,70 @@ static int v4l2_mmap_buffers(zbar_video_t *vdo)
     return (0);
 }
 
+#ifdef VIDIOC_EXPBUF
+/* export each driver buffer as a dmabuf, so frames can be shared with
+ * other devices and processes without copying them
+ */
+static int v4l2_export_buffers(zbar_video_t *vdo)
+{
+    struct v4l2_exportbuffer eb;
+    int i;
+
+    if (!vdo->dmabufs) {
+	vdo->dmabufs = malloc(ZBAR_VIDEO_IMAGES_MAX * sizeof(int));
+	if (!vdo->dmabufs)
+	    return (err_capture(vdo, SEV_FATAL, ZBAR_ERR_NOMEM, __func__,
+				"unable to allocate dmabuf list"));
+    }
+    for (i = 0; i < ZBAR_VIDEO_IMAGES_MAX; i++)
+	vdo->dmabufs[i] = -1;
+
+    for (i = 0; i < vdo->num_images; i++) {
+	memset(&eb, 0, sizeof(eb));
+	eb.type	 = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	eb.index = i;
+	eb.flags = O_RDONLY | O_CLOEXEC;
+	if (v4l2_ioctl(vdo->fd, VIDIOC_EXPBUF, &eb) < 0)
+	    return (err_capture(vdo, SEV_ERROR, ZBAR_ERR_SYSTEM, __func__,
+				"exporting video buffer (VIDIOC_EXPBUF)"));
+	vdo->dmabufs[i] = eb.fd;
+	zprintf(2, "    buf[%d] exported as dmabuf fd=%d\n", i, eb.fd);
+    }
+    return (0);
+}
+
+/* map the application supplied dmabufs the driver will capture into */
+static int v4l2_import_buffers(zbar_video_t *vdo)
+{
+    int i;
+    memset(vdo->dmabuf_reading, 0, sizeof(vdo->dmabuf_reading));
+    for (i = 0; i < vdo->num_images; i++) {
+	zbar_image_t *img = vdo->images[i];
+	off_t len	  = lseek(vdo->dmabufs[i], 0, SEEK_END);
+	if (len < 0 || len < vdo->datalen)
+	    return (err_capture_int(vdo, SEV_ERROR, ZBAR_ERR_INVALID, __func__,
+				    "dmabuf %d is too small for a frame", i));
+	img->data = mmap(NULL, len, PROT_READ, MAP_SHARED, vdo->dmabufs[i], 0);
+	if (img->data == MAP_FAILED) {
+	    img->data = NULL;
+	    return (err_capture(vdo, SEV_ERROR, ZBAR_ERR_SYSTEM, __func__,
+				"mapping dmabuf frame buffers"));
+	}
+	img->datalen = len;
+	zprintf(2, "    buf[%d] dmabuf fd=%d 0x%lx bytes @%p\n", i,
+		vdo->dmabufs[i], img->datalen, img->data);
+    }
+    return (0);
+}
+#endif
+
 static int v4l2_request_buffers(zbar_video_t *vdo, uint32_t num_images)
 {
     struct v4l2_requestbuffers rb;
     memset(&rb, 0, sizeof(rb));
-    rb.count = num_images;
-    rb.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-
-    if (vdo->iomode == VIDEO_MMAP)
-	rb.memory = V4L2_MEMORY_MMAP;
-    else
-	rb.memory = V4L2_MEMORY_USERPTR;
+    rb.count  = num_images;
+    rb.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    rb.memory = v4l2_memory(vdo);
 
     if (v4l2_ioctl(vdo->fd, VIDIOC_REQBUFS, &rb) < 0)
 	return (err_capture(vdo, SEV_ERROR, ZBAR_ERR_SYSTEM, __func__,
@@ -257,6 +361,28 @@ static int v4l2_request_buffers(zbar_video_t *vdo, uint32_t num_images)
     return (0);
 }
 
+/* a driver that grants a single buffer stalls capture while a frame is
+ * held, so ask it for a second one.  frames are copied out when this fails
+ */
+static void v4l2_grow_buffers(zbar_video_t *vdo)
+{
+#ifdef VIDIOC_CREATE_BUFS
+    struct v4l2_create_buffers cb;
+    memset(&cb, 0, sizeof(cb));
+    cb.count	   = 2 - vdo->num_images;
+    cb.memory	   = v4l2_memory(vdo);
+    cb.format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (v4l2_ioctl(vdo->fd, VIDIOC_G_FMT, &cb.format) < 0 ||
+	v4l2_ioctl(vdo->fd, VIDIOC_CREATE_BUFS, &cb) < 0 || !cb.count) {
+	zprintf(1, "unable to add video buffers (VIDIOC_CREATE_BUFS)\n");
+	return;
+    }
+    vdo->num_images = cb.index + cb.count;
+    zprintf(1, "added %u buffers, using %d\n", cb.count, vdo->num_images);
+#endif
+}
+
 static int v4l2_set_format(zbar_video_t *vdo, uint32_t fmt)
 {
     struct v4l2_format vfmt;
@@ -323,12 +449,9 @@ static int v4l2_init(zbar_video_t *vdo, uint32_t fmt)
 	return (-1);
 
     memset(&rb, 0, sizeof(rb));
-    rb.count = vdo->num_images;
-    rb.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (vdo->iomode == VIDEO_MMAP)
-	rb.memory = V4L2_MEMORY_MMAP;
-    else
-	rb.memory = V4L2_MEMORY_USERPTR;
+    rb.count  = vdo->num_images;
+    rb.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    rb.memory = v4l2_memory(vdo);
 
     if (v4l2_ioctl(vdo->fd, VIDIOC_REQBUFS, &rb) < 0)
 	return (err_capture(vdo, SEV_ERROR, ZBAR_ERR_SYSTEM, __func__,
@@ -338,29 +461,47 @@ static int v4l2_init(zbar_video_t *vdo, uint32_t fmt)
 	return (err_capture(vdo, SEV_ERROR, ZBAR_ERR_INVALID, __func__,
 			    "driver returned 0 buffers"));
 
+    /* there are no buffers to capture into beyond the supplied dmabufs */
+    if (vdo->dmabuf_import && rb.count > vdo->num_images)
+	return (err_capture_int(vdo, SEV_ERROR, ZBAR_ERR_INVALID, __func__,
+				"driver requires %d dmabufs", rb.count));
+
     if (vdo->num_images > rb.count)
 	vdo->num_images = rb.count;
 
     zprintf(1, "using %u buffers (of %d requested)\n", rb.count,
 	    vdo->num_images);
 
+    if (vdo->iomode == VIDEO_USERPTR &&
+	v4l2_request_buffers(vdo, vdo->num_images))
+	return (-1);
+    if (vdo->num_images < 2 && vdo->iomode != VIDEO_READWRITE &&
+	!vdo->dmabuf_import)
+	v4l2_grow_buffers(vdo);
+
     if (vdo->iomode == VIDEO_MMAP)
 	return (v4l2_mmap_buffers(vdo));
-    if (vdo->iomode == VIDEO_USERPTR)
-	return (v4l2_request_buffers(vdo, vdo->num_images));
+#ifdef VIDIOC_EXPBUF
+    if (vdo->iomode == VIDEO_DMABUF && vdo->dmabuf_import)
+	return (v4l2_import_buffers(vdo));
+    if (vdo->iomode == VIDEO_DMABUF)
+	return ((v4l2_mmap_buffers(vdo) || v4l2_export_buffers(vdo)) ? -1 : 0);
+#endif
     return (0);
 }
 
 static int v4l2_probe_iomode(zbar_video_t *vdo)
 {
     struct v4l2_requestbuffers rb;
+#ifndef VIDIOC_EXPBUF
+    if (vdo->iomode == VIDEO_DMABUF)
+	return (err_capture(vdo, SEV_ERROR, ZBAR_ERR_UNSUPPORTED, __func__,
+			    "dmabuf I/O not supported by the v4l2 headers"));
+#endif
     memset(&rb, 0, sizeof(rb));
-    rb.count = vdo->num_images;
-    rb.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (vdo->iomode == VIDEO_MMAP)
-	rb.memory = V4L2_MEMORY_MMAP;
-    else
-	rb.memory = V4L2_MEMORY_USERPTR;
+    rb.count  = vdo->num_images;
+    rb.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    rb.memory = v4l2_memory(vdo);
 
     if (v4l2_ioctl(vdo->fd, VIDIOC_REQBUFS, &rb) < 0) {
 	if (vdo->iomode)
@@ -381,10 +522,12 @@ static int v4l2_probe_iomode(zbar_video_t *vdo)
     } else {
 	if (!vdo->iomode)
 	    rb.memory = V4L2_MEMORY_USERPTR;
-	/* Update the num_images with the max supported by the driver */
-	if (rb.count)
+	/* Update the num_images with the max supported by the driver,
+	 * there are only as many application dmabufs as supplied
+	 */
+	if (rb.count && !vdo->dmabuf_import)
 	    vdo->num_images = rb.count;
-	else
+	else if (!rb.count)
 	    err_capture(
 		vdo, SEV_WARNING, ZBAR_ERR_SYSTEM, __func__,
 		"Something is wrong: number of buffers returned by REQBUF is zero!");
@@ -1221,6 +1364,7 @@ int _zbar_v4l2_probe(zbar_video_t *vdo)
 	    (vdo->iomode == VIDEO_READWRITE) ? "READWRITE" :
 	    (vdo->iomode == VIDEO_MMAP)	     ? "MMAP" :
 	    (vdo->iomode == VIDEO_USERPTR)   ? "USERPTR" :
+	    (vdo->iomode == VIDEO_DMABUF)    ? "DMABUF" :
 						     "<UNKNOWN>");
 
     vdo->intf	     = VIDEO_V4L2;
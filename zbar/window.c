@@ -25,6 +25,7 @@
 #include <time.h> /* clock_gettime */
 #include "image.h"
 #include "timer.h"
+#include "video.h"
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h> /* gettimeofday */
 #endif
@@ -259,7 +260,13 @@ int zbar_window_draw(zbar_window_t *w, zbar_image_t *img)
     if (!w->draw_image)
 	img = NULL;
     if (img) {
-	_zbar_image_refcnt(img, 1);
+	/* don't hold on to the only buffer of a video */
+	img = _zbar_video_keep_image(img);
+	if (!img) {
+	    window_unlock(w);
+	    return (err_capture(w, SEV_FATAL, ZBAR_ERR_NOMEM, __func__,
+				"unable to copy video frame"));
+	}
 	if (img->width != w->src_width || img->height != w->src_height)
 	    w->dst_width = 0;
     }